@@ -12,6 +12,9 @@
 ///
 
 #include "BitStream.h"
+#include "BitStreamArena.h"
+#include "BitStreamView.h"
+#include "Quantizer.h"
 #include "RakNetDefines.h"
 #include "SocketIncludes.h"
 #include "StringCompressor.h"
@@ -30,11 +33,211 @@
 #include <cmath>
 #endif
 #include <float.h>
+#include <algorithm>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define BITSTREAM_SSE2 1
+#endif
 
 namespace RakNet {
 
 STATIC_FACTORY_DEFINITIONS( BitStream, BitStream )
 
+// The stream is big endian at the bit level: the first bit is the high bit of the first byte.
+// WriteBits and ReadBits move up to 56 bits at a time through one 64 bit word, so a chunk fits next to the bits already in its first byte.
+
+#if defined( _MSC_VER )
+static inline uint16_t ByteSwap16( uint16_t value ) { return _byteswap_ushort( value ); }
+static inline uint32_t ByteSwap32( uint32_t value ) { return _byteswap_ulong( value ); }
+static inline uint64_t ByteSwap64( uint64_t value ) { return _byteswap_uint64( value ); }
+#else
+static inline uint16_t ByteSwap16( uint16_t value ) { return __builtin_bswap16( value ); }
+static inline uint32_t ByteSwap32( uint32_t value ) { return __builtin_bswap32( value ); }
+static inline uint64_t ByteSwap64( uint64_t value ) { return __builtin_bswap64( value ); }
+#endif
+
+// x must not be 0
+static inline unsigned int CountLeadingZeroes64( uint64_t x )
+{
+#if defined( _MSC_VER ) && defined( _M_X64 )
+    unsigned long index;
+    _BitScanReverse64( &index, x );
+    return 63 - index;
+#elif defined( _MSC_VER )
+    unsigned long index;
+    if( _BitScanReverse( &index, (unsigned long)( x >> 32 ) ) )
+        return 31 - index;
+    _BitScanReverse( &index, (unsigned long)x );
+    return 63 - index;
+#else
+    return (unsigned int)__builtin_clzll( x );
+#endif
+}
+
+static inline uint64_t LoadBigEndian64( const unsigned char* p )
+{
+    uint64_t word;
+    memcpy( &word, p, sizeof( word ) );
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return word;
+#else
+    return ByteSwap64( word );
+#endif
+}
+
+static inline void StoreBigEndian64( unsigned char* p, uint64_t word )
+{
+#if !defined( __BYTE_ORDER__ ) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+    word = ByteSwap64( word );
+#endif
+    memcpy( p, &word, sizeof( word ) );
+}
+
+// The first count bytes at p, at most 8, as a big endian number
+static inline uint64_t LoadBigEndian( const unsigned char* p, unsigned int count )
+{
+    uint64_t value = 0;
+    for( unsigned int i = 0; i < count; i++ )
+        value = ( value << 8 ) | p[i];
+    return value;
+}
+
+// The low count bytes of value to p, big endian
+static inline void StoreBigEndian( unsigned char* p, uint64_t value, unsigned int count )
+{
+    for( unsigned int i = count; i > 0; i-- )
+    {
+        p[i - 1] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+#ifdef BITSTREAM_SSE2
+// Swap the two bytes of each 16 bit lane
+static inline __m128i ByteSwapLanes16( __m128i v )
+{
+    return _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+}
+#endif
+
+// Reverse the bytes of each of count elements of elementSize bytes. source and destination may be the same, but may not otherwise overlap.
+static void ReverseElements( const unsigned char* source, unsigned char* destination, unsigned int elementSize, unsigned int count )
+{
+    unsigned int i = 0;
+    switch( elementSize )
+    {
+    case 2:
+#ifdef BITSTREAM_SSE2
+        for( ; i + 8 <= count; i += 8 )
+            _mm_storeu_si128( (__m128i*)( destination + i * 2 ), ByteSwapLanes16( _mm_loadu_si128( (const __m128i*)( source + i * 2 ) ) ) );
+#endif
+        for( ; i < count; i++ )
+        {
+            uint16_t value;
+            memcpy( &value, source + i * 2, sizeof( value ) );
+            value = ByteSwap16( value );
+            memcpy( destination + i * 2, &value, sizeof( value ) );
+        }
+        break;
+    case 4:
+#ifdef BITSTREAM_SSE2
+        // Swap the 16 bit halves of each element, then the bytes of each half
+        for( ; i + 4 <= count; i += 4 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i*)( source + i * 4 ) );
+            v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) ), _MM_SHUFFLE( 2, 3, 0, 1 ) );
+            _mm_storeu_si128( (__m128i*)( destination + i * 4 ), ByteSwapLanes16( v ) );
+        }
+#endif
+        for( ; i < count; i++ )
+        {
+            uint32_t value;
+            memcpy( &value, source + i * 4, sizeof( value ) );
+            value = ByteSwap32( value );
+            memcpy( destination + i * 4, &value, sizeof( value ) );
+        }
+        break;
+    case 8:
+#ifdef BITSTREAM_SSE2
+        // Reverse the 16 bit quarters of each element, then the bytes of each quarter
+        for( ; i + 2 <= count; i += 2 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i*)( source + i * 8 ) );
+            v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) ), _MM_SHUFFLE( 0, 1, 2, 3 ) );
+            _mm_storeu_si128( (__m128i*)( destination + i * 8 ), ByteSwapLanes16( v ) );
+        }
+#endif
+        for( ; i < count; i++ )
+        {
+            uint64_t value;
+            memcpy( &value, source + i * 8, sizeof( value ) );
+            value = ByteSwap64( value );
+            memcpy( destination + i * 8, &value, sizeof( value ) );
+        }
+        break;
+    default:
+        for( ; i < count; i++ )
+        {
+            const unsigned char* element = source + i * elementSize;
+            if( source == destination )
+                std::reverse( destination + i * elementSize, destination + ( i + 1 ) * elementSize );
+            else
+                std::reverse_copy( element, element + elementSize, destination + i * elementSize );
+        }
+        break;
+    }
+}
+
+// Put the low count bits of value, 1 to 56, at bitOffset.
+// The bits before them in their first byte are kept, and the bits after them in their last byte are cleared, so Write1() can OR into them.
+static inline void PutBits( unsigned char* data, BitSize_t bitOffset, BitSize_t bytesAllocated, uint64_t value, unsigned int count )
+{
+    unsigned char* p = data + ( bitOffset >> 3 );
+    const unsigned int firstBit = bitOffset & 7;
+    const unsigned int endBit = firstBit + count;
+    const unsigned int bytesTouched = ( endBit + 7 ) >> 3;
+    const uint64_t keepMask = ~( ~(uint64_t)0 >> firstBit ) | ( ( ~(uint64_t)0 >> 1 ) >> ( bytesTouched * 8 - 1 ) );
+    const uint64_t bits = value << ( 64 - endBit );
+
+    if( ( bitOffset >> 3 ) + 8 <= bytesAllocated )
+    {
+        StoreBigEndian64( p, ( LoadBigEndian64( p ) & keepMask ) | bits );
+        return;
+    }
+
+    // Near the end of the allocation, only the bytes touched may be accessed
+    unsigned char word[8] = {};
+    memcpy( word, p, bytesTouched );
+    StoreBigEndian64( word, ( LoadBigEndian64( word ) & keepMask ) | bits );
+    memcpy( p, word, bytesTouched );
+}
+
+// Get count bits, 1 to 56, from bitOffset, as the low bits of the result
+static inline uint64_t GetBits( const unsigned char* data, BitSize_t bitOffset, BitSize_t bytesAvailable, unsigned int count )
+{
+    const unsigned char* p = data + ( bitOffset >> 3 );
+    const unsigned int firstBit = bitOffset & 7;
+    uint64_t word;
+
+    if( ( bitOffset >> 3 ) + 8 <= bytesAvailable )
+    {
+        word = LoadBigEndian64( p );
+    }
+    else
+    {
+        unsigned char buffer[8] = {};
+        memcpy( buffer, p, ( firstBit + count + 7 ) >> 3 );
+        word = LoadBigEndian64( buffer );
+    }
+
+    return ( word << firstBit ) >> ( 64 - count );
+}
+
 BitStream::BitStream()
 {
     numberOfBitsUsed = 0;
@@ -49,6 +252,7 @@ BitStream::BitStream()
 #endif
     //memset(data, 0, 32);
     copyData = true;
+    arena = 0;
 }
 
 BitStream::BitStream( const unsigned int initialBytesToAllocate )
@@ -70,6 +274,7 @@ BitStream::BitStream( const unsigned int initialBytesToAllocate )
 #endif
     // memset(data, 0, initialBytesToAllocate);
     copyData = true;
+    arena = 0;
 }
 
 BitStream::BitStream( unsigned char* _data, const unsigned int lengthInBytes, bool _copyData )
@@ -78,6 +283,7 @@ BitStream::BitStream( unsigned char* _data, const unsigned int lengthInBytes, bo
     readOffset = 0;
     copyData = _copyData;
     numberOfBitsAllocated = lengthInBytes << 3;
+    arena = 0;
 
     if( copyData )
     {
@@ -115,8 +321,34 @@ void BitStream::SetNumberOfBitsAllocated( const BitSize_t lengthInBits )
 
 BitStream::~BitStream()
 {
-    if( copyData && numberOfBitsAllocated > ( BITSTREAM_STACK_ALLOCATION_SIZE << 3 ) )
-        rakFree_Ex( data, _FILE_AND_LINE_ ); // Use realloc and free so we are more efficient than delete and new for resizing
+    FreeData();
+}
+
+void BitStream::FreeData( void )
+{
+    if( OwnsAllocatedData() )
+    {
+        if( arena )
+            arena->Release( data );
+        else
+            rakFree_Ex( data, _FILE_AND_LINE_ ); // Use realloc and free so we are more efficient than delete and new for resizing
+    }
+}
+
+void BitStream::SetArena( BitStreamArena* _arena )
+{
+    if( _arena == arena )
+        return;
+
+    if( OwnsAllocatedData() )
+    {
+        const size_t bytes = (size_t)BITS_TO_BYTES( numberOfBitsAllocated );
+        unsigned char* newData = _arena ? (unsigned char*)_arena->Allocate( bytes ) : (unsigned char*)rakMalloc_Ex( bytes, _FILE_AND_LINE_ );
+        memcpy( newData, data, bytes );
+        FreeData();
+        data = newData;
+    }
+    arena = _arena;
 }
 
 void BitStream::Reset( void )
@@ -277,7 +509,8 @@ void BitStream::ResetWritePointer( void )
 // Write a 0
 void BitStream::Write0( void )
 {
-    AddBitsAndReallocate( 1 );
+    if( numberOfBitsUsed >= numberOfBitsAllocated )
+        AddBitsAndReallocate( 1 );
 
     // New bytes need to be zeroed
     if( ( numberOfBitsUsed & 7 ) == 0 )
@@ -289,7 +522,8 @@ void BitStream::Write0( void )
 // Write a 1
 void BitStream::Write1( void )
 {
-    AddBitsAndReallocate( 1 );
+    if( numberOfBitsUsed >= numberOfBitsAllocated )
+        AddBitsAndReallocate( 1 );
 
     BitSize_t numberOfBitsMod8 = numberOfBitsUsed & 7;
 
@@ -396,59 +630,199 @@ bool BitStream::ReadAlignedBytesSafeAlloc( char** outByteArray, unsigned int& in
 // Write numberToWrite bits from the input source
 void BitStream::WriteBits( const unsigned char* inByteArray, BitSize_t numberOfBitsToWrite, const bool rightAlignedBits )
 {
-    //  if (numberOfBitsToWrite<=0)
-    //      return;
-
-    AddBitsAndReallocate( numberOfBitsToWrite );
+    if( numberOfBitsToWrite == 0 )
+        return;
 
-    const BitSize_t numberOfBitsUsedMod8 = numberOfBitsUsed & 7;
+    if( numberOfBitsUsed + numberOfBitsToWrite > numberOfBitsAllocated )
+        AddBitsAndReallocate( numberOfBitsToWrite );
 
     // If currently aligned and numberOfBits is a multiple of 8, just memcpy for speed
-    if( numberOfBitsUsedMod8 == 0 && ( numberOfBitsToWrite & 7 ) == 0 )
+    if( ( numberOfBitsUsed & 7 ) == 0 && ( numberOfBitsToWrite & 7 ) == 0 )
     {
         memcpy( data + ( numberOfBitsUsed >> 3 ), inByteArray, numberOfBitsToWrite >> 3 );
         numberOfBitsUsed += numberOfBitsToWrite;
         return;
     }
 
-    unsigned char dataByte;
+    const BitSize_t bytesAllocated = BITS_TO_BYTES( numberOfBitsAllocated );
     const unsigned char* inputPtr = inByteArray;
 
-    // Faster to put the while at the top surprisingly enough
-    while( numberOfBitsToWrite > 0 )
-    //do
+    // Whole bytes, 7 at a time
+    while( numberOfBitsToWrite >= 56 )
     {
-        dataByte = *( inputPtr++ );
+        uint64_t chunk;
+        if( numberOfBitsToWrite >= 64 )
+            chunk = LoadBigEndian64( inputPtr ) >> 8;
+        else
+            chunk = LoadBigEndian( inputPtr, 7 );
+        PutBits( data, numberOfBitsUsed, bytesAllocated, chunk, 56 );
+        inputPtr += 7;
+        numberOfBitsUsed += 56;
+        numberOfBitsToWrite -= 56;
+    }
 
-        if( numberOfBitsToWrite < 8 && rightAlignedBits ) // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than the left (as in the normal internal representation)
-            dataByte <<= 8 - numberOfBitsToWrite;         // shift left to get the bits on the left, as in our internal representation
+    if( numberOfBitsToWrite == 0 )
+        return;
 
-        // Writing to a new byte each time
-        if( numberOfBitsUsedMod8 == 0 )
-            *( data + ( numberOfBitsUsed >> 3 ) ) = dataByte;
+    // The remaining whole bytes and the partial byte together
+    const unsigned int wholeBytes = numberOfBitsToWrite >> 3;
+    const unsigned int partialBits = numberOfBitsToWrite & 7;
+    uint64_t chunk = LoadBigEndian( inputPtr, wholeBytes );
+    if( partialBits > 0 )
+    {
+        // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than the left (as in the normal internal representation)
+        unsigned char partialByte = inputPtr[wholeBytes];
+        if( rightAlignedBits )
+            partialByte &= ( 1 << partialBits ) - 1;
         else
-        {
-            // Copy over the new data.
-            *( data + ( numberOfBitsUsed >> 3 ) ) |= dataByte >> ( numberOfBitsUsedMod8 ); // First half
+            partialByte >>= 8 - partialBits;
+        chunk = ( chunk << partialBits ) | partialByte;
+    }
+    PutBits( data, numberOfBitsUsed, bytesAllocated, chunk, numberOfBitsToWrite );
+    numberOfBitsUsed += numberOfBitsToWrite;
+}
 
-            if( 8 - ( numberOfBitsUsedMod8 ) < 8 && 8 - ( numberOfBitsUsedMod8 ) < numberOfBitsToWrite ) // If we didn't write it all out in the first half (8 - (numberOfBitsUsed%8) is the number we wrote in the first half)
-            {
-                *( data + ( numberOfBitsUsed >> 3 ) + 1 ) = (unsigned char)( dataByte << ( 8 - ( numberOfBitsUsedMod8 ) ) ); // Second half (overlaps byte boundary)
-            }
-        }
+void BitStream::WriteVarInt64( uint64_t value )
+{
+    // The bytes needed follow from the highest bit set, so the encoding loop has a fixed count
+    unsigned char encoded[10];
+    const unsigned int significantBits = 64 - CountLeadingZeroes64( value | 1 );
+    const unsigned int byteCount = ( significantBits + 6 ) / 7;
+    for( unsigned int i = 0; i < byteCount; i++ )
+    {
+        encoded[i] = (unsigned char)( ( value & 0x7F ) | 0x80 );
+        value >>= 7;
+    }
+    encoded[byteCount - 1] &= 0x7F;
+    WriteBits( encoded, byteCount * 8, true );
+}
 
-        if( numberOfBitsToWrite >= 8 )
-        {
-            numberOfBitsUsed += 8;
-            numberOfBitsToWrite -= 8;
-        }
-        else
+bool BitStream::ReadVarInt64( uint64_t& value )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadVarInt64( value );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStreamView::ReadVarInt64( uint64_t& value )
+{
+    // Look at up to 7 bytes at once. The first byte without its high bit set ends the varint.
+    const BitSize_t unreadBytes = GetNumberOfUnreadBits() >> 3;
+    if( unreadBytes == 0 )
+        return false;
+    const unsigned int peekBytes = unreadBytes < 7 ? (unsigned int)unreadBytes : 7;
+    const uint64_t word = GetBits( data, readOffset, BITS_TO_BYTES( numberOfBitsUsed ), peekBytes * 8 ) << ( 64 - peekBytes * 8 );
+    const uint64_t lastByteMarkers = ~word & 0x8080808080808080ULL & ( ~(uint64_t)0 << ( 64 - peekBytes * 8 ) );
+
+    if( lastByteMarkers != 0 )
+    {
+        const unsigned int byteCount = ( CountLeadingZeroes64( lastByteMarkers ) >> 3 ) + 1;
+        uint64_t result = 0;
+        for( unsigned int i = 0; i < byteCount; i++ )
+            result |= ( ( word >> ( 56 - i * 8 ) ) & 0x7F ) << ( i * 7 );
+        value = result;
+        readOffset += byteCount * 8;
+        return true;
+    }
+
+    // Longer than 7 bytes, or the stream ends first
+    const BitSize_t startOffset = readOffset;
+    uint64_t result = 0;
+    for( unsigned int i = 0; i < 10; i++ )
+    {
+        unsigned char byte;
+        if( ReadBits( &byte, 8 ) == false )
+            break;
+        // The 10th byte only has room for the top bit of 64
+        if( i == 9 && byte > 1 )
+            break;
+        result |= (uint64_t)( byte & 0x7F ) << ( i * 7 );
+        if( ( byte & 0x80 ) == 0 )
         {
-            numberOfBitsUsed += numberOfBitsToWrite;
-            numberOfBitsToWrite = 0;
+            value = result;
+            return true;
         }
     }
-    // } while(numberOfBitsToWrite>0);
+    readOffset = startOffset;
+    return false;
+}
+
+void BitStream::WriteElements( const unsigned char* inArray, const unsigned int elementSize, const unsigned int count )
+{
+    RakAssert( (uint64_t)elementSize * count * 8 < ( (uint64_t)1 << 32 ) );
+    const BitSize_t numberOfBits = BYTES_TO_BITS( elementSize * count );
+    if( numberOfBits == 0 )
+        return;
+
+    if( elementSize == 1 || DoEndianSwap() == false )
+    {
+        WriteBits( inArray, numberOfBits, true );
+        return;
+    }
+
+    if( numberOfBitsUsed + numberOfBits > numberOfBitsAllocated )
+        AddBitsAndReallocate( numberOfBits );
+
+    // Aligned, swap straight into the stream
+    if( ( numberOfBitsUsed & 7 ) == 0 )
+    {
+        ReverseElements( inArray, data + ( numberOfBitsUsed >> 3 ), elementSize, count );
+        numberOfBitsUsed += numberOfBits;
+        return;
+    }
+
+    // Otherwise swap through a buffer of whole elements
+    unsigned char stackBuffer[512];
+    std::vector<unsigned char> heapBuffer;
+    unsigned char* buffer = stackBuffer;
+    unsigned int elementsPerBuffer = sizeof( stackBuffer ) / elementSize;
+    if( elementsPerBuffer == 0 )
+    {
+        heapBuffer.resize( elementSize );
+        buffer = heapBuffer.data();
+        elementsPerBuffer = 1;
+    }
+
+    for( unsigned int i = 0; i < count; i += elementsPerBuffer )
+    {
+        const unsigned int elements = std::min( count - i, elementsPerBuffer );
+        ReverseElements( inArray + i * elementSize, buffer, elementSize, elements );
+        WriteBits( buffer, BYTES_TO_BITS( elements * elementSize ), true );
+    }
+}
+
+bool BitStream::ReadElements( unsigned char* outArray, const unsigned int elementSize, const unsigned int count )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadElements( outArray, elementSize, count );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStreamView::ReadElements( unsigned char* outArray, const unsigned int elementSize, const unsigned int count )
+{
+    if( (uint64_t)elementSize * count * 8 > GetNumberOfUnreadBits() )
+        return false;
+    const BitSize_t numberOfBits = BYTES_TO_BITS( elementSize * count );
+    if( numberOfBits == 0 )
+        return true;
+
+    if( elementSize == 1 || BitStream::DoEndianSwap() == false )
+        return ReadBits( outArray, numberOfBits, true );
+
+    if( ( readOffset & 7 ) == 0 )
+    {
+        // Aligned, swap straight out of the stream
+        ReverseElements( data + ( readOffset >> 3 ), outArray, elementSize, count );
+        readOffset += numberOfBits;
+    }
+    else
+    {
+        ReadBits( outArray, numberOfBits, true );
+        ReverseElements( outArray, outArray, elementSize, count );
+    }
+    return true;
 }
 
 // Set the stream to some initial data.  For internal use
@@ -522,6 +896,14 @@ void BitStream::WriteCompressed( const unsigned char* inByteArray,
 // alignBitsToRight should be set to true to convert internal bitstream data to userdata
 // It should be false if you used WriteBits with rightAlignedBits false
 bool BitStream::ReadBits( unsigned char* inOutByteArray, BitSize_t numberOfBitsToRead, const bool alignBitsToRight )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadBits( inOutByteArray, numberOfBitsToRead, alignBitsToRight );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStreamView::ReadBits( unsigned char* inOutByteArray, BitSize_t numberOfBitsToRead, const bool alignBitsToRight )
 {
 #ifdef _DEBUG
     //  RakAssert( numberOfBitsToRead > 0 );
@@ -532,55 +914,48 @@ bool BitStream::ReadBits( unsigned char* inOutByteArray, BitSize_t numberOfBitsT
     if( readOffset + numberOfBitsToRead > numberOfBitsUsed )
         return false;
 
-
-    const BitSize_t readOffsetMod8 = readOffset & 7;
-
     // If currently aligned and numberOfBits is a multiple of 8, just memcpy for speed
-    if( readOffsetMod8 == 0 && ( numberOfBitsToRead & 7 ) == 0 )
+    if( ( readOffset & 7 ) == 0 && ( numberOfBitsToRead & 7 ) == 0 )
     {
         memcpy( inOutByteArray, data + ( readOffset >> 3 ), numberOfBitsToRead >> 3 );
         readOffset += numberOfBitsToRead;
         return true;
     }
 
+    const BitSize_t bytesUsed = BITS_TO_BYTES( numberOfBitsUsed );
+    unsigned char* outputPtr = inOutByteArray;
 
-    BitSize_t offset = 0;
-
-    memset( inOutByteArray, 0, (size_t)BITS_TO_BYTES( numberOfBitsToRead ) );
-
-    while( numberOfBitsToRead > 0 )
+    // Whole bytes, 7 at a time
+    while( numberOfBitsToRead >= 56 )
     {
-        *( inOutByteArray + offset ) |= *( data + ( readOffset >> 3 ) ) << ( readOffsetMod8 ); // First half
-
-        if( readOffsetMod8 > 0 && numberOfBitsToRead > 8 - ( readOffsetMod8 ) )                                // If we have a second half, we didn't read enough bytes in the first half
-            *( inOutByteArray + offset ) |= *( data + ( readOffset >> 3 ) + 1 ) >> ( 8 - ( readOffsetMod8 ) ); // Second half (overlaps byte boundary)
-
-        if( numberOfBitsToRead >= 8 )
-        {
-            numberOfBitsToRead -= 8;
-            readOffset += 8;
-            offset++;
-        }
+        uint64_t chunk = GetBits( data, readOffset, bytesUsed, 56 );
+        if( numberOfBitsToRead >= 64 )
+            StoreBigEndian64( outputPtr, chunk << 8 );
         else
-        {
-            int neg = (int)numberOfBitsToRead - 8;
-
-            if( neg < 0 ) // Reading a partial byte for the last byte, shift right so the data is aligned on the right
-            {
-
-                if( alignBitsToRight )
-                    *( inOutByteArray + offset ) >>= -neg;
-
-                readOffset += 8 + neg;
-            }
-            else
-                readOffset += 8;
+            StoreBigEndian( outputPtr, chunk, 7 );
+        outputPtr += 7;
+        readOffset += 56;
+        numberOfBitsToRead -= 56;
+    }
 
-            offset++;
+    if( numberOfBitsToRead == 0 )
+        return true;
 
-            numberOfBitsToRead = 0;
-        }
+    // The remaining whole bytes and the partial byte together
+    const unsigned int wholeBytes = numberOfBitsToRead >> 3;
+    const unsigned int partialBits = numberOfBitsToRead & 7;
+    uint64_t chunk = GetBits( data, readOffset, bytesUsed, numberOfBitsToRead );
+    readOffset += numberOfBitsToRead;
+    if( partialBits > 0 )
+    {
+        // Reading a partial byte for the last byte, aligned on the right unless asked otherwise
+        unsigned char partialByte = (unsigned char)( chunk & ( ( 1 << partialBits ) - 1 ) );
+        if( alignBitsToRight == false )
+            partialByte <<= 8 - partialBits;
+        outputPtr[wholeBytes] = partialByte;
+        chunk >>= partialBits;
     }
+    StoreBigEndian( outputPtr, chunk, wholeBytes );
 
     return true;
 }
@@ -588,6 +963,15 @@ bool BitStream::ReadBits( unsigned char* inOutByteArray, BitSize_t numberOfBitsT
 // Assume the input source points to a compressed native type. Decompress and read it
 bool BitStream::ReadCompressed( unsigned char* inOutByteArray,
                                 const unsigned int size, const bool unsignedData )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadCompressed( inOutByteArray, size, unsignedData );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStreamView::ReadCompressed( unsigned char* inOutByteArray,
+                                    const unsigned int size, const bool unsignedData )
 {
     unsigned int currentByte = ( size >> 3 ) - 1;
 
@@ -688,13 +1072,20 @@ void BitStream::AddBitsAndReallocate( const BitSize_t numberOfBitsToWrite )
         {
             if( amountToAllocate > BITSTREAM_STACK_ALLOCATION_SIZE )
             {
-                data = (unsigned char*)rakMalloc_Ex( (size_t)amountToAllocate, _FILE_AND_LINE_ );
+                if( arena )
+                    data = (unsigned char*)arena->Allocate( (size_t)amountToAllocate );
+                else
+                    data = (unsigned char*)rakMalloc_Ex( (size_t)amountToAllocate, _FILE_AND_LINE_ );
                 RakAssert( data );
 
                 // need to copy the stack data over to our new memory area too
                 memcpy( (void*)data, (void*)stackData, (size_t)BITS_TO_BYTES( numberOfBitsAllocated ) );
             }
         }
+        else if( arena )
+        {
+            data = (unsigned char*)arena->Reallocate( data, (size_t)BITS_TO_BYTES( numberOfBitsAllocated ), (size_t)amountToAllocate );
+        }
         else
         {
             data = (unsigned char*)rakRealloc_Ex( data, (size_t)amountToAllocate, _FILE_AND_LINE_ );
@@ -985,7 +1376,11 @@ void BitStream::AssertCopyData( void )
 
         if( numberOfBitsAllocated > 0 )
         {
-            unsigned char* newdata = (unsigned char*)rakMalloc_Ex( (size_t)BITS_TO_BYTES( numberOfBitsAllocated ), _FILE_AND_LINE_ );
+            unsigned char* newdata;
+            if( arena )
+                newdata = (unsigned char*)arena->Allocate( (size_t)BITS_TO_BYTES( numberOfBitsAllocated ) );
+            else
+                newdata = (unsigned char*)rakMalloc_Ex( (size_t)BITS_TO_BYTES( numberOfBitsAllocated ), _FILE_AND_LINE_ );
 #ifdef _DEBUG
 
             RakAssert( data );
@@ -1170,6 +1565,125 @@ void BitStream::WriteFloat16( float inOutFloat, float floatMin, float floatMax )
     Write( (unsigned short)percentile );
 }
 
+// Quantized values go through a buffer of this many, a whole number of quantization patterns and of quaternions
+static const unsigned int QUANTIZE_BUFFER_LENGTH = QUANTIZE_PATTERN_LENGTH * 16;
+
+static void WriteQuantized( BitStream* bitStream, const float* values, const unsigned int count, const QuantizeParameters& parameters, const int bits )
+{
+    const unsigned char width = (unsigned char)bits;
+    bitStream->AddBitsAndReallocate( (BitSize_t)count * bits );
+
+    uint32_t quantized[QUANTIZE_BUFFER_LENGTH];
+    for( unsigned int i = 0; i < count; i += QUANTIZE_BUFFER_LENGTH )
+    {
+        const unsigned int chunk = std::min( count - i, QUANTIZE_BUFFER_LENGTH );
+        QuantizeFloats( values + i, chunk, parameters, quantized );
+        bitStream->WritePackedValues( quantized, chunk, &width, 1 );
+    }
+}
+
+void BitStream::WriteQuantizedFloats( const float* values, const unsigned int count, float floatMin, float floatMax, const int bitsPerValue )
+{
+    QuantizeParameters parameters;
+    QuantizeParametersForRange( floatMin, floatMax, bitsPerValue, &parameters );
+    WriteQuantized( this, values, count, parameters, bitsPerValue );
+}
+
+void BitStream::WriteQuantizedVectors( const float* xyz, const unsigned int count, const float vectorMin[3], const float vectorMax[3], const int bitsPerComponent )
+{
+    QuantizeParameters parameters;
+    QuantizeParametersForBox( vectorMin, vectorMax, bitsPerComponent, &parameters );
+    WriteQuantized( this, xyz, count * 3, parameters, bitsPerComponent );
+}
+
+// The components other than the largest are within +-1/sqrt(2)
+static void QuantizeParametersForQuats( const int bits, QuantizeParameters* parameters )
+{
+    QuantizeParametersForRange( -0.707106781f, 0.707106781f, bits, parameters );
+}
+
+void BitStream::WriteQuantizedQuats( const float* wxyz, const unsigned int count, const int bitsPerComponent )
+{
+    QuantizeParameters parameters;
+    QuantizeParametersForQuats( bitsPerComponent, &parameters );
+    const unsigned char widths[4] = { 2, (unsigned char)bitsPerComponent, (unsigned char)bitsPerComponent, (unsigned char)bitsPerComponent };
+    AddBitsAndReallocate( (BitSize_t)count * ( 2 + 3 * bitsPerComponent ) );
+
+    uint32_t quantized[QUANTIZE_BUFFER_LENGTH];
+    const unsigned int quatsPerBuffer = QUANTIZE_BUFFER_LENGTH / 4;
+    for( unsigned int i = 0; i < count; i += quatsPerBuffer )
+    {
+        const unsigned int chunk = std::min( count - i, quatsPerBuffer );
+        QuantizeQuats( wxyz + i * 4, chunk, parameters, quantized );
+        WritePackedValues( quantized, chunk * 4, widths, 4 );
+    }
+}
+
+void BitStream::WritePackedValues( const uint32_t* values, const unsigned int count, const unsigned char* widths, const unsigned int period )
+{
+    // 32 bits at a time through a 64 bit accumulator, which has room for 31 bits left over plus a value of up to 32 bits
+    uint64_t accumulator = 0;
+    unsigned int accumulatorBits = 0;
+    for( unsigned int i = 0, j = 0; i < count; i++ )
+    {
+        RakAssert( widths[j] >= 1 && widths[j] <= 32 && ( widths[j] == 32 || values[i] >> widths[j] == 0 ) );
+        accumulator = ( accumulator << widths[j] ) | values[i];
+        accumulatorBits += widths[j];
+        if( ++j == period )
+            j = 0;
+
+        if( accumulatorBits >= 32 )
+        {
+            accumulatorBits -= 32;
+            if( numberOfBitsUsed + 32 > numberOfBitsAllocated )
+                AddBitsAndReallocate( 32 );
+            PutBits( data, numberOfBitsUsed, BITS_TO_BYTES( numberOfBitsAllocated ), accumulator >> accumulatorBits, 32 );
+            numberOfBitsUsed += 32;
+            accumulator &= ( (uint64_t)1 << accumulatorBits ) - 1;
+        }
+    }
+
+    if( accumulatorBits > 0 )
+    {
+        if( numberOfBitsUsed + accumulatorBits > numberOfBitsAllocated )
+            AddBitsAndReallocate( accumulatorBits );
+        PutBits( data, numberOfBitsUsed, BITS_TO_BYTES( numberOfBitsAllocated ), accumulator, accumulatorBits );
+        numberOfBitsUsed += accumulatorBits;
+    }
+}
+
+bool BitStream::ReadQuantizedFloats( float* values, const unsigned int count, float floatMin, float floatMax, const int bitsPerValue )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadQuantizedFloats( values, count, floatMin, floatMax, bitsPerValue );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStream::ReadQuantizedVectors( float* xyz, const unsigned int count, const float vectorMin[3], const float vectorMax[3], const int bitsPerComponent )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadQuantizedVectors( xyz, count, vectorMin, vectorMax, bitsPerComponent );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStream::ReadQuantizedQuats( float* wxyz, const unsigned int count, const int bitsPerComponent )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadQuantizedQuats( wxyz, count, bitsPerComponent );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
+bool BitStream::ReadPackedValues( uint32_t* values, const unsigned int count, const unsigned char* widths, const unsigned int period )
+{
+    BitStreamView view( data, numberOfBitsUsed, readOffset );
+    bool result = view.ReadPackedValues( values, count, widths, period );
+    readOffset = view.GetReadOffset();
+    return result;
+}
+
 void BitStream::Serialize( const std::string& str )
 {
     const uint16_t size = static_cast<uint16_t>( str.size() );
@@ -1200,4 +1714,160 @@ bool BitStream::DeserializeCompressed( std::string& str )
     return StringCompressor::Instance()->DecodeString( str, 0xFFFF, this );
 }
 
+bool BitStreamView::Read( char* outByteArray, const unsigned int numberOfBytes )
+{
+    if( ( readOffset & 7 ) == 0 )
+    {
+        if( readOffset + ( numberOfBytes << 3 ) > numberOfBitsUsed )
+            return false;
+
+        memcpy( outByteArray, data + ( readOffset >> 3 ), (size_t)numberOfBytes );
+        readOffset += numberOfBytes << 3;
+        return true;
+    }
+    else
+    {
+        return ReadBits( (unsigned char*)outByteArray, numberOfBytes * 8 );
+    }
+}
+
+bool BitStreamView::ReadFloat16( float& outFloat, float floatMin, float floatMax )
+{
+    unsigned short percentile;
+    if( Read( percentile ) )
+    {
+        RakAssert( floatMax > floatMin );
+        outFloat = floatMin + ( (float)percentile / 65535.0f ) * ( floatMax - floatMin );
+        if( outFloat < floatMin )
+            outFloat = floatMin;
+        else if( outFloat > floatMax )
+            outFloat = floatMax;
+        return true;
+    }
+    return false;
+}
+
+static bool ReadQuantized( BitStreamView* view, float* values, const unsigned int count, const QuantizeParameters& parameters, const int bits )
+{
+    if( (uint64_t)count * bits > view->GetNumberOfUnreadBits() )
+        return false;
+
+    const unsigned char width = (unsigned char)bits;
+    uint32_t quantized[QUANTIZE_BUFFER_LENGTH];
+    for( unsigned int i = 0; i < count; i += QUANTIZE_BUFFER_LENGTH )
+    {
+        const unsigned int chunk = std::min( count - i, QUANTIZE_BUFFER_LENGTH );
+        view->ReadPackedValues( quantized, chunk, &width, 1 );
+        DequantizeFloats( quantized, chunk, parameters, values + i );
+    }
+    return true;
+}
+
+bool BitStreamView::ReadQuantizedFloats( float* values, const unsigned int count, float floatMin, float floatMax, const int bitsPerValue )
+{
+    QuantizeParameters parameters;
+    QuantizeParametersForRange( floatMin, floatMax, bitsPerValue, &parameters );
+    return ReadQuantized( this, values, count, parameters, bitsPerValue );
+}
+
+bool BitStreamView::ReadQuantizedVectors( float* xyz, const unsigned int count, const float vectorMin[3], const float vectorMax[3], const int bitsPerComponent )
+{
+    QuantizeParameters parameters;
+    QuantizeParametersForBox( vectorMin, vectorMax, bitsPerComponent, &parameters );
+    return ReadQuantized( this, xyz, count * 3, parameters, bitsPerComponent );
+}
+
+bool BitStreamView::ReadQuantizedQuats( float* wxyz, const unsigned int count, const int bitsPerComponent )
+{
+    if( (uint64_t)count * ( 2 + 3 * bitsPerComponent ) > GetNumberOfUnreadBits() )
+        return false;
+
+    QuantizeParameters parameters;
+    QuantizeParametersForQuats( bitsPerComponent, &parameters );
+    const unsigned char widths[4] = { 2, (unsigned char)bitsPerComponent, (unsigned char)bitsPerComponent, (unsigned char)bitsPerComponent };
+
+    uint32_t quantized[QUANTIZE_BUFFER_LENGTH];
+    const unsigned int quatsPerBuffer = QUANTIZE_BUFFER_LENGTH / 4;
+    for( unsigned int i = 0; i < count; i += quatsPerBuffer )
+    {
+        const unsigned int chunk = std::min( count - i, quatsPerBuffer );
+        ReadPackedValues( quantized, chunk * 4, widths, 4 );
+        DequantizeQuats( quantized, chunk, parameters, wxyz + i * 4 );
+    }
+    return true;
+}
+
+bool BitStreamView::ReadPackedValues( uint32_t* values, const unsigned int count, const unsigned char* widths, const unsigned int period )
+{
+    uint64_t numberOfBits = 0;
+    for( unsigned int j = 0; j < period && j < count; j++ )
+        numberOfBits += (uint64_t)widths[j] * ( ( count - j + period - 1 ) / period );
+    if( numberOfBits > GetNumberOfUnreadBits() )
+        return false;
+
+    // Refilled 32 bits at a time, so it never holds more than 31 + 32 bits
+    const BitSize_t bytesAvailable = BITS_TO_BYTES( numberOfBitsUsed );
+    const BitSize_t endOffset = readOffset + (BitSize_t)numberOfBits;
+    uint64_t accumulator = 0;
+    unsigned int accumulatorBits = 0;
+    for( unsigned int i = 0, j = 0; i < count; i++ )
+    {
+        const unsigned int width = widths[j];
+        if( ++j == period )
+            j = 0;
+
+        if( accumulatorBits < width )
+        {
+            const unsigned int refill = std::min<BitSize_t>( 32, endOffset - readOffset );
+            accumulator = ( accumulator << refill ) | GetBits( data, readOffset, bytesAvailable, refill );
+            accumulatorBits += refill;
+            readOffset += refill;
+        }
+
+        accumulatorBits -= width;
+        values[i] = (uint32_t)( accumulator >> accumulatorBits );
+        accumulator &= ( (uint64_t)1 << accumulatorBits ) - 1;
+    }
+    return true;
+}
+
+bool BitStreamView::ReadAlignedBytes( unsigned char* inOutByteArray, const unsigned int numberOfBytesToRead )
+{
+    if( numberOfBytesToRead <= 0 )
+        return false;
+
+    AlignReadToByteBoundary();
+
+    if( readOffset + ( numberOfBytesToRead << 3 ) > numberOfBitsUsed )
+        return false;
+
+    memcpy( inOutByteArray, data + ( readOffset >> 3 ), (size_t)numberOfBytesToRead );
+    readOffset += numberOfBytesToRead << 3;
+    return true;
+}
+
+bool BitStreamView::ReadAlignedBytesSafe( char* inOutByteArray, unsigned int& inputLength, const unsigned int maxBytesToRead )
+{
+    if( ReadCompressed( inputLength ) == false )
+        return false;
+    if( inputLength > maxBytesToRead )
+        inputLength = maxBytesToRead;
+    if( inputLength == 0 )
+        return true;
+    return ReadAlignedBytes( (unsigned char*)inOutByteArray, inputLength );
+}
+
+bool BitStreamView::Deserialize( std::string& str )
+{
+    uint16_t size = 0;
+    bool b = Read( size );
+    if( b && size > 0 )
+    {
+        str.resize( size );
+        b = ReadAlignedBytes( reinterpret_cast<unsigned char*>( str.data() ), size );
+    }
+
+    return b;
+}
+
 } // namespace RakNet
@@ -17,15 +17,22 @@
 
 #include <cmath>
 #include <cfloat>
+#include <array>
 #include <string>
+#include <limits>
+#include <type_traits>
+#include <vector>
 #include "RakMemoryOverride.h"
 #include "RakNetDefines.h"
 #include "Export.h"
 #include "RakNetTypes.h"
 #include "RakAssert.h"
+#include "BitStreamSchema.h"
 
 namespace RakNet {
 
+class BitStreamArena;
+
 /// This class allows you to write and read native types as a string of bits.  BitStream is used extensively throughout RakNet and is designed to be used by users as well.
 /// \sa BitStreamSample.txt
 class RAK_DLL_EXPORT BitStream
@@ -62,6 +69,26 @@ public:
     /// Resets the bitstream for reuse.
     void Reset( void );
 
+    /// \brief Take memory from \a arena rather than rakMalloc_Ex once the stream outgrows BITSTREAM_STACK_ALLOCATION_SIZE.
+    /// \details For building many short lived streams each tick. RakPeerInterface::Send() copies the data, so the arena may be reset once the streams built from it were sent and destroyed:
+    /// \code
+    /// BitStreamArena* arena = BitStreamArena::GetThreadArena();
+    /// for( each client )
+    /// {
+    ///     BitStream bs;
+    ///     bs.SetArena( arena );
+    ///     WriteSnapshot( client, &bs );
+    ///     peer->Send( &bs, HIGH_PRIORITY, UNRELIABLE, 0, client, false );
+    /// }
+    /// arena->Reset();
+    /// \endcode
+    /// Data already on the heap moves to the arena, or back to the heap when \a arena is 0.
+    /// \param[in] arena The arena to use, which must outlive the data of this stream
+    void SetArena( BitStreamArena* arena );
+
+    /// \return The arena from SetArena(), or 0 for the heap
+    inline BitStreamArena* GetArena( void ) const { return arena; }
+
     /// \brief Bidirectional serialize/deserialize any integral type to/from a bitstream.
     /// \details Undefine __BITSTREAM_NATIVE_END if you need endian swapping.
     /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
@@ -98,6 +125,13 @@ public:
     template<class templateType>
     bool SerializeCompressed( bool writeToBitstream, templateType& inOutTemplateVar );
 
+    /// \brief Bidirectional version of WriteVarInt() and ReadVarInt().
+    /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
+    /// \param[in] inOutTemplateVar The value to write
+    /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.  false if \a writeToBitstream is false and the read was not successful.
+    template<class templateType>
+    bool SerializeVarInt( bool writeToBitstream, templateType& inOutTemplateVar );
+
     /// \brief Bidirectional serialize/deserialize any integral type to/from a bitstream.
     /// \details If the current value is different from the last value
     /// the current value will be written.  Otherwise, a single bit will be written
@@ -123,6 +157,22 @@ public:
     /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.  false if \a writeToBitstream is false and the read was not successful.
     bool Serialize( bool writeToBitstream, char* inOutByteArray, const unsigned int numberOfBytes );
 
+    /// \brief Bidirectional version of WriteArray() and ReadArray() for a fixed number of elements.
+    /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
+    /// \param[in] inOutArray The elements
+    /// \param[in] count The number of elements
+    /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.  false if \a writeToBitstream is false and the read was not successful.
+    template<class templateType>
+    bool SerializeArray( bool writeToBitstream, templateType* inOutArray, const unsigned int count );
+
+    /// \brief Bidirectional version of WriteArray() and ReadArray() for a vector, which is written with its element count.
+    /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
+    /// \param[in] inOutVector The elements
+    /// \param[in] maxCount When reading, fail rather than read more elements than this
+    /// \return true if \a writeToBitstream is true.  true if \a writeToBitstream is false and the read was successful.  false if \a writeToBitstream is false and the read was not successful.
+    template<class templateType>
+    bool SerializeArray( bool writeToBitstream, std::vector<templateType>& inOutVector, const unsigned int maxCount );
+
     /// \brief Serialize a float into 2 bytes, spanning the range between \a floatMin and \a floatMax
     /// \param[in] writeToBitstream true to write from your data to this bitstream.  False to read from this bitstream and write to your data
     /// \param[in] inOutFloat The float to write
@@ -209,6 +259,7 @@ public:
 
     /// \brief Write any integral type to a bitstream.
     /// \details Undefine __BITSTREAM_NATIVE_END if you need endian swapping.
+    /// Types declared with RAKNET_SERIALIZABLE are written field by field.
     /// \param[in] inTemplateVar The value to write
     template<class templateType>
     void Write( const templateType& inTemplateVar );
@@ -241,6 +292,13 @@ public:
     template<class templateType>
     void WriteCompressed( const templateType& inTemplateVar );
 
+    /// \brief Write an integer as a LEB128 varint: 7 bits per byte, low bits first, the high bit of each byte set if more follow.
+    /// \details Signed types are zigzag encoded first, so that small negative numbers are small too.
+    /// Values below 128 take 1 byte, below 16384 2 bytes, and so on. Better than WriteCompressed() for values that are usually small but use the whole range of their type.
+    /// \param[in] inTemplateVar The value to write
+    template<class templateType>
+    void WriteVarInt( const templateType& inTemplateVar );
+
     /// \brief Write any integral type to a bitstream.
     /// \details If the current value is different from the last value
     /// the current value will be written.  Otherwise, a single bit will be written
@@ -258,6 +316,7 @@ public:
 
     /// \brief Read any integral type from a bitstream.
     /// \details Define __BITSTREAM_NATIVE_END if you need endian swapping.
+    /// Types declared with RAKNET_SERIALIZABLE are read field by field.
     /// \param[in] outTemplateVar The value to read
     /// \return true on success, false on failure.
     template<class templateType>
@@ -282,6 +341,13 @@ public:
     template<class templateType>
     bool ReadCompressed( templateType& outTemplateVar );
 
+    /// \brief Read an integer written by WriteVarInt().
+    /// \param[out] outTemplateVar The value read, of the same signedness as written
+    /// \return true on success, false if the stream ended, the varint was malformed or the value does not fit \a outTemplateVar.
+    /// On failure the read offset is left where it was.
+    template<class templateType>
+    bool ReadVarInt( templateType& outTemplateVar );
+
     /// \brief Read any integral type from a bitstream.
     /// \details If the written value differed from the value compared against in the write function,
     /// var will be updated.  Otherwise it will retain the current value.
@@ -309,6 +375,18 @@ public:
     /// \param[in] numberOfBytes the size of \a input in bytes
     void Write( const char* inputByteArray, const unsigned int numberOfBytes );
 
+    /// \brief Write an array of a trivially copyable type in bulk.
+    /// \details Writes the same bits as calling Write() on each element, so the elements are endian swapped unless __BITSTREAM_NATIVE_END is defined.
+    /// Not for bool and the other types Write() has its own format for.
+    /// \param[in] inArray The elements
+    /// \param[in] count The number of elements
+    template<class templateType>
+    void WriteArray( const templateType* inArray, const unsigned int count );
+
+    /// \brief Write the element count of \a inVector as a varint, then its elements as WriteArray() does.
+    template<class templateType>
+    void WriteArray( const std::vector<templateType>& inVector );
+
     /// \brief Write one bitstream to another.
     /// \param[in] numberOfBits bits to write
     /// \param bitStream the bitstream to copy from
@@ -323,6 +401,30 @@ public:
     /// \param[in] floatMax Predetermined maximum value of f
     void WriteFloat16( float x, float floatMin, float floatMax );
 
+    /// \brief Write an array of floats between \a floatMin and \a floatMax, each in \a bitsPerValue bits.
+    /// \details Quantized in bulk, with AVX2 or SSE2 when the CPU has them, and the same results as the scalar code. Values outside the range are clamped.
+    /// \param[in] values The floats
+    /// \param[in] count The number of floats
+    /// \param[in] floatMin Predetermined minimum of the values
+    /// \param[in] floatMax Predetermined maximum of the values
+    /// \param[in] bitsPerValue Precision, from 1 to 24 bits. The error is at most half of ( floatMax - floatMin ) / ( 2^bitsPerValue - 1 ).
+    void WriteQuantizedFloats( const float* values, const unsigned int count, float floatMin, float floatMax, const int bitsPerValue = 16 );
+
+    /// \brief Write an array of 3-vectors, such as positions, inside a box. Each component takes \a bitsPerComponent bits.
+    /// \param[in] xyz x, y and z of each vector
+    /// \param[in] count The number of vectors
+    /// \param[in] vectorMin Predetermined minimum x, y and z
+    /// \param[in] vectorMax Predetermined maximum x, y and z
+    /// \param[in] bitsPerComponent Precision, from 1 to 24 bits
+    void WriteQuantizedVectors( const float* xyz, const unsigned int count, const float vectorMin[3], const float vectorMax[3], const int bitsPerComponent = 16 );
+
+    /// \brief Write an array of unit quaternions with smallest-three encoding: the index of the largest component in 2 bits, then the other three.
+    /// \details Takes 2 + 3 * \a bitsPerComponent bits per quaternion, against 52 for WriteNormQuat().
+    /// \param[in] wxyz w, x, y and z of each quaternion. They must be normalized.
+    /// \param[in] count The number of quaternions
+    /// \param[in] bitsPerComponent Precision, from 1 to 24 bits
+    void WriteQuantizedQuats( const float* wxyz, const unsigned int count, const int bitsPerComponent = 12 );
+
     /// Write one type serialized as another (smaller) type, to save bandwidth
     /// serializationType should be uint8_t, uint16_t, uint24_t, or uint32_t
     /// Example: int num=53; WriteCasted<uint8_t>(num); would use 1 byte to write what would otherwise be an integer (4 or 8 bytes)
@@ -385,12 +487,37 @@ public:
     /// \return true on success false if there is some missing bytes.
     bool Read( char* output, const unsigned int numberOfBytes );
 
+    /// \brief Read an array written by WriteArray().
+    /// \param[out] outArray Receives \a count elements
+    /// \param[in] count The number of elements
+    /// \return true on success, false if the stream does not hold \a count elements. Nothing is read then.
+    template<class templateType>
+    bool ReadArray( templateType* outArray, const unsigned int count );
+
+    /// \brief Read a vector written by WriteArray().
+    /// \details The element count comes from the stream, so it is checked against \a maxCount and against the data left before anything is allocated.
+    /// \param[out] outVector Resized to the number of elements read
+    /// \param[in] maxCount The most elements to accept
+    /// \return true on success, false if the count is over \a maxCount or the stream is too short.
+    template<class templateType>
+    bool ReadArray( std::vector<templateType>& outVector, const unsigned int maxCount );
+
     /// \brief Read a float into 2 bytes, spanning the range between \a floatMin and \a floatMax
     /// \param[in] outFloat The float to read
     /// \param[in] floatMin Predetermined minimum value of f
     /// \param[in] floatMax Predetermined maximum value of f
     bool ReadFloat16( float& outFloat, float floatMin, float floatMax );
 
+    /// \brief Read floats written with WriteQuantizedFloats(), with the same range and precision
+    /// \return false if the stream does not hold \a count values. Nothing is read then.
+    bool ReadQuantizedFloats( float* values, const unsigned int count, float floatMin, float floatMax, const int bitsPerValue = 16 );
+
+    /// \brief Read vectors written with WriteQuantizedVectors(), with the same box and precision
+    bool ReadQuantizedVectors( float* xyz, const unsigned int count, const float vectorMin[3], const float vectorMax[3], const int bitsPerComponent = 16 );
+
+    /// \brief Read quaternions written with WriteQuantizedQuats(), with the same precision
+    bool ReadQuantizedQuats( float* wxyz, const unsigned int count, const int bitsPerComponent = 12 );
+
     /// Read one type serialized to another (smaller) type, to save bandwidth
     /// serializationType should be uint8_t, uint16_t, uint24_t, or uint32_t
     /// Example: int num; ReadCasted<uint8_t>(num); would read 1 bytefrom the stream, and put the value in an integer
@@ -639,6 +766,51 @@ public:
     /// \internal Unrolled inner loop, for when performance is critical
     bool ReadAlignedVar32( char* inOutByteArray );
 
+    /// \internal Write \a value as an unsigned LEB128 varint
+    void WriteVarInt64( uint64_t value );
+    /// \internal Read an unsigned LEB128 varint of at most 10 bytes
+    bool ReadVarInt64( uint64_t& value );
+
+    /// \internal Write \a count elements of \a elementSize bytes each as if by Write(), endian swapping them in bulk
+    void WriteElements( const unsigned char* inArray, const unsigned int elementSize, const unsigned int count );
+    /// \internal Read \a count elements of \a elementSize bytes each as if by Read(), endian swapping them in bulk
+    bool ReadElements( unsigned char* outArray, const unsigned int elementSize, const unsigned int count );
+
+    /// \internal Write the fields of a type declared with RAKNET_SERIALIZABLE, reserving room for all of them first
+    template<class templateType>
+    void WriteSchema( const templateType& inTemplateVar );
+    /// \internal Read the fields of a type declared with RAKNET_SERIALIZABLE, stopping at the first that fails
+    template<class templateType>
+    bool ReadSchema( templateType& outTemplateVar );
+    /// \internal One field of a RAKNET_SERIALIZABLE type. Arrays of bulk copyable types are written as WriteArray() does.
+    template<class templateType>
+    void WriteField( const templateType& inTemplateVar ) { Write( inTemplateVar ); }
+    template<class templateType, size_t count>
+    void WriteField( const templateType ( &inArray )[count] );
+    template<class templateType, size_t count>
+    void WriteField( const std::array<templateType, count>& inArray );
+    template<class templateType>
+    bool ReadField( templateType& outTemplateVar ) { return Read( outTemplateVar ); }
+    template<class templateType, size_t count>
+    bool ReadField( templateType ( &outArray )[count] );
+    template<class templateType, size_t count>
+    bool ReadField( std::array<templateType, count>& outArray );
+
+    /// \internal Write each value in the bits given by \a widths, which repeat every \a period values
+    void WritePackedValues( const uint32_t* values, const unsigned int count, const unsigned char* widths, const unsigned int period );
+    /// \internal Read values written by WritePackedValues()
+    bool ReadPackedValues( uint32_t* values, const unsigned int count, const unsigned char* widths, const unsigned int period );
+
+    /// \internal Types WriteArray() can copy in bulk: what Write() would write byte for byte
+    template<class templateType>
+    struct IsBulkCopyable
+    {
+        static const bool value = std::is_trivially_copyable<templateType>::value && !std::is_pointer<templateType>::value &&
+                                  !std::is_same<templateType, bool>::value && !std::is_same<templateType, uint24_t>::value &&
+                                  !std::is_same<templateType, SystemAddress>::value && !std::is_same<templateType, RakNetGUID>::value &&
+                                  !IsSerializable<templateType>::value;
+    };
+
     inline static bool DoEndianSwap( void )
     {
 #ifndef __BITSTREAM_NATIVE_END
@@ -688,6 +860,12 @@ private:
     void SerializeCompressed( const std::string& str );
     bool DeserializeCompressed( std::string& str );
 
+    /// true if data was allocated by this stream, from the arena or the heap
+    inline bool OwnsAllocatedData( void ) const { return copyData && data != 0 && data != stackData; }
+
+    /// Give back data that outgrew stackData, to the arena or the heap
+    void FreeData( void );
+
     BitSize_t numberOfBitsUsed;
     BitSize_t numberOfBitsAllocated;
     BitSize_t readOffset;
@@ -699,6 +877,9 @@ private:
 
     /// BitStreams that use less than BITSTREAM_STACK_ALLOCATION_SIZE use the stack, rather than the heap to store data.  It switches over if BITSTREAM_STACK_ALLOCATION_SIZE is exceeded
     unsigned char stackData[BITSTREAM_STACK_ALLOCATION_SIZE];
+
+    /// Where data comes from when it outgrows stackData, 0 for rakMalloc_Ex
+    BitStreamArena* arena;
 };
 
 template<class templateType>
@@ -849,10 +1030,181 @@ inline bool BitStream::SerializeBits( bool writeToBitstream, unsigned char* inOu
     return true;
 }
 
+template<class templateType>
+inline bool BitStream::SerializeVarInt( bool writeToBitstream, templateType& inOutTemplateVar )
+{
+    if( writeToBitstream )
+        WriteVarInt( inOutTemplateVar );
+    else
+        return ReadVarInt( inOutTemplateVar );
+    return true;
+}
+
+template<class templateType>
+inline void BitStream::WriteVarInt( const templateType& inTemplateVar )
+{
+    static_assert( std::is_integral<templateType>::value && !std::is_same<templateType, bool>::value, "WriteVarInt needs an integer type" );
+    if( std::is_signed<templateType>::value )
+    {
+        // Zigzag: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+        const int64_t value = (int64_t)inTemplateVar;
+        WriteVarInt64( ( (uint64_t)value << 1 ) ^ (uint64_t)( value >> 63 ) );
+    }
+    else
+        WriteVarInt64( (uint64_t)inTemplateVar );
+}
+
+template<class templateType>
+inline bool BitStream::ReadVarInt( templateType& outTemplateVar )
+{
+    static_assert( std::is_integral<templateType>::value && !std::is_same<templateType, bool>::value, "ReadVarInt needs an integer type" );
+    // Out of range values are left unread, like malformed ones
+    const BitSize_t startOffset = readOffset;
+    uint64_t encoded;
+    if( ReadVarInt64( encoded ) == false )
+        return false;
+
+    if( std::is_signed<templateType>::value )
+    {
+        const int64_t value = (int64_t)( encoded >> 1 ) ^ -(int64_t)( encoded & 1 );
+        if( value < (int64_t)std::numeric_limits<templateType>::min() || value > (int64_t)std::numeric_limits<templateType>::max() )
+        {
+            readOffset = startOffset;
+            return false;
+        }
+        outTemplateVar = (templateType)value;
+    }
+    else
+    {
+        if( encoded > (uint64_t)std::numeric_limits<templateType>::max() )
+        {
+            readOffset = startOffset;
+            return false;
+        }
+        outTemplateVar = (templateType)encoded;
+    }
+    return true;
+}
+
+template<class templateType>
+inline bool BitStream::SerializeArray( bool writeToBitstream, templateType* inOutArray, const unsigned int count )
+{
+    if( writeToBitstream )
+        WriteArray( inOutArray, count );
+    else
+        return ReadArray( inOutArray, count );
+    return true;
+}
+
+template<class templateType>
+inline bool BitStream::SerializeArray( bool writeToBitstream, std::vector<templateType>& inOutVector, const unsigned int maxCount )
+{
+    if( writeToBitstream )
+        WriteArray( inOutVector );
+    else
+        return ReadArray( inOutVector, maxCount );
+    return true;
+}
+
+template<class templateType>
+inline void BitStream::WriteArray( const templateType* inArray, const unsigned int count )
+{
+    static_assert( IsBulkCopyable<templateType>::value, "WriteArray needs a trivially copyable type that Write() writes byte for byte" );
+    WriteElements( (const unsigned char*)inArray, sizeof( templateType ), count );
+}
+
+template<class templateType>
+inline void BitStream::WriteArray( const std::vector<templateType>& inVector )
+{
+    WriteVarInt( (uint32_t)inVector.size() );
+    WriteArray( inVector.data(), (unsigned int)inVector.size() );
+}
+
+template<class templateType>
+inline bool BitStream::ReadArray( templateType* outArray, const unsigned int count )
+{
+    static_assert( IsBulkCopyable<templateType>::value, "ReadArray needs a trivially copyable type that Read() reads byte for byte" );
+    return ReadElements( (unsigned char*)outArray, sizeof( templateType ), count );
+}
+
+template<class templateType>
+inline bool BitStream::ReadArray( std::vector<templateType>& outVector, const unsigned int maxCount )
+{
+    uint32_t count;
+    if( ReadVarInt( count ) == false )
+        return false;
+
+    // Before resizing, so a bad count cannot allocate much
+    if( count > maxCount || (uint64_t)count * sizeof( templateType ) * 8 > GetNumberOfUnreadBits() )
+        return false;
+
+    outVector.resize( count );
+    return ReadArray( outVector.data(), count );
+}
+
+template<class templateType>
+inline void BitStream::WriteSchema( const templateType& inTemplateVar )
+{
+    // One reallocation for the whole type rather than one check per field
+    const BitSize_t maxBits = SerializedSize<templateType>::maxBits;
+    if( numberOfBitsUsed + maxBits > numberOfBitsAllocated )
+        AddBitsAndReallocate( maxBits );
+
+    std::apply( [&]( auto... fields ) { ( WriteField( inTemplateVar.*fields ), ... ); }, RakNetSchemaFields( (const templateType*)0 ) );
+}
+
+template<class templateType>
+inline bool BitStream::ReadSchema( templateType& outTemplateVar )
+{
+    return std::apply( [&]( auto... fields ) { return ( ReadField( outTemplateVar.*fields ) && ... ); }, RakNetSchemaFields( (const templateType*)0 ) );
+}
+
+template<class templateType, size_t count>
+inline void BitStream::WriteField( const templateType ( &inArray )[count] )
+{
+    if constexpr( IsBulkCopyable<templateType>::value && !IsSchemaArray<templateType>::value )
+        WriteArray( inArray, (unsigned int)count );
+    else
+    {
+        for( size_t i = 0; i < count; i++ )
+            WriteField( inArray[i] );
+    }
+}
+
+template<class templateType, size_t count>
+inline void BitStream::WriteField( const std::array<templateType, count>& inArray )
+{
+    WriteField( *(const templateType( * )[count])inArray.data() );
+}
+
+template<class templateType, size_t count>
+inline bool BitStream::ReadField( templateType ( &outArray )[count] )
+{
+    if constexpr( IsBulkCopyable<templateType>::value && !IsSchemaArray<templateType>::value )
+        return ReadArray( outArray, (unsigned int)count );
+    else
+    {
+        for( size_t i = 0; i < count; i++ )
+        {
+            if( ReadField( outArray[i] ) == false )
+                return false;
+        }
+        return true;
+    }
+}
+
+template<class templateType, size_t count>
+inline bool BitStream::ReadField( std::array<templateType, count>& outArray )
+{
+    return ReadField( *(templateType( * )[count])outArray.data() );
+}
+
 template<class templateType>
 inline void BitStream::Write( const templateType& inTemplateVar )
 {
-    if( sizeof( inTemplateVar ) == 1 )
+    if constexpr( IsSerializable<templateType>::value )
+        WriteSchema( inTemplateVar );
+    else if( sizeof( inTemplateVar ) == 1 )
         WriteBits( (unsigned char*)&inTemplateVar, sizeof( templateType ) * 8, true );
     else
     {
@@ -1149,7 +1501,9 @@ inline void BitStream::WriteCompressedDelta( const bool& currentValue )
 template<class templateType>
 inline bool BitStream::Read( templateType& outTemplateVar )
 {
-    if( sizeof( outTemplateVar ) == 1 )
+    if constexpr( IsSerializable<templateType>::value )
+        return ReadSchema( outTemplateVar );
+    else if( sizeof( outTemplateVar ) == 1 )
         return ReadBits( (unsigned char*)&outTemplateVar, sizeof( templateType ) * 8, true );
     else
     {
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "BitStreamArena.h"
+
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+
+#include <string.h>
+
+using namespace RakNet;
+
+static const size_t ARENA_ALIGNMENT = 16;
+
+static size_t AlignUp( size_t size )
+{
+    return ( size + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 );
+}
+
+BitStreamArena::BitStreamArena( size_t _chunkSize )
+{
+    chunkSize = _chunkSize;
+    chunks = 0;
+    cursor = 0;
+    end = 0;
+    last = 0;
+    liveAllocations = 0;
+    memset( &statistics, 0, sizeof( statistics ) );
+}
+
+BitStreamArena::~BitStreamArena()
+{
+    RakAssert( liveAllocations == 0 );
+    FreeChunks();
+}
+
+void* BitStreamArena::Allocate( size_t size )
+{
+    size = AlignUp( size );
+    if( (size_t)( end - cursor ) < size )
+        cursor = AllocateChunk( size );
+
+    last = cursor;
+    cursor += size;
+    liveAllocations++;
+    statistics.allocations++;
+    statistics.bytesUsed += size;
+    return last;
+}
+
+void* BitStreamArena::Reallocate( void* p, size_t oldSize, size_t newSize )
+{
+    if( p == 0 )
+        return Allocate( newSize );
+
+    statistics.reallocations++;
+    newSize = AlignUp( newSize );
+    if( p == last && (size_t)( end - last ) >= newSize )
+    {
+        statistics.bytesUsed += newSize - (size_t)( cursor - last );
+        cursor = last + newSize;
+        return p;
+    }
+
+    statistics.reallocationCopies++;
+    void* moved = Allocate( newSize );
+    memcpy( moved, p, oldSize );
+    // Allocate() counted the copy as a new buffer
+    liveAllocations--;
+    statistics.allocations--;
+    return moved;
+}
+
+void BitStreamArena::Release( void* p )
+{
+    RakAssert( liveAllocations > 0 );
+    liveAllocations--;
+    if( p == last )
+    {
+        statistics.bytesUsed -= (size_t)( cursor - last );
+        cursor = last;
+        last = 0;
+    }
+}
+
+void BitStreamArena::Reset( void )
+{
+    RakAssert( liveAllocations == 0 );
+
+    // Merge the chunks of this tick into one big enough for all of them
+    if( chunks != 0 && chunks->next != 0 )
+    {
+        size_t total = 0;
+        for( Chunk* chunk = chunks; chunk; chunk = chunk->next )
+            total += chunk->size;
+        FreeChunks();
+        AllocateChunk( total );
+    }
+
+    if( chunks != 0 )
+    {
+        cursor = (unsigned char*)chunks + AlignUp( sizeof( Chunk ) );
+        end = cursor + chunks->size;
+    }
+    last = 0;
+    const uint64_t bytesReserved = statistics.bytesReserved;
+    memset( &statistics, 0, sizeof( statistics ) );
+    statistics.bytesReserved = bytesReserved;
+}
+
+unsigned int BitStreamArena::GetLiveAllocationCount( void ) const
+{
+    return liveAllocations;
+}
+
+void BitStreamArena::GetStatistics( BitStreamArenaStatistics* _statistics ) const
+{
+    *_statistics = statistics;
+}
+
+BitStreamArena* BitStreamArena::GetThreadArena( void )
+{
+    static thread_local BitStreamArena threadArena;
+    return &threadArena;
+}
+
+unsigned char* BitStreamArena::AllocateChunk( size_t size )
+{
+    if( size < chunkSize )
+        size = AlignUp( chunkSize );
+
+    Chunk* chunk = (Chunk*)rakMalloc_Ex( AlignUp( sizeof( Chunk ) ) + size, _FILE_AND_LINE_ );
+    RakAssert( chunk );
+    chunk->next = chunks;
+    chunk->size = size;
+    chunks = chunk;
+    statistics.chunkAllocations++;
+    statistics.bytesReserved += size;
+
+    unsigned char* start = (unsigned char*)chunk + AlignUp( sizeof( Chunk ) );
+    end = start + size;
+    return start;
+}
+
+void BitStreamArena::FreeChunks( void )
+{
+    while( chunks )
+    {
+        Chunk* next = chunks->next;
+        rakFree_Ex( chunks, _FILE_AND_LINE_ );
+        chunks = next;
+    }
+    statistics.bytesReserved = 0;
+    cursor = 0;
+    end = 0;
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief A bump allocator for the buffers of BitStreams that only live for one tick, see BitStream::SetArena().
+///
+
+#pragma once
+
+#include "Export.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RakNet {
+
+/// What a BitStreamArena did since it was last reset
+struct RAK_DLL_EXPORT BitStreamArenaStatistics
+{
+    /// Buffers handed out
+    uint32_t allocations;
+    /// Buffers grown, in place when they were the last allocation and still fit
+    uint32_t reallocations;
+    /// Buffers grown by copying to a new place
+    uint32_t reallocationCopies;
+    /// Chunks taken from rakMalloc_Ex. After the first few ticks this is normally 0.
+    uint32_t chunkAllocations;
+    /// Bytes handed out, including alignment
+    uint64_t bytesUsed;
+    /// Bytes in the chunks the arena holds
+    uint64_t bytesReserved;
+};
+
+/// Hands out memory by moving a pointer through large chunks, and takes it all back at once with Reset().
+/// Buffers are released individually only to keep count, except that releasing the last one makes its memory available again.
+/// Reset() merges the chunks of a tick into one, so a steady workload stops allocating after the first tick.
+/// Not thread safe. Use one arena per thread, such as GetThreadArena().
+class RAK_DLL_EXPORT BitStreamArena
+{
+public:
+    /// \param[in] chunkSize Bytes to take from rakMalloc_Ex when the arena runs out, or more if one buffer needs more
+    BitStreamArena( size_t chunkSize = 65536 );
+    ~BitStreamArena();
+
+    /// \return \a size bytes aligned to 16
+    void* Allocate( size_t size );
+
+    /// Grow a buffer from Allocate() to \a newSize, keeping its first \a oldSize bytes
+    void* Reallocate( void* p, size_t oldSize, size_t newSize );
+
+    /// Done with a buffer from Allocate() or Reallocate()
+    void Release( void* p );
+
+    /// Take back every buffer. Every BitStream using the arena must have been destroyed or moved off it with SetArena( 0 ).
+    void Reset( void );
+
+    /// \return How many buffers were allocated and not released
+    unsigned int GetLiveAllocationCount( void ) const;
+
+    /// Statistics since the last Reset()
+    void GetStatistics( BitStreamArenaStatistics* statistics ) const;
+
+    /// \return An arena for the calling thread, destroyed when the thread exits
+    static BitStreamArena* GetThreadArena( void );
+
+protected:
+    struct Chunk
+    {
+        Chunk* next;
+        size_t size;
+    };
+
+    unsigned char* AllocateChunk( size_t size );
+    void FreeChunks( void );
+
+    size_t chunkSize;
+    // The chunk being used first, then the ones filled before it
+    Chunk* chunks;
+    unsigned char* cursor;
+    unsigned char* end;
+    // The most recent buffer, which can grow and be released in place
+    unsigned char* last;
+    unsigned int liveAllocations;
+    BitStreamArenaStatistics statistics;
+
+private:
+    BitStreamArena( const BitStreamArena& );
+    BitStreamArena& operator=( const BitStreamArena& );
+};
+
+} // namespace RakNet
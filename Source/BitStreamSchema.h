@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Declares which fields of a struct BitStream serializes, so the read and write code is generated at compile time.
+/// \details
+/// \code
+/// struct PlayerState
+/// {
+///     uint32_t id;
+///     float position[3];
+///     bool isAlive;
+/// };
+/// RAKNET_SERIALIZABLE( PlayerState, id, position, isAlive )
+///
+/// bitStream.Write( state );            // Writes id, position and isAlive in that order
+/// bitStream.Serialize( false, state ); // Reads them back
+/// \endcode
+/// RAKNET_SERIALIZABLE goes after the struct, in the same namespace, and lists up to 32 fields in the order they are sent.
+/// Each field is written as BitStream::Write() would write it on its own, so fields can be other serializable structs.
+/// Arrays of trivially copyable types go through BitStream::WriteArray().
+///
+
+#pragma once
+
+#include "RakNetTypes.h"
+
+#include <array>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace RakNet {
+
+/// True for types declared with RAKNET_SERIALIZABLE
+template<class templateType, class = void>
+struct IsSerializable : std::false_type
+{
+};
+
+template<class templateType>
+struct IsSerializable<templateType, std::void_t<decltype( RakNetSchemaFields( (const templateType*)0 ) )>> : std::true_type
+{
+};
+
+/// \brief The most bits BitStream::Write() uses for a \a templateType.
+/// \details isBounded is false for types of variable size, such as std::string. maxBits then counts only their fixed part.
+template<class templateType, class = void>
+struct SerializedSize
+{
+    // Written as raw bytes
+    static constexpr BitSize_t maxBits = sizeof( templateType ) * 8;
+    static constexpr bool isBounded = true;
+};
+
+template<>
+struct SerializedSize<bool>
+{
+    static constexpr BitSize_t maxBits = 1;
+    static constexpr bool isBounded = true;
+};
+
+template<>
+struct SerializedSize<uint24_t>
+{
+    // Byte aligned first
+    static constexpr BitSize_t maxBits = 7 + 24;
+    static constexpr bool isBounded = true;
+};
+
+template<>
+struct SerializedSize<RakNetGUID>
+{
+    static constexpr BitSize_t maxBits = sizeof( uint64_t ) * 8;
+    static constexpr bool isBounded = true;
+};
+
+template<>
+struct SerializedSize<SystemAddress>
+{
+#if RAKNET_SUPPORT_IPV6 == 1
+    static constexpr BitSize_t maxBits = 8 + sizeof( sockaddr_in6 ) * 8;
+#else
+    static constexpr BitSize_t maxBits = 8 + ( 4 + 2 ) * 8;
+#endif
+    static constexpr bool isBounded = true;
+};
+
+template<>
+struct SerializedSize<std::string>
+{
+    // The length, and padding to the byte aligned characters
+    static constexpr BitSize_t maxBits = 16 + 7;
+    static constexpr bool isBounded = false;
+};
+
+template<class elementType, size_t count>
+struct SerializedSize<elementType[count]>
+{
+    static constexpr BitSize_t maxBits = SerializedSize<elementType>::maxBits * count;
+    static constexpr bool isBounded = SerializedSize<elementType>::isBounded;
+};
+
+template<class elementType, size_t count>
+struct SerializedSize<std::array<elementType, count>> : SerializedSize<elementType[count]>
+{
+};
+
+/// \internal Array fields are written element by element, so arrays of arrays are not copied in bulk as one element
+template<class templateType>
+struct IsSchemaArray : std::is_array<templateType>
+{
+};
+
+template<class elementType, size_t count>
+struct IsSchemaArray<std::array<elementType, count>> : std::true_type
+{
+};
+
+/// \internal The type of the field a member pointer points to
+template<class memberPointer>
+struct SchemaFieldType;
+
+template<class classType, class fieldType>
+struct SchemaFieldType<fieldType classType::*>
+{
+    typedef fieldType type;
+};
+
+/// \internal The sum of the sizes of the fields in a RakNetSchemaFields() tuple
+template<class fieldTuple>
+struct SchemaSize;
+
+template<class... memberPointers>
+struct SchemaSize<std::tuple<memberPointers...>>
+{
+    static constexpr BitSize_t maxBits = ( (BitSize_t)0 + ... + SerializedSize<typename SchemaFieldType<memberPointers>::type>::maxBits );
+    static constexpr bool isBounded = ( true && ... && SerializedSize<typename SchemaFieldType<memberPointers>::type>::isBounded );
+};
+
+template<class templateType>
+struct SerializedSize<templateType, typename std::enable_if<IsSerializable<templateType>::value>::type>
+: SchemaSize<decltype( RakNetSchemaFields( (const templateType*)0 ) )>
+{
+};
+
+} // namespace RakNet
+
+// Expands to &Type::field for each field. The extra expansion makes MSVC split __VA_ARGS__ into arguments.
+#define RAKNET_SCHEMA_EXPAND( x ) x
+#define RAKNET_SCHEMA_CONCATENATE( a, b ) RAKNET_SCHEMA_CONCATENATE_IMPL( a, b )
+#define RAKNET_SCHEMA_CONCATENATE_IMPL( a, b ) a##b
+#define RAKNET_SCHEMA_COUNT( ... ) RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_COUNT_N( __VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 ) )
+#define RAKNET_SCHEMA_COUNT_N( _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ... ) N
+#define RAKNET_SCHEMA_FIELDS_1( Type, field ) &Type::field
+#define RAKNET_SCHEMA_FIELDS_2( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_1( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_3( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_2( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_4( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_3( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_5( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_4( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_6( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_5( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_7( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_6( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_8( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_7( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_9( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_8( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_10( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_9( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_11( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_10( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_12( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_11( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_13( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_12( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_14( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_13( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_15( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_14( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_16( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_15( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_17( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_16( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_18( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_17( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_19( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_18( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_20( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_19( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_21( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_20( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_22( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_21( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_23( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_22( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_24( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_23( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_25( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_24( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_26( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_25( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_27( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_26( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_28( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_27( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_29( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_28( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_30( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_29( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_31( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_30( Type, __VA_ARGS__ ) )
+#define RAKNET_SCHEMA_FIELDS_32( Type, field, ... ) &Type::field, RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_FIELDS_31( Type, __VA_ARGS__ ) )
+
+/// Declare the fields of \a Type that BitStream serializes, in order. See BitStreamSchema.h.
+#define RAKNET_SERIALIZABLE( Type, ... )                                                                                                              \
+    constexpr auto RakNetSchemaFields( const Type* )                                                                                                \
+    {                                                                                                                                               \
+        return std::make_tuple( RAKNET_SCHEMA_EXPAND( RAKNET_SCHEMA_CONCATENATE( RAKNET_SCHEMA_FIELDS_, RAKNET_SCHEMA_COUNT( __VA_ARGS__ ) )( Type, __VA_ARGS__ ) ) ); \
+    }
@@ -0,0 +1,507 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file BitStreamView.h
+/// \brief A read only, non-owning view of serialized data, for parsing packets without constructing a BitStream.
+///
+
+#pragma once
+
+#include "BitStream.h"
+
+namespace RakNet {
+
+/// \brief Reads data written by BitStream, without owning or copying it.
+/// \details A view is a pointer, a length and a read offset, so it costs nothing to set up and can be passed by value.
+/// It reads the same formats as the matching BitStream Read functions, and BitStream reads through one internally.
+/// \code
+/// BitStreamView view( packet );
+/// view.IgnoreBytes( sizeof( MessageID ) );
+/// view.Read( value );
+/// \endcode
+/// The data must outlive the view.
+class RAK_DLL_EXPORT BitStreamView
+{
+public:
+    constexpr BitStreamView()
+    : data( 0 ), numberOfBitsUsed( 0 ), readOffset( 0 )
+    {
+    }
+
+    /// \param[in] _data The data to read
+    /// \param[in] lengthInBytes Size of \a _data
+    constexpr BitStreamView( const unsigned char* _data, const unsigned int lengthInBytes )
+    : data( _data ), numberOfBitsUsed( lengthInBytes << 3 ), readOffset( 0 )
+    {
+    }
+
+    /// \param[in] _data The data to read
+    /// \param[in] lengthInBits Number of bits of \a _data that can be read
+    /// \param[in] _readOffset The bit to start reading at
+    constexpr BitStreamView( const unsigned char* _data, const BitSize_t lengthInBits, const BitSize_t _readOffset )
+    : data( _data ), numberOfBitsUsed( lengthInBits ), readOffset( _readOffset )
+    {
+    }
+
+    /// View the contents of a received packet, from the start
+    explicit BitStreamView( const Packet* packet )
+    : data( packet->data ), numberOfBitsUsed( packet->bitSize ), readOffset( 0 )
+    {
+    }
+
+    /// View what is left to read in \a bitStream. Reading from the view does not move the read offset of \a bitStream.
+    explicit BitStreamView( const BitStream& bitStream )
+    : data( bitStream.GetData() ), numberOfBitsUsed( bitStream.GetNumberOfBitsUsed() ), readOffset( bitStream.GetReadOffset() )
+    {
+    }
+
+    /// \brief Read any integral type, as BitStream::Read() does.
+    /// \return true on success, false if there is not enough data left
+    template<class templateType>
+    bool Read( templateType& outTemplateVar );
+
+    /// \brief Read a value written with BitStream::WriteDelta()
+    template<class templateType>
+    bool ReadDelta( templateType& outTemplateVar );
+
+    /// \brief Read a value written with BitStream::WriteCompressed()
+    template<class templateType>
+    bool ReadCompressed( templateType& outTemplateVar );
+
+    /// \brief Read a value written with BitStream::WriteCompressedDelta()
+    template<class templateType>
+    bool ReadCompressedDelta( templateType& outTemplateVar );
+
+    /// \brief Read a value written with BitStream::WriteCasted()
+    template<class serializationType, class sourceType>
+    bool ReadCasted( sourceType& value );
+
+    /// \brief Read a value written with BitStream::WriteBitsFromIntegerRange()
+    template<class templateType>
+    bool ReadBitsFromIntegerRange( templateType& value, const templateType minimum, const templateType maximum, bool allowOutsideRange = false );
+    template<class templateType>
+    bool ReadBitsFromIntegerRange( templateType& value, const templateType minimum, const templateType maximum, const int requiredBits, bool allowOutsideRange = false );
+
+    /// \brief Read a value written with BitStream::WriteVarInt()
+    /// On failure the read offset is left where it was
+    template<class templateType>
+    bool ReadVarInt( templateType& outTemplateVar );
+
+    /// \brief Read an array written with BitStream::WriteArray()
+    template<class templateType>
+    bool ReadArray( templateType* outArray, const unsigned int count );
+    template<class templateType>
+    bool ReadArray( std::vector<templateType>& outVector, const unsigned int maxCount );
+
+    /// \brief Read raw bytes, as BitStream::Read( char*, const unsigned int ) does
+    bool Read( char* output, const unsigned int numberOfBytes );
+
+    /// \brief Read a float written with BitStream::WriteFloat16()
+    bool ReadFloat16( float& outFloat, float floatMin, float floatMax );
+
+    /// \brief Read values written with BitStream::WriteQuantizedFloats(), WriteQuantizedVectors() and WriteQuantizedQuats()
+    bool ReadQuantizedFloats( float* values, const unsigned int count, float floatMin, float floatMax, const int bitsPerValue = 16 );
+    bool ReadQuantizedVectors( float* xyz, const unsigned int count, const float vectorMin[3], const float vectorMax[3], const int bitsPerComponent = 16 );
+    bool ReadQuantizedQuats( float* wxyz, const unsigned int count, const int bitsPerComponent = 12 );
+
+    /// \brief Read bits, as BitStream::ReadBits() does
+    bool ReadBits( unsigned char* inOutByteArray, BitSize_t numberOfBitsToRead, const bool alignBitsToRight = true );
+
+    /// \brief Read bytes written with BitStream::WriteAlignedBytes()
+    bool ReadAlignedBytes( unsigned char* inOutByteArray, const unsigned int numberOfBytesToRead );
+
+    /// \brief Read bytes written with BitStream::WriteAlignedBytesSafe()
+    bool ReadAlignedBytesSafe( char* inOutByteArray, unsigned int& inputLength, const unsigned int maxBytesToRead );
+
+    /// \brief Reads 1 bit and returns true if that bit is 1 and false if it is 0. There must be a bit left to read.
+    bool ReadBit( void )
+    {
+        bool result = ( data[readOffset >> 3] & ( 0x80 >> ( readOffset & 7 ) ) ) != 0;
+        readOffset++;
+        return result;
+    }
+
+    /// \brief Skip bits
+    void IgnoreBits( const BitSize_t numberOfBits ) { readOffset += numberOfBits; }
+    void IgnoreBytes( const unsigned int numberOfBytes ) { readOffset += BYTES_TO_BITS( numberOfBytes ); }
+
+    /// \brief Skip to the next byte boundary, as BitStream::AlignReadToByteBoundary() does
+    void AlignReadToByteBoundary( void ) { readOffset += 8 - ( ( ( readOffset - 1 ) & 7 ) + 1 ); }
+
+    constexpr const unsigned char* GetData( void ) const { return data; }
+    constexpr BitSize_t GetNumberOfBitsUsed( void ) const { return numberOfBitsUsed; }
+    constexpr BitSize_t GetReadOffset( void ) const { return readOffset; }
+    constexpr BitSize_t GetNumberOfUnreadBits( void ) const { return readOffset < numberOfBitsUsed ? numberOfBitsUsed - readOffset : 0; }
+    void SetReadOffset( const BitSize_t newReadOffset ) { readOffset = newReadOffset; }
+
+    /// \internal Read a value written by BitStream::WriteCompressed( const unsigned char*, ... )
+    bool ReadCompressed( unsigned char* inOutByteArray, const unsigned int size, const bool unsignedData );
+    /// \internal Read an unsigned LEB128 varint of at most 10 bytes
+    bool ReadVarInt64( uint64_t& value );
+    /// \internal Read \a count elements of \a elementSize bytes each as if by Read(), endian swapping them in bulk
+    bool ReadElements( unsigned char* outArray, const unsigned int elementSize, const unsigned int count );
+    /// \internal Read values written by BitStream::WritePackedValues()
+    bool ReadPackedValues( uint32_t* values, const unsigned int count, const unsigned char* widths, const unsigned int period );
+    /// \internal Read the fields of a type declared with RAKNET_SERIALIZABLE, as BitStream::ReadSchema() does
+    template<class templateType>
+    bool ReadSchema( templateType& outTemplateVar );
+    template<class templateType>
+    bool ReadField( templateType& outTemplateVar ) { return Read( outTemplateVar ); }
+    template<class templateType, size_t count>
+    bool ReadField( templateType ( &outArray )[count] );
+    template<class templateType, size_t count>
+    bool ReadField( std::array<templateType, count>& outArray );
+
+private:
+    bool Deserialize( std::string& str );
+
+    const unsigned char* data;
+    BitSize_t numberOfBitsUsed;
+    BitSize_t readOffset;
+};
+
+static_assert( std::is_trivially_copyable<BitStreamView>::value, "BitStreamView is passed by value" );
+
+template<class templateType>
+inline bool BitStreamView::Read( templateType& outTemplateVar )
+{
+    if constexpr( IsSerializable<templateType>::value )
+        return ReadSchema( outTemplateVar );
+    else if( sizeof( outTemplateVar ) == 1 )
+        return ReadBits( (unsigned char*)&outTemplateVar, sizeof( templateType ) * 8, true );
+    else
+    {
+#ifndef __BITSTREAM_NATIVE_END
+        if( BitStream::DoEndianSwap() )
+        {
+            unsigned char output[sizeof( templateType )];
+            if( ReadBits( (unsigned char*)output, sizeof( templateType ) * 8, true ) )
+            {
+                BitStream::ReverseBytes( output, (unsigned char*)&outTemplateVar, sizeof( templateType ) );
+                return true;
+            }
+            return false;
+        }
+        else
+#endif
+            return ReadBits( (unsigned char*)&outTemplateVar, sizeof( templateType ) * 8, true );
+    }
+}
+
+template<>
+inline bool BitStreamView::Read( bool& outTemplateVar )
+{
+    if( readOffset + 1 > numberOfBitsUsed )
+        return false;
+
+    outTemplateVar = ReadBit();
+    return true;
+}
+
+template<>
+inline bool BitStreamView::Read( SystemAddress& outTemplateVar )
+{
+    unsigned char ipVersion;
+    Read( ipVersion );
+    if( ipVersion == 4 )
+    {
+        outTemplateVar.address.addr4.sin_family = AF_INET;
+        // Don't endian swap the address or port
+        uint32_t binaryAddress;
+        ReadBits( (unsigned char*)&binaryAddress, sizeof( binaryAddress ) * 8, true );
+        // Unhide the IP address, done to prevent routers from changing it
+        outTemplateVar.address.addr4.sin_addr.s_addr = ~binaryAddress;
+        bool b = ReadBits( (unsigned char*)&outTemplateVar.address.addr4.sin_port, sizeof( outTemplateVar.address.addr4.sin_port ) * 8, true );
+        outTemplateVar.debugPort = ntohs( outTemplateVar.address.addr4.sin_port );
+        return b;
+    }
+    else
+    {
+#if RAKNET_SUPPORT_IPV6 == 1
+        bool b = ReadBits( (unsigned char*)&outTemplateVar.address.addr6, sizeof( outTemplateVar.address.addr6 ) * 8, true );
+        outTemplateVar.debugPort = ntohs( outTemplateVar.address.addr6.sin6_port );
+        return b;
+#else
+        return false;
+#endif
+    }
+}
+
+template<>
+inline bool BitStreamView::Read( uint24_t& outTemplateVar )
+{
+    AlignReadToByteBoundary();
+    if( readOffset + 3 * 8 > numberOfBitsUsed )
+        return false;
+
+    if( BitStream::IsBigEndian() == false )
+    {
+        ( (unsigned char*)&outTemplateVar.val )[0] = data[( readOffset >> 3 ) + 0];
+        ( (unsigned char*)&outTemplateVar.val )[1] = data[( readOffset >> 3 ) + 1];
+        ( (unsigned char*)&outTemplateVar.val )[2] = data[( readOffset >> 3 ) + 2];
+        ( (unsigned char*)&outTemplateVar.val )[3] = 0;
+    }
+    else
+    {
+        ( (unsigned char*)&outTemplateVar.val )[3] = data[( readOffset >> 3 ) + 0];
+        ( (unsigned char*)&outTemplateVar.val )[2] = data[( readOffset >> 3 ) + 1];
+        ( (unsigned char*)&outTemplateVar.val )[1] = data[( readOffset >> 3 ) + 2];
+        ( (unsigned char*)&outTemplateVar.val )[0] = 0;
+    }
+
+    readOffset += 3 * 8;
+    return true;
+}
+
+template<>
+inline bool BitStreamView::Read( RakNetGUID& outTemplateVar )
+{
+    return Read( outTemplateVar.g );
+}
+
+template<>
+inline bool BitStreamView::Read( std::string& outTemplateVar )
+{
+    return Deserialize( outTemplateVar );
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadDelta( templateType& outTemplateVar )
+{
+    bool dataWritten;
+    bool success;
+    success = Read( dataWritten );
+    if( dataWritten )
+        success = Read( outTemplateVar );
+    return success;
+}
+
+template<>
+inline bool BitStreamView::ReadDelta( bool& outTemplateVar )
+{
+    return Read( outTemplateVar );
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadCompressed( templateType& outTemplateVar )
+{
+    if( sizeof( outTemplateVar ) == 1 )
+        return ReadCompressed( (unsigned char*)&outTemplateVar, sizeof( templateType ) * 8, true );
+    else
+    {
+#ifndef __BITSTREAM_NATIVE_END
+        if( BitStream::DoEndianSwap() )
+        {
+            unsigned char output[sizeof( templateType )];
+            if( ReadCompressed( (unsigned char*)output, sizeof( templateType ) * 8, true ) )
+            {
+                BitStream::ReverseBytes( output, (unsigned char*)&outTemplateVar, sizeof( templateType ) );
+                return true;
+            }
+            return false;
+        }
+        else
+#endif
+            return ReadCompressed( (unsigned char*)&outTemplateVar, sizeof( templateType ) * 8, true );
+    }
+}
+
+template<>
+inline bool BitStreamView::ReadCompressed( SystemAddress& outTemplateVar )
+{
+    return Read( outTemplateVar );
+}
+
+template<>
+inline bool BitStreamView::ReadCompressed( uint24_t& outTemplateVar )
+{
+    return Read( outTemplateVar );
+}
+
+template<>
+inline bool BitStreamView::ReadCompressed( RakNetGUID& outTemplateVar )
+{
+    return Read( outTemplateVar );
+}
+
+template<>
+inline bool BitStreamView::ReadCompressed( bool& outTemplateVar )
+{
+    return Read( outTemplateVar );
+}
+
+/// For values between -1 and 1
+template<>
+inline bool BitStreamView::ReadCompressed( float& outTemplateVar )
+{
+    unsigned short compressedFloat;
+    if( Read( compressedFloat ) )
+    {
+        outTemplateVar = ( (float)compressedFloat / 32767.5f - 1.0f );
+        return true;
+    }
+    return false;
+}
+
+/// For values between -1 and 1
+template<>
+inline bool BitStreamView::ReadCompressed( double& outTemplateVar )
+{
+    uint32_t compressedFloat;
+    if( Read( compressedFloat ) )
+    {
+        outTemplateVar = ( (double)compressedFloat / 2147483648.0 - 1.0 );
+        return true;
+    }
+    return false;
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadCompressedDelta( templateType& outTemplateVar )
+{
+    bool dataWritten;
+    bool success;
+    success = Read( dataWritten );
+    if( dataWritten )
+        success = ReadCompressed( outTemplateVar );
+    return success;
+}
+
+template<>
+inline bool BitStreamView::ReadCompressedDelta( bool& outTemplateVar )
+{
+    return Read( outTemplateVar );
+}
+
+template<class serializationType, class sourceType>
+inline bool BitStreamView::ReadCasted( sourceType& value )
+{
+    serializationType val;
+    bool success = Read( val );
+    value = (sourceType)val;
+    return success;
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadBitsFromIntegerRange( templateType& value, const templateType minimum, const templateType maximum, bool allowOutsideRange )
+{
+    int requiredBits = BYTES_TO_BITS( sizeof( templateType ) ) - BitStream::NumberOfLeadingZeroes( templateType( maximum - minimum ) );
+    return ReadBitsFromIntegerRange( value, minimum, maximum, requiredBits, allowOutsideRange );
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadBitsFromIntegerRange( templateType& value, const templateType minimum, const templateType maximum, const int requiredBits, bool allowOutsideRange )
+{
+    RakAssert( maximum >= minimum );
+    if( allowOutsideRange )
+    {
+        bool isOutsideRange;
+        Read( isOutsideRange );
+        if( isOutsideRange )
+            return Read( value );
+    }
+    unsigned char output[sizeof( templateType )];
+    memset( output, 0, sizeof( output ) );
+    bool success = ReadBits( output, requiredBits );
+    if( success )
+    {
+        if( BitStream::IsBigEndian() == true )
+            BitStream::ReverseBytesInPlace( output, sizeof( output ) );
+        memcpy( &value, output, sizeof( output ) );
+
+        value += minimum;
+    }
+
+    return success;
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadVarInt( templateType& outTemplateVar )
+{
+    static_assert( std::is_integral<templateType>::value && !std::is_same<templateType, bool>::value, "ReadVarInt needs an integer type" );
+    // Out of range values are left unread, like malformed ones
+    const BitSize_t startOffset = readOffset;
+    uint64_t encoded;
+    if( ReadVarInt64( encoded ) == false )
+        return false;
+
+    if( std::is_signed<templateType>::value )
+    {
+        const int64_t value = (int64_t)( encoded >> 1 ) ^ -(int64_t)( encoded & 1 );
+        if( value < (int64_t)std::numeric_limits<templateType>::min() || value > (int64_t)std::numeric_limits<templateType>::max() )
+        {
+            readOffset = startOffset;
+            return false;
+        }
+        outTemplateVar = (templateType)value;
+    }
+    else
+    {
+        if( encoded > (uint64_t)std::numeric_limits<templateType>::max() )
+        {
+            readOffset = startOffset;
+            return false;
+        }
+        outTemplateVar = (templateType)encoded;
+    }
+    return true;
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadArray( templateType* outArray, const unsigned int count )
+{
+    static_assert( BitStream::IsBulkCopyable<templateType>::value, "ReadArray needs a trivially copyable type that Read() reads byte for byte" );
+    return ReadElements( (unsigned char*)outArray, sizeof( templateType ), count );
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadArray( std::vector<templateType>& outVector, const unsigned int maxCount )
+{
+    uint32_t count;
+    if( ReadVarInt( count ) == false )
+        return false;
+
+    // Before resizing, so a bad count cannot allocate much
+    if( count > maxCount || (uint64_t)count * sizeof( templateType ) * 8 > GetNumberOfUnreadBits() )
+        return false;
+
+    outVector.resize( count );
+    return ReadArray( outVector.data(), count );
+}
+
+template<class templateType>
+inline bool BitStreamView::ReadSchema( templateType& outTemplateVar )
+{
+    return std::apply( [&]( auto... fields ) { return ( ReadField( outTemplateVar.*fields ) && ... ); }, RakNetSchemaFields( (const templateType*)0 ) );
+}
+
+template<class templateType, size_t count>
+inline bool BitStreamView::ReadField( templateType ( &outArray )[count] )
+{
+    if constexpr( BitStream::IsBulkCopyable<templateType>::value && !IsSchemaArray<templateType>::value )
+        return ReadArray( outArray, (unsigned int)count );
+    else
+    {
+        for( size_t i = 0; i < count; i++ )
+        {
+            if( ReadField( outArray[i] ) == false )
+                return false;
+        }
+        return true;
+    }
+}
+
+template<class templateType, size_t count>
+inline bool BitStreamView::ReadField( std::array<templateType, count>& outArray )
+{
+    return ReadField( *(templateType( * )[count])outArray.data() );
+}
+
+} // namespace RakNet
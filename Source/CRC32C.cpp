@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "CRC32C.h"
+
+#include <string.h>
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_SSE42_AVAILABLE
+#define CRC32C_TARGET_SSE42
+#elif( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <nmmintrin.h>
+#define CRC32C_SSE42_AVAILABLE
+#define CRC32C_TARGET_SSE42 __attribute__( ( target( "sse4.2" ) ) )
+#endif
+
+namespace RakNet {
+
+// Reflected form of the Castagnoli polynomial
+static const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+// Slicing-by-8 lookup tables, generated at compile time.
+// table[0] is the classic byte-at-a-time table, table[k][n] advances table[k-1][n] by one more zero byte.
+struct CRC32CTables
+{
+    uint32_t table[8][256];
+
+    constexpr CRC32CTables()
+    : table()
+    {
+        for( uint32_t n = 0; n < 256; n++ )
+        {
+            uint32_t crc = n;
+            for( int bit = 0; bit < 8; bit++ )
+                crc = ( crc & 1 ) ? ( crc >> 1 ) ^ CRC32C_POLYNOMIAL : crc >> 1;
+            table[0][n] = crc;
+        }
+        for( uint32_t n = 0; n < 256; n++ )
+        {
+            for( int k = 1; k < 8; k++ )
+                table[k][n] = ( table[k - 1][n] >> 8 ) ^ table[0][table[k - 1][n] & 0xFF];
+        }
+    }
+};
+
+static constexpr CRC32CTables crc32cTables;
+
+uint32_t CRC32CPortable( const unsigned char* data, unsigned int length, uint32_t crc )
+{
+    const uint32_t( *t )[256] = crc32cTables.table;
+
+    crc = ~crc;
+    while( length >= 8 )
+    {
+        // Assemble little-endian words byte by byte so this works regardless of alignment and host byte order
+        uint32_t lo = crc ^ ( (uint32_t)data[0] | ( (uint32_t)data[1] << 8 ) | ( (uint32_t)data[2] << 16 ) | ( (uint32_t)data[3] << 24 ) );
+        uint32_t hi = (uint32_t)data[4] | ( (uint32_t)data[5] << 8 ) | ( (uint32_t)data[6] << 16 ) | ( (uint32_t)data[7] << 24 );
+        crc = t[7][lo & 0xFF] ^ t[6][( lo >> 8 ) & 0xFF] ^ t[5][( lo >> 16 ) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][( hi >> 8 ) & 0xFF] ^ t[1][( hi >> 16 ) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while( length-- > 0 )
+        crc = ( crc >> 8 ) ^ t[0][( crc ^ *data++ ) & 0xFF];
+
+    return ~crc;
+}
+
+#ifdef CRC32C_SSE42_AVAILABLE
+static CRC32C_TARGET_SSE42 uint32_t CRC32CSSE42( const unsigned char* data, unsigned int length, uint32_t crc )
+{
+    crc = ~crc;
+#if defined( __x86_64__ ) || defined( _M_X64 )
+    uint64_t crc64 = crc;
+    while( length >= 8 )
+    {
+        uint64_t word;
+        memcpy( &word, data, sizeof( word ) );
+        crc64 = _mm_crc32_u64( crc64, word );
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while( length >= 4 )
+    {
+        uint32_t word;
+        memcpy( &word, data, sizeof( word ) );
+        crc = _mm_crc32_u32( crc, word );
+        data += 4;
+        length -= 4;
+    }
+    while( length-- > 0 )
+        crc = _mm_crc32_u8( crc, *data++ );
+
+    return ~crc;
+}
+
+static bool CPUSupportsSSE42( void )
+{
+#if defined( _MSC_VER )
+    int cpuInfo[4];
+    __cpuid( cpuInfo, 1 );
+    return ( cpuInfo[2] & ( 1 << 20 ) ) != 0;
+#else
+    return __builtin_cpu_supports( "sse4.2" ) != 0;
+#endif
+}
+#endif // CRC32C_SSE42_AVAILABLE
+
+using CRC32CFunction = uint32_t ( * )( const unsigned char*, unsigned int, uint32_t );
+
+static CRC32CFunction SelectCRC32CFunction( void )
+{
+#ifdef CRC32C_SSE42_AVAILABLE
+    if( CPUSupportsSSE42() )
+        return CRC32CSSE42;
+#endif
+    return CRC32CPortable;
+}
+
+// Resolved once, the first time any thread asks for a checksum
+static CRC32CFunction GetCRC32CFunction( void )
+{
+    static const CRC32CFunction crc32cFunction = SelectCRC32CFunction();
+    return crc32cFunction;
+}
+
+uint32_t CRC32C( const unsigned char* data, unsigned int length, uint32_t crc )
+{
+    return GetCRC32CFunction()( data, length, crc );
+}
+
+bool CRC32CIsHardwareAccelerated( void )
+{
+    return GetCRC32CFunction() != CRC32CPortable;
+}
+
+} // namespace RakNet
@@ -0,0 +1,39 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief CRC32C (Castagnoli polynomial 0x1EDC6F41) checksum, used to detect corrupted datagrams.
+///
+
+#pragma once
+
+#include <stdint.h>
+
+namespace RakNet {
+
+/// Size, in bytes, of the checksum appended to each datagram when the integrity check is enabled
+static const unsigned int CRC32C_LENGTH = 4;
+
+/// Computes the CRC32C of \a data.
+/// Uses the SSE4.2 crc32 instruction when the CPU supports it, otherwise a slicing-by-8 table implementation.
+/// Both paths produce identical results.
+/// \param[in] data The data to checksum
+/// \param[in] length The length of \a data in bytes
+/// \param[in] crc The result of a previous call, to checksum data incrementally. Pass 0 to start.
+/// \return The checksum
+uint32_t CRC32C( const unsigned char* data, unsigned int length, uint32_t crc = 0 );
+
+/// Same as CRC32C() but always uses the table implementation
+uint32_t CRC32CPortable( const unsigned char* data, unsigned int length, uint32_t crc = 0 );
+
+/// \return true if CRC32C() uses the hardware crc32 instruction on this CPU
+bool CRC32CIsHardwareAccelerated( void );
+
+} // namespace RakNet
@@ -0,0 +1,236 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "CompressionDictionary.h"
+
+#include "CRC32C.h"
+
+#include <algorithm>
+#include <string.h>
+#include <unordered_map>
+
+namespace RakNet {
+
+// Length of the sequences the trainer counts. Shorter than this rarely pays for a match.
+static const unsigned int TRAINER_SEQUENCE_LENGTH = 6;
+// Length of the segments the trainer copies into the dictionary
+static const unsigned int TRAINER_SEGMENT_LENGTH = 48;
+
+static inline uint64_t ReadSequence( const unsigned char* p )
+{
+    uint64_t sequence = 0;
+    memcpy( &sequence, p, TRAINER_SEQUENCE_LENGTH );
+    return sequence;
+}
+
+CompressionDictionary::CompressionDictionary( const unsigned char* _data, unsigned int length )
+{
+    if( length > LZ_MAX_DICTIONARY_LENGTH )
+    {
+        _data += length - LZ_MAX_DICTIONARY_LENGTH;
+        length = LZ_MAX_DICTIONARY_LENGTH;
+    }
+    data.assign( _data, _data + length );
+
+    // 0 means no dictionary in the connection handshake
+    id = CRC32C( data.data(), length );
+    if( id == 0 )
+        id = 1;
+
+    LZInitDictionary( &lzDictionary, data.data(), length );
+}
+
+uint32_t CompressionDictionary::GetID( void ) const
+{
+    return id;
+}
+
+const unsigned char* CompressionDictionary::GetData( void ) const
+{
+    return data.data();
+}
+
+unsigned int CompressionDictionary::GetLength( void ) const
+{
+    return (unsigned int)data.size();
+}
+
+unsigned int CompressionDictionary::Compress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity ) const
+{
+    return LZCompressWithDictionary( &lzDictionary, input, inputLength, output, outputCapacity );
+}
+
+bool CompressionDictionary::Decompress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity, unsigned int* outputLength ) const
+{
+    return LZDecompressWithDictionary( data.data(), (unsigned int)data.size(), input, inputLength, output, outputCapacity, outputLength );
+}
+
+CompressionDictionaryTrainer::CompressionDictionaryTrainer( unsigned int _maxSamples, unsigned int _sampleInterval )
+{
+    maxSamples = _maxSamples > 0 ? _maxSamples : 1;
+    sampleInterval = _sampleInterval > 0 ? _sampleInterval : 1;
+    messagesSeen = 0;
+}
+
+void CompressionDictionaryTrainer::AddSample( const unsigned char* data, unsigned int length )
+{
+    std::lock_guard<std::mutex> guard( samplesMutex );
+
+    messagesSeen++;
+    if( length == 0 || messagesSeen % sampleInterval != 0 )
+        return;
+
+    if( samples.size() < maxSamples )
+    {
+        samples.emplace_back( data, data + length );
+        return;
+    }
+
+    // Reservoir sampling, so the sample stays representative of everything offered so far
+    uint64_t offered = messagesSeen / sampleInterval;
+    uint64_t random = messagesSeen * 0x9E3779B97F4A7C15ULL;
+    random ^= random >> 31;
+    random *= 0xBF58476D1CE4E5B9ULL;
+    random ^= random >> 29;
+    uint64_t index = random % offered;
+    if( index < maxSamples )
+        samples[(size_t)index].assign( data, data + length );
+}
+
+unsigned int CompressionDictionaryTrainer::GetSampleCount( void ) const
+{
+    std::lock_guard<std::mutex> guard( samplesMutex );
+    return (unsigned int)samples.size();
+}
+
+void CompressionDictionaryTrainer::Clear( void )
+{
+    std::lock_guard<std::mutex> guard( samplesMutex );
+    samples.clear();
+    messagesSeen = 0;
+}
+
+void CompressionDictionaryTrainer::Train( unsigned int dictionaryLength, std::vector<unsigned char>& dictionary ) const
+{
+    dictionary.clear();
+
+    std::vector<std::vector<unsigned char>> trainingSet;
+    {
+        std::lock_guard<std::mutex> guard( samplesMutex );
+        trainingSet = samples;
+    }
+
+    if( dictionaryLength > LZ_MAX_DICTIONARY_LENGTH )
+        dictionaryLength = LZ_MAX_DICTIONARY_LENGTH;
+    if( trainingSet.empty() || dictionaryLength == 0 )
+        return;
+
+    // How many samples each sequence appears in. Sequences in only one sample are not worth anything.
+    struct SequenceCount
+    {
+        uint32_t samples;
+        uint32_t lastSample;
+    };
+    std::unordered_map<uint64_t, SequenceCount> counts;
+    for( uint32_t sampleIndex = 0; sampleIndex < trainingSet.size(); sampleIndex++ )
+    {
+        const std::vector<unsigned char>& sample = trainingSet[sampleIndex];
+        for( size_t i = 0; i + TRAINER_SEQUENCE_LENGTH <= sample.size(); i++ )
+        {
+            SequenceCount& count = counts.emplace( ReadSequence( &sample[i] ), SequenceCount{ 0, 0 } ).first->second;
+            if( count.samples == 0 || count.lastSample != sampleIndex )
+            {
+                count.samples++;
+                count.lastSample = sampleIndex;
+            }
+        }
+    }
+    std::unordered_map<uint64_t, uint32_t> score;
+    for( const auto& count : counts )
+    {
+        if( count.second.samples > 1 )
+            score[count.first] = count.second.samples;
+    }
+
+    struct Segment
+    {
+        size_t sample, offset, length;
+        uint64_t score;
+    };
+    std::vector<Segment> segments;
+
+    // Each epoch picks the best segment from its share of the samples, then forgets the sequences that segment covers,
+    // so the next epochs pick something else
+    const size_t epochs = std::max<size_t>( 1, dictionaryLength / TRAINER_SEGMENT_LENGTH );
+    const size_t sampleCount = trainingSet.size();
+    for( size_t epoch = 0; epoch < epochs; epoch++ )
+    {
+        size_t begin = epoch * sampleCount / epochs;
+        size_t end = std::max( ( epoch + 1 ) * sampleCount / epochs, begin + 1 );
+
+        Segment best = { 0, 0, 0, 0 };
+        for( size_t sampleIndex = begin; sampleIndex < end; sampleIndex++ )
+        {
+            const std::vector<unsigned char>& sample = trainingSet[sampleIndex];
+            if( sample.size() < TRAINER_SEQUENCE_LENGTH )
+                continue;
+
+            // Slide a window of segmentLength bytes over the sample, scoring each distinct sequence in it once
+            const size_t segmentLength = std::min<size_t>( TRAINER_SEGMENT_LENGTH, sample.size() );
+            const size_t window = segmentLength - TRAINER_SEQUENCE_LENGTH + 1;
+            std::unordered_map<uint64_t, uint32_t> inWindow;
+            uint64_t windowScore = 0;
+            for( size_t i = 0; i + TRAINER_SEQUENCE_LENGTH <= sample.size(); i++ )
+            {
+                uint64_t entering = ReadSequence( &sample[i] );
+                if( inWindow[entering]++ == 0 )
+                {
+                    auto it = score.find( entering );
+                    if( it != score.end() )
+                        windowScore += it->second;
+                }
+
+                if( i >= window )
+                {
+                    uint64_t leaving = ReadSequence( &sample[i - window] );
+                    if( --inWindow[leaving] == 0 )
+                    {
+                        auto it = score.find( leaving );
+                        if( it != score.end() )
+                            windowScore -= it->second;
+                    }
+                }
+
+                if( i + 1 >= window && windowScore > best.score )
+                    best = { sampleIndex, i + 1 - window, segmentLength, windowScore };
+            }
+        }
+
+        if( best.score == 0 )
+            continue;
+
+        segments.push_back( best );
+        const std::vector<unsigned char>& sample = trainingSet[best.sample];
+        for( size_t i = best.offset; i + TRAINER_SEQUENCE_LENGTH <= best.offset + best.length; i++ )
+            score.erase( ReadSequence( &sample[i] ) );
+    }
+
+    // Most valuable last, because LZ_MAX_DICTIONARY_LENGTH keeps the end and matches near the end have the shortest offsets
+    std::stable_sort( segments.begin(), segments.end(), []( const Segment& a, const Segment& b ) { return a.score < b.score; } );
+    for( const Segment& segment : segments )
+    {
+        const std::vector<unsigned char>& sample = trainingSet[segment.sample];
+        dictionary.insert( dictionary.end(), sample.begin() + segment.offset, sample.begin() + segment.offset + segment.length );
+    }
+    if( dictionary.size() > dictionaryLength )
+        dictionary.erase( dictionary.begin(), dictionary.end() - dictionaryLength );
+}
+
+} // namespace RakNet
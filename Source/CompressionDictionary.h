@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Dictionaries that small messages are compressed against, and a trainer that builds them from sampled messages.
+///
+
+#pragma once
+
+#include "Export.h"
+#include "LZCompressor.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace RakNet {
+
+/// Data that is common to many messages, so that small messages compress by referring to it.
+/// Both systems of a connection must have the same dictionary. It is identified by the CRC32C of its contents.
+/// \sa RakPeerInterface::SetCompressionDictionary()
+class RAK_DLL_EXPORT CompressionDictionary
+{
+public:
+    /// \param[in] data The dictionary contents. Only the last LZ_MAX_DICTIONARY_LENGTH bytes are used.
+    /// \param[in] length The length of \a data in bytes
+    CompressionDictionary( const unsigned char* data, unsigned int length );
+
+    CompressionDictionary( const CompressionDictionary& ) = delete;
+    CompressionDictionary& operator=( const CompressionDictionary& ) = delete;
+
+    /// \return Identifies the dictionary in the connection handshake. Never 0.
+    uint32_t GetID( void ) const;
+
+    const unsigned char* GetData( void ) const;
+    unsigned int GetLength( void ) const;
+
+    /// Compress \a input against this dictionary
+    /// \return The number of bytes written to \a output, or 0 if the result did not fit in \a outputCapacity
+    unsigned int Compress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity ) const;
+
+    /// Decompress data written by Compress() with a dictionary of the same ID
+    /// \return false if \a input is malformed or decompresses to more than \a outputCapacity bytes
+    bool Decompress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity, unsigned int* outputLength ) const;
+
+protected:
+    std::vector<unsigned char> data;
+    uint32_t id;
+    LZDictionary lzDictionary;
+};
+
+/// Collects a sample of messages and builds a CompressionDictionary from the sequences most of them share.
+/// Can be fed by RakPeerInterface::SetCompressionDictionaryTrainer() or by hand, and trained periodically or once offline.
+/// AddSample() and Train() may be called from different threads.
+class RAK_DLL_EXPORT CompressionDictionaryTrainer
+{
+public:
+    /// \param[in] maxSamples How many messages to keep. Once full, new samples randomly replace old ones.
+    /// \param[in] sampleInterval Only every sampleInterval'th message passed to AddSample() is considered
+    CompressionDictionaryTrainer( unsigned int maxSamples = 2048, unsigned int sampleInterval = 1 );
+
+    /// Offer a message to the sample
+    void AddSample( const unsigned char* data, unsigned int length );
+
+    /// \return How many messages are currently in the sample
+    unsigned int GetSampleCount( void ) const;
+
+    /// Discard the sample
+    void Clear( void );
+
+    /// Build a dictionary of at most \a dictionaryLength bytes from the current sample.
+    /// The segments that cover the most sequences common to many samples are picked, with the most valuable at the end, where offsets are shortest.
+    /// \param[in] dictionaryLength Size of the dictionary. At most LZ_MAX_DICTIONARY_LENGTH.
+    /// \param[out] dictionary The dictionary contents, for CompressionDictionary or RakPeerInterface::SetCompressionDictionary(). Empty if there was nothing to train on.
+    void Train( unsigned int dictionaryLength, std::vector<unsigned char>& dictionary ) const;
+
+protected:
+    mutable std::mutex samplesMutex;
+    std::vector<std::vector<unsigned char>> samples;
+    unsigned int maxSamples, sampleInterval;
+    uint64_t messagesSeen;
+};
+
+} // namespace RakNet
@@ -9,7 +9,8 @@
  */
 
 #include "DS_ByteQueue.h"
-#include <string.h> // Memmove
+#include "RakAssert.h"
+#include <string.h> // memcpy
 #include <stdlib.h> // realloc
 #include <stdio.h>
 
@@ -26,42 +27,21 @@ ByteQueue::~ByteQueue()
 }
 void ByteQueue::WriteBytes( const char* in, unsigned length, const char* file, unsigned int line )
 {
-    unsigned bytesWritten;
-    bytesWritten = GetBytesWritten();
-    if( lengthAllocated == 0 || length > lengthAllocated - bytesWritten - 1 )
-    {
-        unsigned oldLengthAllocated = lengthAllocated;
-        // Always need to waste 1 byte for the math to work, else writeoffset==readoffset
-        unsigned newAmountToAllocate = length + oldLengthAllocated + 1;
-        if( newAmountToAllocate < 256 )
-            newAmountToAllocate = 256;
-        lengthAllocated = lengthAllocated + newAmountToAllocate;
-        data = (char*)rakRealloc_Ex( data, lengthAllocated, file, line );
-        if( writeOffset < readOffset )
-        {
-            if( writeOffset <= newAmountToAllocate )
-            {
-                memcpy( data + oldLengthAllocated, data, writeOffset );
-                writeOffset = readOffset + bytesWritten;
-            }
-            else
-            {
-                memcpy( data + oldLengthAllocated, data, newAmountToAllocate );
-                memmove( data, data + newAmountToAllocate, writeOffset - newAmountToAllocate );
-                writeOffset -= newAmountToAllocate;
-            }
-        }
-    }
-
-    if( length <= lengthAllocated - writeOffset )
-        memcpy( data + writeOffset, in, length );
+    if( length == 0 )
+        return;
+    ByteQueueRegion regions[2] = {};
+    int regionCount = ReserveWriteRegions( length, regions, file, line );
+    if( length <= regions[0].length )
+        memcpy( regions[0].data, in, length );
     else
     {
         // Wrap
-        memcpy( data + writeOffset, in, lengthAllocated - writeOffset );
-        memcpy( data, in + ( lengthAllocated - writeOffset ), length - ( lengthAllocated - writeOffset ) );
+        RakAssert( regionCount == 2 );
+        (void)regionCount;
+        memcpy( regions[0].data, in, regions[0].length );
+        memcpy( regions[1].data, in + regions[0].length, length - regions[0].length );
     }
-    writeOffset = ( writeOffset + length ) % lengthAllocated;
+    writeOffset += length;
 }
 bool ByteQueue::ReadBytes( char* out, unsigned maxLengthToRead, bool peek )
 {
@@ -69,22 +49,16 @@ bool ByteQueue::ReadBytes( char* out, unsigned maxLengthToRead, bool peek )
     unsigned bytesToRead = bytesWritten < maxLengthToRead ? bytesWritten : maxLengthToRead;
     if( bytesToRead == 0 )
         return false;
-    if( writeOffset >= readOffset )
+    ByteQueueRegion regions[2] = {};
+    PeekReadRegions( regions );
+    if( bytesToRead <= regions[0].length )
     {
-        memcpy( out, data + readOffset, bytesToRead );
+        memcpy( out, regions[0].data, bytesToRead );
     }
     else
     {
-        unsigned availableUntilWrap = lengthAllocated - readOffset;
-        if( bytesToRead <= availableUntilWrap )
-        {
-            memcpy( out, data + readOffset, bytesToRead );
-        }
-        else
-        {
-            memcpy( out, data + readOffset, availableUntilWrap );
-            memcpy( out + availableUntilWrap, data, bytesToRead - availableUntilWrap );
-        }
+        memcpy( out, regions[0].data, regions[0].length );
+        memcpy( out + regions[0].length, regions[1].data, bytesToRead - regions[0].length );
     }
 
     if( peek == false )
@@ -94,11 +68,77 @@ bool ByteQueue::ReadBytes( char* out, unsigned maxLengthToRead, bool peek )
 }
 char* ByteQueue::PeekContiguousBytes( unsigned int* outLength ) const
 {
-    if( writeOffset >= readOffset )
-        *outLength = writeOffset - readOffset;
-    else
-        *outLength = lengthAllocated - readOffset;
-    return data + readOffset;
+    ByteQueueRegion regions[2] = {};
+    if( PeekReadRegions( regions ) == 0 )
+    {
+        *outLength = 0;
+        return data;
+    }
+    *outLength = regions[0].length;
+    return regions[0].data;
+}
+int ByteQueue::PeekReadRegions( ByteQueueRegion regions[2] ) const
+{
+    const unsigned bytesWritten = GetBytesWritten();
+    if( bytesWritten == 0 )
+        return 0;
+    const unsigned position = readOffset & ( lengthAllocated - 1 );
+    const unsigned untilWrap = lengthAllocated - position;
+    regions[0].data = data + position;
+    if( bytesWritten <= untilWrap )
+    {
+        regions[0].length = bytesWritten;
+        return 1;
+    }
+    regions[0].length = untilWrap;
+    regions[1].data = data;
+    regions[1].length = bytesWritten - untilWrap;
+    return 2;
+}
+int ByteQueue::ReserveWriteRegions( unsigned minLength, ByteQueueRegion regions[2], const char* file, unsigned int line )
+{
+    Reserve( GetBytesWritten() + minLength, file, line );
+    const unsigned freeLength = lengthAllocated - GetBytesWritten();
+    regions[0].data = data;
+    regions[0].length = 0;
+    if( freeLength == 0 )
+        return 0;
+    const unsigned position = writeOffset & ( lengthAllocated - 1 );
+    const unsigned untilWrap = lengthAllocated - position;
+    regions[0].data = data + position;
+    if( freeLength <= untilWrap )
+    {
+        regions[0].length = freeLength;
+        return 1;
+    }
+    regions[0].length = untilWrap;
+    regions[1].data = data;
+    regions[1].length = freeLength - untilWrap;
+    return 2;
+}
+void ByteQueue::IncrementWriteOffset( unsigned length )
+{
+    RakAssert( length <= lengthAllocated - GetBytesWritten() );
+    writeOffset += length;
+}
+void ByteQueue::Reserve( unsigned length, const char* file, unsigned int line )
+{
+    if( length <= lengthAllocated )
+        return;
+    unsigned newLengthAllocated = lengthAllocated < 256 ? 256 : lengthAllocated;
+    while( newLengthAllocated < length )
+        newLengthAllocated <<= 1;
+
+    // Start counting from the old position of the first byte. Offsets below 2*lengthAllocated then land on the same byte in the larger buffer,
+    // so only the bytes that wrapped to the start need copying, to just past the old end.
+    const unsigned bytesWritten = GetBytesWritten();
+    const unsigned position = lengthAllocated ? readOffset & ( lengthAllocated - 1 ) : 0;
+    data = (char*)rakRealloc_Ex( data, newLengthAllocated, file, line );
+    if( position + bytesWritten > lengthAllocated )
+        memcpy( data + lengthAllocated, data, position + bytesWritten - lengthAllocated );
+    readOffset = position;
+    writeOffset = position + bytesWritten;
+    lengthAllocated = newLengthAllocated;
 }
 void ByteQueue::Clear( const char* file, unsigned int line )
 {
@@ -109,27 +149,23 @@ void ByteQueue::Clear( const char* file, unsigned int line )
 }
 unsigned ByteQueue::GetBytesWritten( void ) const
 {
-    if( writeOffset >= readOffset )
-        return writeOffset - readOffset;
-    else
-        return writeOffset + ( lengthAllocated - readOffset );
+    return writeOffset - readOffset;
 }
 void ByteQueue::IncrementReadOffset( unsigned length )
 {
-    readOffset = ( readOffset + length ) % lengthAllocated;
+    RakAssert( length <= GetBytesWritten() );
+    readOffset += length;
 }
 void ByteQueue::DecrementReadOffset( unsigned length )
 {
-    if( length > readOffset )
-        readOffset = lengthAllocated - ( length - readOffset );
-    else
-        readOffset -= length;
+    RakAssert( GetBytesWritten() + length <= lengthAllocated );
+    readOffset -= length;
 }
 void ByteQueue::Print( void )
 {
     unsigned i;
     for( i = readOffset; i != writeOffset; i++ )
-        RAKNET_DEBUG_PRINTF( "%i ", data[i] );
+        RAKNET_DEBUG_PRINTF( "%i ", data[i & ( lengthAllocated - 1 )] );
     RAKNET_DEBUG_PRINTF( "\n" );
 }
 
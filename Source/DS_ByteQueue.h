@@ -22,6 +22,14 @@
 /// As these data structures are stand-alone, you can use them outside of RakNet for your own projects if you wish.
 namespace RakNet { namespace DataStructures {
 
+/// A run of bytes inside a ByteQueue
+struct ByteQueueRegion
+{
+    char* data;
+    unsigned length;
+};
+
+/// Ring buffer of bytes. The buffer grows by powers of two, and bytes already written are not moved unless they wrapped.
 class ByteQueue
 {
 public:
@@ -31,13 +39,27 @@ public:
     bool ReadBytes( char* out, unsigned maxLengthToRead, bool peek );
     unsigned GetBytesWritten( void ) const;
     char* PeekContiguousBytes( unsigned int* outLength ) const;
+    /// Describes the bytes waiting to be read, in order, so they can be passed to writev or WSASend without copying.
+    /// Call IncrementReadOffset() with however many were consumed.
+    /// \return How many regions were filled. 2 if the bytes wrap around the end of the buffer.
+    int PeekReadRegions( ByteQueueRegion regions[2] ) const;
+    /// Grows so that at least minLength bytes can be written, then describes all the free space, so it can be passed to readv or WSARecv.
+    /// Call IncrementWriteOffset() with however many bytes were put there.
+    /// \return How many regions were filled. 2 if the free space wraps around the end of the buffer.
+    int ReserveWriteRegions( unsigned minLength, ByteQueueRegion regions[2], const char* file, unsigned int line );
+    void IncrementWriteOffset( unsigned length );
     void IncrementReadOffset( unsigned length );
     void DecrementReadOffset( unsigned length );
     void Clear( const char* file, unsigned int line );
     void Print( void );
 
 protected:
+    // Grows lengthAllocated to a power of two of at least length
+    void Reserve( unsigned length, const char* file, unsigned int line );
+
     char* data;
+    // Count up without wrapping, so writeOffset-readOffset is the number of bytes and a full buffer is not mistaken for an empty one.
+    // The byte at offset is at data[offset & ( lengthAllocated - 1 )].
     unsigned readOffset, writeOffset, lengthAllocated;
 };
 
@@ -0,0 +1,376 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_FlatHashMap.h
+/// \internal
+/// \brief Open addressing hash map with its keys and data in contiguous arrays.
+///
+
+#pragma once
+
+#include "RakMemoryOverride.h"
+#include "Export.h"
+#include "RakAssert.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace RakNet { namespace DataStructures {
+
+/// Keys and data are stored densely, in the order inserted, and indexed from 0 to Size()-1 like OrderedList.
+/// A separate table of buckets, probed with robin hood hashing, maps each key to its index.
+/// Lookup, insertion and removal take constant time on average instead of a binary search and a shift.
+/// \note Unlike OrderedList, indices are not sorted by key. Removing an element moves the last element into its index,
+/// so a loop removing elements as it goes must check the same index again after a removal.
+/// \note hasher need not mix its bits. The hash is scrambled before use, so std::hash on an integer is fine.
+template<class key_type, class data_type, class hasher = std::hash<key_type>, class key_equal = std::equal_to<key_type>>
+class RAK_DLL_EXPORT FlatHashMap
+{
+public:
+    FlatHashMap();
+    ~FlatHashMap();
+
+    bool HasData( const key_type& key ) const;
+    /// \param[out] objectExists Whether key is in the map
+    /// \return The index of key, or Size() if it is not in the map
+    unsigned GetIndexFromKey( const key_type& key, bool* objectExists ) const;
+    data_type GetElementFromKey( const key_type& key ) const;
+    bool GetElementFromKey( const key_type& key, data_type& element ) const;
+    /// \return The index of the new element, which is always the last, or ~0u if key was already in the map
+    unsigned Insert( const key_type& key, const data_type& data, bool assertOnDuplicate, const char* file, unsigned int line );
+    /// \return The index key was at, which now holds what was the last element
+    unsigned Remove( const key_type& key );
+    unsigned RemoveIfExists( const key_type& key );
+    data_type& operator[]( const unsigned int position );
+    const data_type& operator[]( const unsigned int position ) const;
+    const key_type& GetKeyAtIndex( const unsigned int position ) const;
+    /// Moves the last element into index
+    void RemoveAtIndex( const unsigned index );
+    /// Makes room for count elements without growing again
+    void Reserve( unsigned count, const char* file, unsigned int line );
+    void Clear( bool doNotDeallocate, const char* file, unsigned int line );
+    unsigned Size( void ) const;
+
+protected:
+    static const uint32_t EMPTY_BUCKET = ~0u;
+    static const uint32_t MIN_BUCKETS = 8;
+
+    struct Bucket
+    {
+        uint32_t hash;
+        // Into keys, data and hashes, or EMPTY_BUCKET
+        uint32_t index;
+    };
+
+    uint32_t HashOf( const key_type& key ) const;
+    uint32_t HomeOf( uint32_t hash ) const { return hash >> shift; }
+    uint32_t DistanceOf( uint32_t position, uint32_t hash ) const { return ( position - HomeOf( hash ) ) & mask; }
+    // \return The bucket holding key, or EMPTY_BUCKET
+    uint32_t FindBucket( const key_type& key, uint32_t hash ) const;
+    // \return The bucket holding index, which must be in the map
+    uint32_t FindBucketOfIndex( uint32_t index ) const;
+    void PlaceBucket( Bucket bucket );
+    void EraseBucket( uint32_t position );
+    void Rehash( uint32_t bucketCount );
+
+    std::vector<key_type> keys;
+    std::vector<data_type> data;
+    // The hash of each key, so growing and removing need not hash again
+    std::vector<uint32_t> hashes;
+    std::vector<Bucket> buckets;
+    uint32_t mask;
+    uint32_t shift;
+    hasher hashFunction;
+    key_equal keyEqual;
+};
+
+template<class key_type, class data_type, class hasher, class key_equal>
+FlatHashMap<key_type, data_type, hasher, key_equal>::FlatHashMap()
+{
+    mask = 0;
+    shift = 32;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+FlatHashMap<key_type, data_type, hasher, key_equal>::~FlatHashMap()
+{
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+bool FlatHashMap<key_type, data_type, hasher, key_equal>::HasData( const key_type& key ) const
+{
+    return FindBucket( key, HashOf( key ) ) != EMPTY_BUCKET;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+unsigned FlatHashMap<key_type, data_type, hasher, key_equal>::GetIndexFromKey( const key_type& key, bool* objectExists ) const
+{
+    const uint32_t position = FindBucket( key, HashOf( key ) );
+    *objectExists = position != EMPTY_BUCKET;
+    return *objectExists ? buckets[position].index : Size();
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+data_type FlatHashMap<key_type, data_type, hasher, key_equal>::GetElementFromKey( const key_type& key ) const
+{
+    bool objectExists;
+    unsigned index = GetIndexFromKey( key, &objectExists );
+    RakAssert( objectExists );
+    return data[index];
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+bool FlatHashMap<key_type, data_type, hasher, key_equal>::GetElementFromKey( const key_type& key, data_type& element ) const
+{
+    bool objectExists;
+    unsigned index = GetIndexFromKey( key, &objectExists );
+    if( objectExists )
+        element = data[index];
+    return objectExists;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+unsigned FlatHashMap<key_type, data_type, hasher, key_equal>::Insert( const key_type& key, const data_type& element, bool assertOnDuplicate, const char* file, unsigned int line )
+{
+    (void)assertOnDuplicate;
+    (void)file;
+    (void)line;
+    const uint32_t hash = HashOf( key );
+
+    // Don't allow duplicate insertion.
+    if( FindBucket( key, hash ) != EMPTY_BUCKET )
+    {
+        // This is usually a bug!
+        RakAssert( assertOnDuplicate == false );
+        return ~0u;
+    }
+
+    // Grow at 7/8 full, after which probes get long
+    if( ( keys.size() + 1 ) * 8 > buckets.size() * 7 )
+        Rehash( buckets.empty() ? MIN_BUCKETS : (uint32_t)buckets.size() * 2 );
+
+    const uint32_t index = (uint32_t)keys.size();
+    keys.push_back( key );
+    data.push_back( element );
+    hashes.push_back( hash );
+    Bucket bucket;
+    bucket.hash = hash;
+    bucket.index = index;
+    PlaceBucket( bucket );
+    return index;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+unsigned FlatHashMap<key_type, data_type, hasher, key_equal>::Remove( const key_type& key )
+{
+    bool objectExists;
+    unsigned index = GetIndexFromKey( key, &objectExists );
+
+    // Can't find the element to remove if this assert hits
+    if( objectExists == false )
+    {
+        RakAssert( objectExists == true );
+        return 0;
+    }
+
+    RemoveAtIndex( index );
+    return index;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+unsigned FlatHashMap<key_type, data_type, hasher, key_equal>::RemoveIfExists( const key_type& key )
+{
+    bool objectExists;
+    unsigned index = GetIndexFromKey( key, &objectExists );
+    if( objectExists == false )
+        return 0;
+
+    RemoveAtIndex( index );
+    return index;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+data_type& FlatHashMap<key_type, data_type, hasher, key_equal>::operator[]( const unsigned int position )
+{
+    return data[position];
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+const data_type& FlatHashMap<key_type, data_type, hasher, key_equal>::operator[]( const unsigned int position ) const
+{
+    return data[position];
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+const key_type& FlatHashMap<key_type, data_type, hasher, key_equal>::GetKeyAtIndex( const unsigned int position ) const
+{
+    return keys[position];
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+void FlatHashMap<key_type, data_type, hasher, key_equal>::RemoveAtIndex( const unsigned index )
+{
+    RakAssert( index < keys.size() );
+    EraseBucket( FindBucketOfIndex( index ) );
+
+    const uint32_t last = (uint32_t)keys.size() - 1;
+    if( index != last )
+    {
+        buckets[FindBucketOfIndex( last )].index = index;
+        keys[index] = std::move( keys[last] );
+        data[index] = std::move( data[last] );
+        hashes[index] = hashes[last];
+    }
+    keys.pop_back();
+    data.pop_back();
+    hashes.pop_back();
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+void FlatHashMap<key_type, data_type, hasher, key_equal>::Reserve( unsigned count, const char* file, unsigned int line )
+{
+    (void)file;
+    (void)line;
+    uint32_t bucketCount = buckets.empty() ? MIN_BUCKETS : (uint32_t)buckets.size();
+    while( (uint64_t)count * 8 > (uint64_t)bucketCount * 7 )
+        bucketCount <<= 1;
+    keys.reserve( count );
+    data.reserve( count );
+    hashes.reserve( count );
+    if( bucketCount != buckets.size() )
+        Rehash( bucketCount );
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+void FlatHashMap<key_type, data_type, hasher, key_equal>::Clear( bool doNotDeallocate, const char* file, unsigned int line )
+{
+    (void)file;
+    (void)line;
+    keys.clear();
+    data.clear();
+    hashes.clear();
+    if( doNotDeallocate )
+    {
+        Bucket empty;
+        empty.hash = 0;
+        empty.index = EMPTY_BUCKET;
+        std::fill( buckets.begin(), buckets.end(), empty );
+        return;
+    }
+
+    std::vector<key_type>().swap( keys );
+    std::vector<data_type>().swap( data );
+    std::vector<uint32_t>().swap( hashes );
+    std::vector<Bucket>().swap( buckets );
+    mask = 0;
+    shift = 32;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+unsigned FlatHashMap<key_type, data_type, hasher, key_equal>::Size( void ) const
+{
+    return static_cast<unsigned>( keys.size() );
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+uint32_t FlatHashMap<key_type, data_type, hasher, key_equal>::HashOf( const key_type& key ) const
+{
+    // Fibonacci hashing. The high bits pick the bucket, and depend on every bit of the hash.
+    const uint64_t scrambled = (uint64_t)hashFunction( key ) * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)( scrambled >> 32 );
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+uint32_t FlatHashMap<key_type, data_type, hasher, key_equal>::FindBucket( const key_type& key, uint32_t hash ) const
+{
+    if( buckets.empty() )
+        return EMPTY_BUCKET;
+
+    uint32_t position = HomeOf( hash );
+    for( uint32_t distance = 0;; distance++ )
+    {
+        const Bucket& bucket = buckets[position];
+        // Robin hood order: had key been here, it would have displaced any element closer to its home
+        if( bucket.index == EMPTY_BUCKET || DistanceOf( position, bucket.hash ) < distance )
+            return EMPTY_BUCKET;
+        if( bucket.hash == hash && keyEqual( keys[bucket.index], key ) )
+            return position;
+        position = ( position + 1 ) & mask;
+    }
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+uint32_t FlatHashMap<key_type, data_type, hasher, key_equal>::FindBucketOfIndex( uint32_t index ) const
+{
+    uint32_t position = HomeOf( hashes[index] );
+    while( buckets[position].index != index )
+        position = ( position + 1 ) & mask;
+    return position;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+void FlatHashMap<key_type, data_type, hasher, key_equal>::PlaceBucket( Bucket bucket )
+{
+    uint32_t position = HomeOf( bucket.hash );
+    uint32_t distance = 0;
+    while( buckets[position].index != EMPTY_BUCKET )
+    {
+        // Take the place of an element nearer its home, and carry that one on instead
+        const uint32_t existingDistance = DistanceOf( position, buckets[position].hash );
+        if( existingDistance < distance )
+        {
+            std::swap( buckets[position], bucket );
+            distance = existingDistance;
+        }
+        position = ( position + 1 ) & mask;
+        distance++;
+    }
+    buckets[position] = bucket;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+void FlatHashMap<key_type, data_type, hasher, key_equal>::EraseBucket( uint32_t position )
+{
+    // Shift the run after position back by one, so no lookup stops early at the hole
+    uint32_t next = ( position + 1 ) & mask;
+    while( buckets[next].index != EMPTY_BUCKET && DistanceOf( next, buckets[next].hash ) != 0 )
+    {
+        buckets[position] = buckets[next];
+        position = next;
+        next = ( next + 1 ) & mask;
+    }
+    buckets[position].index = EMPTY_BUCKET;
+}
+
+template<class key_type, class data_type, class hasher, class key_equal>
+void FlatHashMap<key_type, data_type, hasher, key_equal>::Rehash( uint32_t bucketCount )
+{
+    Bucket empty;
+    empty.hash = 0;
+    empty.index = EMPTY_BUCKET;
+    buckets.assign( bucketCount, empty );
+    mask = bucketCount - 1;
+    shift = 32;
+    while( ( 1u << ( 32 - shift ) ) < bucketCount )
+        shift--;
+
+    for( uint32_t index = 0; index < (uint32_t)keys.size(); index++ )
+    {
+        Bucket bucket;
+        bucket.hash = hashes[index];
+        bucket.index = index;
+        PlaceBucket( bucket );
+    }
+}
+
+}} // namespace RakNet::DataStructures
@@ -15,12 +15,14 @@
 #include <array>
 #include <deque>
 #include <list>
+#include <string.h>
 
 namespace RakNet {
 
 HuffmanEncodingTree::HuffmanEncodingTree()
 {
     root = 0;
+    maxCodeLength = 0;
 }
 
 HuffmanEncodingTree::~HuffmanEncodingTree()
@@ -51,10 +53,6 @@ void HuffmanEncodingTree::FreeMemory( void )
         RakNet::OP_DELETE( node, _FILE_AND_LINE_ );
     }
 
-    // Delete the encoding table
-    for( int i = 0; i < 256; i++ )
-        rakFree_Ex( encodingTable[i].encoding, _FILE_AND_LINE_ );
-
     root = 0;
 }
 
@@ -123,46 +121,108 @@ void HuffmanEncodingTree::GenerateFromFrequencyTable( unsigned int frequencyTabl
         InsertNode( node, aHuffmanEncodingTreeNodeList );
     }
 
-    bool tempPath[256]; // Maximum path length is 256
-    BitStream bitStream;
+    // The depth of each leaf is the length of its code. From before, we have an array of pointers to all the leaves which contain pointers to their parents.
+    unsigned short codeLengths[256];
+    for( int counter = 0; counter < 256; counter++ )
+    {
+        unsigned short depth = 0;
+        for( HuffmanEncodingTreeNode* currentNode = aLeafs[counter]; currentNode != root; currentNode = currentNode->parent )
+            depth++;
+        codeLengths[counter] = depth;
+    }
+
+    GenerateCanonicalCodes( codeLengths );
+}
 
-    // Generate the encryption table. From before, we have an array of pointers to all the leaves which contain pointers to their parents.
-    // This can be done more efficiently but this isn't bad and it's way easier to program and debug
+void HuffmanEncodingTree::GenerateCanonicalCodes( const unsigned short codeLengths[256] )
+{
+    // Replace the tree by one with the canonical codes, so the tree walk and the tables agree
+    FreeMemory();
 
+    unsigned short lengthCount[257] = {};
+    maxCodeLength = 0;
     for( int counter = 0; counter < 256; counter++ )
     {
-        // Already done at the end of the loop and before it!
-        unsigned short tempPathLength = 0;
+        lengthCount[codeLengths[counter]]++;
+        if( codeLengths[counter] > maxCodeLength )
+            maxCodeLength = codeLengths[counter];
+    }
+    RakAssert( maxCodeLength <= HUFFMAN_MAX_CODE_LENGTH );
 
-        // Set the current node at the leaf
-        HuffmanEncodingTreeNode* currentNode = aLeafs[counter];
+    // Codes of each length start where the codes one bit shorter left off, doubled
+    uint64_t nextCode[257];
+    uint64_t code = 0;
+    nextCode[0] = 0;
+    for( int length = 1; length <= maxCodeLength; length++ )
+    {
+        code = ( code + lengthCount[length - 1] ) << 1;
+        nextCode[length] = code;
+    }
 
-        do
+    memset( decodeTable, 0, sizeof( decodeTable ) );
+    memset( codeCount, 0, sizeof( codeCount ) );
+    uint16_t sortedIndex = 0;
+    for( int length = 1; length <= maxCodeLength && length <= HUFFMAN_MAX_CODE_LENGTH; length++ )
+    {
+        firstCode[length] = nextCode[length];
+        firstIndex[length] = sortedIndex;
+        codeCount[length] = lengthCount[length];
+        for( int counter = 0; counter < 256; counter++ )
         {
-            if( currentNode->parent->left == currentNode ) // We're storing the paths in reverse order.since we are going from the leaf to the root
-                tempPath[tempPathLength++] = false;
-            else
-                tempPath[tempPathLength++] = true;
-
-            currentNode = currentNode->parent;
+            if( codeLengths[counter] == length )
+                sortedCharacters[sortedIndex++] = (unsigned char)counter;
         }
+    }
 
-        while( currentNode != root );
+    root = RakNet::OP_NEW<HuffmanEncodingTreeNode>( _FILE_AND_LINE_ );
+    root->left = 0;
+    root->right = 0;
+    root->parent = 0;
+    root->weight = 0;
+    for( int counter = 0; counter < 256; counter++ )
+    {
+        const unsigned short length = codeLengths[counter];
+        encodingTable[counter].code = nextCode[length]++;
+        encodingTable[counter].bitLength = length;
 
-        // Write to the bitstream in the reverse order that we stored the path, which gives us the correct order from the root to the leaf
-        while( tempPathLength-- > 0 )
+        if( length <= HUFFMAN_DECODE_TABLE_BITS )
         {
-            if( tempPath[tempPathLength] ) // Write 1's and 0's because writing a bool will write the BitStream TYPE_CHECKING validation bits if that is defined along with the actual data bit, which is not what we want
-                bitStream.Write1();
-            else
-                bitStream.Write0();
+            // Every index that starts with this code
+            const int first = (int)( encodingTable[counter].code << ( HUFFMAN_DECODE_TABLE_BITS - length ) );
+            for( int index = first; index < first + ( 1 << ( HUFFMAN_DECODE_TABLE_BITS - length ) ); index++ )
+                decodeTable[index] = (uint16_t)( ( length << 8 ) | counter );
         }
 
-        // Read data from the bitstream, which is written to the encoding table in bits and bitlength. Note this function allocates the encodingTable[counter].encoding pointer
-        encodingTable[counter].bitLength = (unsigned char)bitStream.CopyData( &encodingTable[counter].encoding );
+        // Add the path to the tree, from the first bit of the code
+        HuffmanEncodingTreeNode* currentNode = root;
+        for( int bit = length - 1; bit >= 0; bit-- )
+        {
+            HuffmanEncodingTreeNode** child = ( ( encodingTable[counter].code >> bit ) & 1 ) ? &currentNode->right : &currentNode->left;
+            if( *child == 0 )
+            {
+                *child = RakNet::OP_NEW<HuffmanEncodingTreeNode>( _FILE_AND_LINE_ );
+                ( *child )->left = 0;
+                ( *child )->right = 0;
+                ( *child )->parent = currentNode;
+                ( *child )->weight = 0;
+            }
+            currentNode = *child;
+        }
+        currentNode->value = (unsigned char)counter;
+    }
+}
 
-        // Reset the bitstream for the next iteration
-        bitStream.Reset();
+// Adds up to 32 bits to a right aligned accumulator, writing it to output each time it fills 32 bits
+static void AppendBits( uint64_t value, int count, uint64_t* accumulator, int* accumulatorBits, BitStream* output )
+{
+    *accumulator = ( *accumulator << count ) | value;
+    *accumulatorBits += count;
+    if( *accumulatorBits >= 32 )
+    {
+        *accumulatorBits -= 32;
+        const uint32_t word = (uint32_t)( *accumulator >> *accumulatorBits );
+        const unsigned char bytes[4] = { (unsigned char)( word >> 24 ), (unsigned char)( word >> 16 ), (unsigned char)( word >> 8 ), (unsigned char)word };
+        output->WriteBits( bytes, 32, false );
     }
 }
 
@@ -170,23 +230,32 @@ void HuffmanEncodingTree::GenerateFromFrequencyTable( unsigned int frequencyTabl
 void HuffmanEncodingTree::EncodeArray( unsigned char* input, size_t sizeInBytes, BitStream* output )
 {
     unsigned counter;
+    uint64_t accumulator = 0;
+    int accumulatorBits = 0;
 
     // For each input byte, Write out the corresponding series of 1's and 0's that give the encoded representation
     for( counter = 0; counter < sizeInBytes; counter++ )
     {
-        output->WriteBits( encodingTable[input[counter]].encoding, encodingTable[input[counter]].bitLength, false ); // Data is left aligned
+        const CharacterEncoding& encoding = encodingTable[input[counter]];
+        if( encoding.bitLength > 32 )
+        {
+            AppendBits( encoding.code >> 32, encoding.bitLength - 32, &accumulator, &accumulatorBits, output );
+            AppendBits( encoding.code & 0xFFFFFFFF, 32, &accumulator, &accumulatorBits, output );
+        }
+        else
+            AppendBits( encoding.code, encoding.bitLength, &accumulator, &accumulatorBits, output );
     }
 
     // Byte align the output so the unassigned remaining bits don't equate to some actual value
-    if( output->GetNumberOfBitsUsed() % 8 != 0 )
+    if( ( output->GetNumberOfBitsUsed() + accumulatorBits ) % 8 != 0 )
     {
         // Find an input that is longer than the remaining bits.  Write out part of it to pad the output to be byte aligned.
-        unsigned char remainingBits = (unsigned char)( 8 - ( output->GetNumberOfBitsUsed() % 8 ) );
+        unsigned char remainingBits = (unsigned char)( 8 - ( ( output->GetNumberOfBitsUsed() + accumulatorBits ) % 8 ) );
 
         for( counter = 0; counter < 256; counter++ )
             if( encodingTable[counter].bitLength > remainingBits )
             {
-                output->WriteBits( encodingTable[counter].encoding, remainingBits, false ); // Data is left aligned
+                AppendBits( encodingTable[counter].code >> ( encodingTable[counter].bitLength - remainingBits ), remainingBits, &accumulator, &accumulatorBits, output );
                 break;
             }
 
@@ -195,9 +264,76 @@ void HuffmanEncodingTree::EncodeArray( unsigned char* input, size_t sizeInBytes,
 
 #endif
     }
+
+    if( accumulatorBits > 0 )
+    {
+        const uint32_t word = (uint32_t)( accumulator << ( 32 - accumulatorBits ) );
+        const unsigned char bytes[4] = { (unsigned char)( word >> 24 ), (unsigned char)( word >> 16 ), (unsigned char)( word >> 8 ), (unsigned char)word };
+        output->WriteBits( bytes, accumulatorBits, false ); // Data is left aligned
+    }
 }
 
 unsigned HuffmanEncodingTree::DecodeArray( BitStream* input, BitSize_t sizeInBits, size_t maxCharsToWrite, unsigned char* output )
+{
+    if( maxCodeLength > HUFFMAN_MAX_CODE_LENGTH )
+        return DecodeArrayTreeWalk( input, sizeInBits, maxCharsToWrite, output );
+
+    unsigned outputWriteIndex = 0;
+    if( sizeInBits == 0 )
+        return outputWriteIndex;
+
+    // Bits waiting to be decoded, from the most significant bit down. Refilling keeps at least 57 of them, or every bit left, which is enough for any code.
+    const unsigned char* data = input->GetData();
+    const BitSize_t readOffset = input->GetReadOffset();
+    const BitSize_t endByte = BITS_TO_BYTES( readOffset + sizeInBits );
+    BitSize_t nextByte = readOffset >> 3;
+    uint64_t bits = (uint64_t)data[nextByte++] << ( 56 + ( readOffset & 7 ) );
+    int bitCount = 8 - (int)( readOffset & 7 );
+    BitSize_t remainingBits = sizeInBits;
+
+    while( remainingBits > 0 )
+    {
+        while( bitCount <= 56 && nextByte < endByte )
+        {
+            bits |= (uint64_t)data[nextByte++] << ( 56 - bitCount );
+            bitCount += 8;
+        }
+
+        const uint16_t entry = decodeTable[bits >> ( 64 - HUFFMAN_DECODE_TABLE_BITS )];
+        int length = entry >> 8;
+        unsigned char value = (unsigned char)entry;
+        if( length == 0 )
+        {
+            // Codes of each length are consecutive, so the first length whose range holds the bits read so far is the one
+            for( length = HUFFMAN_DECODE_TABLE_BITS + 1; length <= maxCodeLength; length++ )
+            {
+                const uint64_t offset = ( bits >> ( 64 - length ) ) - firstCode[length];
+                if( offset < codeCount[length] )
+                {
+                    value = sortedCharacters[firstIndex[length] + offset];
+                    break;
+                }
+            }
+        }
+
+        // The rest is padding
+        if( (BitSize_t)length > remainingBits )
+            break;
+
+        if( outputWriteIndex < maxCharsToWrite )
+            output[outputWriteIndex] = value;
+        outputWriteIndex++;
+
+        bits <<= length;
+        bitCount -= length;
+        remainingBits -= length;
+    }
+
+    input->IgnoreBits( sizeInBits );
+    return outputWriteIndex;
+}
+
+unsigned HuffmanEncodingTree::DecodeArrayTreeWalk( BitStream* input, BitSize_t sizeInBits, size_t maxCharsToWrite, unsigned char* output )
 {
     HuffmanEncodingTreeNode* currentNode;
 
@@ -19,9 +19,19 @@
 #include "BitStream.h"
 #include "Export.h"
 
+#include <stdint.h>
+
 namespace RakNet {
 
+/// Bits DecodeArray() looks up at once. Longer codes, which are rare, are finished one length at a time.
+static const int HUFFMAN_DECODE_TABLE_BITS = 10;
+
+/// The longest code the table decoder handles. Deeper trees, which need extreme frequency tables, are decoded by walking the tree.
+static const int HUFFMAN_MAX_CODE_LENGTH = 56;
+
 /// This generates special cases of the huffman encoding tree using 8 bit keys with the additional condition that unused combinations of 8 bits are treated as a frequency of 1
+/// Codes are canonical: the tree only decides the length of each code, and codes of the same length count up in character order.
+/// That lets DecodeArray() decode through a lookup table rather than walking the tree one bit at a time.
 class RAK_DLL_EXPORT HuffmanEncodingTree
 {
 
@@ -36,9 +46,14 @@ public:
     void EncodeArray( unsigned char* input, size_t sizeInBytes, BitStream* output );
 
     // \brief Decodes an array encoded by EncodeArray().
+    /// \details Reads exactly \a sizeInBits bits from \a input, which must hold that many. Bits left over after the last whole code are padding.
+    /// \return How many characters were decoded, which may be more than \a maxCharsToWrite. Only the first \a maxCharsToWrite are written.
     unsigned DecodeArray( BitStream* input, BitSize_t sizeInBits, size_t maxCharsToWrite, unsigned char* output );
     void DecodeArray( unsigned char* input, BitSize_t sizeInBits, BitStream* output );
 
+    /// \brief Same as DecodeArray(), walking the tree one bit at a time
+    unsigned DecodeArrayTreeWalk( BitStream* input, BitSize_t sizeInBits, size_t maxCharsToWrite, unsigned char* output );
+
     /// \brief Given a frequency table of 256 elements, all with a frequency of 1 or more, generate the tree.
     void GenerateFromFrequencyTable( unsigned int frequencyTable[256] );
 
@@ -47,17 +62,33 @@ public:
 
 private:
 
+    /// Give every character a canonical code of the length the tree gave it, and build the tree and tables for those codes
+    void GenerateCanonicalCodes( const unsigned short codeLengths[256] );
+
     /// The root node of the tree
     HuffmanEncodingTreeNode* root;
 
     /// Used to hold bit encoding for one character
     struct CharacterEncoding
     {
-        unsigned char* encoding;
+        /// Right aligned
+        uint64_t code;
         unsigned short bitLength;
     };
 
     CharacterEncoding encodingTable[256];
+
+    /// Indexed by the next HUFFMAN_DECODE_TABLE_BITS bits: the code length in the high byte and the character in the low byte.
+    /// 0 if the code is longer than the table.
+    uint16_t decodeTable[1 << HUFFMAN_DECODE_TABLE_BITS];
+
+    /// For each code length, the first code, how many codes have it, and where their characters start in sortedCharacters
+    uint64_t firstCode[HUFFMAN_MAX_CODE_LENGTH + 1];
+    uint16_t codeCount[HUFFMAN_MAX_CODE_LENGTH + 1];
+    uint16_t firstIndex[HUFFMAN_MAX_CODE_LENGTH + 1];
+    /// Characters in code order
+    unsigned char sortedCharacters[256];
+    unsigned short maxCodeLength;
 };
 
 } // namespace RakNet
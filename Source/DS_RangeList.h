@@ -10,12 +10,11 @@
 
 /// \file DS_RangeList.h
 /// \internal
-/// \brief A queue implemented as a linked list.
+/// \brief Sorted list of disjoint ranges, used for acks and naks.
 ///
 
 #pragma once
 
-#include "DS_OrderedList.h"
 #include "BitStream.h"
 #include "RakMemoryOverride.h"
 #include "RakAssert.h"
@@ -37,78 +36,87 @@ struct RangeNode
 };
 
 
-template<class range_type>
-int RangeNodeComp( const range_type& a, const RangeNode<range_type>& b )
-{
-    if( a < b.minIndex )
-        return -1;
-    if( a == b.minIndex )
-        return 0;
-    return 1;
-}
-
 template<class range_type>
 class RAK_DLL_EXPORT RangeList
 {
 public:
     RangeList();
     ~RangeList();
+    RangeList( const RangeList& original_copy );
+    RangeList& operator=( const RangeList& original_copy );
+    /// Adds index, merging it with the ranges either side. Inserting after the last range takes constant time.
     void Insert( range_type index );
     void Clear( void );
     unsigned Size( void ) const;
     unsigned RangeSum( void ) const;
+    /// \return The range at position, in ascending order
+    const RangeNode<range_type>& operator[]( const unsigned int position ) const;
     BitSize_t Serialize( BitStream* in, BitSize_t maxBits, bool clearSerialized );
     bool Deserialize( BitStream* out );
 
-    DataStructures::OrderedList<range_type, RangeNode<range_type>, RangeNodeComp<range_type>> ranges;
+protected:
+    // Enough for the acks of one update unless many datagrams were lost
+    static const unsigned INLINE_RANGE_COUNT = 8;
+
+    // \return The first range whose minIndex is not less than index, or Size()
+    unsigned LowerBound( range_type index ) const;
+    void InsertAtIndex( const RangeNode<range_type>& node, unsigned position );
+    void RemoveAtIndex( unsigned position );
+    void Reserve( unsigned capacity );
+
+    // Points to inlineRanges until more are needed, then to an array kept until destruction
+    RangeNode<range_type>* ranges;
+    unsigned rangeCount;
+    unsigned rangeCapacity;
+    RangeNode<range_type> inlineRanges[INLINE_RANGE_COUNT];
 };
 
 template<class range_type>
 BitSize_t RangeList<range_type>::Serialize( BitStream* in, BitSize_t maxBits, bool clearSerialized )
 {
-    RakAssert( ranges.Size() < (unsigned short)-1 );
-    BitStream tempBS;
+    RakAssert( rangeCount < (unsigned short)-1 );
     BitSize_t bitsWritten;
     unsigned short countWritten;
     unsigned i;
     countWritten = 0;
     bitsWritten = 0;
-    for( i = 0; i < ranges.Size(); i++ )
+    // Count what fits first, so the ranges can be written straight into in
+    for( i = 0; i < rangeCount; i++ )
     {
         if( (int)sizeof( unsigned short ) * 8 + bitsWritten + (int)sizeof( range_type ) * 8 * 2 + 1 > maxBits )
             break;
-        unsigned char minEqualsMax;
-        if( ranges[i].minIndex == ranges[i].maxIndex )
-            minEqualsMax = 1;
-        else
-            minEqualsMax = 0;
-        tempBS.Write( minEqualsMax ); // Use one byte, intead of one bit, for speed, as this is done a lot
-        tempBS.Write( ranges[i].minIndex );
         bitsWritten += sizeof( range_type ) * 8 + 8;
         if( ranges[i].minIndex != ranges[i].maxIndex )
-        {
-            tempBS.Write( ranges[i].maxIndex );
             bitsWritten += sizeof( range_type ) * 8;
-        }
         countWritten++;
     }
 
     in->AlignWriteToByteBoundary();
+    // bitsWritten is at least what is written, so in reallocates once at most
+    in->AddBitsAndReallocate( sizeof( unsigned short ) * 8 + bitsWritten );
     BitSize_t before = in->GetWriteOffset();
     in->Write( countWritten );
     bitsWritten += in->GetWriteOffset() - before;
-    //  RAKNET_DEBUG_PRINTF("%i ", in->GetNumberOfBitsUsed());
-    in->Write( &tempBS, tempBS.GetNumberOfBitsUsed() );
-    //  RAKNET_DEBUG_PRINTF("%i %i \n", tempBS.GetNumberOfBitsUsed(),in->GetNumberOfBitsUsed());
+    for( i = 0; i < countWritten; i++ )
+    {
+        unsigned char minEqualsMax;
+        if( ranges[i].minIndex == ranges[i].maxIndex )
+            minEqualsMax = 1;
+        else
+            minEqualsMax = 0;
+        in->Write( minEqualsMax ); // Use one byte, intead of one bit, for speed, as this is done a lot
+        in->Write( ranges[i].minIndex );
+        if( ranges[i].minIndex != ranges[i].maxIndex )
+            in->Write( ranges[i].maxIndex );
+    }
 
     if( clearSerialized && countWritten )
     {
-        unsigned rangeSize = ranges.Size();
-        for( i = 0; i < rangeSize - countWritten; i++ )
+        for( i = 0; i < rangeCount - countWritten; i++ )
         {
             ranges[i] = ranges[i + countWritten];
         }
-        ranges.RemoveFromEnd( countWritten );
+        rangeCount -= countWritten;
     }
 
     return bitsWritten;
@@ -116,7 +124,7 @@ BitSize_t RangeList<range_type>::Serialize( BitStream* in, BitSize_t maxBits, bo
 template<class range_type>
 bool RangeList<range_type>::Deserialize( BitStream* out )
 {
-    ranges.Clear( true, _FILE_AND_LINE_ );
+    Clear();
     unsigned short count;
     out->AlignReadToByteBoundary();
     out->Read( count );
@@ -140,7 +148,7 @@ bool RangeList<range_type>::Deserialize( BitStream* out )
             max = min;
 
 
-        ranges.InsertAtEnd( RangeNode<range_type>( min, max ), _FILE_AND_LINE_ );
+        InsertAtIndex( RangeNode<range_type>( min, max ), rangeCount );
     }
     return true;
 }
@@ -148,96 +156,148 @@ bool RangeList<range_type>::Deserialize( BitStream* out )
 template<class range_type>
 RangeList<range_type>::RangeList()
 {
-    RangeNodeComp<range_type>( 0, RangeNode<range_type>() );
+    ranges = inlineRanges;
+    rangeCount = 0;
+    rangeCapacity = INLINE_RANGE_COUNT;
 }
 
 template<class range_type>
 RangeList<range_type>::~RangeList()
 {
-    Clear();
+    if( ranges != inlineRanges )
+        RakNet::OP_DELETE_ARRAY( ranges, _FILE_AND_LINE_ );
+}
+
+template<class range_type>
+RangeList<range_type>::RangeList( const RangeList& original_copy )
+{
+    ranges = inlineRanges;
+    rangeCount = 0;
+    rangeCapacity = INLINE_RANGE_COUNT;
+    *this = original_copy;
+}
+
+template<class range_type>
+RangeList<range_type>& RangeList<range_type>::operator=( const RangeList& original_copy )
+{
+    if( this == &original_copy )
+        return *this;
+    Reserve( original_copy.rangeCount );
+    for( unsigned i = 0; i < original_copy.rangeCount; i++ )
+        ranges[i] = original_copy.ranges[i];
+    rangeCount = original_copy.rangeCount;
+    return *this;
 }
 
 template<class range_type>
 void RangeList<range_type>::Insert( range_type index )
 {
-    if( ranges.Size() == 0 )
+    unsigned position;
+    if( rangeCount == 0 || !( index < ranges[rangeCount - 1].minIndex ) )
     {
-        ranges.Insert( index, RangeNode<range_type>( index, index ), true, _FILE_AND_LINE_ );
-        return;
+        // Sequence numbers mostly arrive in order, so skip the search
+        position = rangeCount;
     }
-
-    bool objectExists;
-    unsigned insertionIndex = ranges.GetIndexFromKey( index, &objectExists );
-    if( insertionIndex == ranges.Size() )
+    else
     {
-        if( index == ranges[insertionIndex - 1].maxIndex + (range_type)1 )
-            ranges[insertionIndex - 1].maxIndex++;
-        else if( index > ranges[insertionIndex - 1].maxIndex + (range_type)1 )
-        {
-            // Insert at end
-            ranges.Insert( index, RangeNode<range_type>( index, index ), true, _FILE_AND_LINE_ );
-        }
-
-        return;
+        position = LowerBound( index );
+        if( ranges[position].minIndex == index )
+            return;
     }
 
-    if( index < ranges[insertionIndex].minIndex - (range_type)1 )
-    {
-        // Insert here
-        ranges.InsertAtIndex( RangeNode<range_type>( index, index ), insertionIndex, _FILE_AND_LINE_ );
-
+    // Already exists
+    if( position > 0 && !( ranges[position - 1].maxIndex < index ) )
         return;
-    }
-    else if( index == ranges[insertionIndex].minIndex - (range_type)1 )
-    {
-        // Decrease minIndex and join left
-        ranges[insertionIndex].minIndex--;
-        if( insertionIndex > 0 && ranges[insertionIndex - 1].maxIndex + (range_type)1 == ranges[insertionIndex].minIndex )
-        {
-            ranges[insertionIndex - 1].maxIndex = ranges[insertionIndex].maxIndex;
-            ranges.RemoveAtIndex( insertionIndex );
-        }
 
-        return;
-    }
-    else if( index >= ranges[insertionIndex].minIndex && index <= ranges[insertionIndex].maxIndex )
+    const bool joinLeft = position > 0 && index == ranges[position - 1].maxIndex + (range_type)1;
+    const bool joinRight = position < rangeCount && index + (range_type)1 == ranges[position].minIndex;
+    if( joinLeft && joinRight )
     {
-        // Already exists
-        return;
-    }
-    else if( index == ranges[insertionIndex].maxIndex + (range_type)1 )
-    {
-        // Increase maxIndex and join right
-        ranges[insertionIndex].maxIndex++;
-        if( insertionIndex < ranges.Size() - 1 && ranges[insertionIndex + (range_type)1].minIndex == ranges[insertionIndex].maxIndex + (range_type)1 )
-        {
-            ranges[insertionIndex + 1].minIndex = ranges[insertionIndex].minIndex;
-            ranges.RemoveAtIndex( insertionIndex );
-        }
-
-        return;
+        ranges[position - 1].maxIndex = ranges[position].maxIndex;
+        RemoveAtIndex( position );
     }
+    else if( joinLeft )
+        ranges[position - 1].maxIndex = index;
+    else if( joinRight )
+        ranges[position].minIndex = index;
+    else
+        InsertAtIndex( RangeNode<range_type>( index, index ), position );
 }
 
 template<class range_type>
 void RangeList<range_type>::Clear( void )
 {
-    ranges.Clear( true, _FILE_AND_LINE_ );
+    rangeCount = 0;
 }
 
 template<class range_type>
 unsigned RangeList<range_type>::Size( void ) const
 {
-    return ranges.Size();
+    return rangeCount;
 }
 
 template<class range_type>
 unsigned RangeList<range_type>::RangeSum( void ) const
 {
     unsigned sum = 0, i;
-    for( i = 0; i < ranges.Size(); i++ )
-        sum += ranges[i].maxIndex - ranges[i].minIndex + 1;
+    for( i = 0; i < rangeCount; i++ )
+        sum += (unsigned)( ranges[i].maxIndex - ranges[i].minIndex ) + 1;
     return sum;
 }
 
+template<class range_type>
+const RangeNode<range_type>& RangeList<range_type>::operator[]( const unsigned int position ) const
+{
+    RakAssert( position < rangeCount );
+    return ranges[position];
+}
+
+template<class range_type>
+unsigned RangeList<range_type>::LowerBound( range_type index ) const
+{
+    unsigned lowerBound = 0, upperBound = rangeCount;
+    while( lowerBound < upperBound )
+    {
+        const unsigned middle = lowerBound + ( upperBound - lowerBound ) / 2;
+        if( ranges[middle].minIndex < index )
+            lowerBound = middle + 1;
+        else
+            upperBound = middle;
+    }
+    return lowerBound;
+}
+
+template<class range_type>
+void RangeList<range_type>::InsertAtIndex( const RangeNode<range_type>& node, unsigned position )
+{
+    if( rangeCount == rangeCapacity )
+        Reserve( rangeCapacity * 2 );
+    for( unsigned i = rangeCount; i > position; i-- )
+        ranges[i] = ranges[i - 1];
+    ranges[position] = node;
+    rangeCount++;
+}
+
+template<class range_type>
+void RangeList<range_type>::RemoveAtIndex( unsigned position )
+{
+    for( unsigned i = position; i + 1 < rangeCount; i++ )
+        ranges[i] = ranges[i + 1];
+    rangeCount--;
+}
+
+template<class range_type>
+void RangeList<range_type>::Reserve( unsigned capacity )
+{
+    if( capacity <= rangeCapacity )
+        return;
+    RangeNode<range_type>* grown = RakNet::OP_NEW_ARRAY<RangeNode<range_type>>( capacity, _FILE_AND_LINE_ );
+    for( unsigned i = 0; i < rangeCount; i++ )
+        grown[i] = ranges[i];
+    if( ranges != inlineRanges )
+        RakNet::OP_DELETE_ARRAY( ranges, _FILE_AND_LINE_ );
+    ranges = grown;
+    rangeCapacity = capacity;
+}
+
 }} // namespace RakNet::DataStructures
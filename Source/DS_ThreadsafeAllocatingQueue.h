@@ -14,10 +14,10 @@
 
 #pragma once
 
-#include "DS_MemoryPool.h"
+#include "DS_ThreadsafeMemoryPool.h"
 
-#include <deque>
-#include <mutex>
+#include <atomic>
+#include <thread>
 
 // #if defined(new)
 // #pragma push_macro("new")
@@ -27,12 +27,19 @@
 
 namespace RakNet { namespace DataStructures {
 
+/// Push() never waits: it links the element in with one atomic exchange, as in Dmitry Vyukov's intrusive MPSC queue.
+/// Popping needs no lock either when one thread pops, as RakNet does. Threads popping at the same time take turns on a spin flag.
+/// Nodes are never compared and swapped, so a node popped, deallocated and pushed again at once cannot be mistaken for the old one.
+/// Only pointers returned by Allocate() can be pushed.
 template<class structureType>
 class RAK_DLL_EXPORT ThreadsafeAllocatingQueue
 {
 public:
+    ThreadsafeAllocatingQueue();
+
     // Queue operations
     void Push( structureType* s );
+    /// Returns 0 rather than wait for a Push() that is halfway done, or for another thread popping
     structureType* PopInaccurate( void );
     structureType* Pop( void );
     void SetPageSize( int size );
@@ -45,84 +52,98 @@ public:
     void Clear( const char* file, unsigned int line );
 
 protected:
-    mutable MemoryPool<structureType> memoryPool;
-    std::mutex memoryPoolMutex;
-    std::deque<structureType*> queue;
-    std::mutex queueMutex;
+    struct Link
+    {
+        std::atomic<Link*> next;
+        // 0 for the stub
+        structureType* value;
+    };
+
+    struct Node
+    {
+        structureType value;
+        Link link;
+    };
+
+    void PushLink( Link* link );
+    // \param[in] wait Whether to wait for a Push() that exchanged the head but did not link its node yet
+    structureType* PopLink( bool wait );
+
+    ThreadsafeMemoryPool<Node> memoryPool;
+
+    // Producers and consumers on separate cache lines
+    std::atomic<Link*> head;
+    char headPadding[64 - sizeof( std::atomic<Link*> )];
+    Link* tail;
+    Link stub;
+    std::atomic<bool> isPopping;
+    std::atomic<unsigned int> size;
 };
 
+template<class structureType>
+ThreadsafeAllocatingQueue<structureType>::ThreadsafeAllocatingQueue()
+{
+    stub.next.store( 0, std::memory_order_relaxed );
+    stub.value = 0;
+    head.store( &stub, std::memory_order_relaxed );
+    tail = &stub;
+    isPopping.store( false, std::memory_order_relaxed );
+    size.store( 0, std::memory_order_relaxed );
+}
+
 template<class structureType>
 void ThreadsafeAllocatingQueue<structureType>::Push( structureType* s )
 {
-    std::lock_guard<std::mutex> guard( queueMutex );
-    queue.push_back( s );
+    // Counted first, so that Pop() knows to wait for a node being linked
+    size.fetch_add( 1, std::memory_order_relaxed );
+    PushLink( &( (Node*)s )->link );
 }
 
 template<class structureType>
 structureType* ThreadsafeAllocatingQueue<structureType>::PopInaccurate( void )
 {
-    structureType* s;
-    if( queue.empty() )
+    if( size.load( std::memory_order_relaxed ) == 0 || isPopping.exchange( true, std::memory_order_acquire ) )
         return 0;
-    std::lock_guard<std::mutex> guard( queueMutex );
-    if( !queue.empty() )
-    {
-        s = queue.front();
-        queue.pop_front();
-    }
-    else
-        s = 0;
+    structureType* s = PopLink( false );
+    isPopping.store( false, std::memory_order_release );
     return s;
 }
 
 template<class structureType>
 structureType* ThreadsafeAllocatingQueue<structureType>::Pop( void )
 {
-    std::lock_guard<std::mutex> guard( queueMutex );
-    if( queue.empty() )
-    {
-        return 0;
-    }
-    structureType* s = queue.front();
-    queue.pop_front();
+    while( isPopping.exchange( true, std::memory_order_acquire ) )
+        std::this_thread::yield();
+    structureType* s = PopLink( true );
+    isPopping.store( false, std::memory_order_release );
     return s;
 }
 
 template<class structureType>
 structureType* ThreadsafeAllocatingQueue<structureType>::Allocate( const char* file, unsigned int line )
 {
-    structureType* s;
-    memoryPoolMutex.lock();
-    s = memoryPool.Allocate( file, line );
-    memoryPoolMutex.unlock();
+    Node* node = memoryPool.Allocate( file, line );
     // Call new operator, memoryPool doesn't do this
-    s = new( (void*)s ) structureType;
-    return s;
+    node = new( (void*)node ) Node;
+    node->link.value = &node->value;
+    return &node->value;
 }
 template<class structureType>
 void ThreadsafeAllocatingQueue<structureType>::Deallocate( structureType* s, const char* file, unsigned int line )
 {
     // Call delete operator, memory pool doesn't do this
-    s->~structureType();
-    memoryPoolMutex.lock();
-    memoryPool.Release( s, file, line );
-    memoryPoolMutex.unlock();
+    Node* node = (Node*)s;
+    node->~Node();
+    memoryPool.Release( node, file, line );
 }
 
 template<class structureType>
 void ThreadsafeAllocatingQueue<structureType>::Clear( const char* file, unsigned int line )
 {
-    memoryPoolMutex.lock();
-    for( structureType* s : queue )
-    {
-        s->~structureType();
-        memoryPool.Release( s, file, line );
-    }
-    queue.clear();
-    memoryPoolMutex.unlock();
-    memoryPoolMutex.lock();
+    structureType* s;
+    while( ( s = Pop() ) != 0 )
+        Deallocate( s, file, line );
     memoryPool.Clear( file, line );
-    memoryPoolMutex.unlock();
 }
 
 template<class structureType>
@@ -134,15 +155,73 @@ void ThreadsafeAllocatingQueue<structureType>::SetPageSize( int size )
 template<class structureType>
 bool ThreadsafeAllocatingQueue<structureType>::IsEmpty( void )
 {
-    std::lock_guard<std::mutex> queueGuard( queueMutex );
-    return queue.empty();
+    return size.load( std::memory_order_relaxed ) == 0;
 }
 
 template<class structureType>
 unsigned int ThreadsafeAllocatingQueue<structureType>::Size( void )
 {
-    std::lock_guard<std::mutex> queueGuard( queueMutex );
-    return queue.size();
+    return size.load( std::memory_order_relaxed );
+}
+
+template<class structureType>
+void ThreadsafeAllocatingQueue<structureType>::PushLink( Link* link )
+{
+    link->next.store( 0, std::memory_order_relaxed );
+    Link* previous = head.exchange( link, std::memory_order_acq_rel );
+    // Until this store, Pop() sees the queue end at previous
+    previous->next.store( link, std::memory_order_release );
+}
+
+template<class structureType>
+structureType* ThreadsafeAllocatingQueue<structureType>::PopLink( bool wait )
+{
+    while( size.load( std::memory_order_relaxed ) > 0 )
+    {
+        Link* first = tail;
+        Link* next = first->next.load( std::memory_order_acquire );
+        if( first == &stub )
+        {
+            if( next == 0 )
+            {
+                if( wait == false )
+                    return 0;
+                std::this_thread::yield();
+                continue;
+            }
+            tail = next;
+            first = next;
+            next = next->next.load( std::memory_order_acquire );
+        }
+
+        // A node is only returned once the one after it is linked, so no Push() still refers to it
+        if( next == 0 )
+        {
+            if( first != head.load( std::memory_order_acquire ) )
+            {
+                // A Push() is between its exchange and its store
+                if( wait == false )
+                    return 0;
+                std::this_thread::yield();
+                continue;
+            }
+            // first is the last node. The stub goes after it so that it can be returned.
+            PushLink( &stub );
+            next = first->next.load( std::memory_order_acquire );
+            if( next == 0 )
+            {
+                if( wait == false )
+                    return 0;
+                std::this_thread::yield();
+                continue;
+            }
+        }
+
+        tail = next;
+        size.fetch_sub( 1, std::memory_order_relaxed );
+        return first->value;
+    }
+    return 0;
 }
 
 }} // namespace RakNet::DataStructures
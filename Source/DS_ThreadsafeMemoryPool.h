@@ -0,0 +1,362 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_ThreadsafeMemoryPool.h
+/// \brief A MemoryPool that many threads can allocate from and release to, with a cache of blocks per thread
+///
+
+#pragma once
+
+#include "DS_MemoryPool.h"
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Blocks each magazine holds. Each thread keeps up to two magazines of each pool it uses.
+#define DS_THREADSAFE_MEMORY_POOL_MAGAZINE_SIZE 32
+// Full magazines kept in the depot. Blocks released beyond that go back to the MemoryPool.
+#define DS_THREADSAFE_MEMORY_POOL_MAX_FULL_MAGAZINES 16
+
+namespace RakNet { namespace DataStructures {
+
+/// Same as MemoryPool, but safe to use from any number of threads, including releasing blocks on a thread other than the one that allocated them.
+/// Each thread takes blocks from and releases them to its own two magazines without locking.
+/// Only when both are empty, or both full, does it lock to swap one with the depot of full and empty magazines, or with the MemoryPool behind it.
+/// So a thread that allocates what another releases locks once per DS_THREADSAFE_MEMORY_POOL_MAGAZINE_SIZE blocks rather than for every block.
+/// A thread's magazines go back to the pool when it exits.
+/// A block released to another pool of the same type, such as a Packet allocated by one RakPeer and deallocated by another, goes back to the pool that allocated it,
+/// which must still exist.
+/// SetPageSize(), Clear() and the destructor must not run while other threads use the pool.
+template<class MemoryBlockType>
+class RAK_DLL_EXPORT ThreadsafeMemoryPool
+{
+public:
+    struct Slot
+    {
+        MemoryBlockType userMemory;
+        ThreadsafeMemoryPool* owner;
+    };
+    // For SetPageSize()
+    typedef typename MemoryPool<Slot>::MemoryWithPage MemoryWithPage;
+
+    ThreadsafeMemoryPool();
+    ~ThreadsafeMemoryPool();
+    void SetPageSize( int size ); // Defaults to 16384 bytes
+    MemoryBlockType* Allocate( const char* file, unsigned int line );
+    void Release( MemoryBlockType* m, const char* file, unsigned int line );
+    void Clear( const char* file, unsigned int line );
+
+    /// \return How many threads have magazines for this pool
+    unsigned int GetThreadCacheCount( void ) const;
+
+protected:
+    struct Magazine
+    {
+        int count;
+        MemoryBlockType* blocks[DS_THREADSAFE_MEMORY_POOL_MAGAZINE_SIZE];
+    };
+
+    struct ThreadCache
+    {
+        // Set to 0 when the pool is destroyed before the thread exits
+        std::atomic<ThreadsafeMemoryPool*> pool;
+        Magazine* loaded;
+        Magazine* previous;
+    };
+
+    // The caches of one thread, for every pool of this type it used
+    struct ThreadCacheList
+    {
+        ~ThreadCacheList();
+        std::vector<ThreadCache*> caches;
+    };
+
+    ThreadCache* GetThreadCache( const char* file, unsigned int line );
+    ThreadCache* AddThreadCache( ThreadCacheList& list, const char* file, unsigned int line );
+    void Refill( ThreadCache* cache, const char* file, unsigned int line );
+    void Spill( ThreadCache* cache, const char* file, unsigned int line );
+    void FlushThreadCache( ThreadCache* cache, const char* file, unsigned int line );
+    void ReleaseMagazine( Magazine* magazine, const char* file, unsigned int line );
+    Magazine* TakeEmptyMagazine( const char* file, unsigned int line );
+    static void FreeThreadCache( ThreadCache* cache, const char* file, unsigned int line );
+
+    static ThreadCacheList& GetThreadCacheList( void );
+    // Guards ThreadCache::pool and threadCaches, for every pool of this type, so that a thread exiting never flushes to a destroyed pool
+    static std::mutex& GetRegistryMutex( void );
+
+    // Guards the depot and memoryPool
+    std::mutex mutex;
+    MemoryPool<Slot> memoryPool;
+    std::vector<Magazine*> fullMagazines;
+    std::vector<Magazine*> emptyMagazines;
+    std::vector<ThreadCache*> threadCaches;
+
+private:
+    ThreadsafeMemoryPool( const ThreadsafeMemoryPool& );
+    ThreadsafeMemoryPool& operator=( const ThreadsafeMemoryPool& );
+};
+
+template<class MemoryBlockType>
+ThreadsafeMemoryPool<MemoryBlockType>::ThreadsafeMemoryPool()
+{
+}
+
+template<class MemoryBlockType>
+ThreadsafeMemoryPool<MemoryBlockType>::~ThreadsafeMemoryPool()
+{
+    Clear( _FILE_AND_LINE_ );
+
+    // The threads free their caches when they next look one up, or exit
+    std::lock_guard<std::mutex> registryGuard( GetRegistryMutex() );
+    for( ThreadCache* cache : threadCaches )
+        cache->pool.store( 0, std::memory_order_relaxed );
+    threadCaches.clear();
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::SetPageSize( int size )
+{
+    std::lock_guard<std::mutex> guard( mutex );
+    memoryPool.SetPageSize( size );
+}
+
+template<class MemoryBlockType>
+MemoryBlockType* ThreadsafeMemoryPool<MemoryBlockType>::Allocate( const char* file, unsigned int line )
+{
+    ThreadCache* cache = GetThreadCache( file, line );
+    if( cache->loaded->count == 0 )
+    {
+        if( cache->previous->count > 0 )
+            std::swap( cache->loaded, cache->previous );
+        else
+        {
+            Refill( cache, file, line );
+            if( cache->loaded->count == 0 )
+                return 0;
+        }
+    }
+    return cache->loaded->blocks[--cache->loaded->count];
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::Release( MemoryBlockType* m, const char* file, unsigned int line )
+{
+    ThreadsafeMemoryPool* owner = ( (Slot*)m )->owner;
+    if( owner != this )
+    {
+        owner->Release( m, file, line );
+        return;
+    }
+
+    ThreadCache* cache = GetThreadCache( file, line );
+    if( cache->loaded->count == DS_THREADSAFE_MEMORY_POOL_MAGAZINE_SIZE )
+    {
+        if( cache->previous->count == 0 )
+            std::swap( cache->loaded, cache->previous );
+        else
+            Spill( cache, file, line );
+    }
+    cache->loaded->blocks[cache->loaded->count++] = m;
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::Clear( const char* file, unsigned int line )
+{
+    std::lock_guard<std::mutex> registryGuard( GetRegistryMutex() );
+    std::lock_guard<std::mutex> guard( mutex );
+
+    // Return the blocks before clearing the pages, which matters with _DISABLE_MEMORY_POOL
+    for( ThreadCache* cache : threadCaches )
+    {
+        ReleaseMagazine( cache->loaded, file, line );
+        ReleaseMagazine( cache->previous, file, line );
+    }
+    for( Magazine* magazine : fullMagazines )
+    {
+        ReleaseMagazine( magazine, file, line );
+        RakNet::OP_DELETE( magazine, file, line );
+    }
+    fullMagazines.clear();
+    for( Magazine* magazine : emptyMagazines )
+        RakNet::OP_DELETE( magazine, file, line );
+    emptyMagazines.clear();
+
+    memoryPool.Clear( file, line );
+}
+
+template<class MemoryBlockType>
+unsigned int ThreadsafeMemoryPool<MemoryBlockType>::GetThreadCacheCount( void ) const
+{
+    std::lock_guard<std::mutex> registryGuard( GetRegistryMutex() );
+    return (unsigned int)threadCaches.size();
+}
+
+template<class MemoryBlockType>
+typename ThreadsafeMemoryPool<MemoryBlockType>::ThreadCache* ThreadsafeMemoryPool<MemoryBlockType>::GetThreadCache( const char* file, unsigned int line )
+{
+    ThreadCacheList& list = GetThreadCacheList();
+    for( ThreadCache* cache : list.caches )
+    {
+        if( cache->pool.load( std::memory_order_relaxed ) == this )
+            return cache;
+    }
+    return AddThreadCache( list, file, line );
+}
+
+template<class MemoryBlockType>
+typename ThreadsafeMemoryPool<MemoryBlockType>::ThreadCache* ThreadsafeMemoryPool<MemoryBlockType>::AddThreadCache( ThreadCacheList& list, const char* file,
+                                                                                                                     unsigned int line )
+{
+    std::lock_guard<std::mutex> registryGuard( GetRegistryMutex() );
+
+    // Caches of pools destroyed since
+    for( size_t i = 0; i < list.caches.size(); )
+    {
+        if( list.caches[i]->pool.load( std::memory_order_relaxed ) == 0 )
+        {
+            FreeThreadCache( list.caches[i], file, line );
+            list.caches[i] = list.caches.back();
+            list.caches.pop_back();
+        }
+        else
+            i++;
+    }
+
+    ThreadCache* cache = RakNet::OP_NEW<ThreadCache>( file, line );
+    cache->pool.store( this, std::memory_order_relaxed );
+    {
+        std::lock_guard<std::mutex> guard( mutex );
+        cache->loaded = TakeEmptyMagazine( file, line );
+        cache->previous = TakeEmptyMagazine( file, line );
+    }
+    threadCaches.push_back( cache );
+    list.caches.push_back( cache );
+    return cache;
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::Refill( ThreadCache* cache, const char* file, unsigned int line )
+{
+    std::lock_guard<std::mutex> guard( mutex );
+    if( !fullMagazines.empty() )
+    {
+        emptyMagazines.push_back( cache->loaded );
+        cache->loaded = fullMagazines.back();
+        fullMagazines.pop_back();
+        return;
+    }
+
+    Magazine* magazine = cache->loaded;
+    while( magazine->count < DS_THREADSAFE_MEMORY_POOL_MAGAZINE_SIZE )
+    {
+        Slot* slot = memoryPool.Allocate( file, line );
+        if( slot == 0 )
+            break;
+        slot->owner = this;
+        magazine->blocks[magazine->count++] = &slot->userMemory;
+    }
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::Spill( ThreadCache* cache, const char* file, unsigned int line )
+{
+    std::lock_guard<std::mutex> guard( mutex );
+    if( fullMagazines.size() < DS_THREADSAFE_MEMORY_POOL_MAX_FULL_MAGAZINES )
+    {
+        fullMagazines.push_back( cache->previous );
+        cache->previous = TakeEmptyMagazine( file, line );
+    }
+    else
+        ReleaseMagazine( cache->previous, file, line );
+    std::swap( cache->loaded, cache->previous );
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::FlushThreadCache( ThreadCache* cache, const char* file, unsigned int line )
+{
+    std::lock_guard<std::mutex> guard( mutex );
+    ReleaseMagazine( cache->loaded, file, line );
+    ReleaseMagazine( cache->previous, file, line );
+    emptyMagazines.push_back( cache->loaded );
+    emptyMagazines.push_back( cache->previous );
+    cache->loaded = 0;
+    cache->previous = 0;
+    for( size_t i = 0; i < threadCaches.size(); i++ )
+    {
+        if( threadCaches[i] == cache )
+        {
+            threadCaches[i] = threadCaches.back();
+            threadCaches.pop_back();
+            break;
+        }
+    }
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::ReleaseMagazine( Magazine* magazine, const char* file, unsigned int line )
+{
+    for( int i = 0; i < magazine->count; i++ )
+        memoryPool.Release( (Slot*)magazine->blocks[i], file, line );
+    magazine->count = 0;
+}
+
+template<class MemoryBlockType>
+typename ThreadsafeMemoryPool<MemoryBlockType>::Magazine* ThreadsafeMemoryPool<MemoryBlockType>::TakeEmptyMagazine( const char* file, unsigned int line )
+{
+    if( emptyMagazines.empty() )
+    {
+        Magazine* magazine = RakNet::OP_NEW<Magazine>( file, line );
+        magazine->count = 0;
+        return magazine;
+    }
+    Magazine* magazine = emptyMagazines.back();
+    emptyMagazines.pop_back();
+    return magazine;
+}
+
+template<class MemoryBlockType>
+void ThreadsafeMemoryPool<MemoryBlockType>::FreeThreadCache( ThreadCache* cache, const char* file, unsigned int line )
+{
+    RakNet::OP_DELETE( cache->loaded, file, line );
+    RakNet::OP_DELETE( cache->previous, file, line );
+    RakNet::OP_DELETE( cache, file, line );
+}
+
+template<class MemoryBlockType>
+typename ThreadsafeMemoryPool<MemoryBlockType>::ThreadCacheList& ThreadsafeMemoryPool<MemoryBlockType>::GetThreadCacheList( void )
+{
+    static thread_local ThreadCacheList list;
+    return list;
+}
+
+template<class MemoryBlockType>
+std::mutex& ThreadsafeMemoryPool<MemoryBlockType>::GetRegistryMutex( void )
+{
+    // Never destroyed, as pools with static storage may be destroyed after it would be
+    static std::mutex* registryMutex = new std::mutex;
+    return *registryMutex;
+}
+
+template<class MemoryBlockType>
+ThreadsafeMemoryPool<MemoryBlockType>::ThreadCacheList::~ThreadCacheList()
+{
+    std::lock_guard<std::mutex> registryGuard( GetRegistryMutex() );
+    for( ThreadCache* cache : caches )
+    {
+        ThreadsafeMemoryPool* pool = cache->pool.load( std::memory_order_relaxed );
+        if( pool != 0 )
+            pool->FlushThreadCache( cache, _FILE_AND_LINE_ );
+        FreeThreadCache( cache, _FILE_AND_LINE_ );
+    }
+}
+
+}} // namespace RakNet::DataStructures
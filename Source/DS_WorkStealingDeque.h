@@ -0,0 +1,183 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_WorkStealingDeque.h
+/// \internal
+/// \brief The Chase-Lev deque each ThreadPool worker keeps its work in
+///
+
+#pragma once
+
+#include "RakMemoryOverride.h"
+#include "Export.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+namespace RakNet { namespace DataStructures {
+
+/// One thread, the owner, pushes and takes at the bottom. Any other thread steals from the top.
+/// None of them lock. Taking and stealing only compare and swap when they race for the last element.
+/// Follows Le, Pop, Cohen and Zappa Nardelli, Correct and Efficient Work-Stealing for Weak Memory Models, 2013.
+/// \note Element must be a pointer or another type std::atomic holds without locking. 0 means empty.
+template<class Element>
+class RAK_DLL_EXPORT WorkStealingDeque
+{
+public:
+    WorkStealingDeque( int initialCapacity = 64 );
+    ~WorkStealingDeque();
+
+    /// Owner only
+    void Push( Element element );
+
+    /// Owner only
+    /// \return The element pushed last, or 0 if empty
+    Element Take( void );
+
+    /// Any thread
+    /// \return The element pushed first, or 0 if empty
+    Element Steal( void );
+
+    /// \return How many elements there are, which may have changed by the time it returns
+    int64_t Size( void ) const;
+
+protected:
+    struct Array
+    {
+        int64_t capacity;
+        std::atomic<Element>* elements;
+
+        Element Get( int64_t i ) const { return elements[i & ( capacity - 1 )].load( std::memory_order_relaxed ); }
+        void Put( int64_t i, Element element ) { elements[i & ( capacity - 1 )].store( element, std::memory_order_relaxed ); }
+    };
+
+    Array* AllocateArray( int64_t capacity );
+    void FreeArray( Array* array );
+
+    std::atomic<int64_t> top;
+    char topPadding[64 - sizeof( std::atomic<int64_t> )];
+    std::atomic<int64_t> bottom;
+    std::atomic<Array*> array;
+    // Arrays outgrown, which a thread stealing may still be reading, freed with the deque
+    std::vector<Array*> retiredArrays;
+
+private:
+    WorkStealingDeque( const WorkStealingDeque& );
+    WorkStealingDeque& operator=( const WorkStealingDeque& );
+};
+
+template<class Element>
+WorkStealingDeque<Element>::WorkStealingDeque( int initialCapacity )
+{
+    int64_t capacity = 1;
+    while( capacity < initialCapacity )
+        capacity <<= 1;
+    top.store( 0, std::memory_order_relaxed );
+    bottom.store( 0, std::memory_order_relaxed );
+    array.store( AllocateArray( capacity ), std::memory_order_relaxed );
+}
+
+template<class Element>
+WorkStealingDeque<Element>::~WorkStealingDeque()
+{
+    FreeArray( array.load( std::memory_order_relaxed ) );
+    for( Array* retired : retiredArrays )
+        FreeArray( retired );
+}
+
+template<class Element>
+void WorkStealingDeque<Element>::Push( Element element )
+{
+    const int64_t b = bottom.load( std::memory_order_relaxed );
+    const int64_t t = top.load( std::memory_order_acquire );
+    Array* a = array.load( std::memory_order_relaxed );
+    if( b - t > a->capacity - 1 )
+    {
+        Array* grown = AllocateArray( a->capacity * 2 );
+        for( int64_t i = t; i < b; i++ )
+            grown->Put( i, a->Get( i ) );
+        retiredArrays.push_back( a );
+        array.store( grown, std::memory_order_release );
+        a = grown;
+    }
+    a->Put( b, element );
+    std::atomic_thread_fence( std::memory_order_release );
+    bottom.store( b + 1, std::memory_order_relaxed );
+}
+
+template<class Element>
+Element WorkStealingDeque<Element>::Take( void )
+{
+    const int64_t b = bottom.load( std::memory_order_relaxed ) - 1;
+    Array* a = array.load( std::memory_order_relaxed );
+    bottom.store( b, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    int64_t t = top.load( std::memory_order_relaxed );
+    if( t > b )
+    {
+        bottom.store( b + 1, std::memory_order_relaxed );
+        return 0;
+    }
+
+    Element element = a->Get( b );
+    if( t == b )
+    {
+        // The last element, which a thread stealing may be taking too
+        if( !top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+            element = 0;
+        bottom.store( b + 1, std::memory_order_relaxed );
+    }
+    return element;
+}
+
+template<class Element>
+Element WorkStealingDeque<Element>::Steal( void )
+{
+    while( true )
+    {
+        int64_t t = top.load( std::memory_order_acquire );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        const int64_t b = bottom.load( std::memory_order_acquire );
+        if( t >= b )
+            return 0;
+
+        Array* a = array.load( std::memory_order_acquire );
+        Element element = a->Get( t );
+        if( top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+            return element;
+        // Another thread took it first. Try the next one.
+    }
+}
+
+template<class Element>
+int64_t WorkStealingDeque<Element>::Size( void ) const
+{
+    const int64_t size = bottom.load( std::memory_order_relaxed ) - top.load( std::memory_order_relaxed );
+    return size > 0 ? size : 0;
+}
+
+template<class Element>
+typename WorkStealingDeque<Element>::Array* WorkStealingDeque<Element>::AllocateArray( int64_t capacity )
+{
+    Array* a = RakNet::OP_NEW<Array>( _FILE_AND_LINE_ );
+    a->capacity = capacity;
+    a->elements = RakNet::OP_NEW_ARRAY<std::atomic<Element>>( (int)capacity, _FILE_AND_LINE_ );
+    return a;
+}
+
+template<class Element>
+void WorkStealingDeque<Element>::FreeArray( Array* a )
+{
+    RakNet::OP_DELETE_ARRAY( a->elements, _FILE_AND_LINE_ );
+    RakNet::OP_DELETE( a, _FILE_AND_LINE_ );
+}
+
+}} // namespace RakNet::DataStructures
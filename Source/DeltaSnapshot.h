@@ -0,0 +1,360 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Sends snapshots of a RAKNET_SERIALIZABLE type to each connection as deltas against the last snapshot that connection acknowledged.
+///
+
+#pragma once
+
+#include "BitStream.h"
+#include "MessageIdentifiers.h"
+#include "PacketPriority.h"
+#include "RakNetTypes.h"
+#include "RakPeerInterface.h"
+
+#include <iterator>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+namespace RakNet {
+
+/// \internal Writes the parts of a RAKNET_SERIALIZABLE type that differ from a baseline, and reads them back onto a copy of that baseline.
+/// Each struct and array starts with a mask of which of its fields or elements changed, followed by the changes to those, so nested types cost one bit when unchanged.
+struct DeltaSnapshotCodec
+{
+    template<class templateType>
+    static bool Equals( const templateType& a, const templateType& b )
+    {
+        if constexpr( IsSerializable<templateType>::value )
+            return std::apply( [&]( auto... fields ) { return ( Equals( a.*fields, b.*fields ) && ... ); }, RakNetSchemaFields( (const templateType*)0 ) );
+        else if constexpr( IsSchemaArray<templateType>::value )
+        {
+            for( size_t i = 0; i < std::size( a ); i++ )
+            {
+                if( Equals( a[i], b[i] ) == false )
+                    return false;
+            }
+            return true;
+        }
+        else if constexpr( std::is_trivially_copyable<templateType>::value )
+            return memcmp( &a, &b, sizeof( templateType ) ) == 0;
+        else
+            return a == b;
+    }
+
+    template<class templateType>
+    static void WriteChanges( BitStream* bitStream, const templateType& current, const templateType& baseline )
+    {
+        if constexpr( IsSerializable<templateType>::value )
+        {
+            std::apply(
+                [&]( auto... fields ) {
+                    const bool changed[] = { ( Equals( current.*fields, baseline.*fields ) == false )... };
+                    for( bool fieldChanged : changed )
+                        bitStream->Write( fieldChanged );
+                    size_t index = 0;
+                    ( ( changed[index++] ? WriteChanges( bitStream, current.*fields, baseline.*fields ) : (void)0 ), ... );
+                },
+                RakNetSchemaFields( (const templateType*)0 ) );
+        }
+        else if constexpr( IsSchemaArray<templateType>::value )
+        {
+            for( size_t i = 0; i < std::size( current ); i++ )
+                bitStream->Write( Equals( current[i], baseline[i] ) == false );
+            for( size_t i = 0; i < std::size( current ); i++ )
+            {
+                if( Equals( current[i], baseline[i] ) == false )
+                    WriteChanges( bitStream, current[i], baseline[i] );
+            }
+        }
+        else
+            bitStream->Write( current );
+    }
+
+    /// \param[in,out] inOutSnapshot Holds the baseline on input
+    template<class templateType>
+    static bool ReadChanges( BitStream* bitStream, templateType& inOutSnapshot )
+    {
+        if constexpr( IsSerializable<templateType>::value )
+        {
+            return std::apply(
+                [&]( auto... fields ) {
+                    bool changed[sizeof...( fields )];
+                    for( bool& fieldChanged : changed )
+                    {
+                        if( bitStream->Read( fieldChanged ) == false )
+                            return false;
+                    }
+                    size_t index = 0;
+                    return ( ( changed[index++] == false || ReadChanges( bitStream, inOutSnapshot.*fields ) ) && ... );
+                },
+                RakNetSchemaFields( (const templateType*)0 ) );
+        }
+        else if constexpr( IsSchemaArray<templateType>::value )
+        {
+            bool changed[std::size( inOutSnapshot )];
+            for( bool& elementChanged : changed )
+            {
+                if( bitStream->Read( elementChanged ) == false )
+                    return false;
+            }
+            for( size_t i = 0; i < std::size( inOutSnapshot ); i++ )
+            {
+                if( changed[i] && ReadChanges( bitStream, inOutSnapshot[i] ) == false )
+                    return false;
+            }
+            return true;
+        }
+        else
+            return bitStream->Read( inOutSnapshot );
+    }
+};
+
+/// \brief Sends snapshots of a RAKNET_SERIALIZABLE type as deltas against the newest snapshot each connection acknowledged.
+/// \details Each connection keeps the last \a maxBaselines snapshots sent to it. Snapshots go out with UNRELIABLE_WITH_ACK_RECEIPT,
+/// and ID_SND_RECEIPT_ACKED marks them acknowledged. A snapshot is then written as a mask of the fields that differ from the newest acknowledged one, followed by those fields.
+/// Until something is acknowledged, or once the newest acknowledged snapshot is \a maxBaselines old, snapshots are written in full.
+/// Lost snapshots need no handling: later ones are simply deltas against an older baseline.
+/// \sa DeltaSnapshotReceiver
+template<class templateType>
+class DeltaSnapshotSender
+{
+public:
+    static_assert( IsSerializable<templateType>::value, "DeltaSnapshotSender needs a type declared with RAKNET_SERIALIZABLE" );
+
+    /// \param[in] maxBaselines How many sent snapshots to keep per connection. Must match the DeltaSnapshotReceiver.
+    DeltaSnapshotSender( unsigned int _maxBaselines = 32 )
+    {
+        maxBaselines = _maxBaselines > 0 ? _maxBaselines : 1;
+    }
+
+    /// Write \a snapshot for \a guid, as a delta if it has acknowledged a baseline
+    /// \return The sequence number of the snapshot. Pass it to SetSendReceipt() once the snapshot is sent.
+    uint32_t Write( const templateType& snapshot, RakNetGUID guid, BitStream* bitStream )
+    {
+        Connection& connection = GetConnection( guid );
+        const uint32_t sequence = connection.nextSequence++;
+
+        // The receiver keeps as many snapshots as we do, so only baselines newer than the one this snapshot replaces are still there
+        uint32_t distance = 0;
+        if( connection.hasAcknowledged && sequence - connection.newestAcknowledged < maxBaselines )
+        {
+            const Baseline& baseline = connection.baselines[connection.newestAcknowledged % maxBaselines];
+            if( baseline.isAcknowledged && baseline.sequence == connection.newestAcknowledged )
+                distance = sequence - connection.newestAcknowledged;
+        }
+
+        bitStream->WriteVarInt( sequence );
+        bitStream->WriteVarInt( distance );
+        if( distance == 0 )
+            bitStream->Write( snapshot );
+        else
+            DeltaSnapshotCodec::WriteChanges( bitStream, snapshot, connection.baselines[( sequence - distance ) % maxBaselines].snapshot );
+
+        Baseline& sent = connection.baselines[sequence % maxBaselines];
+        sent.snapshot = snapshot;
+        sent.sequence = sequence;
+        sent.sendReceipt = 0;
+        sent.isAcknowledged = false;
+        return sequence;
+    }
+
+    /// Identify the message the snapshot \a sequence went out in, so its ID_SND_RECEIPT_ACKED can be matched
+    void SetSendReceipt( RakNetGUID guid, uint32_t sequence, uint32_t sendReceipt )
+    {
+        Connection& connection = GetConnection( guid );
+        Baseline& baseline = connection.baselines[sequence % maxBaselines];
+        if( baseline.sequence == sequence )
+            baseline.sendReceipt = sendReceipt;
+    }
+
+    /// Write \a snapshot after \a messageId and send it to \a guid with UNRELIABLE_WITH_ACK_RECEIPT
+    /// \return The send receipt, or 0 if it could not be sent
+    uint32_t Send( const templateType& snapshot, RakPeerInterface* peer, RakNetGUID guid, MessageID messageId, PacketPriority priority = HIGH_PRIORITY, char orderingChannel = 0 )
+    {
+        BitStream bitStream;
+        bitStream.Write( messageId );
+        uint32_t sequence = Write( snapshot, guid, &bitStream );
+        uint32_t sendReceipt = peer->Send( &bitStream, priority, UNRELIABLE_WITH_ACK_RECEIPT, orderingChannel, guid, false );
+        SetSendReceipt( guid, sequence, sendReceipt );
+        return sendReceipt;
+    }
+
+    /// Pass packets from RakPeerInterface::Receive() here to have their snapshots acknowledged
+    /// \return true if \a packet was the ID_SND_RECEIPT_ACKED of a snapshot. Other packets, including other receipts, are left to the caller.
+    bool OnReceive( const Packet* packet )
+    {
+        if( packet->length < 1 + sizeof( uint32_t ) || packet->data[0] != ID_SND_RECEIPT_ACKED )
+            return false;
+
+        // Written in host order by ReliabilityLayer
+        uint32_t sendReceipt;
+        memcpy( &sendReceipt, packet->data + 1, sizeof( sendReceipt ) );
+        return OnAcknowledged( packet->guid, sendReceipt );
+    }
+
+    /// Mark the snapshot sent with \a sendReceipt as received by \a guid
+    /// \return false if no snapshot still kept for \a guid went out with that receipt
+    bool OnAcknowledged( RakNetGUID guid, uint32_t sendReceipt )
+    {
+        auto it = connections.find( guid );
+        if( it == connections.end() || sendReceipt == 0 )
+            return false;
+
+        Connection& connection = it->second;
+        for( Baseline& baseline : connection.baselines )
+        {
+            if( baseline.sendReceipt != sendReceipt )
+                continue;
+
+            baseline.isAcknowledged = true;
+            if( connection.hasAcknowledged == false || (int32_t)( baseline.sequence - connection.newestAcknowledged ) > 0 )
+            {
+                connection.newestAcknowledged = baseline.sequence;
+                connection.hasAcknowledged = true;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /// Forget \a guid, for example on ID_DISCONNECTION_NOTIFICATION. Its next snapshot is written in full.
+    void RemoveConnection( RakNetGUID guid )
+    {
+        connections.erase( guid );
+    }
+
+    void Clear( void )
+    {
+        connections.clear();
+    }
+
+protected:
+    struct Baseline
+    {
+        templateType snapshot;
+        uint32_t sequence;
+        uint32_t sendReceipt;
+        bool isAcknowledged;
+    };
+
+    struct Connection
+    {
+        // Indexed by sequence % maxBaselines
+        std::vector<Baseline> baselines;
+        uint32_t nextSequence;
+        uint32_t newestAcknowledged;
+        bool hasAcknowledged;
+    };
+
+    Connection& GetConnection( RakNetGUID guid )
+    {
+        auto inserted = connections.emplace( guid, Connection() );
+        Connection& connection = inserted.first->second;
+        if( inserted.second )
+        {
+            connection.baselines.resize( maxBaselines );
+            for( Baseline& baseline : connection.baselines )
+            {
+                baseline.sequence = 0;
+                baseline.sendReceipt = 0;
+                baseline.isAcknowledged = false;
+            }
+            connection.nextSequence = 0;
+            connection.newestAcknowledged = 0;
+            connection.hasAcknowledged = false;
+        }
+        return connection;
+    }
+
+    std::unordered_map<RakNetGUID, Connection> connections;
+    unsigned int maxBaselines;
+};
+
+/// \brief Reads the snapshots a DeltaSnapshotSender sends to one system.
+/// \details Keeps the last \a maxBaselines snapshots received, which the deltas refer to.
+template<class templateType>
+class DeltaSnapshotReceiver
+{
+public:
+    static_assert( IsSerializable<templateType>::value, "DeltaSnapshotReceiver needs a type declared with RAKNET_SERIALIZABLE" );
+
+    /// \param[in] maxBaselines How many received snapshots to keep. Must match the DeltaSnapshotSender.
+    DeltaSnapshotReceiver( unsigned int maxBaselines = 32 )
+    : baselines( maxBaselines > 0 ? maxBaselines : 1 )
+    {
+        Clear();
+    }
+
+    /// Read a snapshot written by DeltaSnapshotSender::Write()
+    /// \param[out] snapshot The snapshot
+    /// \param[out] sequence If not 0, the sequence number of the snapshot. Snapshots may arrive out of order, so compare it to drop stale ones.
+    /// \return false if the data is malformed, or refers to a baseline that is no longer kept
+    bool Read( BitStream* bitStream, templateType* snapshot, uint32_t* sequence = 0 )
+    {
+        uint32_t snapshotSequence, distance;
+        if( bitStream->ReadVarInt( snapshotSequence ) == false || bitStream->ReadVarInt( distance ) == false )
+            return false;
+
+        if( distance == 0 )
+        {
+            if( bitStream->Read( *snapshot ) == false )
+                return false;
+        }
+        else
+        {
+            const Baseline& baseline = baselines[( snapshotSequence - distance ) % baselines.size()];
+            if( baseline.isUsed == false || baseline.sequence != snapshotSequence - distance )
+                return false;
+            *snapshot = baseline.snapshot;
+            if( DeltaSnapshotCodec::ReadChanges( bitStream, *snapshot ) == false )
+                return false;
+        }
+
+        // Out of order arrivals must not replace newer snapshots, which later deltas may refer to
+        Baseline& received = baselines[snapshotSequence % baselines.size()];
+        if( received.isUsed == false || (int32_t)( snapshotSequence - received.sequence ) > 0 )
+        {
+            received.snapshot = *snapshot;
+            received.sequence = snapshotSequence;
+            received.isUsed = true;
+        }
+
+        if( sequence )
+            *sequence = snapshotSequence;
+        return true;
+    }
+
+    /// Forget all snapshots, for example when reconnecting
+    void Clear( void )
+    {
+        for( Baseline& baseline : baselines )
+        {
+            baseline.sequence = 0;
+            baseline.isUsed = false;
+        }
+    }
+
+protected:
+    struct Baseline
+    {
+        templateType snapshot;
+        uint32_t sequence;
+        bool isUsed;
+    };
+
+    // Indexed by sequence % maxBaselines
+    std::vector<Baseline> baselines;
+};
+
+} // namespace RakNet
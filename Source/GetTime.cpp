@@ -16,32 +16,32 @@ using namespace std::chrono;
 
 namespace RakNet {
 
-RakNet::Time RakNet::GetTime()
+RakNet::Time GetTime()
 {
     auto now = high_resolution_clock::now();
     return (RakNet::Time)duration_cast<milliseconds>( now.time_since_epoch() ).count();
 }
 
-RakNet::TimeMS RakNet::GetTimeMS()
+RakNet::TimeMS GetTimeMS()
 {
     auto now = high_resolution_clock::now();
     return (RakNet::TimeMS)duration_cast<milliseconds>( now.time_since_epoch() ).count();
 }
 
-RakNet::TimeUS RakNet::GetTimeUS()
+RakNet::TimeUS GetTimeUS()
 {
     auto now = high_resolution_clock::now();
     return (RakNet::TimeUS)duration_cast<microseconds>( now.time_since_epoch() ).count();
 }
 
-bool RakNet::GreaterThan( RakNet::Time a, RakNet::Time b )
+bool GreaterThan( RakNet::Time a, RakNet::Time b )
 {
     // a > b?
     const RakNet::Time halfSpan = ( RakNet::Time )( ( ( RakNet::Time )(const RakNet::Time)-1 ) / (RakNet::Time)2 );
     return b != a && b - a > halfSpan;
 }
 
-bool RakNet::LessThan( RakNet::Time a, RakNet::Time b )
+bool LessThan( RakNet::Time a, RakNet::Time b )
 {
     // a < b?
     const RakNet::Time halfSpan = ( ( RakNet::Time )(const RakNet::Time)-1 ) / (RakNet::Time)2;
@@ -61,6 +61,10 @@ struct InternalPacketFixedSizeTransmissionHeader
     BitSize_t dataBitLength;
     ///What type of reliability algorithm to use with this packet
     PacketReliability reliability;
+    ///If the data was compressed against the connection's CompressionDictionary
+    bool isCompressed;
+    ///If isCompressed, how many bits of the last byte of the uncompressed data were not used
+    unsigned char compressedPaddingBits;
     // Not endian safe
     // unsigned char priority : 3;
     // unsigned char reliability : 5;
@@ -0,0 +1,268 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "LZCompressor.h"
+
+#include <string.h>
+
+namespace RakNet {
+
+static const unsigned int LZ_MAX_OFFSET = 65535;
+
+static inline uint32_t Read32( const unsigned char* p )
+{
+    uint32_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return v;
+}
+
+static inline uint32_t HashSequence( uint32_t sequence )
+{
+    return ( sequence * 2654435761U ) >> ( 32 - LZ_HASH_BITS );
+}
+
+// Writes the continuation bytes of a length whose nibble was 15
+static inline bool WriteLength( unsigned char*& op, const unsigned char* oend, unsigned int length )
+{
+    while( length >= 255 )
+    {
+        if( op >= oend )
+            return false;
+        *op++ = 255;
+        length -= 255;
+    }
+    if( op >= oend )
+        return false;
+    *op++ = (unsigned char)length;
+    return true;
+}
+
+static inline bool ReadLength( const unsigned char*& ip, const unsigned char* iend, unsigned int& length )
+{
+    unsigned char b;
+    do
+    {
+        if( ip >= iend )
+            return false;
+        b = *ip++;
+        length += b;
+    } while( b == 255 );
+    return true;
+}
+
+// Writes one token, its literals and, if matchLength is not 0, the match
+static bool WriteSequence( unsigned char*& op, const unsigned char* oend, const unsigned char* literals, unsigned int literalLength, unsigned int offset, unsigned int matchLength )
+{
+    if( op >= oend )
+        return false;
+    unsigned char* token = op++;
+    unsigned int matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+
+    *token = (unsigned char)( ( literalLength < 15 ? literalLength : 15 ) << 4 );
+    if( literalLength >= 15 && WriteLength( op, oend, literalLength - 15 ) == false )
+        return false;
+    if( (unsigned int)( oend - op ) < literalLength )
+        return false;
+    memcpy( op, literals, literalLength );
+    op += literalLength;
+
+    if( matchLength == 0 )
+        return true;
+
+    if( oend - op < 2 )
+        return false;
+    *op++ = (unsigned char)( offset );
+    *op++ = (unsigned char)( offset >> 8 );
+    *token |= (unsigned char)( matchCode < 15 ? matchCode : 15 );
+    if( matchCode >= 15 && WriteLength( op, oend, matchCode - 15 ) == false )
+        return false;
+    return true;
+}
+
+unsigned int LZCompressBound( unsigned int inputLength )
+{
+    // Incompressible input is one literal run: a token, its length bytes and the literals
+    return inputLength + inputLength / 255 + 16;
+}
+
+// Compress input, with back references allowed into the dictionary as if it came directly before the input.
+// hashTable holds positions in the dictionary followed by the input, plus one, and is modified.
+static unsigned int CompressBlock( const unsigned char* dictionary, unsigned int dictionaryLength, uint16_t* hashTable, const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity )
+{
+    const unsigned char* ip = input;
+    const unsigned char* anchor = input;
+    const unsigned char* const iend = input + inputLength;
+    unsigned char* op = output;
+    const unsigned char* const oend = output + outputCapacity;
+
+    if( inputLength >= LZ_MIN_MATCH )
+    {
+        const unsigned char* const matchLimit = iend - LZ_MIN_MATCH;
+        while( ip <= matchLimit )
+        {
+            uint32_t sequence = Read32( ip );
+            uint32_t h = HashSequence( sequence );
+            unsigned int candidate = hashTable[h];
+            unsigned int position = dictionaryLength + (unsigned int)( ip - input );
+            hashTable[h] = (uint16_t)( position + 1 );
+
+            if( candidate != 0 && position - ( candidate - 1 ) <= LZ_MAX_OFFSET )
+            {
+                unsigned int candidatePosition = candidate - 1;
+                unsigned int offset = position - candidatePosition;
+                const unsigned char* ref;
+                const unsigned char* refEnd;
+                if( candidatePosition < dictionaryLength )
+                {
+                    // Matches in the dictionary stop at its end
+                    ref = dictionary + candidatePosition;
+                    refEnd = dictionary + dictionaryLength;
+                }
+                else
+                {
+                    ref = input + ( candidatePosition - dictionaryLength );
+                    refEnd = iend;
+                }
+
+                if( refEnd - ref >= (int)LZ_MIN_MATCH && Read32( ref ) == sequence )
+                {
+                    unsigned int matchLength = LZ_MIN_MATCH;
+                    while( ip + matchLength < iend && ref + matchLength < refEnd && ref[matchLength] == ip[matchLength] )
+                        matchLength++;
+
+                    if( WriteSequence( op, oend, anchor, (unsigned int)( ip - anchor ), offset, matchLength ) == false )
+                        return 0;
+
+                    ip += matchLength;
+                    anchor = ip;
+                    continue;
+                }
+            }
+
+            // Step faster through data that is not matching
+            ip += 1 + ( ( ip - anchor ) >> 5 );
+        }
+    }
+
+    if( WriteSequence( op, oend, anchor, (unsigned int)( iend - anchor ), 0, 0 ) == false )
+        return 0;
+
+    return (unsigned int)( op - output );
+}
+
+unsigned int LZCompress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity )
+{
+    if( inputLength > LZ_MAX_INPUT_LENGTH )
+        return 0;
+
+    uint16_t hashTable[LZ_HASH_TABLE_SIZE];
+    memset( hashTable, 0, sizeof( hashTable ) );
+    return CompressBlock( 0, 0, hashTable, input, inputLength, output, outputCapacity );
+}
+
+void LZInitDictionary( LZDictionary* dictionary, const unsigned char* data, unsigned int length )
+{
+    if( length > LZ_MAX_DICTIONARY_LENGTH )
+    {
+        // Only the end is used, because that is what is closest to the input
+        data += length - LZ_MAX_DICTIONARY_LENGTH;
+        length = LZ_MAX_DICTIONARY_LENGTH;
+    }
+
+    dictionary->data = data;
+    dictionary->length = length;
+    memset( dictionary->hashTable, 0, sizeof( dictionary->hashTable ) );
+    for( unsigned int position = 0; position + LZ_MIN_MATCH <= length; position++ )
+        dictionary->hashTable[HashSequence( Read32( data + position ) )] = (uint16_t)( position + 1 );
+}
+
+unsigned int LZCompressWithDictionary( const LZDictionary* dictionary, const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity )
+{
+    if( inputLength > LZ_MAX_INPUT_LENGTH - dictionary->length )
+        return 0;
+
+    uint16_t hashTable[LZ_HASH_TABLE_SIZE];
+    memcpy( hashTable, dictionary->hashTable, sizeof( hashTable ) );
+    return CompressBlock( dictionary->data, dictionary->length, hashTable, input, inputLength, output, outputCapacity );
+}
+
+bool LZDecompress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity, unsigned int* outputLength )
+{
+    return LZDecompressWithDictionary( 0, 0, input, inputLength, output, outputCapacity, outputLength );
+}
+
+bool LZDecompressWithDictionary( const unsigned char* dictionary, unsigned int dictionaryLength, const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity, unsigned int* outputLength )
+{
+    const unsigned char* ip = input;
+    const unsigned char* const iend = input + inputLength;
+    unsigned char* op = output;
+    unsigned char* const oend = output + outputCapacity;
+
+    // Every stream ends with a token that has only literals, so running out of input before it means it was truncated
+    for( ;; )
+    {
+        if( ip == iend )
+            return false;
+        unsigned char token = *ip++;
+
+        unsigned int literalLength = token >> 4;
+        if( literalLength == 15 && ReadLength( ip, iend, literalLength ) == false )
+            return false;
+        if( (unsigned int)( iend - ip ) < literalLength || (unsigned int)( oend - op ) < literalLength )
+            return false;
+        memcpy( op, ip, literalLength );
+        ip += literalLength;
+        op += literalLength;
+
+        // The last sequence has no match
+        if( ip == iend )
+            break;
+
+        if( iend - ip < 2 )
+            return false;
+        unsigned int offset = (unsigned int)ip[0] | ( (unsigned int)ip[1] << 8 );
+        ip += 2;
+        unsigned int matchLength = token & 15;
+        if( matchLength == 15 && ReadLength( ip, iend, matchLength ) == false )
+            return false;
+        matchLength += LZ_MIN_MATCH;
+
+        if( offset == 0 || offset > (unsigned int)( op - output ) + dictionaryLength || (unsigned int)( oend - op ) < matchLength )
+            return false;
+
+        if( offset > (unsigned int)( op - output ) )
+        {
+            // The match starts in the dictionary. Copy that part, the rest continues at the start of the output
+            unsigned int fromDictionary = offset - (unsigned int)( op - output );
+            unsigned int length = fromDictionary < matchLength ? fromDictionary : matchLength;
+            memcpy( op, dictionary + dictionaryLength - fromDictionary, length );
+            op += length;
+            matchLength -= length;
+        }
+
+        const unsigned char* match = op - offset;
+        if( offset >= matchLength )
+        {
+            memcpy( op, match, matchLength );
+            op += matchLength;
+        }
+        else
+        {
+            // Overlapping copy repeats the last offset bytes
+            for( unsigned int i = 0; i < matchLength; i++ )
+                *op++ = *match++;
+        }
+    }
+
+    *outputLength = (unsigned int)( op - output );
+    return true;
+}
+
+} // namespace RakNet
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Small, fast LZ77 byte compressor, used to compress datagram payloads.
+///
+/// The format is a sequence of tokens. Each token holds a literal run length in its high nibble and a match length minus
+/// LZ_MIN_MATCH in its low nibble. A nibble of 15 is continued by bytes of 255 and one final byte below 255.
+/// The literals follow the token, then a 2 byte little endian match offset.
+/// The last token has only literals and ends at the end of the input.
+///
+
+#pragma once
+
+#include <stdint.h>
+
+namespace RakNet {
+
+/// Shortest match that is encoded as a back reference
+static const unsigned int LZ_MIN_MATCH = 4;
+
+/// Largest input LZCompress() accepts, so offsets always fit in 16 bits
+static const unsigned int LZ_MAX_INPUT_LENGTH = 65535;
+
+/// Largest dictionary LZInitDictionary() uses. Input compressed against a dictionary must fit in LZ_MAX_INPUT_LENGTH together with it.
+static const unsigned int LZ_MAX_DICTIONARY_LENGTH = 32768;
+
+/// Size of the table of recent positions used to find matches
+static const unsigned int LZ_HASH_BITS = 11;
+static const unsigned int LZ_HASH_TABLE_SIZE = 1 << LZ_HASH_BITS;
+
+/// Data that small inputs are compressed against, so they can refer to sequences that are common to all of them.
+/// Prepared once with LZInitDictionary(). \a data must stay valid for as long as the dictionary is used.
+struct LZDictionary
+{
+    const unsigned char* data;
+    unsigned int length;
+    uint16_t hashTable[LZ_HASH_TABLE_SIZE];
+};
+
+/// \return The worst case output size of LZCompress() for \a inputLength bytes of input
+unsigned int LZCompressBound( unsigned int inputLength );
+
+/// Compress \a input into \a output.
+/// \param[in] input The data to compress
+/// \param[in] inputLength The length of \a input in bytes. Must be at most LZ_MAX_INPUT_LENGTH
+/// \param[out] output Where to write the compressed data
+/// \param[in] outputCapacity The size of \a output. Compression stops early if the result would not fit.
+/// \return The number of bytes written to \a output, or 0 if the result did not fit in \a outputCapacity
+unsigned int LZCompress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity );
+
+/// Prepare \a dictionary for LZCompressWithDictionary(). Only the last LZ_MAX_DICTIONARY_LENGTH bytes of \a data are used.
+void LZInitDictionary( LZDictionary* dictionary, const unsigned char* data, unsigned int length );
+
+/// Same as LZCompress(), but matches may also refer to \a dictionary, as if it came directly before \a input.
+/// Decompress with LZDecompressWithDictionary() and the same dictionary data.
+unsigned int LZCompressWithDictionary( const LZDictionary* dictionary, const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity );
+
+/// Decompress data written by LZCompress(). Malformed input is rejected, never read or written out of bounds.
+/// \param[in] input The compressed data
+/// \param[in] inputLength The length of \a input in bytes
+/// \param[out] output Where to write the decompressed data
+/// \param[in] outputCapacity The size of \a output
+/// \param[out] outputLength The number of bytes written to \a output
+/// \return false if \a input is malformed or decompresses to more than \a outputCapacity bytes
+bool LZDecompress( const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity, unsigned int* outputLength );
+
+/// Decompress data written by LZCompressWithDictionary()
+/// \param[in] dictionary The data the dictionary was made from, limited to the last LZ_MAX_DICTIONARY_LENGTH bytes like LZInitDictionary() does
+/// \param[in] dictionaryLength The length of \a dictionary in bytes
+/// \sa LZDecompress()
+bool LZDecompressWithDictionary( const unsigned char* dictionary, unsigned int dictionaryLength, const unsigned char* input, unsigned int inputLength, unsigned char* output, unsigned int outputCapacity, unsigned int* outputLength );
+
+} // namespace RakNet
@@ -11,6 +11,8 @@
 #pragma once
 
 #if( defined( __GNUC__ ) || defined( __GCCXML__ ) || defined( __S3E__ ) ) && !defined( _WIN32 )
+#include <stddef.h>
+
 #ifndef _stricmp
 int _stricmp( const char* s1, const char* s2 );
 #endif
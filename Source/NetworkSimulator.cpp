@@ -0,0 +1,299 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "NetworkSimulator.h"
+
+#include "GetTime.h"
+#include "RakPeerInterface.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace RakNet {
+
+NetworkSimulatorProfile::NetworkSimulatorProfile()
+{
+    goodToBadProbability = 0.0f;
+    badToGoodProbability = 1.0f;
+    goodLossProbability = 0.0f;
+    badLossProbability = 0.0f;
+    bandwidthBytesPerSecond = 0;
+    burstBytes = 0;
+    queueBytes = 0;
+    latencyMS = 0;
+    latencyVarianceMS = 0;
+    reorderProbability = 0.0f;
+    reorderWindowMS = 0;
+    duplicateProbability = 0.0f;
+}
+
+bool NetworkSimulatorProfile::GetNamedProfile( const char* name, NetworkSimulatorProfile* profile )
+{
+    NetworkSimulatorProfile p;
+    if( strcmp( name, "lte" ) == 0 )
+    {
+        // Mobile link: moderate latency with scheduling jitter, short fades, deep buffers at about 20 Mbit/s
+        p.goodToBadProbability = 0.01f;
+        p.badToGoodProbability = 0.3f;
+        p.goodLossProbability = 0.002f;
+        p.badLossProbability = 0.3f;
+        p.bandwidthBytesPerSecond = 2500000;
+        p.burstBytes = 32 * 1024;
+        p.queueBytes = 256 * 1024;
+        p.latencyMS = 40;
+        p.latencyVarianceMS = 15;
+        p.reorderProbability = 0.01f;
+        p.reorderWindowMS = 20;
+        p.duplicateProbability = 0.001f;
+    }
+    else if( strcmp( name, "wifi-congested" ) == 0 )
+    {
+        // Shared access point: contention causes long loss bursts, jitter and retransmitted duplicates at about 4 Mbit/s
+        p.goodToBadProbability = 0.05f;
+        p.badToGoodProbability = 0.25f;
+        p.goodLossProbability = 0.01f;
+        p.badLossProbability = 0.5f;
+        p.bandwidthBytesPerSecond = 500000;
+        p.burstBytes = 8 * 1024;
+        p.queueBytes = 64 * 1024;
+        p.latencyMS = 5;
+        p.latencyVarianceMS = 20;
+        p.reorderProbability = 0.02f;
+        p.reorderWindowMS = 10;
+        p.duplicateProbability = 0.01f;
+    }
+    else if( strcmp( name, "transatlantic" ) == 0 )
+    {
+        // Long wired path: high, stable latency, rare loss, about 100 Mbit/s
+        p.goodToBadProbability = 0.001f;
+        p.badToGoodProbability = 0.5f;
+        p.goodLossProbability = 0.0005f;
+        p.badLossProbability = 0.2f;
+        p.bandwidthBytesPerSecond = 12500000;
+        p.burstBytes = 64 * 1024;
+        p.queueBytes = 1024 * 1024;
+        p.latencyMS = 40;
+        p.latencyVarianceMS = 2;
+        p.reorderProbability = 0.001f;
+        p.reorderWindowMS = 5;
+        p.duplicateProbability = 0.0f;
+    }
+    else
+    {
+        return false;
+    }
+
+    *profile = p;
+    return true;
+}
+
+NetworkSimulator::NetworkSimulator( const NetworkSimulatorProfile& _profile, unsigned int seed )
+: profile( _profile )
+{
+    rnr.SeedMT( seed );
+    socket = 0;
+    nextOrder = 0;
+    isInBadState = false;
+    tokens = (double)profile.burstBytes;
+    lastTokenTime = 0;
+    lastInOrderDeliveryTime = 0;
+    memset( &statistics, 0, sizeof( statistics ) );
+}
+
+NetworkSimulator::~NetworkSimulator()
+{
+    // The socket may already be gone, so do not detach from it here
+}
+
+bool NetworkSimulator::Attach( RakPeerInterface* peer )
+{
+    std::vector<RakNetSocket2*> sockets;
+    peer->GetSockets( sockets );
+    if( sockets.empty() || sockets[0]->IsBerkleySocket() == false )
+        return false;
+
+    std::lock_guard<std::mutex> guard( simulatorMutex );
+    socket = (RNS2_Berkley*)sockets[0];
+    socket->SetSocketLayerOverride( this );
+    return true;
+}
+
+void NetworkSimulator::Detach( void )
+{
+    std::lock_guard<std::mutex> guard( simulatorMutex );
+    if( socket )
+        socket->SetSocketLayerOverride( 0 );
+    socket = 0;
+    pending = decltype( pending )();
+}
+
+void NetworkSimulator::SetProfile( const NetworkSimulatorProfile& _profile )
+{
+    std::lock_guard<std::mutex> guard( simulatorMutex );
+    profile = _profile;
+    tokens = std::min( tokens, (double)profile.burstBytes );
+}
+
+void NetworkSimulator::Send( const char* data, int length, const SystemAddress& systemAddress, RakNet::TimeUS time )
+{
+    std::lock_guard<std::mutex> guard( simulatorMutex );
+
+    statistics.datagramsSent++;
+
+    // Draw the same numbers for every datagram, whatever happens to it, so each datagram meets the same fate for a given seed
+    float stateDraw = rnr.FrandomMT();
+    float lossDraw = rnr.FrandomMT();
+    float latencyDraw = rnr.FrandomMT();
+    float reorderDraw = rnr.FrandomMT();
+    float reorderDelayDraw = rnr.FrandomMT();
+    float duplicateDraw = rnr.FrandomMT();
+    float duplicateLatencyDraw = rnr.FrandomMT();
+
+    if( isInBadState )
+        isInBadState = stateDraw >= profile.badToGoodProbability;
+    else
+        isInBadState = stateDraw < profile.goodToBadProbability;
+
+    if( lossDraw < ( isInBadState ? profile.badLossProbability : profile.goodLossProbability ) )
+    {
+        statistics.datagramsLost++;
+        return;
+    }
+
+    // The bottleneck. Tokens below zero are bytes still queued, which delay this datagram until they drain.
+    RakNet::TimeUS queueDelay = 0;
+    if( profile.bandwidthBytesPerSecond > 0 )
+    {
+        if( time > lastTokenTime )
+        {
+            tokens = std::min( (double)profile.burstBytes, tokens + (double)( time - lastTokenTime ) * profile.bandwidthBytesPerSecond / 1000000.0 );
+            lastTokenTime = time;
+        }
+
+        if( (double)length - tokens > (double)profile.queueBytes )
+        {
+            statistics.datagramsQueueDropped++;
+            return;
+        }
+
+        tokens -= length;
+        if( tokens < 0.0 )
+            queueDelay = ( RakNet::TimeUS )( -tokens * 1000000.0 / profile.bandwidthBytesPerSecond );
+        statistics.maxQueueDelayUS = std::max( statistics.maxQueueDelayUS, queueDelay );
+    }
+
+    const RakNet::TimeUS latency = (RakNet::TimeUS)profile.latencyMS * 1000;
+    const RakNet::TimeUS latencyVariance = (RakNet::TimeUS)profile.latencyVarianceMS * 1000;
+    RakNet::TimeUS deliveryTime = time + queueDelay + latency + ( RakNet::TimeUS )( latencyDraw * latencyVariance );
+
+    if( profile.reorderWindowMS > 0 && reorderDraw < profile.reorderProbability )
+    {
+        // Held back without holding back the datagrams behind it
+        statistics.datagramsReordered++;
+        deliveryTime += 1 + ( RakNet::TimeUS )( reorderDelayDraw * profile.reorderWindowMS * 1000 );
+    }
+    else
+    {
+        deliveryTime = std::max( deliveryTime, lastInOrderDeliveryTime );
+        lastInOrderDeliveryTime = deliveryTime;
+    }
+
+    Schedule( data, length, systemAddress, deliveryTime );
+
+    if( duplicateDraw < profile.duplicateProbability )
+    {
+        statistics.datagramsDuplicated++;
+        Schedule( data, length, systemAddress, deliveryTime + ( RakNet::TimeUS )( duplicateLatencyDraw * latencyVariance ) );
+    }
+}
+
+void NetworkSimulator::Schedule( const char* data, int length, const SystemAddress& systemAddress, RakNet::TimeUS deliveryTime )
+{
+    PendingDatagram datagram;
+    datagram.deliveryTime = deliveryTime;
+    datagram.order = nextOrder++;
+    datagram.systemAddress = systemAddress;
+    datagram.data.assign( data, data + length );
+    pending.push( std::move( datagram ) );
+}
+
+void NetworkSimulator::Update( RakNet::TimeUS time )
+{
+    // Deliver outside the lock, so sending does not block the thread that sends more
+    std::vector<PendingDatagram> due;
+    {
+        std::lock_guard<std::mutex> guard( simulatorMutex );
+        while( !pending.empty() && pending.top().deliveryTime <= time )
+        {
+            due.push_back( pending.top() );
+            pending.pop();
+        }
+        statistics.datagramsDelivered += due.size();
+    }
+
+    for( const PendingDatagram& datagram : due )
+        Deliver( datagram.data.data(), (int)datagram.data.size(), datagram.systemAddress );
+}
+
+unsigned int NetworkSimulator::GetPendingCount( void ) const
+{
+    std::lock_guard<std::mutex> guard( simulatorMutex );
+    return (unsigned int)pending.size();
+}
+
+void NetworkSimulator::GetStatistics( NetworkSimulatorStatistics* _statistics ) const
+{
+    std::lock_guard<std::mutex> guard( simulatorMutex );
+    *_statistics = statistics;
+}
+
+void NetworkSimulator::Deliver( const char* data, int length, const SystemAddress& systemAddress )
+{
+    RNS2_Berkley* s;
+    {
+        std::lock_guard<std::mutex> guard( simulatorMutex );
+        s = socket;
+    }
+    if( s == 0 )
+        return;
+
+    RNS2_SendParameters bsp;
+    bsp.data = (char*)data;
+    bsp.length = length;
+    bsp.systemAddress = systemAddress;
+    s->SendWithoutOverride( &bsp, _FILE_AND_LINE_ );
+}
+
+int NetworkSimulator::RakNetSendTo( const char* data, int length, const SystemAddress& systemAddress )
+{
+    Send( data, length, systemAddress, RakNet::GetTimeUS() );
+    return length;
+}
+
+int NetworkSimulator::RakNetRecvFrom( char dataOut[MAXIMUM_MTU_SIZE], SystemAddress* senderOut, bool calledFromMainThread )
+{
+    (void)dataOut;
+    (void)senderOut;
+
+    // Called every update cycle of the attached peer, which is when delayed datagrams go out
+    if( calledFromMainThread )
+        Update( RakNet::GetTimeUS() );
+
+    // Incoming datagrams come from the socket as usual
+    return 0;
+}
+
+bool NetworkSimulator::IsOverrideAddress( const SystemAddress& systemAddress ) const
+{
+    (void)systemAddress;
+    return false;
+}
+
+} // namespace RakNet
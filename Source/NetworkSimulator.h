@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Simulates burst loss, latency, reordering, duplication and a bandwidth limited link on the datagrams a RakPeer sends.
+///
+
+#pragma once
+
+#include "Export.h"
+#include "RakNetSocket2.h"
+#include "RakNetTime.h"
+#include "RakNetTypes.h"
+#include "Rand.h"
+
+#include <mutex>
+#include <queue>
+#include <stdint.h>
+#include <vector>
+
+namespace RakNet {
+
+class RakPeerInterface;
+
+/// The conditions NetworkSimulator puts outgoing datagrams through, in the order they apply
+struct RAK_DLL_EXPORT NetworkSimulatorProfile
+{
+    NetworkSimulatorProfile();
+
+    /// Gilbert-Elliott loss. Before each datagram the link moves from the good to the bad state with goodToBadProbability,
+    /// and back with badToGoodProbability. The datagram is then lost with the loss probability of the current state.
+    float goodToBadProbability, badToGoodProbability;
+    float goodLossProbability, badLossProbability;
+
+    /// Bytes per second the bottleneck link carries, 0 for unlimited. A token bucket of burstBytes lets short bursts through at once.
+    uint32_t bandwidthBytesPerSecond, burstBytes;
+    /// Bytes that may wait for the bottleneck. Datagrams wait longer the fuller the queue is, and are dropped when it is full.
+    uint32_t queueBytes;
+
+    /// One way latency added to every datagram, plus up to latencyVarianceMS. Datagrams keep their order unless reordered below.
+    RakNet::TimeMS latencyMS, latencyVarianceMS;
+
+    /// Probability that a datagram is held back by up to reorderWindowMS, so that the datagrams sent after it in that window overtake it
+    float reorderProbability;
+    RakNet::TimeMS reorderWindowMS;
+
+    /// Probability that a datagram is delivered twice
+    float duplicateProbability;
+
+    /// Get one of the named profiles: "lte", "wifi-congested" or "transatlantic"
+    /// \return false if \a name is not one of them
+    static bool GetNamedProfile( const char* name, NetworkSimulatorProfile* profile );
+};
+
+/// What NetworkSimulator did to the datagrams it was given
+struct RAK_DLL_EXPORT NetworkSimulatorStatistics
+{
+    uint64_t datagramsSent;
+    uint64_t datagramsDelivered;
+    /// Lost to the Gilbert-Elliott model
+    uint64_t datagramsLost;
+    /// Dropped because the bottleneck queue was full
+    uint64_t datagramsQueueDropped;
+    uint64_t datagramsDuplicated;
+    uint64_t datagramsReordered;
+    /// The longest a datagram waited in the bottleneck queue
+    RakNet::TimeUS maxQueueDelayUS;
+};
+
+/// Puts the datagrams a RakPeer sends through the conditions of a NetworkSimulatorProfile before they reach the socket.
+/// Unlike RakPeerInterface::ApplyNetworkSimulator() this works in release builds, and every decision comes from a RakNetRandom with a fixed seed,
+/// so a given sequence of datagrams meets the same fate on every run.
+/// Only outgoing datagrams are affected. Attach a simulator to each system to affect both directions.
+/// Delayed datagrams go out from the update thread of the RakPeer, so delays are accurate to about 10 milliseconds.
+class RAK_DLL_EXPORT NetworkSimulator : public SocketLayerOverride
+{
+public:
+    /// \param[in] profile The conditions to simulate
+    /// \param[in] seed Seeds every random decision
+    NetworkSimulator( const NetworkSimulatorProfile& profile, unsigned int seed );
+    virtual ~NetworkSimulator();
+
+    /// Start simulating on the first socket of \a peer, which must have been started
+    /// \return false if that socket cannot be overridden
+    bool Attach( RakPeerInterface* peer );
+
+    /// Stop simulating. Datagrams that have not been delivered yet are dropped.
+    void Detach( void );
+
+    /// Change the conditions. Datagrams already in flight keep their delivery times.
+    void SetProfile( const NetworkSimulatorProfile& profile );
+
+    /// Simulate sending a datagram at \a time. Called for every datagram the attached peer sends.
+    void Send( const char* data, int length, const SystemAddress& systemAddress, RakNet::TimeUS time );
+
+    /// Deliver the datagrams due by \a time. Called from the update thread of the attached peer.
+    void Update( RakNet::TimeUS time );
+
+    /// \return How many datagrams are waiting to be delivered
+    unsigned int GetPendingCount( void ) const;
+
+    void GetStatistics( NetworkSimulatorStatistics* statistics ) const;
+
+    // SocketLayerOverride
+    virtual int RakNetSendTo( const char* data, int length, const SystemAddress& systemAddress );
+    virtual int RakNetRecvFrom( char dataOut[MAXIMUM_MTU_SIZE], SystemAddress* senderOut, bool calledFromMainThread );
+    virtual bool IsOverrideAddress( const SystemAddress& systemAddress ) const;
+
+protected:
+    /// Hand a datagram whose time has come to the socket
+    virtual void Deliver( const char* data, int length, const SystemAddress& systemAddress );
+
+    struct PendingDatagram
+    {
+        RakNet::TimeUS deliveryTime;
+        uint64_t order; // Keeps datagrams due at the same time in the order they were sent
+        SystemAddress systemAddress;
+        std::vector<char> data;
+
+        bool operator>( const PendingDatagram& other ) const
+        {
+            return deliveryTime != other.deliveryTime ? deliveryTime > other.deliveryTime : order > other.order;
+        }
+    };
+
+    void Schedule( const char* data, int length, const SystemAddress& systemAddress, RakNet::TimeUS deliveryTime );
+
+    mutable std::mutex simulatorMutex;
+    NetworkSimulatorProfile profile;
+    RakNetRandom rnr;
+    RNS2_Berkley* socket;
+    std::priority_queue<PendingDatagram, std::vector<PendingDatagram>, std::greater<PendingDatagram>> pending;
+    uint64_t nextOrder;
+    bool isInBadState;
+    // Token bucket, negative while datagrams are queued for the bottleneck
+    double tokens;
+    RakNet::TimeUS lastTokenTime;
+    // Delivery time of the last datagram that was not reordered, which later ones may not overtake
+    RakNet::TimeUS lastInOrderDeliveryTime;
+    NetworkSimulatorStatistics statistics;
+};
+
+} // namespace RakNet
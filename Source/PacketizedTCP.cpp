@@ -17,6 +17,7 @@
 #include "RakAlloca.h"
 
 #include <stdint.h>
+#include <string.h>
 
 namespace RakNet {
 
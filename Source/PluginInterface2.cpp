@@ -14,6 +14,8 @@
 #include "RakPeerInterface.h"
 #include "BitStream.h"
 
+#include <string.h>
+
 namespace RakNet {
 
 PluginInterface2::PluginInterface2()
@@ -18,6 +18,7 @@
 #include "RakPeerInterface.h"
 #include "TCPInterface.h"
 #include "BitStream.h"
+#include <string.h>
 
 namespace RakNet {
 
@@ -26,15 +27,6 @@ int MessageFilterStrComp( char* const& key, char* const& data )
     return strcmp( key, data );
 }
 
-int FilterSetComp( const int& key, FilterSet* const& data )
-{
-    if( key < data->filterSetID )
-        return -1;
-    else if( key == data->filterSetID )
-        return 0;
-    else
-        return 1;
-}
 STATIC_FACTORY_DEFINITIONS( MessageFilter, MessageFilter );
 
 MessageFilter::MessageFilter()
@@ -20,6 +20,7 @@
 #include "RakNetTypes.h"
 #include "PluginInterface2.h"
 #include "DS_OrderedList.h"
+#include "DS_FlatHashMap.h"
 #include "Export.h"
 
 #include <string>
@@ -54,9 +55,6 @@ struct FilterSet
     DataStructures::OrderedList<std::string, std::string> allowedRPC4;
 };
 
-/// \internal Has to be public so some of the shittier compilers can use it.
-int RAK_DLL_EXPORT FilterSetComp( const int& key, FilterSet* const& data );
-
 /// \internal Has to be public so some of the shittier compilers can use it.
 struct FilteredSystem
 {
@@ -162,6 +160,7 @@ public:
 
     /// Returns the ID of a filter set, by index
     /// \param[in] An index between 0 and GetFilterSetCount()-1 inclusive
+    /// \note Indices are not in order of ID, and DeleteFilterSet() moves the last filter set into the index of the one deleted
     int GetFilterSetIDByIndex( unsigned index );
 
     /// Delete a FilterSet.  All systems formerly subscribed to this filter are now unrestricted.
@@ -182,7 +181,7 @@ protected:
     FilterSet* GetFilterSetByID( int filterSetID );
     void OnInvalidMessage( FilterSet* filterSet, AddressOrGUID systemAddress, unsigned char messageID );
 
-    DataStructures::OrderedList<int, FilterSet*, FilterSetComp> filterList;
+    DataStructures::FlatHashMap<int, FilterSet*> filterList;
     // Change to guid
     std::unordered_map<AddressOrGUID, FilteredSystem> systemList;
 
@@ -88,15 +88,6 @@ void NatPunchthroughServer::User::LogConnectionAttempts( std::string& rs )
     }
 }
 
-int NatPunchthroughServer::NatPunchthroughUserComp( const RakNetGUID& key, User* const& data )
-{
-    if( key < data->guid )
-        return -1;
-    if( key > data->guid )
-        return 1;
-    return 0;
-}
-
 STATIC_FACTORY_DEFINITIONS( NatPunchthroughServer, NatPunchthroughServer );
 
 NatPunchthroughServer::NatPunchthroughServer()
@@ -113,14 +104,13 @@ NatPunchthroughServer::~NatPunchthroughServer()
 {
     while( users.Size() )
     {
-        User* user = users[0];
+        User* user = users[users.Size() - 1];
         for( ConnectionAttempt* pConnectionAttempt : user->connectionAttempts )
         {
             User* otherUser = pConnectionAttempt->sender == user ? pConnectionAttempt->recipient : pConnectionAttempt->sender;
             otherUser->DeleteConnectionAttempt( pConnectionAttempt );
         }
         RakNet::OP_DELETE( user, _FILE_AND_LINE_ );
-        users[0] = users[users.Size() - 1];
         users.RemoveAtIndex( users.Size() - 1 );
     }
 }
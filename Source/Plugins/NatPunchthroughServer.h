@@ -21,7 +21,7 @@
 #include "Export.h"
 #include "PluginInterface2.h"
 #include "SocketIncludes.h"
-#include "DS_OrderedList.h"
+#include "DS_FlatHashMap.h"
 
 #include <string>
 #include <vector>
@@ -132,11 +132,10 @@ public:
         void LogConnectionAttempts( std::string& rs );
     };
     RakNet::Time lastUpdate;
-    static int NatPunchthroughUserComp( const RakNetGUID& key, User* const& data );
 
 protected:
     void OnNATPunchthroughRequest( Packet* packet );
-    DataStructures::OrderedList<RakNetGUID, User*, NatPunchthroughServer::NatPunchthroughUserComp> users;
+    DataStructures::FlatHashMap<RakNetGUID, User*> users;
 
     void OnGetMostRecentPort( Packet* packet );
     void OnClientReady( Packet* packet );
@@ -19,6 +19,7 @@
 //#include "GetTime.h"
 
 #include <chrono>
+#include <string.h>
 #include <deque>
 #include <thread>
 
@@ -115,14 +116,6 @@ int RPC4::LocalSlotObjectComp( const LocalSlotObject& key, const LocalSlotObject
 
     return 1;
 }
-int RPC4::LocalCallbackComp( const MessageID& key, RPC4::LocalCallback* const& data )
-{
-    if( key < data->messageId )
-        return -1;
-    if( key > data->messageId )
-        return 1;
-    return 0;
-}
 
 RPC4::RPC4()
 {
@@ -200,7 +193,7 @@ void RPC4::RegisterLocalCallback( const char* uniqueID, MessageID messageId )
         lc = RakNet::OP_NEW<LocalCallback>( _FILE_AND_LINE_ );
         lc->messageId = messageId;
         lc->functions.Insert( str, str, false, _FILE_AND_LINE_ );
-        localCallbacks.InsertAtIndex( lc, index, _FILE_AND_LINE_ );
+        localCallbacks.Insert( messageId, lc, true, _FILE_AND_LINE_ );
     }
 }
 
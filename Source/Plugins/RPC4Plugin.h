@@ -22,6 +22,7 @@
 #include "RakNetTypes.h"
 #include "BitStream.h"
 #include "DS_OrderedList.h"
+#include "DS_FlatHashMap.h"
 
 #include <string>
 #include <unordered_map>
@@ -172,7 +173,6 @@ public:
         MessageID messageId;
         DataStructures::OrderedList<std::string, std::string> functions;
     };
-    static int LocalCallbackComp( const MessageID& key, LocalCallback* const& data );
 
     /// \internal
     // Callable object, along with priority to call relative to other objects
@@ -211,7 +211,7 @@ protected:
 
     std::unordered_map<std::string, void ( * )( BitStream*, Packet* )> registeredNonblockingFunctions;
     std::unordered_map<std::string, void ( * )( BitStream*, BitStream*, Packet* )> registeredBlockingFunctions;
-    DataStructures::OrderedList<MessageID, LocalCallback*, RPC4::LocalCallbackComp> localCallbacks;
+    DataStructures::FlatHashMap<MessageID, LocalCallback*> localCallbacks;
 
     BitStream blockingReturnValue;
     bool gotBlockingReturnValue;
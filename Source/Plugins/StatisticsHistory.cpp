@@ -15,21 +15,13 @@
 #include "GetTime.h"
 #include "RakNetStatistics.h"
 #include "RakPeerInterface.h"
+#include "DS_OrderedList.h"
 
 namespace RakNet {
 
 STATIC_FACTORY_DEFINITIONS( StatisticsHistory, StatisticsHistory );
 STATIC_FACTORY_DEFINITIONS( StatisticsHistoryPlugin, StatisticsHistoryPlugin );
 
-int StatisticsHistory::TrackedObjectComp( const uint64_t& key, StatisticsHistory::TrackedObject* const& data )
-{
-    if( key < data->trackedObjectData.objectId )
-        return -1;
-    if( key == data->trackedObjectData.objectId )
-        return 0;
-    return 1;
-}
-
 int TimeAndValueQueueCompAsc( StatisticsHistory::TimeAndValueQueue* const& key, StatisticsHistory::TimeAndValueQueue* const& data )
 {
     if( key->sortValue < data->sortValue )
@@ -71,13 +63,11 @@ void StatisticsHistory::SetDefaultTimeToTrack( Time defaultTimeToTrack ) { timeT
 Time StatisticsHistory::GetDefaultTimeToTrack( void ) const { return timeToTrack; }
 bool StatisticsHistory::AddObject( TrackedObjectData tod )
 {
-    bool objectExists;
-    unsigned int idx = objects.GetIndexFromKey( tod.objectId, &objectExists );
-    if( objectExists )
+    if( objects.HasData( tod.objectId ) )
         return false;
     TrackedObject* to = RakNet::OP_NEW<TrackedObject>( _FILE_AND_LINE_ );
     to->trackedObjectData = tod;
-    objects.InsertAtIndex( to, idx, _FILE_AND_LINE_ );
+    objects.Insert( tod.objectId, to, true, _FILE_AND_LINE_ );
     return true;
 }
 bool StatisticsHistory::RemoveObject( uint64_t objectId, void** userData )
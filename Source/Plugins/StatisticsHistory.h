@@ -19,7 +19,7 @@
 #include "PluginInterface2.h"
 #include "RakMemoryOverride.h"
 #include "RakNetTypes.h"
-#include "DS_OrderedList.h"
+#include "DS_FlatHashMap.h"
 
 #include <float.h>
 #include <stdint.h>
@@ -105,6 +105,7 @@ public:
     Time GetDefaultTimeToTrack( void ) const;
     bool AddObject( TrackedObjectData tod );
     bool RemoveObject( uint64_t objectId, void** userData );
+    /// Moves the last object into index. Indices are not in order of objectId.
     void RemoveObjectAtIndex( unsigned int index );
     void Clear( void );
     unsigned int GetObjectCount( void ) const;
@@ -175,12 +176,6 @@ public:
         SHValueType sortValue;
     };
 
-protected:
-    struct TrackedObject;
-
-public:
-    static int TrackedObjectComp( const uint64_t& key, TrackedObject* const& data );
-
 protected:
     struct TrackedObject
     {
@@ -190,7 +185,7 @@ protected:
         std::unordered_map<std::string, TimeAndValueQueue*> dataQueues;
     };
 
-    DataStructures::OrderedList<uint64_t, TrackedObject*, TrackedObjectComp> objects;
+    DataStructures::FlatHashMap<uint64_t, TrackedObject*> objects;
 
     Time timeToTrack;
 };
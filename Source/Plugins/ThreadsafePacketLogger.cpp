@@ -25,6 +25,7 @@ ThreadsafePacketLogger::~ThreadsafePacketLogger()
     while( ( msg = logMessages.ReadLock() ) != 0 )
     {
         rakFree_Ex( ( *msg ), _FILE_AND_LINE_ );
+        logMessages.ReadUnlock();
     }
 }
 void ThreadsafePacketLogger::Update( void )
@@ -34,6 +35,7 @@ void ThreadsafePacketLogger::Update( void )
     {
         WriteLog( *msg );
         rakFree_Ex( ( *msg ), _FILE_AND_LINE_ );
+        logMessages.ReadUnlock();
     }
 }
 void ThreadsafePacketLogger::AddToLog( const char* str )
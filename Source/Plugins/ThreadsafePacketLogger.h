@@ -18,7 +18,7 @@
 #if _RAKNET_SUPPORT_PacketLogger == 1
 
 #include "Plugins/PacketLogger.h"
-#include "SingleProducerConsumer.h"
+#include "SingleProducerConsumerRing.h"
 
 namespace RakNet {
 
@@ -35,7 +35,7 @@ public:
 protected:
     virtual void AddToLog( const char* str );
 
-    DataStructures::SingleProducerConsumer<char*> logMessages;
+    DataStructures::SingleProducerConsumerRing<char*> logMessages;
 };
 
 } // namespace RakNet
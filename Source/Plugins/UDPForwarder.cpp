@@ -21,6 +21,7 @@
 #include "errno.h"
 
 #include <chrono>
+#include <string.h>
 #include <thread>
 
 #ifndef INVALID_SOCKET
@@ -19,6 +19,7 @@
 #include "Rand.h"
 #include "GetTime.h"
 #include "UDPForwarder.h"
+#include "DS_OrderedList.h"
 
 #include <algorithm>
 
@@ -37,17 +38,17 @@ int UDPProxyCoordinator::ServerWithPingComp( const unsigned short& key, const UD
     return 0;
 }
 
-int UDPProxyCoordinator::ForwardingRequestComp( const SenderAndTargetAddress& key, ForwardingRequest* const& data )
+std::size_t UDPProxyCoordinator::SenderAndTargetAddressHash::operator()( const SenderAndTargetAddress& sata ) const
 {
-    if( key.senderClientAddress < data->sata.senderClientAddress )
-        return -1;
-    if( key.senderClientAddress > data->sata.senderClientAddress )
-        return 1;
-    if( key.targetClientAddress < data->sata.targetClientAddress )
-        return -1;
-    if( key.targetClientAddress > data->sata.targetClientAddress )
-        return 1;
-    return 0;
+    // Not symmetric, as a request and its reverse are different keys
+    std::size_t hash = SystemAddress::ToInteger( sata.senderClientAddress );
+    hash ^= SystemAddress::ToInteger( sata.targetClientAddress ) + 0x9E3779B9 + ( hash << 6 ) + ( hash >> 2 );
+    return hash;
+}
+
+bool UDPProxyCoordinator::SenderAndTargetAddressEqual::operator()( const SenderAndTargetAddress& a, const SenderAndTargetAddress& b ) const
+{
+    return a.senderClientAddress == b.senderClientAddress && a.targetClientAddress == b.targetClientAddress;
 }
 
 STATIC_FACTORY_DEFINITIONS( UDPProxyCoordinator, UDPProxyCoordinator );
@@ -77,8 +78,11 @@ void UDPProxyCoordinator::Update( void )
         {
             fw->OrderRemainingServersToTry();
             fw->timeRequestedPings = 0;
+            // With no server left to try, the request is removed and the last one moved to idx
+            const unsigned int sizeBefore = forwardingRequestList.Size();
             TryNextServer( fw->sata, fw );
-            idx++;
+            if( forwardingRequestList.Size() == sizeBefore )
+                idx++;
         }
         else if( fw->timeoutAfterSuccess != 0 &&
                  curTime > fw->timeoutAfterSuccess )
@@ -137,14 +141,18 @@ void UDPProxyCoordinator::OnClosedConnection( const SystemAddress& systemAddress
     if( it != serverList.end() )
     {
         // For each pending client for this server, choose from remaining servers.
-        for( unsigned int idx2 = 0; idx2 < forwardingRequestList.Size(); idx2++ )
+        unsigned int idx2 = 0;
+        while( idx2 < forwardingRequestList.Size() )
         {
             ForwardingRequest* fw = forwardingRequestList[idx2];
+            const unsigned int sizeBefore = forwardingRequestList.Size();
             if( fw->currentlyAttemptedServerAddress == systemAddress )
             {
                 // Try the next server
                 TryNextServer( fw->sata, fw );
             }
+            if( forwardingRequestList.Size() == sizeBefore )
+                idx2++;
         }
 
         // Remove dead server
@@ -193,12 +201,7 @@ void UDPProxyCoordinator::OnForwardingRequestFromClientToCoordinator( Packet* pa
     sataReversed.senderClientGuid = sata.targetClientGuid;
     sataReversed.targetClientGuid = sata.senderClientGuid;
 
-    unsigned int insertionIndex;
-    bool objectExists1, objectExists2;
-    insertionIndex = forwardingRequestList.GetIndexFromKey( sata, &objectExists1 );
-    forwardingRequestList.GetIndexFromKey( sataReversed, &objectExists2 );
-
-    if( objectExists1 || objectExists2 )
+    if( forwardingRequestList.HasData( sata ) || forwardingRequestList.HasData( sataReversed ) )
     {
         outgoingBs.Write( (MessageID)ID_UDP_PROXY_GENERAL );
         outgoingBs.Write( (MessageID)ID_UDP_PROXY_IN_PROGRESS );
@@ -262,13 +265,13 @@ void UDPProxyCoordinator::OnForwardingRequestFromClientToCoordinator( Packet* pa
         {
             fw->remainingServersToTry.push_back( rServer );
         }
-        forwardingRequestList.InsertAtIndex( fw, insertionIndex, _FILE_AND_LINE_ );
+        forwardingRequestList.Insert( sata, fw, true, _FILE_AND_LINE_ );
     }
     else
     {
         fw->timeRequestedPings = 0;
         fw->currentlyAttemptedServerAddress = serverList[0];
-        forwardingRequestList.InsertAtIndex( fw, insertionIndex, _FILE_AND_LINE_ );
+        forwardingRequestList.Insert( sata, fw, true, _FILE_AND_LINE_ );
         SendForwardingRequest( sourceAddress, targetAddress, fw->currentlyAttemptedServerAddress, fw->timeoutOnNoDataMS );
     }
 }
@@ -21,7 +21,7 @@
 #include "RakNetTypes.h"
 #include "PluginInterface2.h"
 #include "BitStream.h"
-#include "DS_OrderedList.h"
+#include "DS_FlatHashMap.h"
 
 #include <deque>
 #include <string>
@@ -85,7 +85,16 @@ public:
 
 protected:
     static int ServerWithPingComp( const unsigned short& key, const UDPProxyCoordinator::ServerWithPing& data );
-    static int ForwardingRequestComp( const SenderAndTargetAddress& key, ForwardingRequest* const& data );
+
+    // Forwarding requests are keyed by the two client addresses only
+    struct SenderAndTargetAddressHash
+    {
+        std::size_t operator()( const SenderAndTargetAddress& sata ) const;
+    };
+    struct SenderAndTargetAddressEqual
+    {
+        bool operator()( const SenderAndTargetAddress& a, const SenderAndTargetAddress& b ) const;
+    };
 
     void OnForwardingRequestFromClientToCoordinator( Packet* packet );
     void OnLoginRequestFromServerToCoordinator( Packet* packet );
@@ -101,7 +110,7 @@ protected:
     std::vector<SystemAddress> serverList;
 
     // Forwarding requests in progress
-    DataStructures::OrderedList<SenderAndTargetAddress, ForwardingRequest*, ForwardingRequestComp> forwardingRequestList;
+    DataStructures::FlatHashMap<SenderAndTargetAddress, ForwardingRequest*, SenderAndTargetAddressHash, SenderAndTargetAddressEqual> forwardingRequestList;
 
     std::string remoteLoginPassword;
 };
@@ -0,0 +1,490 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "Quantizer.h"
+
+#include "RakAssert.h"
+
+#include <math.h>
+
+// Every path must round exactly as the scalar code does, so no multiply and add may be fused into one instruction
+#if defined( __clang__ )
+#pragma clang fp contract( off )
+#elif defined( __GNUC__ )
+#pragma GCC optimize( "fp-contract=off" )
+#elif defined( _MSC_VER )
+#pragma fp_contract( off )
+#endif
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#include <immintrin.h>
+#define QUANTIZE_AVX2_AVAILABLE
+#define QUANTIZE_TARGET_AVX2
+#elif( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <immintrin.h>
+#define QUANTIZE_AVX2_AVAILABLE
+#define QUANTIZE_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#endif
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define QUANTIZE_SSE2 1
+#endif
+
+namespace RakNet {
+
+void QuantizeParametersForRange( float minimum, float maximum, int bits, QuantizeParameters* parameters )
+{
+    RakAssert( maximum > minimum );
+    RakAssert( bits >= 1 && bits <= QUANTIZE_MAX_BITS );
+    parameters->limit = (float)( ( 1u << bits ) - 1 );
+    for( unsigned int i = 0; i < QUANTIZE_PATTERN_LENGTH; i++ )
+    {
+        parameters->minimum[i] = minimum;
+        parameters->scale[i] = parameters->limit / ( maximum - minimum );
+        parameters->step[i] = ( maximum - minimum ) / parameters->limit;
+    }
+}
+
+void QuantizeParametersForBox( const float minimum[3], const float maximum[3], int bits, QuantizeParameters* parameters )
+{
+    RakAssert( bits >= 1 && bits <= QUANTIZE_MAX_BITS );
+    parameters->limit = (float)( ( 1u << bits ) - 1 );
+    for( unsigned int i = 0; i < QUANTIZE_PATTERN_LENGTH; i++ )
+    {
+        const unsigned int axis = i % 3;
+        RakAssert( maximum[axis] > minimum[axis] );
+        parameters->minimum[i] = minimum[axis];
+        parameters->scale[i] = parameters->limit / ( maximum[axis] - minimum[axis] );
+        parameters->step[i] = ( maximum[axis] - minimum[axis] ) / parameters->limit;
+    }
+}
+
+// The same operations in the same order as the SIMD kernels. max and min are written as the SSE instructions define them, which also turns NaN into 0.
+static inline uint32_t QuantizeValue( float value, float minimum, float scale, float limit )
+{
+    float t = ( value - minimum ) * scale + 0.5f;
+    t = t > 0.0f ? t : 0.0f;
+    t = t < limit ? t : limit;
+    return (uint32_t)(int32_t)t;
+}
+
+static inline float DequantizeValue( uint32_t quantized, float minimum, float step )
+{
+    return (float)(int32_t)quantized * step + minimum;
+}
+
+void QuantizeFloatsPortable( const float* values, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    for( unsigned int i = 0, j = 0; i < count; i++ )
+    {
+        quantized[i] = QuantizeValue( values[i], parameters.minimum[j], parameters.scale[j], parameters.limit );
+        if( ++j == QUANTIZE_PATTERN_LENGTH )
+            j = 0;
+    }
+}
+
+void DequantizeFloatsPortable( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* values )
+{
+    for( unsigned int i = 0, j = 0; i < count; i++ )
+    {
+        values[i] = DequantizeValue( quantized[i], parameters.minimum[j], parameters.step[j] );
+        if( ++j == QUANTIZE_PATTERN_LENGTH )
+            j = 0;
+    }
+}
+
+void QuantizeQuatsPortable( const float* wxyz, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    for( unsigned int i = 0; i < count; i++, wxyz += 4, quantized += 4 )
+    {
+        // The first component of largest magnitude
+        unsigned int largestIndex = 0;
+        float largestMagnitude = fabsf( wxyz[0] ), largest = wxyz[0];
+        for( unsigned int k = 1; k < 4; k++ )
+        {
+            if( fabsf( wxyz[k] ) > largestMagnitude )
+            {
+                largestIndex = k;
+                largestMagnitude = fabsf( wxyz[k] );
+                largest = wxyz[k];
+            }
+        }
+
+        // q and -q are the same rotation, so send the one whose largest component is positive
+        const bool negate = largest < 0.0f;
+        quantized[0] = largestIndex;
+        for( unsigned int k = 0, j = 1; k < 4; k++ )
+        {
+            if( k != largestIndex )
+                quantized[j++] = QuantizeValue( negate ? -wxyz[k] : wxyz[k], parameters.minimum[0], parameters.scale[0], parameters.limit );
+        }
+    }
+}
+
+void DequantizeQuatsPortable( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* wxyz )
+{
+    for( unsigned int i = 0; i < count; i++, wxyz += 4, quantized += 4 )
+    {
+        const unsigned int largestIndex = quantized[0] & 3;
+        const float a = DequantizeValue( quantized[1], parameters.minimum[0], parameters.step[0] );
+        const float b = DequantizeValue( quantized[2], parameters.minimum[0], parameters.step[0] );
+        const float c = DequantizeValue( quantized[3], parameters.minimum[0], parameters.step[0] );
+        float largest = 1.0f - a * a - b * b - c * c;
+        largest = largest > 0.0f ? largest : 0.0f;
+        largest = sqrtf( largest );
+
+        const float others[3] = { a, b, c };
+        for( unsigned int k = 0, j = 0; k < 4; k++ )
+            wxyz[k] = k == largestIndex ? largest : others[j++];
+    }
+}
+
+#ifdef QUANTIZE_SSE2
+static inline __m128 SelectSSE2( __m128 mask, __m128 a, __m128 b )
+{
+    return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+static inline __m128i QuantizeSSE2( __m128 values, __m128 minimum, __m128 scale, __m128 limit )
+{
+    __m128 t = _mm_add_ps( _mm_mul_ps( _mm_sub_ps( values, minimum ), scale ), _mm_set1_ps( 0.5f ) );
+    t = _mm_min_ps( _mm_max_ps( t, _mm_setzero_ps() ), limit );
+    return _mm_cvttps_epi32( t );
+}
+
+static inline __m128 DequantizeSSE2( __m128i quantized, __m128 minimum, __m128 step )
+{
+    return _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( quantized ), step ), minimum );
+}
+
+static void QuantizeFloatsSSE2( const float* values, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    const __m128 limit = _mm_set1_ps( parameters.limit );
+    unsigned int i = 0;
+    for( ; i + QUANTIZE_PATTERN_LENGTH <= count; i += QUANTIZE_PATTERN_LENGTH )
+    {
+        for( unsigned int k = 0; k < QUANTIZE_PATTERN_LENGTH; k += 4 )
+        {
+            const __m128i q = QuantizeSSE2( _mm_loadu_ps( values + i + k ), _mm_loadu_ps( parameters.minimum + k ), _mm_loadu_ps( parameters.scale + k ), limit );
+            _mm_storeu_si128( (__m128i*)( quantized + i + k ), q );
+        }
+    }
+    QuantizeFloatsPortable( values + i, count - i, parameters, quantized + i );
+}
+
+static void DequantizeFloatsSSE2( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* values )
+{
+    unsigned int i = 0;
+    for( ; i + QUANTIZE_PATTERN_LENGTH <= count; i += QUANTIZE_PATTERN_LENGTH )
+    {
+        for( unsigned int k = 0; k < QUANTIZE_PATTERN_LENGTH; k += 4 )
+        {
+            const __m128i q = _mm_loadu_si128( (const __m128i*)( quantized + i + k ) );
+            _mm_storeu_ps( values + i + k, DequantizeSSE2( q, _mm_loadu_ps( parameters.minimum + k ), _mm_loadu_ps( parameters.step + k ) ) );
+        }
+    }
+    DequantizeFloatsPortable( quantized + i, count - i, parameters, values + i );
+}
+
+// 4 quaternions at a time, transposed so each register holds one component of all 4
+static void QuantizeQuatsSSE2( const float* wxyz, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    const __m128 minimum = _mm_set1_ps( parameters.minimum[0] ), scale = _mm_set1_ps( parameters.scale[0] ), limit = _mm_set1_ps( parameters.limit );
+    const __m128 magnitudeMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) ), signMask = _mm_castsi128_ps( _mm_set1_epi32( (int)0x80000000 ) );
+    unsigned int i = 0;
+    for( ; i + 4 <= count; i += 4 )
+    {
+        __m128 c[4];
+        for( int k = 0; k < 4; k++ )
+            c[k] = _mm_loadu_ps( wxyz + i * 4 + k * 4 );
+        _MM_TRANSPOSE4_PS( c[0], c[1], c[2], c[3] );
+
+        __m128 largestMagnitude = _mm_and_ps( c[0], magnitudeMask ), largest = c[0];
+        __m128 largestIndex = _mm_setzero_ps();
+        for( int k = 1; k < 4; k++ )
+        {
+            const __m128 magnitude = _mm_and_ps( c[k], magnitudeMask );
+            const __m128 greater = _mm_cmpgt_ps( magnitude, largestMagnitude );
+            largestMagnitude = SelectSSE2( greater, magnitude, largestMagnitude );
+            largest = SelectSSE2( greater, c[k], largest );
+            largestIndex = SelectSSE2( greater, _mm_castsi128_ps( _mm_set1_epi32( k ) ), largestIndex );
+        }
+
+        const __m128 negate = _mm_and_ps( _mm_cmplt_ps( largest, _mm_setzero_ps() ), signMask );
+        for( int k = 0; k < 4; k++ )
+            c[k] = _mm_xor_ps( c[k], negate );
+
+        // The three components other than the largest, in order
+        const __m128i index = _mm_castps_si128( largestIndex );
+        const __m128 isFirst = _mm_castsi128_ps( _mm_cmpeq_epi32( index, _mm_setzero_si128() ) );
+        const __m128 beforeThird = _mm_castsi128_ps( _mm_cmplt_epi32( index, _mm_set1_epi32( 2 ) ) );
+        const __m128 beforeFourth = _mm_castsi128_ps( _mm_cmplt_epi32( index, _mm_set1_epi32( 3 ) ) );
+        __m128 q[4];
+        q[0] = largestIndex;
+        q[1] = _mm_castsi128_ps( QuantizeSSE2( SelectSSE2( isFirst, c[1], c[0] ), minimum, scale, limit ) );
+        q[2] = _mm_castsi128_ps( QuantizeSSE2( SelectSSE2( beforeThird, c[2], c[1] ), minimum, scale, limit ) );
+        q[3] = _mm_castsi128_ps( QuantizeSSE2( SelectSSE2( beforeFourth, c[3], c[2] ), minimum, scale, limit ) );
+
+        _MM_TRANSPOSE4_PS( q[0], q[1], q[2], q[3] );
+        for( int k = 0; k < 4; k++ )
+            _mm_storeu_ps( (float*)( quantized + i * 4 + k * 4 ), q[k] );
+    }
+    QuantizeQuatsPortable( wxyz + i * 4, count - i, parameters, quantized + i * 4 );
+}
+
+static void DequantizeQuatsSSE2( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* wxyz )
+{
+    const __m128 minimum = _mm_set1_ps( parameters.minimum[0] ), step = _mm_set1_ps( parameters.step[0] );
+    unsigned int i = 0;
+    for( ; i + 4 <= count; i += 4 )
+    {
+        __m128 q[4];
+        for( int k = 0; k < 4; k++ )
+            q[k] = _mm_loadu_ps( (const float*)( quantized + i * 4 + k * 4 ) );
+        _MM_TRANSPOSE4_PS( q[0], q[1], q[2], q[3] );
+
+        const __m128i index = _mm_and_si128( _mm_castps_si128( q[0] ), _mm_set1_epi32( 3 ) );
+        const __m128 a = DequantizeSSE2( _mm_castps_si128( q[1] ), minimum, step );
+        const __m128 b = DequantizeSSE2( _mm_castps_si128( q[2] ), minimum, step );
+        const __m128 c = DequantizeSSE2( _mm_castps_si128( q[3] ), minimum, step );
+        __m128 largest = _mm_sub_ps( _mm_sub_ps( _mm_sub_ps( _mm_set1_ps( 1.0f ), _mm_mul_ps( a, a ) ), _mm_mul_ps( b, b ) ), _mm_mul_ps( c, c ) );
+        largest = _mm_sqrt_ps( _mm_max_ps( largest, _mm_setzero_ps() ) );
+
+        const __m128 isFirst = _mm_castsi128_ps( _mm_cmpeq_epi32( index, _mm_setzero_si128() ) );
+        const __m128 isSecond = _mm_castsi128_ps( _mm_cmpeq_epi32( index, _mm_set1_epi32( 1 ) ) );
+        const __m128 isThird = _mm_castsi128_ps( _mm_cmpeq_epi32( index, _mm_set1_epi32( 2 ) ) );
+        const __m128 beforeThird = _mm_castsi128_ps( _mm_cmplt_epi32( index, _mm_set1_epi32( 2 ) ) );
+        const __m128 beforeFourth = _mm_castsi128_ps( _mm_cmplt_epi32( index, _mm_set1_epi32( 3 ) ) );
+        __m128 r[4];
+        r[0] = SelectSSE2( isFirst, largest, a );
+        r[1] = SelectSSE2( isFirst, a, SelectSSE2( isSecond, largest, b ) );
+        r[2] = SelectSSE2( beforeThird, b, SelectSSE2( isThird, largest, c ) );
+        r[3] = SelectSSE2( beforeFourth, c, largest );
+
+        _MM_TRANSPOSE4_PS( r[0], r[1], r[2], r[3] );
+        for( int k = 0; k < 4; k++ )
+            _mm_storeu_ps( wxyz + i * 4 + k * 4, r[k] );
+    }
+    DequantizeQuatsPortable( quantized + i * 4, count - i, parameters, wxyz + i * 4 );
+}
+#endif // QUANTIZE_SSE2
+
+#ifdef QUANTIZE_AVX2_AVAILABLE
+static QUANTIZE_TARGET_AVX2 inline __m256i QuantizeAVX2( __m256 values, __m256 minimum, __m256 scale, __m256 limit )
+{
+    __m256 t = _mm256_add_ps( _mm256_mul_ps( _mm256_sub_ps( values, minimum ), scale ), _mm256_set1_ps( 0.5f ) );
+    t = _mm256_min_ps( _mm256_max_ps( t, _mm256_setzero_ps() ), limit );
+    return _mm256_cvttps_epi32( t );
+}
+
+static QUANTIZE_TARGET_AVX2 inline __m256 DequantizeAVX2( __m256i quantized, __m256 minimum, __m256 step )
+{
+    return _mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( quantized ), step ), minimum );
+}
+
+// Transposes the 4x4 block in each 128 bit half. Rows holding quaternions 0|1, 2|3, 4|5 and 6|7 become components of 0, 2, 4, 6 | 1, 3, 5, 7,
+// and transposing the results the same way puts each quaternion back where it came from.
+static QUANTIZE_TARGET_AVX2 inline void TransposeHalvesAVX2( __m256* r )
+{
+    const __m256 t0 = _mm256_unpacklo_ps( r[0], r[1] );
+    const __m256 t1 = _mm256_unpackhi_ps( r[0], r[1] );
+    const __m256 t2 = _mm256_unpacklo_ps( r[2], r[3] );
+    const __m256 t3 = _mm256_unpackhi_ps( r[2], r[3] );
+    r[0] = _mm256_shuffle_ps( t0, t2, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+    r[1] = _mm256_shuffle_ps( t0, t2, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+    r[2] = _mm256_shuffle_ps( t1, t3, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+    r[3] = _mm256_shuffle_ps( t1, t3, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+}
+
+static QUANTIZE_TARGET_AVX2 void QuantizeFloatsAVX2( const float* values, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    const __m256 limit = _mm256_set1_ps( parameters.limit );
+    unsigned int i = 0;
+    for( ; i + QUANTIZE_PATTERN_LENGTH <= count; i += QUANTIZE_PATTERN_LENGTH )
+    {
+        for( unsigned int k = 0; k < QUANTIZE_PATTERN_LENGTH; k += 8 )
+        {
+            const __m256i q = QuantizeAVX2( _mm256_loadu_ps( values + i + k ), _mm256_loadu_ps( parameters.minimum + k ), _mm256_loadu_ps( parameters.scale + k ), limit );
+            _mm256_storeu_si256( (__m256i*)( quantized + i + k ), q );
+        }
+    }
+    QuantizeFloatsPortable( values + i, count - i, parameters, quantized + i );
+}
+
+static QUANTIZE_TARGET_AVX2 void DequantizeFloatsAVX2( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* values )
+{
+    unsigned int i = 0;
+    for( ; i + QUANTIZE_PATTERN_LENGTH <= count; i += QUANTIZE_PATTERN_LENGTH )
+    {
+        for( unsigned int k = 0; k < QUANTIZE_PATTERN_LENGTH; k += 8 )
+        {
+            const __m256i q = _mm256_loadu_si256( (const __m256i*)( quantized + i + k ) );
+            _mm256_storeu_ps( values + i + k, DequantizeAVX2( q, _mm256_loadu_ps( parameters.minimum + k ), _mm256_loadu_ps( parameters.step + k ) ) );
+        }
+    }
+    DequantizeFloatsPortable( quantized + i, count - i, parameters, values + i );
+}
+
+static QUANTIZE_TARGET_AVX2 void QuantizeQuatsAVX2( const float* wxyz, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    const __m256 minimum = _mm256_set1_ps( parameters.minimum[0] ), scale = _mm256_set1_ps( parameters.scale[0] ), limit = _mm256_set1_ps( parameters.limit );
+    const __m256 magnitudeMask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7FFFFFFF ) ), signMask = _mm256_castsi256_ps( _mm256_set1_epi32( (int)0x80000000 ) );
+    unsigned int i = 0;
+    for( ; i + 8 <= count; i += 8 )
+    {
+        __m256 c[4];
+        for( int k = 0; k < 4; k++ )
+            c[k] = _mm256_loadu_ps( wxyz + i * 4 + k * 8 );
+        TransposeHalvesAVX2( c );
+
+        __m256 largestMagnitude = _mm256_and_ps( c[0], magnitudeMask ), largest = c[0];
+        __m256 largestIndex = _mm256_setzero_ps();
+        for( int k = 1; k < 4; k++ )
+        {
+            const __m256 magnitude = _mm256_and_ps( c[k], magnitudeMask );
+            const __m256 greater = _mm256_cmp_ps( magnitude, largestMagnitude, _CMP_GT_OQ );
+            largestMagnitude = _mm256_blendv_ps( largestMagnitude, magnitude, greater );
+            largest = _mm256_blendv_ps( largest, c[k], greater );
+            largestIndex = _mm256_blendv_ps( largestIndex, _mm256_castsi256_ps( _mm256_set1_epi32( k ) ), greater );
+        }
+
+        const __m256 negate = _mm256_and_ps( _mm256_cmp_ps( largest, _mm256_setzero_ps(), _CMP_LT_OQ ), signMask );
+        for( int k = 0; k < 4; k++ )
+            c[k] = _mm256_xor_ps( c[k], negate );
+
+        const __m256i index = _mm256_castps_si256( largestIndex );
+        const __m256 isFirst = _mm256_castsi256_ps( _mm256_cmpeq_epi32( index, _mm256_setzero_si256() ) );
+        const __m256 beforeThird = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( 2 ), index ) );
+        const __m256 beforeFourth = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( 3 ), index ) );
+        __m256 q[4];
+        q[0] = largestIndex;
+        q[1] = _mm256_castsi256_ps( QuantizeAVX2( _mm256_blendv_ps( c[0], c[1], isFirst ), minimum, scale, limit ) );
+        q[2] = _mm256_castsi256_ps( QuantizeAVX2( _mm256_blendv_ps( c[1], c[2], beforeThird ), minimum, scale, limit ) );
+        q[3] = _mm256_castsi256_ps( QuantizeAVX2( _mm256_blendv_ps( c[2], c[3], beforeFourth ), minimum, scale, limit ) );
+
+        TransposeHalvesAVX2( q );
+        for( int k = 0; k < 4; k++ )
+            _mm256_storeu_ps( (float*)( quantized + i * 4 + k * 8 ), q[k] );
+    }
+    QuantizeQuatsPortable( wxyz + i * 4, count - i, parameters, quantized + i * 4 );
+}
+
+static QUANTIZE_TARGET_AVX2 void DequantizeQuatsAVX2( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* wxyz )
+{
+    const __m256 minimum = _mm256_set1_ps( parameters.minimum[0] ), step = _mm256_set1_ps( parameters.step[0] );
+    unsigned int i = 0;
+    for( ; i + 8 <= count; i += 8 )
+    {
+        __m256 q[4];
+        for( int k = 0; k < 4; k++ )
+            q[k] = _mm256_loadu_ps( (const float*)( quantized + i * 4 + k * 8 ) );
+        TransposeHalvesAVX2( q );
+
+        const __m256i index = _mm256_and_si256( _mm256_castps_si256( q[0] ), _mm256_set1_epi32( 3 ) );
+        const __m256 a = DequantizeAVX2( _mm256_castps_si256( q[1] ), minimum, step );
+        const __m256 b = DequantizeAVX2( _mm256_castps_si256( q[2] ), minimum, step );
+        const __m256 c = DequantizeAVX2( _mm256_castps_si256( q[3] ), minimum, step );
+        __m256 largest = _mm256_sub_ps( _mm256_sub_ps( _mm256_sub_ps( _mm256_set1_ps( 1.0f ), _mm256_mul_ps( a, a ) ), _mm256_mul_ps( b, b ) ), _mm256_mul_ps( c, c ) );
+        largest = _mm256_sqrt_ps( _mm256_max_ps( largest, _mm256_setzero_ps() ) );
+
+        const __m256 isFirst = _mm256_castsi256_ps( _mm256_cmpeq_epi32( index, _mm256_setzero_si256() ) );
+        const __m256 isSecond = _mm256_castsi256_ps( _mm256_cmpeq_epi32( index, _mm256_set1_epi32( 1 ) ) );
+        const __m256 isThird = _mm256_castsi256_ps( _mm256_cmpeq_epi32( index, _mm256_set1_epi32( 2 ) ) );
+        const __m256 beforeThird = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( 2 ), index ) );
+        const __m256 beforeFourth = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( 3 ), index ) );
+        __m256 r[4];
+        r[0] = _mm256_blendv_ps( a, largest, isFirst );
+        r[1] = _mm256_blendv_ps( _mm256_blendv_ps( b, largest, isSecond ), a, isFirst );
+        r[2] = _mm256_blendv_ps( _mm256_blendv_ps( c, largest, isThird ), b, beforeThird );
+        r[3] = _mm256_blendv_ps( largest, c, beforeFourth );
+
+        TransposeHalvesAVX2( r );
+        for( int k = 0; k < 4; k++ )
+            _mm256_storeu_ps( wxyz + i * 4 + k * 8, r[k] );
+    }
+    DequantizeQuatsPortable( quantized + i * 4, count - i, parameters, wxyz + i * 4 );
+}
+
+static bool CPUSupportsAVX2( void )
+{
+#if defined( _MSC_VER )
+    int cpuInfo[4];
+    __cpuid( cpuInfo, 0 );
+    if( cpuInfo[0] < 7 )
+        return false;
+    // The OS must also save the AVX registers
+    __cpuid( cpuInfo, 1 );
+    if( ( cpuInfo[2] & ( 1 << 27 ) ) == 0 || ( cpuInfo[2] & ( 1 << 28 ) ) == 0 || ( _xgetbv( 0 ) & 6 ) != 6 )
+        return false;
+    __cpuidex( cpuInfo, 7, 0 );
+    return ( cpuInfo[1] & ( 1 << 5 ) ) != 0;
+#else
+    return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+}
+#endif // QUANTIZE_AVX2_AVAILABLE
+
+struct QuantizeFunctions
+{
+    void ( *quantizeFloats )( const float*, unsigned int, const QuantizeParameters&, uint32_t* );
+    void ( *dequantizeFloats )( const uint32_t*, unsigned int, const QuantizeParameters&, float* );
+    void ( *quantizeQuats )( const float*, unsigned int, const QuantizeParameters&, uint32_t* );
+    void ( *dequantizeQuats )( const uint32_t*, unsigned int, const QuantizeParameters&, float* );
+    const char* implementation;
+};
+
+static QuantizeFunctions SelectQuantizeFunctions( void )
+{
+#ifdef QUANTIZE_AVX2_AVAILABLE
+    if( CPUSupportsAVX2() )
+        return { QuantizeFloatsAVX2, DequantizeFloatsAVX2, QuantizeQuatsAVX2, DequantizeQuatsAVX2, "AVX2" };
+#endif
+#ifdef QUANTIZE_SSE2
+    return { QuantizeFloatsSSE2, DequantizeFloatsSSE2, QuantizeQuatsSSE2, DequantizeQuatsSSE2, "SSE2" };
+#else
+    return { QuantizeFloatsPortable, DequantizeFloatsPortable, QuantizeQuatsPortable, DequantizeQuatsPortable, "portable" };
+#endif
+}
+
+// Resolved once, the first time any thread quantizes
+static const QuantizeFunctions& GetQuantizeFunctions( void )
+{
+    static const QuantizeFunctions quantizeFunctions = SelectQuantizeFunctions();
+    return quantizeFunctions;
+}
+
+void QuantizeFloats( const float* values, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    GetQuantizeFunctions().quantizeFloats( values, count, parameters, quantized );
+}
+
+void DequantizeFloats( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* values )
+{
+    GetQuantizeFunctions().dequantizeFloats( quantized, count, parameters, values );
+}
+
+void QuantizeQuats( const float* wxyz, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized )
+{
+    GetQuantizeFunctions().quantizeQuats( wxyz, count, parameters, quantized );
+}
+
+void DequantizeQuats( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* wxyz )
+{
+    GetQuantizeFunctions().dequantizeQuats( quantized, count, parameters, wxyz );
+}
+
+const char* QuantizeGetImplementation( void )
+{
+    return GetQuantizeFunctions().implementation;
+}
+
+} // namespace RakNet
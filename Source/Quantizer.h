@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Batched float, 3-vector and quaternion quantization behind BitStream::WriteQuantizedFloats() and its relatives.
+///
+
+#pragma once
+
+#include "Export.h"
+
+#include <stdint.h>
+
+namespace RakNet {
+
+/// Quantization parameters repeat every QUANTIZE_PATTERN_LENGTH values, which is a whole number of 3-vectors and of SSE and AVX registers
+static const unsigned int QUANTIZE_PATTERN_LENGTH = 24;
+
+/// The most bits a quantized value may have. Floats cannot count past 2^24 exactly.
+static const int QUANTIZE_MAX_BITS = 24;
+
+/// How each value of an array is mapped to an integer of a given number of bits, and back
+struct RAK_DLL_EXPORT QuantizeParameters
+{
+    float minimum[QUANTIZE_PATTERN_LENGTH];
+    // Steps per unit, for quantizing
+    float scale[QUANTIZE_PATTERN_LENGTH];
+    // Units per step, for dequantizing
+    float step[QUANTIZE_PATTERN_LENGTH];
+    // The largest integer, 2^bits - 1
+    float limit;
+};
+
+/// Every value between \a minimum and \a maximum, in \a bits bits
+void RAK_DLL_EXPORT QuantizeParametersForRange( float minimum, float maximum, int bits, QuantizeParameters* parameters );
+
+/// x, y and z of 3-vectors inside a box, each in \a bits bits
+void RAK_DLL_EXPORT QuantizeParametersForBox( const float minimum[3], const float maximum[3], int bits, QuantizeParameters* parameters );
+
+/// Map each value to the nearest of 2^bits evenly spaced integers, clamping to the range. NaN becomes 0.
+/// Uses AVX2 or SSE2 when the CPU supports it. Every path gives the same result for every input.
+void RAK_DLL_EXPORT QuantizeFloats( const float* values, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized );
+
+/// Map integers written by QuantizeFloats() back to values
+void RAK_DLL_EXPORT DequantizeFloats( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* values );
+
+/// \brief Smallest-three quaternion quantization.
+/// \details Each unit quaternion, stored as w, x, y, z, becomes 4 integers: the index of its largest component, then the other three.
+/// Those are within +-1/sqrt(2), and are quantized with \a parameters from QuantizeParametersForRange() over that range.
+/// The quaternion is negated if needed so that the largest component, which is left out, is positive.
+void RAK_DLL_EXPORT QuantizeQuats( const float* wxyz, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized );
+
+/// Rebuild quaternions from QuantizeQuats(), computing the largest component from the others
+void RAK_DLL_EXPORT DequantizeQuats( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* wxyz );
+
+/// Same as the functions above, but always scalar
+void RAK_DLL_EXPORT QuantizeFloatsPortable( const float* values, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized );
+void RAK_DLL_EXPORT DequantizeFloatsPortable( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* values );
+void RAK_DLL_EXPORT QuantizeQuatsPortable( const float* wxyz, unsigned int count, const QuantizeParameters& parameters, uint32_t* quantized );
+void RAK_DLL_EXPORT DequantizeQuatsPortable( const uint32_t* quantized, unsigned int count, const QuantizeParameters& parameters, float* wxyz );
+
+/// \return "AVX2", "SSE2" or "portable", whichever the functions above use on this CPU
+RAK_DLL_EXPORT const char* QuantizeGetImplementation( void );
+
+} // namespace RakNet
@@ -0,0 +1,585 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "RakMemoryBackend.h"
+
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+#include "RakNetDefines.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( __linux__ )
+#include <sys/mman.h>
+#endif
+
+using namespace RakNet;
+
+namespace {
+
+// In front of every block, so that free knows where it came from and what to count it against
+struct BlockHeader
+{
+    // Bytes asked for
+    uint64_t size;
+    // Size class, or BLOCK_MALLOC, BLOCK_MAPPED or BLOCK_MAPPED_HUGE_PAGES
+    uint32_t kind;
+    // Index in sites
+    uint32_t site;
+};
+static_assert( sizeof( BlockHeader ) == 16, "Blocks after the header must stay aligned to 16" );
+
+const uint32_t BLOCK_MAPPED_HUGE_PAGES = 0xFFFFFFFD;
+const uint32_t BLOCK_MALLOC = 0xFFFFFFFE;
+const uint32_t BLOCK_MAPPED = 0xFFFFFFFF;
+
+// Steps of 16 up to 128, then four per power of two up to RAK_MEMORY_BACKEND_MAX_SMALL_SIZE
+const unsigned int SIZE_CLASS_COUNT = 40;
+static_assert( RAK_MEMORY_BACKEND_MAX_SMALL_SIZE == 32768, "SIZE_CLASS_COUNT covers sizes up to 32768" );
+
+size_t SizeOfClass( unsigned int sizeClass )
+{
+    if( sizeClass < 8 )
+        return 16 * ( sizeClass + 1 );
+    const unsigned int step = sizeClass - 8;
+    const unsigned int power = 7 + step / 4;
+    return ( (size_t)1 << power ) + ( step % 4 + 1 ) * ( (size_t)1 << ( power - 2 ) );
+}
+
+unsigned int SizeClassOf( size_t size )
+{
+    if( size <= 128 )
+        return size == 0 ? 0 : (unsigned int)( ( size - 1 ) / 16 );
+    // size is in ( 2^power, 2^(power+1) ]
+    unsigned int power = 7;
+    while( ( (size_t)2 << power ) < size )
+        power++;
+    return 8 + ( power - 7 ) * 4 + (unsigned int)( ( size - 1 - ( (size_t)1 << power ) ) >> ( power - 2 ) );
+}
+
+size_t BlockSizeOfClass( unsigned int sizeClass )
+{
+    return sizeof( BlockHeader ) + SizeOfClass( sizeClass );
+}
+
+// Blocks moved between a thread cache and the shared list at a time. A thread caches up to twice that.
+unsigned int BatchSizeOfClass( unsigned int sizeClass )
+{
+    size_t batch = 16384 / BlockSizeOfClass( sizeClass );
+    return (unsigned int)std::min<size_t>( std::max<size_t>( batch, 2 ), 64 );
+}
+
+// Free blocks are linked through the first bytes after their header
+BlockHeader*& NextFree( BlockHeader* block )
+{
+    return *(BlockHeader**)( block + 1 );
+}
+
+struct SizeClassList
+{
+    std::mutex mutex;
+    BlockHeader* head;
+    unsigned int count;
+};
+SizeClassList sharedLists[SIZE_CLASS_COUNT];
+// Bytes of the blocks in sharedLists, changed under their mutexes
+std::atomic<uint64_t> bytesFreeShared;
+
+// The chunk blocks are being carved from
+std::mutex chunkMutex;
+char* chunkCursor;
+char* chunkEnd;
+
+// Index 0 counts rakMalloc without a file, and files once the table is full
+struct Site
+{
+    std::atomic<const char*> file;
+    std::atomic<int64_t> bytesInUse;
+    std::atomic<int64_t> allocationsInUse;
+    std::atomic<uint64_t> allocationCount;
+};
+Site sites[RAK_MEMORY_BACKEND_MAX_FILES];
+
+std::atomic<uint64_t> bytesMapped;
+std::atomic<uint64_t> bytesAdvisedHugePages;
+std::atomic<uint64_t> bytesInChunks;
+std::atomic<uint64_t> bytesInMalloc;
+
+uint32_t FindSite( const char* file )
+{
+    if( file == 0 )
+        return 0;
+    // __FILE__ is normally the same pointer for every call from one translation unit, so compare pointers and merge by name when reporting
+    const uint32_t slots = RAK_MEMORY_BACKEND_MAX_FILES - 1;
+    const uint32_t start = (uint32_t)( ( (uint64_t)(uintptr_t)file * 0x9E3779B97F4A7C15ull ) >> 32 ) % slots;
+    for( uint32_t probe = 0; probe < slots; probe++ )
+    {
+        const uint32_t index = 1 + ( start + probe ) % slots;
+        const char* found = sites[index].file.load( std::memory_order_acquire );
+        if( found == file )
+            return index;
+        if( found == 0 )
+        {
+            if( sites[index].file.compare_exchange_strong( found, file, std::memory_order_acq_rel ) || found == file )
+                return index;
+        }
+    }
+    return 0;
+}
+
+void CountAllocation( uint32_t site, uint64_t size )
+{
+    sites[site].bytesInUse.fetch_add( (int64_t)size, std::memory_order_relaxed );
+    sites[site].allocationsInUse.fetch_add( 1, std::memory_order_relaxed );
+    sites[site].allocationCount.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void CountFree( uint32_t site, uint64_t size )
+{
+    sites[site].bytesInUse.fetch_sub( (int64_t)size, std::memory_order_relaxed );
+    sites[site].allocationsInUse.fetch_sub( 1, std::memory_order_relaxed );
+}
+
+// \param[in] length A multiple of RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE
+// \param[out] advised If the kernel will back the memory with huge pages when it can
+char* MapHugePages( size_t length, bool* advised )
+{
+    *advised = false;
+#if defined( __linux__ )
+    // Map a huge page more than needed, so that the start can be aligned to one, and give back the rest
+    const size_t mappedLength = length + RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE;
+    void* mapping = mmap( 0, mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( mapping == MAP_FAILED )
+        return 0;
+    char* base = (char*)mapping;
+    char* aligned = (char*)( ( (uintptr_t)base + RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE - 1 ) & ~( (uintptr_t)RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE - 1 ) );
+    if( aligned > base )
+        munmap( base, aligned - base );
+    if( base + mappedLength > aligned + length )
+        munmap( aligned + length, base + mappedLength - ( aligned + length ) );
+    // Fails if the kernel has no transparent huge pages, and then the memory is still usable
+    if( madvise( aligned, length, MADV_HUGEPAGE ) == 0 )
+    {
+        *advised = true;
+        bytesAdvisedHugePages.fetch_add( length, std::memory_order_relaxed );
+    }
+    bytesMapped.fetch_add( length, std::memory_order_relaxed );
+    return aligned;
+#else
+    return (char*)malloc( length );
+#endif
+}
+
+void UnmapHugePages( char* p, size_t length, bool advised )
+{
+#if defined( __linux__ )
+    munmap( p, length );
+    bytesMapped.fetch_sub( length, std::memory_order_relaxed );
+    if( advised )
+        bytesAdvisedHugePages.fetch_sub( length, std::memory_order_relaxed );
+#else
+    (void)length;
+    (void)advised;
+    free( p );
+#endif
+}
+
+size_t MappedLengthOf( uint64_t size )
+{
+    return ( sizeof( BlockHeader ) + size + RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE - 1 ) & ~( (size_t)RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE - 1 );
+}
+
+// Links up to count new blocks of sizeClass onto head
+unsigned int CarveBlocks( unsigned int sizeClass, unsigned int count, BlockHeader** head )
+{
+    const size_t blockSize = BlockSizeOfClass( sizeClass );
+    std::lock_guard<std::mutex> guard( chunkMutex );
+    unsigned int carved = 0;
+    while( carved < count )
+    {
+        if( chunkCursor == 0 || (size_t)( chunkEnd - chunkCursor ) < blockSize )
+        {
+            // The rest of the old chunk is smaller than the largest block, and is left unused
+            bool advised;
+            char* chunk = MapHugePages( RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE, &advised );
+            if( chunk == 0 )
+                break;
+            bytesInChunks.fetch_add( RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE, std::memory_order_relaxed );
+            chunkCursor = chunk;
+            chunkEnd = chunk + RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE;
+        }
+        BlockHeader* block = (BlockHeader*)chunkCursor;
+        chunkCursor += blockSize;
+        block->kind = sizeClass;
+        NextFree( block ) = *head;
+        *head = block;
+        carved++;
+    }
+    return carved;
+}
+
+// Takes up to count blocks from the shared list, or carves new ones if it is empty
+unsigned int TakeShared( unsigned int sizeClass, unsigned int count, BlockHeader** head )
+{
+    SizeClassList& shared = sharedLists[sizeClass];
+    {
+        std::lock_guard<std::mutex> guard( shared.mutex );
+        if( shared.count > 0 )
+        {
+            unsigned int taken = 0;
+            while( taken < count && shared.head )
+            {
+                BlockHeader* block = shared.head;
+                shared.head = NextFree( block );
+                NextFree( block ) = *head;
+                *head = block;
+                taken++;
+            }
+            shared.count -= taken;
+            bytesFreeShared.fetch_sub( taken * BlockSizeOfClass( sizeClass ), std::memory_order_relaxed );
+            return taken;
+        }
+    }
+    return CarveBlocks( sizeClass, count, head );
+}
+
+// Gives count blocks from the front of head to the shared list
+void GiveShared( unsigned int sizeClass, unsigned int count, BlockHeader** head )
+{
+    if( count == 0 )
+        return;
+    // Find the end of the run outside the lock, then link it in at once
+    BlockHeader* first = *head;
+    BlockHeader* last = first;
+    for( unsigned int i = 1; i < count; i++ )
+        last = NextFree( last );
+    *head = NextFree( last );
+
+    SizeClassList& shared = sharedLists[sizeClass];
+    std::lock_guard<std::mutex> guard( shared.mutex );
+    NextFree( last ) = shared.head;
+    shared.head = first;
+    shared.count += count;
+    bytesFreeShared.fetch_add( count * BlockSizeOfClass( sizeClass ), std::memory_order_relaxed );
+}
+
+struct ThreadCache
+{
+    ThreadCache();
+    ~ThreadCache();
+
+    // Only written by the thread that owns the cache, so that GetMemoryBackendStatistics can read it without a lock in the fast path
+    void AddBytesFree( int64_t bytes ) { bytesFree.store( bytesFree.load( std::memory_order_relaxed ) + bytes, std::memory_order_relaxed ); }
+
+    BlockHeader* heads[SIZE_CLASS_COUNT];
+    unsigned int counts[SIZE_CLASS_COUNT];
+    std::atomic<uint64_t> bytesFree;
+    ThreadCache* previous;
+    ThreadCache* next;
+};
+
+// Every live thread cache, for GetMemoryBackendStatistics
+std::mutex threadCachesMutex;
+ThreadCache* threadCaches;
+
+thread_local ThreadCache threadCache;
+// Set once threadCache is destroyed, for memory freed later on in the thread's exit
+thread_local bool threadCacheDestroyed;
+
+ThreadCache::ThreadCache() : heads(), counts(), bytesFree( 0 ), previous( 0 )
+{
+    std::lock_guard<std::mutex> guard( threadCachesMutex );
+    next = threadCaches;
+    if( next )
+        next->previous = this;
+    threadCaches = this;
+}
+
+ThreadCache::~ThreadCache()
+{
+    std::lock_guard<std::mutex> guard( threadCachesMutex );
+    for( unsigned int sizeClass = 0; sizeClass < SIZE_CLASS_COUNT; sizeClass++ )
+        GiveShared( sizeClass, counts[sizeClass], &heads[sizeClass] );
+    if( previous )
+        previous->next = next;
+    else
+        threadCaches = next;
+    if( next )
+        next->previous = previous;
+    threadCacheDestroyed = true;
+}
+
+BlockHeader* AllocateSmall( unsigned int sizeClass )
+{
+    if( threadCacheDestroyed )
+    {
+        BlockHeader* block = 0;
+        TakeShared( sizeClass, 1, &block );
+        return block;
+    }
+
+    ThreadCache& cache = threadCache;
+    const size_t blockSize = BlockSizeOfClass( sizeClass );
+    if( cache.heads[sizeClass] == 0 )
+    {
+        cache.counts[sizeClass] = TakeShared( sizeClass, BatchSizeOfClass( sizeClass ), &cache.heads[sizeClass] );
+        if( cache.counts[sizeClass] == 0 )
+            return 0;
+        cache.AddBytesFree( cache.counts[sizeClass] * blockSize );
+    }
+    BlockHeader* block = cache.heads[sizeClass];
+    cache.heads[sizeClass] = NextFree( block );
+    cache.counts[sizeClass]--;
+    cache.AddBytesFree( -(int64_t)blockSize );
+    return block;
+}
+
+void FreeSmall( BlockHeader* block )
+{
+    const unsigned int sizeClass = block->kind;
+    if( threadCacheDestroyed )
+    {
+        GiveShared( sizeClass, 1, &block );
+        return;
+    }
+
+    ThreadCache& cache = threadCache;
+    const size_t blockSize = BlockSizeOfClass( sizeClass );
+    NextFree( block ) = cache.heads[sizeClass];
+    cache.heads[sizeClass] = block;
+    cache.AddBytesFree( blockSize );
+    const unsigned int batch = BatchSizeOfClass( sizeClass );
+    if( ++cache.counts[sizeClass] > 2 * batch )
+    {
+        GiveShared( sizeClass, batch, &cache.heads[sizeClass] );
+        cache.counts[sizeClass] -= batch;
+        cache.AddBytesFree( -(int64_t)( batch * blockSize ) );
+    }
+}
+
+void* Allocate( size_t size, uint32_t site )
+{
+    BlockHeader* block;
+    if( size <= RAK_MEMORY_BACKEND_MAX_SMALL_SIZE )
+        block = AllocateSmall( SizeClassOf( size ) );
+    else if( size < RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE )
+    {
+        block = (BlockHeader*)malloc( sizeof( BlockHeader ) + size );
+        if( block )
+        {
+            block->kind = BLOCK_MALLOC;
+            bytesInMalloc.fetch_add( size, std::memory_order_relaxed );
+        }
+    }
+    else
+    {
+        bool advised;
+        block = (BlockHeader*)MapHugePages( MappedLengthOf( size ), &advised );
+        if( block )
+            block->kind = advised ? BLOCK_MAPPED_HUGE_PAGES : BLOCK_MAPPED;
+    }
+    if( block == 0 )
+        return 0;
+
+    block->size = size;
+    block->site = site;
+    CountAllocation( site, size );
+    return block + 1;
+}
+
+void Free( void* p )
+{
+    if( p == 0 )
+        return;
+    BlockHeader* block = (BlockHeader*)p - 1;
+    CountFree( block->site, block->size );
+    if( block->kind == BLOCK_MALLOC )
+    {
+        bytesInMalloc.fetch_sub( block->size, std::memory_order_relaxed );
+        free( block );
+    }
+    else if( block->kind == BLOCK_MAPPED || block->kind == BLOCK_MAPPED_HUGE_PAGES )
+        UnmapHugePages( (char*)block, MappedLengthOf( block->size ), block->kind == BLOCK_MAPPED_HUGE_PAGES );
+    else
+    {
+        RakAssert( block->kind < SIZE_CLASS_COUNT );
+        FreeSmall( block );
+    }
+}
+
+// \param[in] site Counted against if p is 0. Otherwise the memory stays counted against the file that allocated it.
+void* Reallocate( void* p, size_t size, uint32_t site )
+{
+    if( p == 0 )
+        return Allocate( size, site );
+
+    BlockHeader* block = (BlockHeader*)p - 1;
+    const uint64_t oldSize = block->size;
+    bool inPlace;
+    if( block->kind == BLOCK_MALLOC )
+        inPlace = size > RAK_MEMORY_BACKEND_MAX_SMALL_SIZE && size < RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE;
+    else if( block->kind == BLOCK_MAPPED || block->kind == BLOCK_MAPPED_HUGE_PAGES )
+        inPlace = size >= RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE && MappedLengthOf( size ) == MappedLengthOf( oldSize );
+    else
+        inPlace = size <= RAK_MEMORY_BACKEND_MAX_SMALL_SIZE && SizeClassOf( size ) == block->kind;
+
+    if( inPlace )
+    {
+        if( block->kind == BLOCK_MALLOC )
+        {
+            BlockHeader* moved = (BlockHeader*)realloc( block, sizeof( BlockHeader ) + size );
+            if( moved == 0 )
+                return 0;
+            if( moved != block )
+                sites[moved->site].allocationCount.fetch_add( 1, std::memory_order_relaxed );
+            block = moved;
+            bytesInMalloc.fetch_add( size - oldSize, std::memory_order_relaxed );
+        }
+        sites[block->site].bytesInUse.fetch_add( (int64_t)size - (int64_t)oldSize, std::memory_order_relaxed );
+        block->size = size;
+        return block + 1;
+    }
+
+    void* moved = Allocate( size, block->site );
+    if( moved == 0 )
+        return 0;
+    memcpy( moved, p, (size_t)std::min<uint64_t>( size, oldSize ) );
+    Free( p );
+    return moved;
+}
+
+} // namespace
+
+namespace RakNet {
+
+void UseMemoryBackend( void )
+{
+    SetMalloc( MemoryBackendMalloc );
+    SetRealloc( MemoryBackendRealloc );
+    SetFree( MemoryBackendFree );
+    SetMalloc_Ex( MemoryBackendMalloc_Ex );
+    SetRealloc_Ex( MemoryBackendRealloc_Ex );
+    SetFree_Ex( MemoryBackendFree_Ex );
+}
+
+void* MemoryBackendMalloc( size_t size )
+{
+    return Allocate( size, 0 );
+}
+
+void* MemoryBackendRealloc( void* p, size_t size )
+{
+    return Reallocate( p, size, 0 );
+}
+
+void MemoryBackendFree( void* p )
+{
+    Free( p );
+}
+
+void* MemoryBackendMalloc_Ex( size_t size, const char* file, unsigned int line )
+{
+    (void)line;
+    return Allocate( size, FindSite( file ) );
+}
+
+void* MemoryBackendRealloc_Ex( void* p, size_t size, const char* file, unsigned int line )
+{
+    (void)line;
+    return Reallocate( p, size, FindSite( file ) );
+}
+
+void MemoryBackendFree_Ex( void* p, const char* file, unsigned int line )
+{
+    (void)file;
+    (void)line;
+    Free( p );
+}
+
+unsigned int GetMemoryBackendUsage( MemoryBackendUsage* usage, unsigned int maxCount )
+{
+    MemoryBackendUsage merged[RAK_MEMORY_BACKEND_MAX_FILES];
+    unsigned int mergedCount = 0;
+    for( unsigned int index = 0; index < RAK_MEMORY_BACKEND_MAX_FILES; index++ )
+    {
+        const Site& site = sites[index];
+        const char* file = site.file.load( std::memory_order_acquire );
+        const uint64_t allocationCount = site.allocationCount.load( std::memory_order_relaxed );
+        if( allocationCount == 0 )
+            continue;
+
+        unsigned int target = 0;
+        while( target < mergedCount && !( merged[target].file == file || ( file && merged[target].file && strcmp( merged[target].file, file ) == 0 ) ) )
+            target++;
+        if( target == mergedCount )
+        {
+            memset( &merged[mergedCount], 0, sizeof( merged[mergedCount] ) );
+            merged[mergedCount++].file = file;
+        }
+        merged[target].bytesInUse += (uint64_t)site.bytesInUse.load( std::memory_order_relaxed );
+        merged[target].allocationsInUse += (uint64_t)site.allocationsInUse.load( std::memory_order_relaxed );
+        merged[target].allocationCount += allocationCount;
+    }
+
+    std::sort( merged, merged + mergedCount, []( const MemoryBackendUsage& a, const MemoryBackendUsage& b ) { return a.bytesInUse > b.bytesInUse; } );
+    const unsigned int count = std::min( mergedCount, maxCount );
+    memcpy( usage, merged, count * sizeof( MemoryBackendUsage ) );
+    return count;
+}
+
+void GetMemoryBackendStatistics( MemoryBackendStatistics* statistics )
+{
+    statistics->bytesMapped = bytesMapped.load( std::memory_order_relaxed );
+    statistics->bytesAdvisedHugePages = bytesAdvisedHugePages.load( std::memory_order_relaxed );
+    statistics->bytesInChunks = bytesInChunks.load( std::memory_order_relaxed );
+    {
+        std::lock_guard<std::mutex> guard( threadCachesMutex );
+        uint64_t bytesFree = bytesFreeShared.load( std::memory_order_relaxed );
+        for( ThreadCache* cache = threadCaches; cache; cache = cache->next )
+            bytesFree += cache->bytesFree.load( std::memory_order_relaxed );
+        statistics->bytesFreeInSizeClasses = bytesFree;
+    }
+    statistics->bytesInMalloc = bytesInMalloc.load( std::memory_order_relaxed );
+}
+
+void PrintMemoryBackendUsage( void )
+{
+    MemoryBackendStatistics statistics;
+    GetMemoryBackendStatistics( &statistics );
+    RAKNET_DEBUG_PRINTF( "Mapped %llu bytes, %llu as huge pages, %llu in chunks, %llu of them free, %llu in malloc\n", (unsigned long long)statistics.bytesMapped,
+        (unsigned long long)statistics.bytesAdvisedHugePages, (unsigned long long)statistics.bytesInChunks, (unsigned long long)statistics.bytesFreeInSizeClasses,
+        (unsigned long long)statistics.bytesInMalloc );
+
+    MemoryBackendUsage usage[RAK_MEMORY_BACKEND_MAX_FILES];
+    const unsigned int count = GetMemoryBackendUsage( usage, RAK_MEMORY_BACKEND_MAX_FILES );
+    RAKNET_DEBUG_PRINTF( "%-32s %14s %12s %12s\n", "File", "Bytes", "In use", "Allocations" );
+    for( unsigned int i = 0; i < count; i++ )
+    {
+        const char* name = "(no file)";
+        if( usage[i].file )
+        {
+            name = usage[i].file;
+            for( const char* c = usage[i].file; *c; c++ )
+            {
+                if( *c == '/' || *c == '\\' )
+                    name = c + 1;
+            }
+        }
+        RAKNET_DEBUG_PRINTF( "%-32s %14llu %12llu %12llu\n", name, (unsigned long long)usage[i].bytesInUse, (unsigned long long)usage[i].allocationsInUse,
+            (unsigned long long)usage[i].allocationCount );
+    }
+}
+
+} // namespace RakNet
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief An optional allocator behind rakMalloc, rakRealloc and rakFree, with huge pages, per-thread caches and byte counts per source file.
+///
+
+#pragma once
+
+#include "Export.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest allocation served from the size classes. Larger ones go to malloc, or to their own huge pages.
+#define RAK_MEMORY_BACKEND_MAX_SMALL_SIZE 32768
+// Allocations of at least this many bytes are mapped on their own, rounded up to whole huge pages
+#define RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE 1048576
+// Size of a huge page, and of the chunks the size classes are carved from
+#define RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE 2097152
+// Source files counted separately. Beyond that, allocations are counted under a file of 0.
+#define RAK_MEMORY_BACKEND_MAX_FILES 512
+
+namespace RakNet {
+
+/// Memory in use for one file passed to rakMalloc_Ex
+struct RAK_DLL_EXPORT MemoryBackendUsage
+{
+    /// The file, or 0 for rakMalloc and for files beyond RAK_MEMORY_BACKEND_MAX_FILES
+    const char* file;
+    /// Bytes asked for and not yet freed
+    uint64_t bytesInUse;
+    /// Allocations not yet freed
+    uint64_t allocationsInUse;
+    /// Allocations ever made, including reallocations that moved
+    uint64_t allocationCount;
+};
+
+/// Memory the backend holds
+struct RAK_DLL_EXPORT MemoryBackendStatistics
+{
+    /// Bytes mapped for chunks and huge allocations
+    uint64_t bytesMapped;
+    /// Of bytesMapped, bytes the kernel accepted MADV_HUGEPAGE for
+    uint64_t bytesAdvisedHugePages;
+    /// Bytes of chunks carved into size classes, free or not. Chunks are kept until the process exits.
+    uint64_t bytesInChunks;
+    /// Bytes in free blocks of the size classes, in thread caches or shared, including their headers.
+    /// Blocks moving between a thread cache and the shared lists while this is read may be counted in neither or both.
+    uint64_t bytesFreeInSizeClasses;
+    /// Bytes of allocations passed on to malloc
+    uint64_t bytesInMalloc;
+};
+
+/// Points rakMalloc, rakRealloc, rakFree and their _Ex versions at this backend.
+/// Call it before RakNet allocates anything, as memory from one allocator cannot be freed by the other.
+/// With _USE_RAK_MEMORY_OVERRIDE 0, OP_NEW and OP_NEW_ARRAY still use new, so only memory RakNet takes from rakMalloc_Ex directly,
+/// such as MemoryPool pages and BitStream buffers, goes through the backend.
+///
+/// Allocations up to RAK_MEMORY_BACKEND_MAX_SMALL_SIZE are rounded up to one of a few sizes, four per power of two.
+/// Each thread caches freed blocks of every size, and only locks to swap a batch with the shared lists.
+/// The blocks are carved from chunks of RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE, so many small objects share one TLB entry.
+/// Allocations of RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE or more, such as RakPeer's remoteSystemList with many connections,
+/// are mapped on their own and returned to the system when freed.
+/// On Linux, chunks and huge allocations are aligned to huge pages and advised with MADV_HUGEPAGE.
+/// Pages are placed on the NUMA node of the thread that first writes them, which is normally the one that allocated them.
+/// Elsewhere they come from malloc.
+void RAK_DLL_EXPORT UseMemoryBackend( void );
+
+/// The backend, for calling directly or from your own allocation functions
+void RAK_DLL_EXPORT* MemoryBackendMalloc( size_t size );
+void RAK_DLL_EXPORT* MemoryBackendRealloc( void* p, size_t size );
+void RAK_DLL_EXPORT  MemoryBackendFree( void* p );
+void RAK_DLL_EXPORT* MemoryBackendMalloc_Ex( size_t size, const char* file, unsigned int line );
+void RAK_DLL_EXPORT* MemoryBackendRealloc_Ex( void* p, size_t size, const char* file, unsigned int line );
+void RAK_DLL_EXPORT  MemoryBackendFree_Ex( void* p, const char* file, unsigned int line );
+
+/// Memory in use per file, merging files with the same name, with the most bytes first
+/// \param[out] usage Filled with up to \a maxCount files
+/// \return How many were filled
+unsigned int RAK_DLL_EXPORT GetMemoryBackendUsage( MemoryBackendUsage* usage, unsigned int maxCount );
+
+void RAK_DLL_EXPORT GetMemoryBackendStatistics( MemoryBackendStatistics* statistics );
+
+/// Prints GetMemoryBackendUsage() and GetMemoryBackendStatistics() with RAKNET_DEBUG_PRINTF
+void RAK_DLL_EXPORT PrintMemoryBackendUsage( void );
+
+} // namespace RakNet
@@ -0,0 +1,386 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "RakMemoryProfiler.h"
+
+#include "RakMemoryOverride.h"
+#include "RakNetDefines.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace RakNet;
+
+namespace {
+
+// In front of every block, so that free knows which site to count it against
+struct BlockHeader
+{
+    uint64_t size;
+    uint32_t site;
+    uint32_t unused;
+};
+static_assert( sizeof( BlockHeader ) == 16, "Blocks after the header must stay aligned to 16" );
+
+enum SiteState
+{
+    SITE_EMPTY,
+    SITE_CLAIMED,
+    SITE_READY,
+};
+
+// Index 0 counts allocations without a file, and sites once the table is full
+struct SiteKey
+{
+    std::atomic<uint32_t> state;
+    const char* file;
+    unsigned int line;
+};
+SiteKey siteKeys[RAK_MEMORY_PROFILER_MAX_SITES];
+
+// Only ever increase, so that summing the shards at any moment gives a consistent enough picture
+struct SiteCounters
+{
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> allocatedBytes;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> freedBytes;
+};
+// Each shard is a separate array, so a thread only writes to lines its own shard uses
+SiteCounters counters[RAK_MEMORY_PROFILER_SHARD_COUNT][RAK_MEMORY_PROFILER_MAX_SITES];
+std::atomic<unsigned int> nextShard;
+
+// Guarded by sampleMutex
+struct SiteSample
+{
+    int64_t liveBytes;
+    int64_t liveAllocations;
+    uint64_t peakBytes;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    // Counts when SampleMemoryProfiler() was last called, for the rates
+    uint64_t windowAllocations;
+    uint64_t windowAllocatedBytes;
+    double allocationsPerSecond;
+    double bytesPerSecond;
+};
+std::mutex sampleMutex;
+SiteSample samples[RAK_MEMORY_PROFILER_MAX_SITES];
+std::chrono::steady_clock::time_point windowStart;
+bool hasWindow;
+
+std::atomic<bool> isStarted;
+void* ( *previousMalloc )( size_t size ) = _RakMalloc;
+void* ( *previousRealloc )( void* p, size_t size ) = _RakRealloc;
+void ( *previousFree )( void* p ) = _RakFree;
+void* ( *previousMalloc_Ex )( size_t size, const char* file, unsigned int line ) = _RakMalloc_Ex;
+void* ( *previousRealloc_Ex )( void* p, size_t size, const char* file, unsigned int line ) = _RakRealloc_Ex;
+void ( *previousFree_Ex )( void* p, const char* file, unsigned int line ) = _RakFree_Ex;
+
+SiteCounters* GetShard( void )
+{
+    static thread_local SiteCounters* shard = 0;
+    if( shard == 0 )
+        shard = counters[nextShard.fetch_add( 1, std::memory_order_relaxed ) % RAK_MEMORY_PROFILER_SHARD_COUNT];
+    return shard;
+}
+
+uint32_t FindSite( const char* file, unsigned int line )
+{
+    if( file == 0 )
+        return 0;
+    const uint32_t slots = RAK_MEMORY_PROFILER_MAX_SITES - 1;
+    const uint64_t hash = ( (uint64_t)(uintptr_t)file ^ ( (uint64_t)line << 40 ) ) * 0x9E3779B97F4A7C15ull;
+    const uint32_t start = (uint32_t)( hash >> 32 ) % slots;
+    for( uint32_t probe = 0; probe < slots; probe++ )
+    {
+        SiteKey& key = siteKeys[1 + ( start + probe ) % slots];
+        uint32_t state = key.state.load( std::memory_order_acquire );
+        if( state == SITE_EMPTY )
+        {
+            if( key.state.compare_exchange_strong( state, SITE_CLAIMED, std::memory_order_acquire ) )
+            {
+                key.file = file;
+                key.line = line;
+                key.state.store( SITE_READY, std::memory_order_release );
+                return 1 + ( start + probe ) % slots;
+            }
+        }
+        // Another thread is writing the key, which takes a few instructions
+        while( state == SITE_CLAIMED )
+        {
+            std::this_thread::yield();
+            state = key.state.load( std::memory_order_acquire );
+        }
+        if( key.file == file && key.line == line )
+            return 1 + ( start + probe ) % slots;
+    }
+    return 0;
+}
+
+void* Track( BlockHeader* block, size_t size, uint32_t site )
+{
+    if( block == 0 )
+        return 0;
+    block->size = size;
+    block->site = site;
+    SiteCounters& siteCounters = GetShard()[site];
+    siteCounters.allocations.fetch_add( 1, std::memory_order_relaxed );
+    siteCounters.allocatedBytes.fetch_add( size, std::memory_order_relaxed );
+    return block + 1;
+}
+
+BlockHeader* Untrack( void* p )
+{
+    BlockHeader* block = (BlockHeader*)p - 1;
+    SiteCounters& siteCounters = GetShard()[block->site];
+    siteCounters.frees.fetch_add( 1, std::memory_order_relaxed );
+    siteCounters.freedBytes.fetch_add( block->size, std::memory_order_relaxed );
+    return block;
+}
+
+// Sums the shards into samples. Call with sampleMutex locked.
+// \param[in] endWindow Work out the rates since the last window ended, and start a new one
+void Sample( bool endWindow )
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>( now - windowStart ).count();
+    for( unsigned int site = 0; site < RAK_MEMORY_PROFILER_MAX_SITES; site++ )
+    {
+        if( site > 0 && siteKeys[site].state.load( std::memory_order_acquire ) != SITE_READY )
+            continue;
+        uint64_t allocations = 0, allocatedBytes = 0, frees = 0, freedBytes = 0;
+        for( unsigned int shard = 0; shard < RAK_MEMORY_PROFILER_SHARD_COUNT; shard++ )
+        {
+            const SiteCounters& siteCounters = counters[shard][site];
+            allocations += siteCounters.allocations.load( std::memory_order_relaxed );
+            allocatedBytes += siteCounters.allocatedBytes.load( std::memory_order_relaxed );
+            frees += siteCounters.frees.load( std::memory_order_relaxed );
+            freedBytes += siteCounters.freedBytes.load( std::memory_order_relaxed );
+        }
+
+        SiteSample& sample = samples[site];
+        // A block freed on a shard read after the one it was allocated on can briefly make this negative
+        sample.liveBytes = std::max<int64_t>( (int64_t)( allocatedBytes - freedBytes ), 0 );
+        sample.liveAllocations = std::max<int64_t>( (int64_t)( allocations - frees ), 0 );
+        sample.peakBytes = std::max( sample.peakBytes, (uint64_t)sample.liveBytes );
+        sample.allocations = allocations;
+        sample.allocatedBytes = allocatedBytes;
+        if( endWindow )
+        {
+            if( hasWindow && seconds > 0 )
+            {
+                sample.allocationsPerSecond = (double)( allocations - sample.windowAllocations ) / seconds;
+                sample.bytesPerSecond = (double)( allocatedBytes - sample.windowAllocatedBytes ) / seconds;
+            }
+            sample.windowAllocations = allocations;
+            sample.windowAllocatedBytes = allocatedBytes;
+        }
+    }
+    if( endWindow )
+    {
+        windowStart = now;
+        hasWindow = true;
+    }
+}
+
+bool SameSite( const MemoryProfilerSite& a, const MemoryProfilerSite& b )
+{
+    return a.line == b.line && ( a.file == b.file || ( a.file && b.file && strcmp( a.file, b.file ) == 0 ) );
+}
+
+// Sites with the same line next to each other, then by file name
+bool SiteOrder( const MemoryProfilerSite& a, const MemoryProfilerSite& b )
+{
+    if( a.line != b.line )
+        return a.line < b.line;
+    if( a.file == 0 || b.file == 0 )
+        return a.file == 0 && b.file != 0;
+    return strcmp( a.file, b.file ) < 0;
+}
+
+} // namespace
+
+namespace RakNet {
+
+void StartMemoryProfiler( void )
+{
+    if( isStarted.exchange( true ) )
+        return;
+    previousMalloc = GetMalloc();
+    previousRealloc = GetRealloc();
+    previousFree = GetFree();
+    previousMalloc_Ex = GetMalloc_Ex();
+    previousRealloc_Ex = GetRealloc_Ex();
+    previousFree_Ex = GetFree_Ex();
+    SetMalloc( MemoryProfilerMalloc );
+    SetRealloc( MemoryProfilerRealloc );
+    SetFree( MemoryProfilerFree );
+    SetMalloc_Ex( MemoryProfilerMalloc_Ex );
+    SetRealloc_Ex( MemoryProfilerRealloc_Ex );
+    SetFree_Ex( MemoryProfilerFree_Ex );
+
+    std::lock_guard<std::mutex> guard( sampleMutex );
+    Sample( true );
+}
+
+bool IsMemoryProfilerStarted( void )
+{
+    return isStarted.load();
+}
+
+void SampleMemoryProfiler( void )
+{
+    std::lock_guard<std::mutex> guard( sampleMutex );
+    Sample( true );
+}
+
+unsigned int GetMemoryProfilerSites( MemoryProfilerSite* sites, unsigned int maxCount, MemoryProfilerSort sort )
+{
+    std::vector<MemoryProfilerSite> found;
+    {
+        std::lock_guard<std::mutex> guard( sampleMutex );
+        Sample( false );
+        for( unsigned int site = 0; site < RAK_MEMORY_PROFILER_MAX_SITES; site++ )
+        {
+            const SiteSample& sample = samples[site];
+            if( sample.allocations == 0 )
+                continue;
+            MemoryProfilerSite entry;
+            entry.file = site == 0 ? 0 : siteKeys[site].file;
+            entry.line = site == 0 ? 0 : siteKeys[site].line;
+            entry.liveBytes = (uint64_t)sample.liveBytes;
+            entry.liveAllocations = (uint64_t)sample.liveAllocations;
+            entry.peakBytes = sample.peakBytes;
+            entry.allocationCount = sample.allocations;
+            entry.allocatedBytes = sample.allocatedBytes;
+            entry.allocationsPerSecond = sample.allocationsPerSecond;
+            entry.bytesPerSecond = sample.bytesPerSecond;
+            found.push_back( entry );
+        }
+    }
+
+    // The same line of a header passes a different __FILE__ pointer from each translation unit
+    std::sort( found.begin(), found.end(), SiteOrder );
+    unsigned int mergedCount = 0;
+    for( unsigned int i = 0; i < found.size(); i++ )
+    {
+        if( mergedCount > 0 && SameSite( found[mergedCount - 1], found[i] ) )
+        {
+            MemoryProfilerSite& merged = found[mergedCount - 1];
+            merged.liveBytes += found[i].liveBytes;
+            merged.liveAllocations += found[i].liveAllocations;
+            // Peaks of the parts may not have happened at once, so this is an upper bound
+            merged.peakBytes += found[i].peakBytes;
+            merged.allocationCount += found[i].allocationCount;
+            merged.allocatedBytes += found[i].allocatedBytes;
+            merged.allocationsPerSecond += found[i].allocationsPerSecond;
+            merged.bytesPerSecond += found[i].bytesPerSecond;
+        }
+        else
+            found[mergedCount++] = found[i];
+    }
+    found.resize( mergedCount );
+
+    std::sort( found.begin(), found.end(), [sort]( const MemoryProfilerSite& a, const MemoryProfilerSite& b ) {
+        switch( sort )
+        {
+        case MPS_PEAK_BYTES:
+            return a.peakBytes > b.peakBytes;
+        case MPS_BYTES_PER_SECOND:
+            return a.bytesPerSecond > b.bytesPerSecond;
+        case MPS_ALLOCATIONS_PER_SECOND:
+            return a.allocationsPerSecond > b.allocationsPerSecond;
+        default:
+            return a.liveBytes > b.liveBytes;
+        }
+    } );
+    const unsigned int count = std::min( mergedCount, maxCount );
+    std::copy( found.begin(), found.begin() + count, sites );
+    return count;
+}
+
+void PrintMemoryProfilerReport( unsigned int maxCount, MemoryProfilerSort sort )
+{
+    std::vector<MemoryProfilerSite> sites( maxCount );
+    const unsigned int count = GetMemoryProfilerSites( sites.data(), maxCount, sort );
+    RAKNET_DEBUG_PRINTF( "%-40s %14s %10s %14s %12s %14s\n", "Site", "Live bytes", "Live", "Peak bytes", "Allocs/s", "Bytes/s" );
+    for( unsigned int i = 0; i < count; i++ )
+    {
+        char name[64] = "(no file)";
+        if( sites[i].file )
+        {
+            const char* base = sites[i].file;
+            for( const char* c = sites[i].file; *c; c++ )
+            {
+                if( *c == '/' || *c == '\\' )
+                    base = c + 1;
+            }
+            snprintf( name, sizeof( name ), "%s:%u", base, sites[i].line );
+        }
+        RAKNET_DEBUG_PRINTF( "%-40s %14llu %10llu %14llu %12.0f %14.0f\n", name, (unsigned long long)sites[i].liveBytes, (unsigned long long)sites[i].liveAllocations,
+            (unsigned long long)sites[i].peakBytes, sites[i].allocationsPerSecond, sites[i].bytesPerSecond );
+    }
+}
+
+void* MemoryProfilerMalloc( size_t size )
+{
+    return Track( (BlockHeader*)previousMalloc( sizeof( BlockHeader ) + size ), size, 0 );
+}
+
+void* MemoryProfilerRealloc( void* p, size_t size )
+{
+    if( p == 0 )
+        return MemoryProfilerMalloc( size );
+    const BlockHeader* old = (BlockHeader*)p - 1;
+    BlockHeader* block = (BlockHeader*)previousRealloc( (void*)old, sizeof( BlockHeader ) + size );
+    if( block == 0 )
+        return 0;
+    // The old block is counted as freed, and the new one counted where it was reallocated
+    Untrack( block + 1 );
+    return Track( block, size, 0 );
+}
+
+void MemoryProfilerFree( void* p )
+{
+    if( p )
+        previousFree( Untrack( p ) );
+}
+
+void* MemoryProfilerMalloc_Ex( size_t size, const char* file, unsigned int line )
+{
+    return Track( (BlockHeader*)previousMalloc_Ex( sizeof( BlockHeader ) + size, file, line ), size, FindSite( file, line ) );
+}
+
+void* MemoryProfilerRealloc_Ex( void* p, size_t size, const char* file, unsigned int line )
+{
+    if( p == 0 )
+        return MemoryProfilerMalloc_Ex( size, file, line );
+    const BlockHeader* old = (BlockHeader*)p - 1;
+    BlockHeader* block = (BlockHeader*)previousRealloc_Ex( (void*)old, sizeof( BlockHeader ) + size, file, line );
+    if( block == 0 )
+        return 0;
+    Untrack( block + 1 );
+    return Track( block, size, FindSite( file, line ) );
+}
+
+void MemoryProfilerFree_Ex( void* p, const char* file, unsigned int line )
+{
+    if( p )
+        previousFree_Ex( Untrack( p ), file, line );
+}
+
+} // namespace RakNet
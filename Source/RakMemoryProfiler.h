@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Counts live bytes, peaks and allocation rates for every file and line that calls rakMalloc_Ex, rakRealloc_Ex and OP_NEW.
+///
+
+#pragma once
+
+#include "Export.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Call sites counted separately. Beyond that, allocations are counted under a file of 0 and line 0.
+#define RAK_MEMORY_PROFILER_MAX_SITES 4096
+// Copies of every counter, so that threads rarely write to the same cache line
+#define RAK_MEMORY_PROFILER_SHARD_COUNT 16
+
+namespace RakNet {
+
+/// Memory allocated at one file and line
+struct RAK_DLL_EXPORT MemoryProfilerSite
+{
+    /// The file, or 0 for rakMalloc and rakRealloc, and for sites beyond RAK_MEMORY_PROFILER_MAX_SITES
+    const char* file;
+    unsigned int line;
+    /// Bytes allocated here and not yet freed. A block reallocated elsewhere counts there from then on.
+    uint64_t liveBytes;
+    uint64_t liveAllocations;
+    /// The most liveBytes seen by SampleMemoryProfiler() and GetMemoryProfilerSites()
+    uint64_t peakBytes;
+    /// Allocations since the profiler started
+    uint64_t allocationCount;
+    uint64_t allocatedBytes;
+    /// Between the last two calls to SampleMemoryProfiler()
+    double allocationsPerSecond;
+    double bytesPerSecond;
+};
+
+enum MemoryProfilerSort
+{
+    MPS_LIVE_BYTES,
+    MPS_PEAK_BYTES,
+    MPS_BYTES_PER_SECOND,
+    MPS_ALLOCATIONS_PER_SECOND,
+};
+
+/// Puts the profiler in front of whatever rakMalloc, rakRealloc, rakFree and their _Ex versions point to, such as UseMemoryBackend().
+/// Call it before RakNet allocates anything, as each block carries 16 bytes saying where it was allocated.
+/// The profiler stays in place until the process exits. Calling it again does nothing.
+/// With _USE_RAK_MEMORY_OVERRIDE 0, OP_NEW and OP_NEW_ARRAY use new and are not counted.
+///
+/// Each allocation adds to counters that only threads of the same shard write, so threads allocating at the same site do not contend.
+/// Counters only ever go up, and live bytes are what was allocated less what was freed, summed over the shards.
+void RAK_DLL_EXPORT StartMemoryProfiler( void );
+
+/// \return If StartMemoryProfiler() was called
+bool RAK_DLL_EXPORT IsMemoryProfilerStarted( void );
+
+/// Records the live bytes of every site for peakBytes, and ends the window the rates are worked out over.
+/// Call it regularly, such as once a second, or peaks between calls are missed.
+void RAK_DLL_EXPORT SampleMemoryProfiler( void );
+
+/// Records the live bytes of every site for peakBytes, without ending the window of the rates.
+/// Then fills \a sites with the sites that allocated anything, sorted by \a sort with the largest first.
+/// \return How many were filled, at most \a maxCount
+unsigned int RAK_DLL_EXPORT GetMemoryProfilerSites( MemoryProfilerSite* sites, unsigned int maxCount, MemoryProfilerSort sort );
+
+/// Prints the first \a maxCount sites of GetMemoryProfilerSites() with RAKNET_DEBUG_PRINTF
+void RAK_DLL_EXPORT PrintMemoryProfilerReport( unsigned int maxCount, MemoryProfilerSort sort );
+
+/// The profiler, for calling directly or from your own allocation functions.
+/// Before StartMemoryProfiler() these pass on to malloc, realloc and free.
+void RAK_DLL_EXPORT* MemoryProfilerMalloc( size_t size );
+void RAK_DLL_EXPORT* MemoryProfilerRealloc( void* p, size_t size );
+void RAK_DLL_EXPORT  MemoryProfilerFree( void* p );
+void RAK_DLL_EXPORT* MemoryProfilerMalloc_Ex( size_t size, const char* file, unsigned int line );
+void RAK_DLL_EXPORT* MemoryProfilerRealloc_Ex( void* p, size_t size, const char* file, unsigned int line );
+void RAK_DLL_EXPORT  MemoryProfilerFree_Ex( void* p, const char* file, unsigned int line );
+
+} // namespace RakNet
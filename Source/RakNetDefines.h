@@ -123,6 +123,53 @@
 #define INTERNAL_PACKET_PAGE_SIZE 8
 #endif
 
+// Datagrams with fewer bytes of messages than this are not worth compressing. See RakPeerInterface::SetDatagramCompression()
+#ifndef DATAGRAM_COMPRESSION_MIN_BYTES
+#define DATAGRAM_COMPRESSION_MIN_BYTES 64
+#endif
+
+// Each datagram that does not compress doubles how many of the following datagrams are sent without trying, up to this many
+#ifndef DATAGRAM_COMPRESSION_MAX_BACKOFF
+#define DATAGRAM_COMPRESSION_MAX_BACKOFF 32
+#endif
+
+// Messages between these sizes are compressed against the connection's CompressionDictionary. See RakPeerInterface::SetDictionaryCompression()
+// Larger messages do better with datagram compression. A message is only sent compressed if it then fits in the message payload of one datagram
+// at the connection's current MTU, as split messages are never compressed. At MINIMUM_MTU_SIZE that payload is well under the default maximum.
+#ifndef DICTIONARY_COMPRESSION_MIN_BYTES
+#define DICTIONARY_COMPRESSION_MIN_BYTES 8
+#endif
+
+#ifndef DICTIONARY_COMPRESSION_MAX_BYTES
+#define DICTIONARY_COMPRESSION_MAX_BYTES 512
+#endif
+
+// Path MTU discovery, see RakPeerInterface::SetPathMTUDiscovery(). Milliseconds to wait after the connection starts before the first probe,
+// and between probes while searching
+#ifndef PATH_MTU_DISCOVERY_PROBE_INTERVAL
+#define PATH_MTU_DISCOVERY_PROBE_INTERVAL 200
+#endif
+
+// Milliseconds between probes of the current MTU, which detect a path that no longer carries it
+#ifndef PATH_MTU_DISCOVERY_CONFIRM_INTERVAL
+#define PATH_MTU_DISCOVERY_CONFIRM_INTERVAL 5000
+#endif
+
+// Milliseconds after a search finishes before searching above the current MTU again
+#ifndef PATH_MTU_DISCOVERY_RAISE_INTERVAL
+#define PATH_MTU_DISCOVERY_RAISE_INTERVAL 60000
+#endif
+
+// How many probes of one size must be lost before that size is considered too large
+#ifndef PATH_MTU_DISCOVERY_MAX_PROBES
+#define PATH_MTU_DISCOVERY_MAX_PROBES 3
+#endif
+
+// The search stops once it has narrowed the path MTU down to this many bytes
+#ifndef PATH_MTU_DISCOVERY_GRANULARITY
+#define PATH_MTU_DISCOVERY_GRANULARITY 16
+#endif
+
 // If defined to 1, the user is responsible for calling RakPeer::RunUpdateCycle and RakPeer::RunRecvfrom
 #ifndef RAKPEER_USER_THREADED
 #define RAKPEER_USER_THREADED 0
@@ -16,6 +16,7 @@
 #include "GetTime.h"
 #include <stdio.h>
 #include <string.h> // memcpy
+#include <thread>
 
 #ifdef _WIN32
 #else
@@ -233,7 +234,30 @@ RNS2SendResult RNS2_Berkley::Send( RNS2_SendParameters* sendParameters, const ch
         if( len >= 0 )
             return len;
     }
-    return Send_NoVDP( rns2Socket, sendParameters, file, line );
+    return SendWithOptions( sendParameters, file, line );
+}
+
+RNS2SendResult RNS2_Berkley::SendWithoutOverride( RNS2_SendParameters* sendParameters, const char* file, unsigned int line )
+{
+    return SendWithOptions( sendParameters, file, line );
+}
+
+RNS2SendResult RNS2_Berkley::SendWithOptions( RNS2_SendParameters* sendParameters, const char* file, unsigned int line )
+{
+    if( sendParameters->ttl <= 0 && sendParameters->doNotFragment == false )
+    {
+        std::shared_lock<std::shared_mutex> guard( sendOptionsMutex );
+        return Send_NoVDP( rns2Socket, sendParameters, file, line );
+    }
+
+    // There is no portable way to set don't fragment on one IPv4 datagram, so set it on the socket while nothing else is sent
+    std::unique_lock<std::shared_mutex> guard( sendOptionsMutex );
+    if( sendParameters->doNotFragment )
+        SetDoNotFragment( 1 );
+    RNS2SendResult len = Send_NoVDP( rns2Socket, sendParameters, file, line );
+    if( sendParameters->doNotFragment )
+        SetDoNotFragment( 0 );
+    return len;
 }
 
 } // namespace RakNet
@@ -16,6 +16,7 @@
 
 #include <atomic>
 #include <mutex>
+#include <shared_mutex>
 
 namespace RakNet {
 
@@ -36,11 +37,17 @@ typedef int RNS2SendResult;
 
 struct RNS2_SendParameters
 {
-    RNS2_SendParameters() { ttl = 0; }
+    RNS2_SendParameters()
+    {
+        ttl = 0;
+        doNotFragment = false;
+    }
     char* data;
     int length;
     SystemAddress systemAddress;
     int ttl;
+    // Set the don't fragment flag on this datagram only, so that it is dropped rather than fragmented if larger than the path MTU
+    bool doNotFragment;
 };
 
 struct RNS2RecvStruct
@@ -146,6 +153,8 @@ public:
 
     RNS2BindResult Bind( RNS2_BerkleyBindParameters* bindParameters, const char* file, unsigned int line );
     RNS2SendResult Send( RNS2_SendParameters* sendParameters, const char* file, unsigned int line );
+    /// Send to the socket even if a SocketLayerOverride is set, for overrides that pass datagrams on
+    RNS2SendResult SendWithoutOverride( RNS2_SendParameters* sendParameters, const char* file, unsigned int line );
 
     void SetSocketLayerOverride( SocketLayerOverride* _slo );
     SocketLayerOverride* GetSocketLayerOverride( void );
@@ -184,6 +193,11 @@ protected:
 
     SocketLayerOverride* slo;
     static void RecvFromLoop( void* arg );
+
+    // Datagrams with a ttl or doNotFragment change the socket options for themselves, so they hold this exclusively
+    // while every other datagram holds it shared, and no other datagram is sent with their options
+    std::shared_mutex sendOptionsMutex;
+    RNS2SendResult SendWithOptions( RNS2_SendParameters* sendParameters, const char* file, unsigned int line );
 };
 
 } // namespace RakNet
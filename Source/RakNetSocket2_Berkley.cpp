@@ -198,6 +198,18 @@ void RNS2_Berkley::SetDoNotFragment( int opt )
     RakAssert( IP_DONTFRAGMENT == 14 );
 #endif
     setsockopt__( rns2Socket, boundAddress.GetIPPROTO(), IP_DONTFRAGMENT, (char*)&opt, sizeof( opt ) );
+#elif defined( IP_MTU_DISCOVER ) && defined( IP_PMTUDISC_PROBE )
+    // Probe sets DF without checking the size against the path MTU the kernel has cached, so the datagram tests the path itself
+#if RAKNET_SUPPORT_IPV6 == 1
+    if( boundAddress.GetIPVersion() == 6 )
+    {
+        int discover = opt ? IPV6_PMTUDISC_PROBE : IPV6_PMTUDISC_WANT;
+        setsockopt__( rns2Socket, IPPROTO_IPV6, IPV6_MTU_DISCOVER, (char*)&discover, sizeof( discover ) );
+        return;
+    }
+#endif
+    int discover = opt ? IP_PMTUDISC_PROBE : IP_PMTUDISC_WANT;
+    setsockopt__( rns2Socket, IPPROTO_IP, IP_MTU_DISCOVER, (char*)&discover, sizeof( discover ) );
 #endif
 }
 
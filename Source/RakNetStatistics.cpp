@@ -14,6 +14,7 @@
 
 #include "RakNetStatistics.h"
 #include <stdio.h> // sprintf
+#include <string.h> // strcat
 #include "GetTime.h"
 
 namespace RakNet {
@@ -143,6 +144,18 @@ void RAK_DLL_EXPORT StatisticsToString( RakNetStatistics* s, char* buffer, int v
                      100.0f * s->valueOverLastSecond[ACTUAL_BYTES_SENT] / s->BPSLimitByOutgoingBandwidthLimit );
             strcat( buffer, buff2 );
         }
+        if( s->compressionInputBytes != 0 )
+        {
+            char buff2[256];
+            sprintf( buff2,
+                     "Compression ratio                    %.2f\n"
+                     "Compression time in microseconds     %" PRINTF_64_BIT_MODIFIER "u\n"
+                     "Decompression time in microseconds   %" PRINTF_64_BIT_MODIFIER "u\n",
+                     s->compressionRatio,
+                     (long long unsigned int)s->compressionTimeUS,
+                     (long long unsigned int)s->decompressionTimeUS );
+            strcat( buffer, buff2 );
+        }
     }
 }
 
@@ -95,6 +95,33 @@ struct RAK_DLL_EXPORT RakNetStatistics
     /// What is the average total packetloss over the lifetime of the connection?
     float packetlossTotal;
 
+    /// How many bytes of datagram payload went through the compression stage, and how many bytes that became.
+    /// Datagrams that did not get smaller are sent as is and count the same for both. 0 unless compression was negotiated.
+    /// \sa RakPeerInterface::SetDatagramCompression()
+    uint64_t compressionInputBytes;
+    uint64_t compressionOutputBytes;
+
+    /// compressionInputBytes divided by compressionOutputBytes, or 1 if nothing was compressed
+    float compressionRatio;
+
+    /// How many microseconds were spent compressing outgoing and decompressing incoming datagrams and messages
+    uint64_t compressionTimeUS;
+    uint64_t decompressionTimeUS;
+
+    /// Per message ID, how many bytes of messages were sent while dictionary compression was on, and how many bytes that became.
+    /// Messages that start with ID_TIMESTAMP count for the ID that follows the timestamp.
+    /// \sa RakPeerInterface::SetDictionaryCompression()
+    uint64_t messageCompressionInputBytes[256];
+    uint64_t messageCompressionOutputBytes[256];
+
+    /// \return messageCompressionInputBytes divided by messageCompressionOutputBytes for \a messageID, or 1 if no such messages were sent
+    float GetMessageCompressionRatio( unsigned char messageID ) const
+    {
+        if( messageCompressionOutputBytes[messageID] == 0 )
+            return 1.0f;
+        return (float)( (double)messageCompressionInputBytes[messageID] / (double)messageCompressionOutputBytes[messageID] );
+    }
+
     RakNetStatistics& operator+=( const RakNetStatistics& other )
     {
         unsigned i;
@@ -110,6 +137,18 @@ struct RAK_DLL_EXPORT RakNetStatistics
             runningTotal[i] += other.runningTotal[i];
         }
 
+        compressionInputBytes += other.compressionInputBytes;
+        compressionOutputBytes += other.compressionOutputBytes;
+        compressionRatio = compressionOutputBytes > 0 ? (float)( (double)compressionInputBytes / (double)compressionOutputBytes ) : 1.0f;
+        compressionTimeUS += other.compressionTimeUS;
+        decompressionTimeUS += other.decompressionTimeUS;
+
+        for( i = 0; i < 256; i++ )
+        {
+            messageCompressionInputBytes[i] += other.messageCompressionInputBytes[i];
+            messageCompressionOutputBytes[i] += other.messageCompressionOutputBytes[i];
+        }
+
         return *this;
     }
 };
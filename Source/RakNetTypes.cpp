@@ -20,6 +20,7 @@
 #include "WSAStartupSingleton.h"
 #include "SocketDefines.h"
 #include "RakNetSocket2.h"
+#include "LinuxStrings.h"
 
 
 #if defined( _WIN32 )
@@ -142,9 +142,7 @@ Packet* RakPeer::AllocPacket( unsigned dataSize, const char* file, unsigned int
     //  return p;
 
     Packet* p;
-    packetAllocationPoolMutex.lock();
     p = packetAllocationPool.Allocate( file, line );
-    packetAllocationPoolMutex.unlock();
     p = new( (void*)p ) Packet;
     p->data = (unsigned char*)rakMalloc_Ex( dataSize, file, line );
     p->length = dataSize;
@@ -159,9 +157,7 @@ Packet* RakPeer::AllocPacket( unsigned dataSize, unsigned char* data, const char
 {
     // Packet *p = (Packet *)rakMalloc_Ex(sizeof(Packet), file, line);
     Packet* p;
-    packetAllocationPoolMutex.lock();
     p = packetAllocationPool.Allocate( file, line );
-    packetAllocationPoolMutex.unlock();
     p = new( (void*)p ) Packet;
     RakAssert( p );
     p->data = data;
@@ -240,9 +236,8 @@ RakPeer::RakPeer()
     bufferedCommands.SetPageSize( sizeof( BufferedCommandStruct ) * 16 );
     socketQueryOutput.SetPageSize( sizeof( SocketQueryOutput ) * 8 );
 
-    packetAllocationPoolMutex.lock();
-    packetAllocationPool.SetPageSize( sizeof( DataStructures::MemoryPool<Packet>::MemoryWithPage ) * 32 );
-    packetAllocationPoolMutex.unlock();
+    packetAllocationPool.SetPageSize( sizeof( DataStructures::ThreadsafeMemoryPool<Packet>::MemoryWithPage ) * 32 );
+    bufferedPacketsFreePool.SetPageSize( sizeof( DataStructures::ThreadsafeMemoryPool<RNS2RecvStruct>::MemoryWithPage ) * 16 );
 
     remoteSystemIndexPool.SetPageSize( sizeof( DataStructures::MemoryPool<RemoteSystemIndex>::MemoryWithPage ) * 32 );
 
@@ -250,6 +245,11 @@ RakPeer::RakPeer()
 
     quitAndDataEvents.InitEvent();
     limitConnectionFrequencyFromTheSameIP = false;
+    datagramIntegrityCheck = false;
+    datagramCompression = false;
+    dictionaryCompression = false;
+    compressionDictionaryTrainer = 0;
+    pathMTUDiscovery = false;
     ResetSendReceipt();
 }
 
@@ -875,14 +875,14 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
         DeallocatePacket( pPacket );
     packetReturnQueue.clear();
     packetReturnMutex.unlock();
-    packetAllocationPoolMutex.lock();
     packetAllocationPool.Clear( _FILE_AND_LINE_ );
-    packetAllocationPoolMutex.unlock();
 
     DerefAllSockets();
 
     ClearBufferedCommands();
     ClearBufferedPackets();
+    // Only once the sockets stopped receiving, as Startup() calls ClearBufferedPackets() after they start
+    bufferedPacketsFreePool.Clear( _FILE_AND_LINE_ );
     ClearSocketQueryOutput();
 
     ClearRequestedConnectionList();
@@ -1261,7 +1261,6 @@ void RakPeer::DeallocatePacket( Packet* packet )
     {
         rakFree_Ex( packet->data, _FILE_AND_LINE_ );
         packet->~Packet();
-        std::lock_guard<std::mutex> guard( packetAllocationPoolMutex );
         packetAllocationPool.Release( packet, _FILE_AND_LINE_ );
     }
     else
@@ -2298,6 +2297,78 @@ void RakPeer::SetUnreliableTimeout( RakNet::TimeMS timeoutMS )
         remoteSystemList[i].reliabilityLayer.SetUnreliableTimeout( unreliableTimeout );
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetDatagramIntegrityCheck( bool enabled )
+{
+    datagramIntegrityCheck = enabled;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetDatagramIntegrityCheck( void ) const
+{
+    return datagramIntegrityCheck;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetDatagramCompression( bool enabled )
+{
+    datagramCompression = enabled;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetDatagramCompression( void ) const
+{
+    return datagramCompression;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetDictionaryCompression( bool enabled )
+{
+    dictionaryCompression = enabled;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetDictionaryCompression( void ) const
+{
+    return dictionaryCompression;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetCompressionDictionary( const unsigned char* data, unsigned int length )
+{
+    std::shared_ptr<const CompressionDictionary> dictionary;
+    if( length > 0 )
+        dictionary = std::make_shared<const CompressionDictionary>( data, length );
+
+    std::lock_guard<std::mutex> guard( compressionDictionaryMutex );
+    compressionDictionary = dictionary;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t RakPeer::GetCompressionDictionaryID( void ) const
+{
+    std::lock_guard<std::mutex> guard( compressionDictionaryMutex );
+    return compressionDictionary ? compressionDictionary->GetID() : 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetCompressionDictionaryTrainer( CompressionDictionaryTrainer* trainer )
+{
+    compressionDictionaryTrainer = trainer;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetPathMTUDiscovery( bool enabled )
+{
+    pathMTUDiscovery = enabled;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetPathMTUDiscovery( void ) const
+{
+    return pathMTUDiscovery;
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Send a message to host, with the IP socket option TTL set to 3
 // This message will not reach the host, but will open the router.
@@ -3091,6 +3162,15 @@ void RakPeer::OnConnectionRequest( RakPeer::RemoteSystemStruct* remoteSystem, Ra
     bitStream.Write( incomingTimestamp );
     bitStream.Write( RakNet::GetTime() );
 
+    // The client does not have our compression dictionary yet
+    const std::shared_ptr<const CompressionDictionary>& dictionary = remoteSystem->reliabilityLayer.GetCompressionDictionary();
+    if( dictionary && remoteSystem->reliabilityLayer.GetDictionaryCompression() == false )
+    {
+        bitStream.Write( dictionary->GetID() );
+        bitStream.Write( dictionary->GetLength() );
+        bitStream.WriteAlignedBytes( dictionary->GetData(), dictionary->GetLength() );
+    }
+
     SendImmediate( (char*)bitStream.GetData(), bitStream.GetNumberOfBitsUsed(), IMMEDIATE_PRIORITY, RELIABLE_ORDERED, 0, remoteSystem->systemAddress, false, false, RakNet::GetTimeUS(), 0 );
 }
 
@@ -3267,6 +3347,81 @@ RakPeer::RemoteSystemStruct* RakPeer::AssignSystemAddressToRemoteSystemList( con
     return 0;
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Optional features this system wants on new connections
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned char RakPeer::GetLocalConnectionFeatures( void ) const
+{
+    unsigned char features = 0;
+    if( datagramIntegrityCheck )
+        features |= CONNECTION_FEATURE_DATAGRAM_INTEGRITY_CHECK;
+    if( datagramCompression )
+        features |= CONNECTION_FEATURE_DATAGRAM_COMPRESSION;
+    if( dictionaryCompression )
+        features |= CONNECTION_FEATURE_DICTIONARY_COMPRESSION;
+    if( pathMTUDiscovery )
+        features |= CONNECTION_FEATURE_PATH_MTU_DISCOVERY;
+    return features;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned char RakPeer::GetConnectionFeatures( const RemoteSystemStruct* remoteSystem ) const
+{
+    unsigned char features = 0;
+    if( remoteSystem->reliabilityLayer.GetDatagramIntegrityCheck() )
+        features |= CONNECTION_FEATURE_DATAGRAM_INTEGRITY_CHECK;
+    if( remoteSystem->reliabilityLayer.GetDatagramCompression() )
+        features |= CONNECTION_FEATURE_DATAGRAM_COMPRESSION;
+    if( remoteSystem->reliabilityLayer.GetCompressionDictionary() )
+        features |= CONNECTION_FEATURE_DICTIONARY_COMPRESSION;
+    if( remoteSystem->reliabilityLayer.GetPathMTUDiscovery() )
+        features |= CONNECTION_FEATURE_PATH_MTU_DISCOVERY;
+    return features;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ApplyConnectionFeatures( RemoteSystemStruct* remoteSystem, unsigned char features )
+{
+    remoteSystem->reliabilityLayer.SetDatagramIntegrityCheck( ( features & CONNECTION_FEATURE_DATAGRAM_INTEGRITY_CHECK ) != 0 );
+    remoteSystem->reliabilityLayer.SetDatagramCompression( ( features & CONNECTION_FEATURE_DATAGRAM_COMPRESSION ) != 0 );
+    remoteSystem->reliabilityLayer.SetPathMTUDiscovery( ( features & CONNECTION_FEATURE_PATH_MTU_DISCOVERY ) != 0 );
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+std::shared_ptr<const CompressionDictionary> RakPeer::GetCompressionDictionary( void ) const
+{
+    std::lock_guard<std::mutex> guard( compressionDictionaryMutex );
+    return compressionDictionary;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Read the compression dictionary the server appends to ID_CONNECTION_REQUEST_ACCEPTED when we did not have it
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ReadCompressionDictionary( RemoteSystemStruct* remoteSystem, BitStream& bitStream )
+{
+    uint32_t id;
+    unsigned int length;
+    if( bitStream.Read( id ) == false || bitStream.Read( length ) == false ||
+        length == 0 || length > LZ_MAX_DICTIONARY_LENGTH || BITS_TO_BYTES( bitStream.GetNumberOfUnreadBits() ) < length )
+        return;
+
+    std::vector<unsigned char> data( length );
+    if( bitStream.ReadAlignedBytes( data.data(), length ) == false )
+        return;
+
+    std::shared_ptr<const CompressionDictionary> dictionary = std::make_shared<const CompressionDictionary>( data.data(), length );
+    if( dictionary->GetID() != id )
+        return;
+
+    remoteSystem->reliabilityLayer.SetCompressionDictionary( dictionary );
+    remoteSystem->reliabilityLayer.SetDictionaryCompression( true );
+
+    // Keep it, so the next connection to a system with this dictionary does not need to send it again
+    std::lock_guard<std::mutex> guard( compressionDictionaryMutex );
+    if( compressionDictionary == nullptr )
+        compressionDictionary = dictionary;
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Adjust the first four bytes (treated as unsigned int) of the pointer
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -3495,39 +3650,22 @@ bool RakPeer::AllowIncomingConnections( void ) const
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::DeallocRNS2RecvStruct( RNS2RecvStruct* s, const char* file, unsigned int line )
 {
-    std::lock_guard<std::mutex> guard( bufferedPacketsFreePoolMutex );
-    bufferedPacketsFreePool.push_back( s );
+    s->~RNS2RecvStruct();
+    bufferedPacketsFreePool.Release( s, file, line );
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RNS2RecvStruct* RakPeer::AllocRNS2RecvStruct( const char* file, unsigned int line )
 {
-    std::lock_guard<std::mutex> guard( bufferedPacketsFreePoolMutex );
-    if( !bufferedPacketsFreePool.empty() )
-    {
-        RNS2RecvStruct* s = bufferedPacketsFreePool.front();
-        bufferedPacketsFreePool.pop_front();
-        return s;
-    }
-    else
-    {
-        return RakNet::OP_NEW<RNS2RecvStruct>( file, line );
-    }
+    RNS2RecvStruct* s = bufferedPacketsFreePool.Allocate( file, line );
+    return new( (void*)s ) RNS2RecvStruct;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::ClearBufferedPackets( void )
 {
-    bufferedPacketsFreePoolMutex.lock();
-    for( RNS2RecvStruct* pPacket : bufferedPacketsFreePool )
-    {
-        RakNet::OP_DELETE( pPacket, _FILE_AND_LINE_ );
-    }
-    bufferedPacketsFreePool.clear();
-    bufferedPacketsFreePoolMutex.unlock();
-
     bufferedPacketsQueueMutex.lock();
     for( RNS2RecvStruct* pPacket : bufferedPacketsQueue )
     {
-        RakNet::OP_DELETE( pPacket, _FILE_AND_LINE_ );
+        DeallocRNS2RecvStruct( pPacket, _FILE_AND_LINE_ );
     }
     bufferedPacketsQueue.clear();
     bufferedPacketsQueueMutex.unlock();
@@ -3746,6 +3884,13 @@ bool RakPeer::SendImmediate( char* data, BitSize_t numberOfBitsToSend, PacketPri
     unsigned int remoteSystemIndex, sendListIndex; // Iterates into the list of remote systems
     callerDataAllocationUsed = false;
 
+    if( compressionDictionaryTrainer )
+    {
+        unsigned int numberOfBytesToSend = (unsigned int)BITS_TO_BYTES( numberOfBitsToSend );
+        if( numberOfBytesToSend >= DICTIONARY_COMPRESSION_MIN_BYTES && numberOfBytesToSend <= DICTIONARY_COMPRESSION_MAX_BYTES )
+            compressionDictionaryTrainer->AddSample( (const unsigned char*)data, numberOfBytesToSend );
+    }
+
     sendListSize = 0;
 
     if( systemIdentifier.systemAddress != UNASSIGNED_SYSTEM_ADDRESS )
@@ -4245,6 +4390,11 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
                     bsOut.Write( mtu );
                     // Our guid
                     bsOut.Write( rakPeer->GetGuidFromSystemAddress( UNASSIGNED_SYSTEM_ADDRESS ) );
+                    // Optional features we would like on this connection
+                    unsigned char localConnectionFeatures = rakPeer->GetLocalConnectionFeatures();
+                    bsOut.Write( localConnectionFeatures );
+                    if( localConnectionFeatures & RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION )
+                        bsOut.Write( rakPeer->GetCompressionDictionaryID() );
 
                     for( PluginInterface2* pPlugin : rakPeer->pluginListNTS )
                     {
@@ -4295,6 +4445,13 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
             cat::ClientEasyHandshake* client_handshake = 0;
 #endif // LIBCAT_SECURITY
 
+            // Optional features the server agreed to. Older systems do not write this.
+            unsigned char connectionFeatures = 0;
+            bs.Read( connectionFeatures );
+            uint32_t remoteDictionaryID = 0;
+            if( connectionFeatures & RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION )
+                bs.Read( remoteDictionaryID );
+
             bool unlock = true;
             rakPeer->requestedConnectionQueueMutex.lock();
             for( RakPeer::RequestedConnectionStruct* rcs : rakPeer->requestedConnectionQueue )
@@ -4342,6 +4499,19 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
                         {
                             remoteSystem = rakPeer->AssignSystemAddressToRemoteSystemList( systemAddress, RakPeer::RemoteSystemStruct::UNVERIFIED_SENDER, rcs->socket, &thisIPConnectedRecently, bindingAddress, mtu, guid, doSecurity );
                         }
+
+                        if( remoteSystem )
+                        {
+                            rakPeer->ApplyConnectionFeatures( remoteSystem, connectionFeatures );
+
+                            // If we do not have the server's dictionary it comes with ID_CONNECTION_REQUEST_ACCEPTED
+                            std::shared_ptr<const CompressionDictionary> dictionary = rakPeer->GetCompressionDictionary();
+                            if( ( connectionFeatures & RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION ) && dictionary && dictionary->GetID() == remoteDictionaryID )
+                            {
+                                remoteSystem->reliabilityLayer.SetCompressionDictionary( dictionary );
+                                remoteSystem->reliabilityLayer.SetDictionaryCompression( true );
+                            }
+                        }
                     }
 
                     // 4/13/09 Attackers can flood ID_OPEN_CONNECTION_REQUEST and use up all available connection slots
@@ -4577,15 +4747,8 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
             bsp.data = (char*)bsOut.GetData();
             bsp.length = bsOut.GetNumberOfBytesUsed();
             bsp.systemAddress = systemAddress;
-            if( rakNetSocket->IsBerkleySocket() )
-            {
-                ( (RNS2_Berkley*)rakNetSocket )->SetDoNotFragment( 1 );
-            }
+            bsp.doNotFragment = true;
             rakNetSocket->Send( &bsp, _FILE_AND_LINE_ );
-            if( rakNetSocket->IsBerkleySocket() )
-            {
-                ( (RNS2_Berkley*)rakNetSocket )->SetDoNotFragment( 0 );
-            }
         }
         else if( (unsigned char)( data )[0] == ID_OPEN_CONNECTION_REQUEST_2 )
         {
@@ -4643,6 +4806,12 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
             uint16_t mtu;
             bs.Read( mtu );
             bs.Read( guid );
+            // Optional features the client would like. Older systems do not write this.
+            unsigned char requestedConnectionFeatures = 0;
+            bs.Read( requestedConnectionFeatures );
+            uint32_t remoteDictionaryID = 0;
+            if( requestedConnectionFeatures & RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION )
+                bs.Read( remoteDictionaryID );
 
             RakPeer::RemoteSystemStruct* rssFromSA = rakPeer->GetRemoteSystemFromSystemAddress( systemAddress, true, true );
             bool IPAddrInUse = rssFromSA != 0 && rssFromSA->isActive;
@@ -4707,6 +4876,10 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
                     bsAnswer.WriteAlignedBytes( (const unsigned char*)rssFromSA->answer, sizeof( rssFromSA->answer ) );
                 }
 #endif // LIBCAT_SECURITY
+                unsigned char connectionFeatures = rakPeer->GetConnectionFeatures( rssFromSA );
+                bsAnswer.Write( connectionFeatures );
+                if( connectionFeatures & RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION )
+                    bsAnswer.Write( rssFromSA->reliabilityLayer.GetCompressionDictionary()->GetID() );
 
                 for( PluginInterface2* pPlugin : rakPeer->pluginListNTS )
                 {
@@ -4781,6 +4954,26 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
                 return true;
             }
 
+            if( rssFromSA == 0 )
+            {
+                // Every slot is taken, by connections still being set up
+                bsOut.Write( (MessageID)ID_NO_FREE_INCOMING_CONNECTIONS );
+                bsOut.WriteAlignedBytes( (const unsigned char*)OFFLINE_MESSAGE_DATA_ID, sizeof( OFFLINE_MESSAGE_DATA_ID ) );
+                bsOut.Write( rakPeer->myGuid );
+                for( PluginInterface2* pPlugin : rakPeer->pluginListNTS )
+                {
+                    pPlugin->OnDirectSocketSend( (const char*)bsOut.GetData(), bsOut.GetNumberOfBitsUsed(), systemAddress );
+                }
+
+                RNS2_SendParameters bsp;
+                bsp.data = (char*)bsOut.GetData();
+                bsp.length = bsOut.GetNumberOfBytesUsed();
+                bsp.systemAddress = systemAddress;
+                rakNetSocket->Send( &bsp, _FILE_AND_LINE_ );
+
+                return true;
+            }
+
 #if LIBCAT_SECURITY == 1
             if( requiresSecurityOfThisClient )
             {
@@ -4803,6 +4996,21 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char* data,
             }
 #endif // LIBCAT_SECURITY
 
+            // Only features both systems want are turned on. Must be applied before the client sends its first datagram.
+            unsigned char connectionFeatures = requestedConnectionFeatures & rakPeer->GetLocalConnectionFeatures();
+            std::shared_ptr<const CompressionDictionary> dictionary = rakPeer->GetCompressionDictionary();
+            if( dictionary == nullptr )
+                connectionFeatures &= ~RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION;
+            rakPeer->ApplyConnectionFeatures( rssFromSA, connectionFeatures );
+            bsAnswer.Write( connectionFeatures );
+            if( connectionFeatures & RakPeer::CONNECTION_FEATURE_DICTIONARY_COMPRESSION )
+            {
+                // If the client has a different dictionary, ours is sent with ID_CONNECTION_REQUEST_ACCEPTED, and we only compress once ID_NEW_INCOMING_CONNECTION shows it arrived
+                rssFromSA->reliabilityLayer.SetCompressionDictionary( dictionary );
+                rssFromSA->reliabilityLayer.SetDictionaryCompression( dictionary->GetID() == remoteDictionaryID );
+                bsAnswer.Write( dictionary->GetID() );
+            }
+
             for( PluginInterface2* pPlugin : rakPeer->pluginListNTS )
             {
                 pPlugin->OnDirectSocketSend( (const char*)bsAnswer.GetData(), bsAnswer.GetNumberOfBitsUsed(), systemAddress );
@@ -5096,17 +5304,14 @@ bool RakPeer::RunUpdateCycle( BitStream& updateBitStream )
 
                     rcs->systemAddress.FixForIPVersion( socketToUse->GetBoundAddress() );
 
-                    if( socketToUse->IsBerkleySocket() )
-                    {
-                        ( (RNS2_Berkley*)socketToUse )->SetDoNotFragment( 1 );
-                    }
-
                     RakNet::Time sendToStart = RakNet::GetTime();
 
                     RNS2_SendParameters bsp;
                     bsp.data = (char*)bitStream.GetData();
                     bsp.length = bitStream.GetNumberOfBytesUsed();
                     bsp.systemAddress = rcs->systemAddress;
+                    // The reply tells which MTU got through, so this must not be fragmented
+                    bsp.doNotFragment = true;
                     if( socketToUse->Send( &bsp, _FILE_AND_LINE_ ) == 10040 )
                     {
                         // Don't use this MTU size again
@@ -5131,10 +5336,6 @@ bool RakPeer::RunUpdateCycle( BitStream& updateBitStream )
                             }
                         }
                     }
-                    if( socketToUse->IsBerkleySocket() )
-                    {
-                        ( (RNS2_Berkley*)socketToUse )->SetDoNotFragment( 0 );
-                    }
 
                     ++it;
                 }
@@ -5186,6 +5387,9 @@ bool RakPeer::RunUpdateCycle( BitStream& updateBitStream )
         }
 
         remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, timeNS, maxOutgoingBPS, pluginListNTS, &rnr, updateBitStream ); // systemAddress only used for the internet simulator test
+        // Path MTU discovery may have moved it
+        if( remoteSystem->reliabilityLayer.GetPathMTUDiscovery() )
+            remoteSystem->MTUSize = remoteSystem->reliabilityLayer.GetMTUSize();
 
         // Check for failure conditions
         if( remoteSystem->reliabilityLayer.IsDeadConnection() ||
@@ -5330,6 +5534,10 @@ bool RakPeer::RunUpdateCycle( BitStream& updateBitStream )
                         inBitStream.Read( sendPongTime );
                         OnConnectedPong( sendPingTime, sendPongTime, remoteSystem );
 
+                        // The client has our compression dictionary now
+                        if( remoteSystem->reliabilityLayer.GetCompressionDictionary() )
+                            remoteSystem->reliabilityLayer.SetDictionaryCompression( true );
+
                         // Overwrite the data in the packet
                         //                  NewIncomingConnectionStruct newIncomingConnectionStruct;
                         //                  BitStream nICS_BS( data, NewIncomingConnectionStruct_Size, false );
@@ -5480,6 +5688,9 @@ bool RakPeer::RunUpdateCycle( BitStream& updateBitStream )
                             inBitStream.Read( sendPongTime );
                             OnConnectedPong( sendPingTime, sendPongTime, remoteSystem );
 
+                            if( dictionaryCompression && remoteSystem->reliabilityLayer.GetCompressionDictionary() == nullptr )
+                                ReadCompressionDictionary( remoteSystem, inBitStream );
+
                             // Find a free remote system struct to use
                             //                      BitStream casBitS(data, byteSize, false);
                             //                      ConnectionAcceptStruct cas;
@@ -22,11 +22,14 @@
 #include "BitStream.h"
 #include "Export.h"
 #include "DS_ThreadsafeAllocatingQueue.h"
+#include "DS_ThreadsafeMemoryPool.h"
 #include "SignaledEvent.h"
 #include "NativeFeatureIncludes.h"
 #include "SecureHandshake.h"
+#include "CompressionDictionary.h"
 
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -503,6 +506,59 @@ public:
     /// \param[in] timeoutMS How many ms to wait before simply not sending an unreliable message.
     void SetUnreliableTimeout( RakNet::TimeMS timeoutMS );
 
+    /// \brief Append a CRC32C to every datagram and drop datagrams that arrive corrupted.
+    /// \details Only used on connections where both systems enabled it, which is negotiated during the connection handshake.
+    /// Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request the check on new connections.
+    void SetDatagramIntegrityCheck( bool enabled );
+
+    /// \brief Returns what was passed to SetDatagramIntegrityCheck().
+    bool GetDatagramIntegrityCheck( void ) const;
+
+    /// \brief Compress outgoing datagrams with a fast LZ compressor, when that makes them smaller.
+    /// \details Only used on connections where both systems enabled it, which is negotiated during the connection handshake.
+    /// Datagrams that do not shrink are sent uncompressed, and after several in a row compression is skipped for a while.
+    /// See compressionRatio and compressionTimeUS in RakNetStatistics for the effect. Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request compression on new connections.
+    void SetDatagramCompression( bool enabled );
+
+    /// \brief Returns what was passed to SetDatagramCompression().
+    bool GetDatagramCompression( void ) const;
+
+    /// \brief Compress small messages against a dictionary of data common to many messages.
+    /// \details Only used on connections where both systems enabled it and the system accepting the connection has a dictionary, which is negotiated during the connection handshake.
+    /// That system's dictionary is used in both directions. The handshake carries its ID, and the dictionary itself is sent with ID_CONNECTION_REQUEST_ACCEPTED if the other system does not have it yet.
+    /// See messageCompressionInputBytes and messageCompressionOutputBytes in RakNetStatistics for the effect. Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request dictionary compression on new connections.
+    void SetDictionaryCompression( bool enabled );
+
+    /// \brief Returns what was passed to SetDictionaryCompression().
+    bool GetDictionaryCompression( void ) const;
+
+    /// \brief Set the dictionary new connections compress small messages against.
+    /// \details Connections already made keep the dictionary they started with.
+    /// \param[in] data The dictionary, for example from CompressionDictionaryTrainer::Train(). The data is copied.
+    /// \param[in] length The length of \a data in bytes. 0 to remove the dictionary.
+    void SetCompressionDictionary( const unsigned char* data, unsigned int length );
+
+    /// \brief Returns the ID of the dictionary new connections compress against, or 0 if there is none.
+    /// \details A system without a dictionary of its own uses the first one it receives.
+    uint32_t GetCompressionDictionaryID( void ) const;
+
+    /// \brief Offer outgoing messages that are small enough for dictionary compression to \a trainer.
+    /// \param[in] trainer The trainer, which must stay valid until this is called again with 0. Set before Startup().
+    void SetCompressionDictionaryTrainer( CompressionDictionaryTrainer* trainer );
+
+    /// \brief Keep probing the path of established connections for the largest datagram that gets through without fragmentation, and size datagrams for it.
+    /// \details The MTU found during the connection handshake is only the starting point, and is raised or lowered as the probes succeed or fail. GetMTUSize() returns the current value.
+    /// Messages that were split for a larger MTU before it was lowered are still sent at that size.
+    /// Only used on connections where both systems enabled it, which is negotiated during the connection handshake. Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request path MTU discovery on new connections.
+    void SetPathMTUDiscovery( bool enabled );
+
+    /// \brief Returns what was passed to SetPathMTUDiscovery().
+    bool GetPathMTUDiscovery( void ) const;
+
     /// \brief Send a message to a host, with the IP socket option TTL set to 3.
     /// \details This message will not reach the host, but will open the router.
     /// \param[in] host The address of the remote host in dotted notation.
@@ -719,6 +775,28 @@ protected:
     /// \param[in] bindingAddress   Address to be binded with the remote system
     /// \param[in] incomingMTU  MTU for the remote system
     RemoteSystemStruct* AssignSystemAddressToRemoteSystemList( const SystemAddress systemAddress, RemoteSystemStruct::ConnectMode connectionMode, RakNetSocket2* incomingRakNetSocket, bool* thisIPConnectedRecently, SystemAddress bindingAddress, int incomingMTU, RakNetGUID guid, bool useSecurity );
+
+    /// Optional per-connection features. The client writes the ones it wants at the end of ID_OPEN_CONNECTION_REQUEST_2,
+    /// the server answers with the ones both systems want at the end of ID_OPEN_CONNECTION_REPLY_2.
+    /// Systems that do not write this byte get none of them.
+    enum ConnectionFeatures
+    {
+        CONNECTION_FEATURE_DATAGRAM_INTEGRITY_CHECK = 1 << 0,
+        CONNECTION_FEATURE_DATAGRAM_COMPRESSION = 1 << 1,
+        /// Followed by the uint32_t ID of the CompressionDictionary the system has, 0 for none
+        CONNECTION_FEATURE_DICTIONARY_COMPRESSION = 1 << 2,
+        CONNECTION_FEATURE_PATH_MTU_DISCOVERY = 1 << 3
+    };
+    /// \return The ConnectionFeatures this system wants on new connections
+    unsigned char GetLocalConnectionFeatures( void ) const;
+    /// \return The ConnectionFeatures in use on \a remoteSystem
+    unsigned char GetConnectionFeatures( const RemoteSystemStruct* remoteSystem ) const;
+    /// Turns on the ConnectionFeatures in \a features for \a remoteSystem. Must be called before its first datagram is sent or received.
+    void ApplyConnectionFeatures( RemoteSystemStruct* remoteSystem, unsigned char features );
+    /// \return The dictionary new connections compress against, may be 0
+    std::shared_ptr<const CompressionDictionary> GetCompressionDictionary( void ) const;
+    /// Reads the dictionary the server appends to ID_CONNECTION_REQUEST_ACCEPTED, if it did, and starts compressing against it
+    void ReadCompressionDictionary( RemoteSystemStruct* remoteSystem, BitStream& bitStream );
     /// \brief Adjust the timestamp of the incoming packet to be relative to this system.
     /// \param[in] data Data in the incoming packet.
     /// \param[in] systemAddress Sender of the incoming packet.
@@ -854,8 +932,7 @@ protected:
 
     DataStructures::ThreadsafeAllocatingQueue<BufferedCommandStruct> bufferedCommands;
 
-    std::deque<RNS2RecvStruct*> bufferedPacketsFreePool;
-    std::mutex bufferedPacketsFreePoolMutex;
+    DataStructures::ThreadsafeMemoryPool<RNS2RecvStruct> bufferedPacketsFreePool;
     std::deque<RNS2RecvStruct*> bufferedPacketsQueue;
     std::mutex bufferedPacketsQueueMutex;
 
@@ -936,9 +1013,15 @@ protected:
 
     SignaledEvent quitAndDataEvents;
     bool limitConnectionFrequencyFromTheSameIP;
-
-    std::mutex packetAllocationPoolMutex;
-    DataStructures::MemoryPool<Packet> packetAllocationPool;
+    bool datagramIntegrityCheck;
+    bool datagramCompression;
+    bool dictionaryCompression;
+    std::shared_ptr<const CompressionDictionary> compressionDictionary;
+    mutable std::mutex compressionDictionaryMutex;
+    CompressionDictionaryTrainer* compressionDictionaryTrainer;
+    bool pathMTUDiscovery;
+
+    DataStructures::ThreadsafeMemoryPool<Packet> packetAllocationPool;
 
     std::mutex packetReturnMutex;
     std::deque<Packet*> packetReturnQueue;
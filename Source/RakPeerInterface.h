@@ -27,6 +27,7 @@ namespace RakNet {
 // Forward declarations
 class BitStream;
 class PluginInterface2;
+class CompressionDictionaryTrainer;
 struct RakNetStatistics;
 
 /// The primary interface for RakNet, RakPeer contains all major functions for the library.
@@ -468,6 +469,56 @@ public:
     /// \param[in] timeoutMS How many ms to wait before simply not sending an unreliable message.
     virtual void SetUnreliableTimeout( RakNet::TimeMS timeoutMS ) = 0;
 
+    /// Append a CRC32C to every datagram and drop datagrams that arrive corrupted.
+    /// Only used on connections where both systems enabled it, which is negotiated during the connection handshake.
+    /// Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request the check on new connections.
+    virtual void SetDatagramIntegrityCheck( bool enabled ) = 0;
+
+    /// Returns what was passed to SetDatagramIntegrityCheck()
+    virtual bool GetDatagramIntegrityCheck( void ) const = 0;
+
+    /// Compress outgoing datagrams with a fast LZ compressor, when that makes them smaller.
+    /// Only used on connections where both systems enabled it, which is negotiated during the connection handshake.
+    /// Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request compression on new connections.
+    virtual void SetDatagramCompression( bool enabled ) = 0;
+
+    /// Returns what was passed to SetDatagramCompression()
+    virtual bool GetDatagramCompression( void ) const = 0;
+
+    /// Compress small messages against a dictionary of data common to many messages, which gains where compressing them on their own does not.
+    /// Only used on connections where both systems enabled it and the system accepting the connection has a dictionary, which is negotiated during the connection handshake.
+    /// That system's dictionary is used in both directions, and sent to the other system if it does not have one with the same ID yet.
+    /// See messageCompressionInputBytes and messageCompressionOutputBytes in RakNetStatistics for the effect. Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request dictionary compression on new connections.
+    virtual void SetDictionaryCompression( bool enabled ) = 0;
+
+    /// Returns what was passed to SetDictionaryCompression()
+    virtual bool GetDictionaryCompression( void ) const = 0;
+
+    /// Set the dictionary new connections compress small messages against. Connections already made keep the dictionary they started with.
+    /// \param[in] data The dictionary, for example from CompressionDictionaryTrainer::Train(). The data is copied.
+    /// \param[in] length The length of \a data in bytes. 0 to remove the dictionary.
+    virtual void SetCompressionDictionary( const unsigned char* data, unsigned int length ) = 0;
+
+    /// \return The ID of the dictionary new connections compress against, or 0 if there is none.
+    /// A system without a dictionary of its own uses the first one it receives.
+    virtual uint32_t GetCompressionDictionaryID( void ) const = 0;
+
+    /// Offer outgoing messages that are small enough for dictionary compression to \a trainer, to train the next dictionary from.
+    /// \param[in] trainer The trainer, which must stay valid until this is called again with 0. Set before Startup().
+    virtual void SetCompressionDictionaryTrainer( CompressionDictionaryTrainer* trainer ) = 0;
+
+    /// Keep probing the path of established connections for the largest datagram that gets through without fragmentation, and size datagrams for it.
+    /// The MTU found during the connection handshake is only the starting point, and is raised or lowered as the probes succeed or fail. GetMTUSize() returns the current value.
+    /// Only used on connections where both systems enabled it, which is negotiated during the connection handshake. Affects connections made after the call. Defaults to false.
+    /// \param[in] enabled True to request path MTU discovery on new connections.
+    virtual void SetPathMTUDiscovery( bool enabled ) = 0;
+
+    /// Returns what was passed to SetPathMTUDiscovery()
+    virtual bool GetPathMTUDiscovery( void ) const = 0;
+
     /// Send a message to host, with the IP socket option TTL set to 3
     /// This message will not reach the host, but will open the router.
     /// Used for NAT-Punchthrough
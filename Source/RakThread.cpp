@@ -26,7 +26,7 @@ int RakThread::Create( std::function<void( void* )> func, void* arg, int priorit
     std::thread aThread( func, arg );
     std::thread::native_handle_type hThread = aThread.native_handle();
 
-    if( hThread != nullptr )
+    if( aThread.joinable() )
     {
 #ifdef _WIN32
         BOOL res = SetThreadPriority( hThread, priority );
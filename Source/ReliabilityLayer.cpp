@@ -20,7 +20,9 @@
 #ifdef USE_THREADED_SEND
 #include "SendToThread.h"
 #endif
+#include <algorithm>
 #include <math.h>
+#include <string.h>
 
 namespace RakNet {
 
@@ -97,7 +99,9 @@ struct DatagramHeaderFormat
     bool hasBAndAS;
     bool isContinuousSend;
     bool needsBAndAs;
-    bool isValid; // To differentiate between what I serialized, and offline data
+    bool isCompressed; // Payload after the header went through LZCompress()
+    bool isProbe;      // Path MTU probe. Acknowledged, but the padding after the header is not messages
+    bool isValid;      // To differentiate between what I serialized, and offline data
 
     static BitSize_t GetDataHeaderBitLength()
     {
@@ -148,6 +152,8 @@ struct DatagramHeaderFormat
             b->Write( isPacketPair );
             b->Write( isContinuousSend );
             b->Write( needsBAndAs );
+            b->Write( isCompressed );
+            b->Write( isProbe );
             b->AlignWriteToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
             RakNet::TimeMS timeMSLow = (RakNet::TimeMS)sourceSystemTime & 0xFFFFFFFF;
@@ -168,6 +174,8 @@ struct DatagramHeaderFormat
         {
             isNAK = false;
             isPacketPair = false;
+            isCompressed = false;
+            isProbe = false;
             b->Read( hasBAndAS );
             b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
@@ -186,12 +194,16 @@ struct DatagramHeaderFormat
             if( isNAK )
             {
                 isPacketPair = false;
+                isCompressed = false;
+                isProbe = false;
             }
             else
             {
                 b->Read( isPacketPair );
                 b->Read( isContinuousSend );
                 b->Read( needsBAndAs );
+                b->Read( isCompressed );
+                b->Read( isProbe );
                 b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
                 RakNet::TimeMS timeMS;
@@ -280,6 +292,11 @@ void ReliabilityLayer::Reset( bool resetVariables, int MTUSize, bool _useSecurit
         (void)_useSecurity;
 #endif // LIBCAT_SECURITY
         congestionManager.Init( RakNet::GetTimeUS(), MTUSize - UDP_HEADER_SIZE );
+        pathMTUSize = MTUSize;
+#if LIBCAT_SECURITY == 1
+        if( _useSecurity )
+            pathMTUSize += cat::AuthenticatedEncryption::OVERHEAD_BYTES;
+#endif
     }
 }
 
@@ -323,6 +340,22 @@ void ReliabilityLayer::InitializeVariables( void )
     bandwidthExceededStatistic = false;
     remoteSystemTime = 0;
     unreliableTimeout = 0;
+    datagramIntegrityCheck = false;
+    datagramCompression = false;
+    compressionSkipCount = 0;
+    compressionBackoff = 0;
+    compressionDictionary.reset();
+    dictionaryCompression = false;
+    pathMTUDiscovery = false;
+    pathMTUSize = MAXIMUM_MTU_SIZE;
+    pathMTUSearchHigh = MAXIMUM_MTU_SIZE;
+    pathMTUProbeSize = 0;
+    pathMTUProbeFailures = 0;
+    pathMTUProbeInFlight = false;
+    pathMTUProbeDatagramNumber = 0;
+    pathMTUProbeTimeout = 0;
+    pathMTUNextProbeTime = 0;
+    pathMTUNextRaiseTime = 0;
     lastBpsClear = 0;
 
     // Disable packet pairs
@@ -542,6 +575,27 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
     }
 #endif
 
+    if( datagramIntegrityCheck && CheckDatagramChecksum( (const unsigned char*)buffer, length ) == false )
+    {
+        for( PluginInterface2* pPlugin : messageHandlerList )
+        {
+            pPlugin->OnReliabilityLayerNotification( "CheckDatagramChecksum failed", BYTES_TO_BITS( length ), systemAddress, true );
+        }
+
+        return true;
+    }
+
+    unsigned char decompressedDatagram[MAXIMUM_MTU_SIZE];
+    if( datagramCompression && DecompressDatagram( buffer, length, decompressedDatagram, sizeof( decompressedDatagram ) ) == false )
+    {
+        for( PluginInterface2* pPlugin : messageHandlerList )
+        {
+            pPlugin->OnReliabilityLayerNotification( "DecompressDatagram failed", BYTES_TO_BITS( length ), systemAddress, true );
+        }
+
+        return true;
+    }
+
     BitStream socketData( (unsigned char*)buffer, length, false ); // Convert the incoming data to a bitstream for easy parsing
 
     DatagramHeaderFormat dhf;
@@ -555,6 +609,15 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
         return true;
     }
+    if( dhf.isCompressed && datagramCompression == false )
+    {
+        for( PluginInterface2* pPlugin : messageHandlerList )
+        {
+            pPlugin->OnReliabilityLayerNotification( "Compressed datagram without negotiated compression", BYTES_TO_BITS( length ), systemAddress, true );
+        }
+
+        return true;
+    }
     if( dhf.isACK )
     {
         DatagramSequenceNumberType datagramNumber;
@@ -597,11 +660,11 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
             return false;
         }
-        for( unsigned int i = 0; i < incomingAcks.ranges.Size(); i++ )
+        for( unsigned int i = 0; i < incomingAcks.Size(); i++ )
         {
-            if( incomingAcks.ranges[i].minIndex > incomingAcks.ranges[i].maxIndex || ( incomingAcks.ranges[i].maxIndex == (uint24_t)( 0xFFFFFFFF ) ) )
+            if( incomingAcks[i].minIndex > incomingAcks[i].maxIndex || ( incomingAcks[i].maxIndex == (uint24_t)( 0xFFFFFFFF ) ) )
             {
-                RakAssert( incomingAcks.ranges[i].minIndex <= incomingAcks.ranges[i].maxIndex );
+                RakAssert( incomingAcks[i].minIndex <= incomingAcks[i].maxIndex );
 
                 for( PluginInterface2* pPlugin : messageHandlerList )
                 {
@@ -609,7 +672,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 }
                 return false;
             }
-            for( datagramNumber = incomingAcks.ranges[i].minIndex; datagramNumber >= incomingAcks.ranges[i].minIndex && datagramNumber <= incomingAcks.ranges[i].maxIndex; datagramNumber++ )
+            for( datagramNumber = incomingAcks[i].minIndex; datagramNumber >= incomingAcks[i].minIndex && datagramNumber <= incomingAcks[i].maxIndex; datagramNumber++ )
             {
                 for( auto it = unreliableWithAckReceiptHistory.begin();  it != unreliableWithAckReceiptHistory.end(); /**/ )
                 {
@@ -630,6 +693,9 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                     }
                 }
 
+                if( pathMTUProbeInFlight && datagramNumber == pathMTUProbeDatagramNumber )
+                    OnPathMTUProbeResult( true, timeRead );
+
                 CCTimeType whenSent;
                 MessageNumberNode* messageNumberNode = GetMessageNumberNodeByDatagramIndex( datagramNumber, &whenSent );
                 if( messageNumberNode )
@@ -668,11 +734,11 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
             return false;
         }
-        for( unsigned int i = 0; i < incomingNAKs.ranges.Size(); i++ )
+        for( unsigned int i = 0; i < incomingNAKs.Size(); i++ )
         {
-            if( incomingNAKs.ranges[i].minIndex > incomingNAKs.ranges[i].maxIndex )
+            if( incomingNAKs[i].minIndex > incomingNAKs[i].maxIndex )
             {
-                RakAssert( incomingNAKs.ranges[i].minIndex <= incomingNAKs.ranges[i].maxIndex );
+                RakAssert( incomingNAKs[i].minIndex <= incomingNAKs[i].maxIndex );
 
                 for( PluginInterface2* pPlugin : messageHandlerList )
                 {
@@ -682,9 +748,16 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
                 return false;
             }
             // Sanity check
-            //RakAssert(incomingNAKs.ranges[i].maxIndex.val-incomingNAKs.ranges[i].minIndex.val<1000);
-            for( messageNumber = incomingNAKs.ranges[i].minIndex; messageNumber >= incomingNAKs.ranges[i].minIndex && messageNumber <= incomingNAKs.ranges[i].maxIndex; messageNumber++ )
+            //RakAssert(incomingNAKs[i].maxIndex.val-incomingNAKs[i].minIndex.val<1000);
+            for( messageNumber = incomingNAKs[i].minIndex; messageNumber >= incomingNAKs[i].minIndex && messageNumber <= incomingNAKs[i].maxIndex; messageNumber++ )
             {
+                // A lost probe says the probe was too large, not that the network is congested
+                if( pathMTUProbeInFlight && messageNumber == pathMTUProbeDatagramNumber )
+                {
+                    OnPathMTUProbeResult( false, timeRead );
+                    continue;
+                }
+
                 congestionManager.OnNAK( timeRead, messageNumber );
 
                 // REMOVEME
@@ -742,6 +815,9 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
         SendAcknowledgementPacket( dhf.datagramNumber, 0 );
 #endif
 
+        if( dhf.isProbe )
+            return true;
+
         InternalPacket* internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead );
         if( internalPacket == 0 )
         {
@@ -1293,17 +1369,24 @@ bool ReliabilityLayer::Send( char* data, BitSize_t numberOfBitsToSend, PacketPri
         AllocInternalPacketData( internalPacket, (unsigned char*)data );
     }
 
+    // Calculate if I need to split the packet
+    //  int headerLength = BITS_TO_BYTES( GetMessageHeaderLengthBits( internalPacket, true ) );
+
+    unsigned int maxDataSizeBytes = GetMaxDatagramSizeExcludingMessageHeaderBytes() - BITS_TO_BYTES( GetMaxMessageHeaderLengthBits() );
+
     internalPacket->dataBitLength = numberOfBitsToSend;
+    internalPacket->isCompressed = false;
+    if( dictionaryCompression )
+    {
+        // Split messages are never compressed, so only compress what then fits in one datagram
+        CompressMessage( internalPacket, maxDataSizeBytes );
+        numberOfBytesToSend = (unsigned int)BITS_TO_BYTES( internalPacket->dataBitLength );
+    }
     internalPacket->messageInternalOrder = internalOrderIndex++;
     internalPacket->priority = priority;
     internalPacket->reliability = reliability;
     internalPacket->sendReceiptSerial = receipt;
 
-    // Calculate if I need to split the packet
-    //  int headerLength = BITS_TO_BYTES( GetMessageHeaderLengthBits( internalPacket, true ) );
-
-    unsigned int maxDataSizeBytes = GetMaxDatagramSizeExcludingMessageHeaderBytes() - BITS_TO_BYTES( GetMaxMessageHeaderLengthBits() );
-
     bool splitPacket = numberOfBytesToSend > maxDataSizeBytes;
 
     // If a split packet, we might have to upgrade the reliability
@@ -1505,6 +1588,8 @@ void ReliabilityLayer::Update( RakNetSocket2* s, SystemAddress& systemAddress, i
     DatagramHeaderFormat dhf;
     dhf.needsBAndAs = congestionManager.GetIsInSlowStart();
     dhf.isContinuousSend = bandwidthExceededStatistic;
+    dhf.isCompressed = false;
+    dhf.isProbe = false;
     bandwidthExceededStatistic = !outgoingPacketBuffer.empty();
 
     const bool hasDataToSendOrResend = IsResendQueueEmpty() == false || bandwidthExceededStatistic;
@@ -1584,7 +1669,8 @@ void ReliabilityLayer::Update( RakNetSocket2* s, SystemAddress& systemAddress, i
                     if( time - internalPacket->nextActionTime < ( ( (CCTimeType)-1 ) / 2 ) )
                     {
                         nextPacketBitLength = internalPacket->headerLength + internalPacket->dataBitLength;
-                        if( datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
+                        // A message split before the MTU was lowered may not fit at all, so it goes in a datagram of its own
+                        if( datagramSizeSoFar > 0 && datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
                         {
                             // Gathers all PushPackets()
                             PushDatagram();
@@ -1678,10 +1764,9 @@ void ReliabilityLayer::Update( RakNetSocket2* s, SystemAddress& systemAddress, i
 
                     internalPacket->headerLength = GetMessageHeaderLengthBits( internalPacket );
                     nextPacketBitLength = internalPacket->headerLength + internalPacket->dataBitLength;
-                    if( datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
+                    if( datagramSizeSoFar > 0 && datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
                     {
                         // Hit MTU. May still push packets if smaller ones exist at a lower priority
-                        RakAssert( datagramSizeSoFar != 0 );
                         RakAssert( internalPacket->dataBitLength < BYTES_TO_BITS( MAXIMUM_MTU_SIZE ) );
                         break;
                     }
@@ -1851,6 +1936,10 @@ void ReliabilityLayer::Update( RakNetSocket2* s, SystemAddress& systemAddress, i
                 AddFirstToDatagramHistory( dhf.datagramNumber, time );
             }
 
+            // Packet pairs are padded to the same size to measure bandwidth, so leave them alone
+            if( datagramCompression && dhf.isPacketPair == false )
+                CompressDatagram( &updateBitStream, dhf );
+
             congestionManager.OnSendBytes( time, UDP_HEADER_SIZE + DatagramHeaderFormat::GetDataHeaderByteLength() );
 
             SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
@@ -1865,17 +1954,23 @@ void ReliabilityLayer::Update( RakNetSocket2* s, SystemAddress& systemAddress, i
         // Any data waiting to send after attempting to send, then bandwidth is exceeded
         bandwidthExceededStatistic = !outgoingPacketBuffer.empty();
     }
+
+    if( pathMTUDiscovery )
+        UpdatePathMTUDiscovery( s, systemAddress, rnr, updateBitStream, time );
 }
 
 
 //-------------------------------------------------------------------------------------------------------
 // Writes a bitstream to the socket
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::SendBitStream( RakNetSocket2* s, SystemAddress& systemAddress, BitStream* bitStream, RakNetRandom* rnr, CCTimeType currentTime )
+void ReliabilityLayer::SendBitStream( RakNetSocket2* s, SystemAddress& systemAddress, BitStream* bitStream, RakNetRandom* rnr, CCTimeType currentTime, bool doNotFragment )
 {
     (void)systemAddress;
     (void)rnr;
 
+    if( datagramIntegrityCheck )
+        AppendDatagramChecksum( bitStream );
+
     unsigned int length;
 
     length = (unsigned int)bitStream->GetNumberOfBytesUsed();
@@ -1943,24 +2038,30 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2* s, SystemAddress& systemAdd
 
     bpsMetrics[(int)ACTUAL_BYTES_SENT].Push1( currentTime, length );
 
-    RakAssert( length <= congestionManager.GetMTU() );
+    // Path MTU probes, and messages split before the MTU was lowered, may exceed the current MTU
+    RakAssert( length <= congestionManager.GetMTU() || pathMTUDiscovery );
 
 #ifdef USE_THREADED_SEND
-    SendToThread::SendToThreadBlock* block = SendToThread::AllocateBlock();
-    memcpy( block->data, bitStream->GetData(), length );
-    block->dataWriteOffset = length;
-    block->extraSocketOptions = extraSocketOptions;
-    block->s = s;
-    block->systemAddress = systemAddress;
-    SendToThread::ProcessBlock( block );
-#else
+    // Datagrams with don't fragment are sent from this thread, as the socket holds off the send thread while their flag is set
+    if( doNotFragment == false )
+    {
+        SendToThread::SendToThreadBlock* block = SendToThread::AllocateBlock();
+        memcpy( block->data, bitStream->GetData(), length );
+        block->dataWriteOffset = length;
+        block->extraSocketOptions = extraSocketOptions;
+        block->s = s;
+        block->systemAddress = systemAddress;
+        SendToThread::ProcessBlock( block );
+        return;
+    }
+#endif
 
     RNS2_SendParameters bsp;
     bsp.data = (char*)bitStream->GetData();
     bsp.length = length;
     bsp.systemAddress = systemAddress;
+    bsp.doNotFragment = doNotFragment;
     s->Send( &bsp, _FILE_AND_LINE_ );
-#endif
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -2002,6 +2103,65 @@ void ReliabilityLayer::SetUnreliableTimeout( RakNet::TimeMS timeoutMS )
     unreliableTimeout = (CCTimeType)timeoutMS * (CCTimeType)1000;
 #endif
 }
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetDatagramIntegrityCheck( bool enabled )
+{
+    datagramIntegrityCheck = enabled;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetDatagramIntegrityCheck( void ) const
+{
+    return datagramIntegrityCheck;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetDatagramCompression( bool enabled )
+{
+    datagramCompression = enabled;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetDatagramCompression( void ) const
+{
+    return datagramCompression;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetCompressionDictionary( const std::shared_ptr<const CompressionDictionary>& dictionary )
+{
+    compressionDictionary = dictionary;
+}
+//-------------------------------------------------------------------------------------------------------
+const std::shared_ptr<const CompressionDictionary>& ReliabilityLayer::GetCompressionDictionary( void ) const
+{
+    return compressionDictionary;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetDictionaryCompression( bool enabled )
+{
+    dictionaryCompression = enabled;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetDictionaryCompression( void ) const
+{
+    return dictionaryCompression;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetPathMTUDiscovery( bool enabled )
+{
+    pathMTUDiscovery = enabled;
+    pathMTUSearchHigh = MAXIMUM_MTU_SIZE;
+    pathMTUProbeFailures = 0;
+    pathMTUProbeInFlight = false;
+    pathMTUNextProbeTime = 0;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetPathMTUDiscovery( void ) const
+{
+    return pathMTUDiscovery;
+}
+//-------------------------------------------------------------------------------------------------------
+int ReliabilityLayer::GetMTUSize( void ) const
+{
+    return pathMTUSize;
+}
 
 //-------------------------------------------------------------------------------------------------------
 // This will return true if we should not send at this time
@@ -2213,6 +2373,10 @@ BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket( BitStream* bitSt
 
     bool hasSplitPacket = internalPacket->splitPacketCount > 0;
     bitStream->Write( hasSplitPacket ); // Write 1 bit to indicate if splitPacketCount>0
+    // Only ever set once dictionary compression was negotiated, so older systems always read 0 in these bits
+    bitStream->Write( internalPacket->isCompressed );
+    if( internalPacket->isCompressed )
+        bitStream->WriteBits( &internalPacket->compressedPaddingBits, 3, true );
     bitStream->AlignWriteToByteBoundary();
     RakAssert( internalPacket->dataBitLength < 65535 );
     unsigned short s;
@@ -2291,6 +2455,10 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( BitStream*
     bitStream->ReadBits( (unsigned char*)( &( tempChar ) ), 3 );
     internalPacket->reliability = (const PacketReliability)tempChar;
     readSuccess = bitStream->Read( hasSplitPacket ); // Read 1 bit to indicate if splitPacketCount>0
+    bitStream->Read( internalPacket->isCompressed );
+    internalPacket->compressedPaddingBits = 0;
+    if( internalPacket->isCompressed )
+        bitStream->ReadBits( &internalPacket->compressedPaddingBits, 3 );
     bitStream->AlignReadToByteBoundary();
     unsigned short s;
     bitStream->ReadAlignedVar16( (char*)&s );
@@ -2348,7 +2516,8 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( BitStream*
         internalPacket->dataBitLength == 0 ||
         internalPacket->reliability >= NUMBER_OF_RELIABILITIES ||
         internalPacket->orderingChannel >= 32 ||
-        ( hasSplitPacket && ( internalPacket->splitPacketIndex >= internalPacket->splitPacketCount ) ) )
+        ( hasSplitPacket && ( internalPacket->splitPacketIndex >= internalPacket->splitPacketCount ) ) ||
+        ( hasSplitPacket && internalPacket->isCompressed ) )
     {
         // If this assert hits, encoding is garbage
         RakAssert( "Encoding is garbage" && 0 );
@@ -2384,38 +2553,324 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( BitStream*
         return 0;
     }
 
+    if( internalPacket->isCompressed && DecompressMessage( internalPacket ) == false )
+    {
+        FreeInternalPacketData( internalPacket, _FILE_AND_LINE_ );
+        ReleaseToInternalPacketPool( internalPacket );
+        return 0;
+    }
+
     return internalPacket;
 }
 
 
 //-------------------------------------------------------------------------------------------------------
-// Get the SHA1 code
+// Append the CRC32C of the datagram to its end
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::GetSHA1( unsigned char* const buffer, unsigned int nbytes, char code[SHA1_LENGTH] )
+void ReliabilityLayer::AppendDatagramChecksum( BitStream* bitStream )
 {
-    CSHA1 sha1;
+    // Covers every byte that goes out, including the padding bits of the last byte
+    uint32_t crc = CRC32C( bitStream->GetData(), (unsigned int)bitStream->GetNumberOfBytesUsed() );
 
-    sha1.Reset();
-    sha1.Update( (unsigned char*)buffer, nbytes );
-    sha1.Final();
-    memcpy( code, sha1.GetHash(), SHA1_LENGTH );
+    // Always little endian on the wire
+    unsigned char code[CRC32C_LENGTH];
+    code[0] = (unsigned char)( crc );
+    code[1] = (unsigned char)( crc >> 8 );
+    code[2] = (unsigned char)( crc >> 16 );
+    code[3] = (unsigned char)( crc >> 24 );
+    bitStream->WriteAlignedBytes( code, CRC32C_LENGTH );
 }
 
 //-------------------------------------------------------------------------------------------------------
-// Check the SHA1 code
+// Check the CRC32C at the end of a received datagram
 //-------------------------------------------------------------------------------------------------------
-bool ReliabilityLayer::CheckSHA1( char code[SHA1_LENGTH], unsigned char* const buffer, unsigned int nbytes )
+bool ReliabilityLayer::CheckDatagramChecksum( const unsigned char* buffer, unsigned int& length )
 {
-    char code2[SHA1_LENGTH];
-    GetSHA1( buffer, nbytes, code2 );
+    if( length <= CRC32C_LENGTH )
+        return false;
 
-    for( int i = 0; i < SHA1_LENGTH; i++ )
-        if( code[i] != code2[i] )
-            return false;
+    unsigned int dataLength = length - CRC32C_LENGTH;
+    const unsigned char* code = buffer + dataLength;
+    uint32_t crc = (uint32_t)code[0] | ( (uint32_t)code[1] << 8 ) | ( (uint32_t)code[2] << 16 ) | ( (uint32_t)code[3] << 24 );
+    if( CRC32C( buffer, dataLength ) != crc )
+        return false;
 
+    length = dataLength;
     return true;
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Compress the messages of a data datagram, if that makes it smaller
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::CompressDatagram( BitStream* bitStream, const DatagramHeaderFormat& dhf )
+{
+    // Back off from data that recently did not compress
+    if( compressionSkipCount > 0 )
+    {
+        compressionSkipCount--;
+        return;
+    }
+
+    DatagramHeaderFormat compressedHeader = dhf;
+    compressedHeader.isCompressed = true;
+    BitStream header;
+    compressedHeader.Serialize( &header );
+
+    const unsigned int headerLength = header.GetNumberOfBytesUsed();
+    const unsigned int datagramLength = bitStream->GetNumberOfBytesUsed();
+    if( datagramLength < headerLength + DATAGRAM_COMPRESSION_MIN_BYTES )
+        return;
+
+    const unsigned int payloadLength = datagramLength - headerLength;
+    unsigned char compressed[MAXIMUM_MTU_SIZE];
+    RakNet::TimeUS startTime = RakNet::GetTimeUS();
+    // One byte less than the input, so data that does not shrink is given up on early
+    unsigned int compressedLength = LZCompress( bitStream->GetData() + headerLength, payloadLength, compressed, payloadLength - 1 );
+    statistics.compressionTimeUS += RakNet::GetTimeUS() - startTime;
+    statistics.compressionInputBytes += payloadLength;
+
+    if( compressedLength == 0 )
+    {
+        statistics.compressionOutputBytes += payloadLength;
+        compressionBackoff = compressionBackoff == 0 ? 1 : compressionBackoff * 2;
+        if( compressionBackoff > DATAGRAM_COMPRESSION_MAX_BACKOFF )
+            compressionBackoff = DATAGRAM_COMPRESSION_MAX_BACKOFF;
+        compressionSkipCount = compressionBackoff;
+        return;
+    }
+
+    statistics.compressionOutputBytes += compressedLength;
+    compressionBackoff = 0;
+
+    bitStream->Reset();
+    bitStream->Write( &header );
+    bitStream->WriteAlignedBytes( compressed, compressedLength );
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Decompress the messages of a data datagram, if the sender compressed them
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::DecompressDatagram( const char*& buffer, unsigned int& length, unsigned char* decompressedDatagram, unsigned int decompressedDatagramSize )
+{
+    BitStream bs( (unsigned char*)buffer, length, false );
+    DatagramHeaderFormat dhf = DatagramHeaderFormat();
+    dhf.Deserialize( &bs );
+    if( dhf.isValid == false || dhf.isACK || dhf.isNAK || dhf.isCompressed == false )
+        return true;
+
+    const unsigned int headerLength = BITS_TO_BYTES( bs.GetReadOffset() );
+    if( headerLength >= length || headerLength >= decompressedDatagramSize )
+        return false;
+
+    unsigned int payloadLength;
+    RakNet::TimeUS startTime = RakNet::GetTimeUS();
+    bool success = LZDecompress( (const unsigned char*)buffer + headerLength, length - headerLength, decompressedDatagram + headerLength, decompressedDatagramSize - headerLength, &payloadLength );
+    statistics.decompressionTimeUS += RakNet::GetTimeUS() - startTime;
+    if( success == false )
+        return false;
+
+    memcpy( decompressedDatagram, buffer, headerLength );
+    buffer = (const char*)decompressedDatagram;
+    length = headerLength + payloadLength;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Compress a small message against the dictionary, if that makes it smaller
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::CompressMessage( InternalPacket* internalPacket, unsigned int maxCompressedBytes )
+{
+    static_assert( DICTIONARY_COMPRESSION_MAX_BYTES <= MAXIMUM_MTU_SIZE, "DecompressMessage() decompresses into a buffer of MAXIMUM_MTU_SIZE" );
+
+    const unsigned int length = (unsigned int)BITS_TO_BYTES( internalPacket->dataBitLength );
+    if( compressionDictionary == nullptr || length == 0 )
+        return;
+
+    unsigned char messageID = internalPacket->data[0];
+    if( messageID == ID_TIMESTAMP && length > sizeof( MessageID ) + sizeof( RakNet::Time ) )
+        messageID = internalPacket->data[sizeof( MessageID ) + sizeof( RakNet::Time )];
+    statistics.messageCompressionInputBytes[messageID] += length;
+
+    unsigned int compressedLength = 0;
+    unsigned char compressed[DICTIONARY_COMPRESSION_MAX_BYTES];
+    if( length >= DICTIONARY_COMPRESSION_MIN_BYTES && length <= DICTIONARY_COMPRESSION_MAX_BYTES )
+    {
+        RakNet::TimeUS startTime = RakNet::GetTimeUS();
+        compressedLength = compressionDictionary->Compress( internalPacket->data, length, compressed, std::min( length - 1, maxCompressedBytes ) );
+        statistics.compressionTimeUS += RakNet::GetTimeUS() - startTime;
+    }
+
+    if( compressedLength == 0 )
+    {
+        statistics.messageCompressionOutputBytes[messageID] += length;
+        return;
+    }
+    statistics.messageCompressionOutputBytes[messageID] += compressedLength;
+
+    internalPacket->compressedPaddingBits = (unsigned char)( BYTES_TO_BITS( length ) - internalPacket->dataBitLength );
+    internalPacket->isCompressed = true;
+    FreeInternalPacketData( internalPacket, _FILE_AND_LINE_ );
+    AllocInternalPacketData( internalPacket, compressedLength, true, _FILE_AND_LINE_ );
+    memcpy( internalPacket->data, compressed, compressedLength );
+    internalPacket->dataBitLength = BYTES_TO_BITS( compressedLength );
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Decompress a message that was compressed against the dictionary
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::DecompressMessage( InternalPacket* internalPacket )
+{
+    if( compressionDictionary == nullptr )
+        return false;
+
+    unsigned char decompressed[MAXIMUM_MTU_SIZE];
+    unsigned int length;
+    RakNet::TimeUS startTime = RakNet::GetTimeUS();
+    bool success = compressionDictionary->Decompress( internalPacket->data, (unsigned int)BITS_TO_BYTES( internalPacket->dataBitLength ), decompressed, sizeof( decompressed ), &length );
+    statistics.decompressionTimeUS += RakNet::GetTimeUS() - startTime;
+    if( success == false || BYTES_TO_BITS( length ) <= internalPacket->compressedPaddingBits )
+        return false;
+
+    FreeInternalPacketData( internalPacket, _FILE_AND_LINE_ );
+    AllocInternalPacketData( internalPacket, length, false, _FILE_AND_LINE_ );
+    if( internalPacket->data == 0 )
+    {
+        notifyOutOfMemory( _FILE_AND_LINE_ );
+        return false;
+    }
+    memcpy( internalPacket->data, decompressed, length );
+    internalPacket->dataBitLength = BYTES_TO_BITS( length ) - internalPacket->compressedPaddingBits;
+    internalPacket->isCompressed = false;
+    return true;
+}
+
+static CCTimeType PathMTUDiscoveryInterval( RakNet::TimeMS intervalMS )
+{
+#if CC_TIME_TYPE_BYTES == 4
+    return intervalMS;
+#else
+    return (CCTimeType)intervalMS * (CCTimeType)1000;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Probe the path for a larger MTU, or confirm it still carries the current one
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::UpdatePathMTUDiscovery( RakNetSocket2* s, SystemAddress& systemAddress, RakNetRandom* rnr, BitStream& updateBitStream, CCTimeType time )
+{
+    if( pathMTUProbeInFlight )
+    {
+        // Lost without a NAK, for instance because nothing was sent after it
+        if( time >= pathMTUProbeTimeout )
+            OnPathMTUProbeResult( false, time );
+        return;
+    }
+
+    if( pathMTUNextProbeTime == 0 )
+    {
+        // Give the remote system time to finish the handshake before the first probe
+        pathMTUNextProbeTime = time + PathMTUDiscoveryInterval( PATH_MTU_DISCOVERY_PROBE_INTERVAL );
+        pathMTUNextRaiseTime = time + PathMTUDiscoveryInterval( PATH_MTU_DISCOVERY_RAISE_INTERVAL );
+        return;
+    }
+
+    if( time < pathMTUNextProbeTime )
+        return;
+
+    // The path may have changed since the last search
+    if( pathMTUSearchHigh - pathMTUSize < PATH_MTU_DISCOVERY_GRANULARITY && time >= pathMTUNextRaiseTime )
+    {
+        pathMTUSearchHigh = MAXIMUM_MTU_SIZE;
+        pathMTUNextRaiseTime = time + PathMTUDiscoveryInterval( PATH_MTU_DISCOVERY_RAISE_INTERVAL );
+    }
+
+    if( pathMTUSearchHigh - pathMTUSize >= PATH_MTU_DISCOVERY_GRANULARITY )
+        pathMTUProbeSize = ( pathMTUSize + pathMTUSearchHigh + 1 ) / 2;
+    else
+        pathMTUProbeSize = pathMTUSize;
+
+    // Bytes SendBitStream() adds to the datagram
+    int overhead = datagramIntegrityCheck ? CRC32C_LENGTH : 0;
+#if LIBCAT_SECURITY == 1
+    if( useSecurity )
+        overhead += cat::AuthenticatedEncryption::OVERHEAD_BYTES;
+#endif
+
+    DatagramHeaderFormat dhf;
+    dhf.isACK = false;
+    dhf.isNAK = false;
+    dhf.isPacketPair = false;
+    dhf.isContinuousSend = false;
+    dhf.needsBAndAs = false;
+    dhf.isCompressed = false;
+    dhf.isProbe = true;
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS == 1
+    dhf.sourceSystemTime = RakNet::GetTimeUS();
+#endif
+    dhf.datagramNumber = congestionManager.GetAndIncrementNextDatagramSequenceNumber();
+    updateBitStream.Reset();
+    dhf.Serialize( &updateBitStream );
+    updateBitStream.PadWithZeroToByteLength( pathMTUProbeSize - UDP_HEADER_SIZE - overhead );
+
+    // Keeps the datagram history in step with the datagram numbers
+    AddFirstToDatagramHistory( dhf.datagramNumber, time );
+    congestionManager.OnSendBytes( time, pathMTUProbeSize );
+
+    pathMTUProbeInFlight = true;
+    pathMTUProbeDatagramNumber = dhf.datagramNumber;
+    pathMTUProbeTimeout = time + congestionManager.GetRTOForRetransmission( 1 );
+
+    // A probe that gets fragmented on the way proves nothing
+    SendBitStream( s, systemAddress, &updateBitStream, rnr, time, true );
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Move the MTU or narrow the search depending on whether the probe got through
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::OnPathMTUProbeResult( bool delivered, CCTimeType time )
+{
+    pathMTUProbeInFlight = false;
+
+    if( delivered )
+    {
+        pathMTUProbeFailures = 0;
+        if( pathMTUProbeSize > pathMTUSize )
+            SetMTUSize( pathMTUProbeSize );
+    }
+    else if( ++pathMTUProbeFailures >= PATH_MTU_DISCOVERY_MAX_PROBES )
+    {
+        pathMTUProbeFailures = 0;
+        if( pathMTUProbeSize > pathMTUSize )
+        {
+            pathMTUSearchHigh = pathMTUProbeSize - 1;
+        }
+        else if( pathMTUSize > MINIMUM_MTU_SIZE )
+        {
+            // The path no longer carries the current MTU. Start over from the smallest one and search back up.
+            pathMTUSearchHigh = pathMTUSize - 1;
+            SetMTUSize( MINIMUM_MTU_SIZE );
+        }
+    }
+
+    // Retry lost probes and keep searching quickly, but only confirm a finished search now and then
+    if( pathMTUProbeFailures == 0 && pathMTUSearchHigh - pathMTUSize < PATH_MTU_DISCOVERY_GRANULARITY )
+        pathMTUNextProbeTime = time + PathMTUDiscoveryInterval( PATH_MTU_DISCOVERY_CONFIRM_INTERVAL );
+    else
+        pathMTUNextProbeTime = time + PathMTUDiscoveryInterval( PATH_MTU_DISCOVERY_PROBE_INTERVAL );
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetMTUSize( int MTUSize )
+{
+    pathMTUSize = MTUSize;
+
+#if LIBCAT_SECURITY == 1
+    if( useSecurity )
+        MTUSize -= cat::AuthenticatedEncryption::OVERHEAD_BYTES;
+#endif
+    congestionManager.SetMTU( MTUSize - UDP_HEADER_SIZE );
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Returns true if newPacketOrderingIndex is older than the waitingForPacketOrderingIndex
 //-------------------------------------------------------------------------------------------------------
@@ -2797,6 +3252,8 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketCopy( InternalPacket* orig
     copy->reliableMessageNumber = original->reliableMessageNumber;
     copy->priority = original->priority;
     copy->reliability = original->reliability;
+    copy->isCompressed = original->isCompressed;
+    copy->compressedPaddingBits = original->compressedPaddingBits;
 #if PREALLOCATE_LARGE_MESSAGES == 1
     copy->splitPacketCount = original->splitPacketCount;
     copy->splitPacketId = original->splitPacketId;
@@ -2870,6 +3327,11 @@ RakNetStatistics* ReliabilityLayer::GetStatistics( RakNetStatistics* rns )
         }
     }
 
+    if( rns->compressionOutputBytes > 0 )
+        rns->compressionRatio = (float)( (double)rns->compressionInputBytes / (double)rns->compressionOutputBytes );
+    else
+        rns->compressionRatio = 1.0f;
+
     rns->isLimitedByCongestionControl = statistics.isLimitedByCongestionControl;
     rns->BPSLimitByCongestionControl = statistics.BPSLimitByCongestionControl;
     rns->isLimitedByOutgoingBandwidthLimit = statistics.isLimitedByOutgoingBandwidthLimit;
@@ -3129,6 +3591,7 @@ InternalPacket* ReliabilityLayer::AllocateFromInternalPacketPool( void )
     ip->allocationScheme = InternalPacket::NORMAL;
     ip->data = 0;
     ip->timesSent = 0;
+    ip->isCompressed = false;
     return ip;
 }
 //-------------------------------------------------------------------------------------------------------
@@ -3359,6 +3822,9 @@ unsigned int ReliabilityLayer::GetMaxDatagramSizeExcludingMessageHeaderBytes( vo
         val -= cat::AuthenticatedEncryption::OVERHEAD_BYTES;
 #endif
 
+    if( datagramIntegrityCheck )
+        val -= CRC32C_LENGTH;
+
     return val;
 }
 //-------------------------------------------------------------------------------------------------------
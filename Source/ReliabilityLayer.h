@@ -20,7 +20,9 @@
 #include "BitStream.h"
 #include "InternalPacket.h"
 #include "RakNetStatistics.h"
-#include "DR_SHA1.h"
+#include "CRC32C.h"
+#include "LZCompressor.h"
+#include "CompressionDictionary.h"
 #include "DS_OrderedList.h"
 #include "DS_RangeList.h"
 #include "DS_MemoryPool.h"
@@ -39,6 +41,7 @@
 #endif
 
 #include <deque>
+#include <memory>
 #include <queue>
 #include <vector>
 
@@ -52,6 +55,7 @@ namespace RakNet {
 /// Forward declarations
 class PluginInterface2;
 class RakNetRandom;
+struct DatagramHeaderFormat;
 typedef uint64_t reliabilityHeapWeightType;
 
 
@@ -268,6 +272,37 @@ public:
 
     void SetSplitMessageProgressInterval( int interval );
     void SetUnreliableTimeout( RakNet::TimeMS timeoutMS );
+
+    /// Append a CRC32C to every outgoing datagram and drop incoming datagrams whose CRC32C does not match.
+    /// Both systems must agree, so this is set from the connection handshake, before the first datagram is sent.
+    /// Reset() turns it off.
+    void SetDatagramIntegrityCheck( bool enabled );
+    bool GetDatagramIntegrityCheck( void ) const;
+
+    /// Compress the messages of outgoing datagrams with LZCompress() when that makes them smaller, and decompress incoming ones.
+    /// Both systems must agree, so this is set from the connection handshake, before the first datagram is sent.
+    /// Reset() turns it off.
+    void SetDatagramCompression( bool enabled );
+    bool GetDatagramCompression( void ) const;
+
+    /// Decompress incoming messages that were compressed against \a dictionary. Both systems must have a dictionary with the same ID.
+    /// Reset() drops it.
+    void SetCompressionDictionary( const std::shared_ptr<const CompressionDictionary>& dictionary );
+    const std::shared_ptr<const CompressionDictionary>& GetCompressionDictionary( void ) const;
+
+    /// Compress outgoing messages of DICTIONARY_COMPRESSION_MIN_BYTES to DICTIONARY_COMPRESSION_MAX_BYTES against the dictionary, when that makes them smaller.
+    /// Only turn this on once the remote system has the dictionary. Reset() turns it off.
+    void SetDictionaryCompression( bool enabled );
+    bool GetDictionaryCompression( void ) const;
+
+    /// Periodically send padded probe datagrams that may not be fragmented, and size datagrams for the largest probe the remote system acknowledged, up to MAXIMUM_MTU_SIZE.
+    /// Probes of the current size that keep getting lost lower it again. Probes carry no messages, so both systems must agree.
+    /// This is set from the connection handshake. Reset() turns it off.
+    void SetPathMTUDiscovery( bool enabled );
+    bool GetPathMTUDiscovery( void ) const;
+
+    /// \return The MTU, including the UDP header, that outgoing datagrams are sized for. Starts at the size passed to Reset().
+    int GetMTUSize( void ) const;
     /// Has a lot of time passed since the last ack
     bool AckTimeout( RakNet::Time curTime );
     CCTimeType GetNextSendTime( void ) const;
@@ -285,7 +320,8 @@ private:
     /// \param[in] s The socket used for sending data
     /// \param[in] systemAddress The address and port to send to
     /// \param[in] bitStream The data to send.
-    void SendBitStream( RakNetSocket2* s, SystemAddress& systemAddress, BitStream* bitStream, RakNetRandom* rnr, CCTimeType currentTime );
+    /// \param[in] doNotFragment Set don't fragment on this datagram, so that it is dropped rather than fragmented if larger than the path MTU
+    void SendBitStream( RakNetSocket2* s, SystemAddress& systemAddress, BitStream* bitStream, RakNetRandom* rnr, CCTimeType currentTime, bool doNotFragment = false );
 
     ///Parse an internalPacket and create a bitstream to represent this data
     /// \return Returns number of bits used
@@ -314,11 +350,38 @@ private:
     BitSize_t GetMaxMessageHeaderLengthBits( void );
     BitSize_t GetMessageHeaderLengthBits( const InternalPacket* const internalPacket );
 
-    /// Get the SHA1 code
-    void GetSHA1( unsigned char* const buffer, unsigned int nbytes, char code[SHA1_LENGTH] );
+    /// Append the CRC32C of the datagram in \a bitStream to its end
+    void AppendDatagramChecksum( BitStream* bitStream );
+
+    /// Check the CRC32C at the end of a received datagram
+    /// \param[in,out] length The length of the datagram. On success the checksum is stripped from it.
+    /// \return false if the datagram is too short or was corrupted in transit
+    bool CheckDatagramChecksum( const unsigned char* buffer, unsigned int& length );
+
+    /// Replace the messages in a data datagram with their compressed form, if that is smaller
+    /// \param[in] dhf The header already written to \a bitStream
+    void CompressDatagram( BitStream* bitStream, const DatagramHeaderFormat& dhf );
+
+    /// If \a buffer is a compressed data datagram, decompress it into \a decompressedDatagram and point \a buffer and \a length at the result
+    /// \return false if the datagram could not be decompressed
+    bool DecompressDatagram( const char*& buffer, unsigned int& length, unsigned char* decompressedDatagram, unsigned int decompressedDatagramSize );
+
+    /// Replace the data of an outgoing message with its form compressed against the dictionary, if that is smaller
+    /// and no more than \a maxCompressedBytes, so that it is sent whole
+    void CompressMessage( InternalPacket* internalPacket, unsigned int maxCompressedBytes );
+
+    /// Replace the data of an incoming message marked isCompressed with its decompressed form
+    /// \return false if the message could not be decompressed
+    bool DecompressMessage( InternalPacket* internalPacket );
+
+    /// Send a path MTU probe if one is due, and give up on one that was not acknowledged in time
+    void UpdatePathMTUDiscovery( RakNetSocket2* s, SystemAddress& systemAddress, RakNetRandom* rnr, BitStream& updateBitStream, CCTimeType time );
+
+    /// The probe in flight was acknowledged, or was lost
+    void OnPathMTUProbeResult( bool delivered, CCTimeType time );
 
-    /// Check the SHA1 code
-    bool CheckSHA1( char code[SHA1_LENGTH], unsigned char* const buffer, unsigned int nbytes );
+    /// Size outgoing datagrams for \a MTUSize, which includes the UDP header
+    void SetMTUSize( int MTUSize );
 
     /// Returns true if newPacketOrderingIndex is older than the waitingForPacketOrderingIndex
     bool IsOlderOrderedPacket( OrderingIndexType newPacketOrderingIndex, OrderingIndexType waitingForPacketOrderingIndex );
@@ -356,6 +419,18 @@ private:
     std::deque<InternalPacket*> outputQueue;
     int splitMessageProgressInterval;
     CCTimeType unreliableTimeout;
+    bool datagramIntegrityCheck;
+    bool datagramCompression;
+    // Datagrams to send without trying to compress them, and how many to skip after the next one that does not compress
+    unsigned int compressionSkipCount, compressionBackoff;
+    std::shared_ptr<const CompressionDictionary> compressionDictionary;
+    bool dictionaryCompression;
+    bool pathMTUDiscovery;
+    // Datagrams are sized for pathMTUSize. Probes search (pathMTUSize, pathMTUSearchHigh], or confirm pathMTUSize when the search is done.
+    int pathMTUSize, pathMTUSearchHigh, pathMTUProbeSize, pathMTUProbeFailures;
+    bool pathMTUProbeInFlight;
+    DatagramSequenceNumberType pathMTUProbeDatagramNumber;
+    CCTimeType pathMTUProbeTimeout, pathMTUNextProbeTime, pathMTUNextRaiseTime;
 
     struct MessageNumberNode
     {
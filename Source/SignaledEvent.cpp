@@ -10,9 +10,61 @@
 
 #include "SignaledEvent.h"
 
-#if defined( __GNUC__ )
-#include <sys/time.h>
+#if defined( __linux__ )
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
 #include <unistd.h>
+#if defined( __i386__ ) || defined( __x86_64__ )
+#include <immintrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+#if defined( __linux__ )
+namespace {
+
+enum EventState
+{
+    EVENT_UNSIGNALED,
+    EVENT_SIGNALED,
+    // Unsignaled, and a thread may be sleeping in futex, so SetEvent has to wake it
+    EVENT_UNSIGNALED_WITH_WAITERS,
+};
+
+static_assert( sizeof( std::atomic<int> ) == sizeof( int ), "The futex syscalls are passed the address of the atomic" );
+
+// FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline, so waking early and waiting again does not add up rounding
+int FutexWait( std::atomic<int>* futex, int expected, const struct timespec* deadline )
+{
+    return (int)syscall( SYS_futex, (int*)futex, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, expected, deadline, 0, FUTEX_BITSET_MATCH_ANY );
+}
+
+void FutexWakeAll( std::atomic<int>* futex )
+{
+    syscall( SYS_futex, (int*)futex, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, 0, 0, 0 );
+}
+
+void CpuRelax( void )
+{
+#if defined( __i386__ ) || defined( __x86_64__ )
+    _mm_pause();
+#elif defined( __aarch64__ )
+    __asm__ __volatile__( "yield" );
+#endif
+}
+
+bool TakeSignal( std::atomic<int>& state )
+{
+    int expected = EVENT_SIGNALED;
+    return state.load( std::memory_order_relaxed ) == EVENT_SIGNALED && state.compare_exchange_strong( expected, EVENT_UNSIGNALED, std::memory_order_acquire );
+}
+
+} // namespace
 #endif
 
 namespace RakNet {
@@ -21,6 +73,9 @@ SignaledEvent::SignaledEvent()
 {
 #ifdef _WIN32
     eventList = INVALID_HANDLE_VALUE;
+#elif defined( __linux__ )
+    state.store( EVENT_UNSIGNALED, std::memory_order_relaxed );
+    spinBeforeWaiting = false;
 #else
     isSignaled = false;
 #endif
@@ -34,11 +89,12 @@ void SignaledEvent::InitEvent( void )
 {
 #if defined( _WIN32 )
     eventList = CreateEvent( 0, false, false, 0 );
+#elif defined( __linux__ )
+    state.store( EVENT_UNSIGNALED, std::memory_order_relaxed );
+    // With one hardware thread, the thread that would set the event cannot run while this one spins
+    spinBeforeWaiting = std::thread::hardware_concurrency() > 1;
 #else
-    pthread_condattr_init( &condAttr );
-    pthread_cond_init( &eventList, &condAttr );
-    pthread_mutexattr_init( &mutexAttr );
-    pthread_mutex_init( &hMutex, &mutexAttr );
+    isSignaled = false;
 #endif
 }
 
@@ -50,11 +106,6 @@ void SignaledEvent::CloseEvent( void )
         CloseHandle( eventList );
         eventList = INVALID_HANDLE_VALUE;
     }
-#else
-    pthread_cond_destroy( &eventList );
-    pthread_mutex_destroy( &hMutex );
-    pthread_condattr_destroy( &condAttr );
-    pthread_mutexattr_destroy( &mutexAttr );
 #endif
 }
 
@@ -62,15 +113,16 @@ void SignaledEvent::SetEvent( void )
 {
 #ifdef _WIN32
     ::SetEvent( eventList );
+#elif defined( __linux__ )
+    // Only enter the kernel if a thread may be sleeping
+    if( state.exchange( EVENT_SIGNALED, std::memory_order_release ) == EVENT_UNSIGNALED_WITH_WAITERS )
+        FutexWakeAll( &state );
 #else
-    // Different from SetEvent which stays signaled.
-    // We have to record manually that the event was signaled
-    isSignaledMutex.lock();
-    isSignaled = true;
-    isSignaledMutex.unlock();
-
-    // Unblock waiting threads
-    pthread_cond_broadcast( &eventList );
+    {
+        std::lock_guard<std::mutex> guard( isSignaledMutex );
+        isSignaled = true;
+    }
+    eventList.notify_all();
 #endif
 }
 
@@ -78,73 +130,49 @@ void SignaledEvent::WaitOnEvent( int timeoutMs )
 {
 #ifdef _WIN32
     WaitForSingleObjectEx( eventList, timeoutMs, FALSE );
-#else
-
-    // If was previously set signaled, just unset and return
-    isSignaledMutex.lock();
-    if( isSignaled == true )
-    {
-        isSignaled = false;
-        isSignaledMutex.unlock();
+#elif defined( __linux__ )
+    if( TakeSignal( state ) )
         return;
-    }
-    isSignaledMutex.unlock();
-
-    // Else wait for SetEvent to be called
-    struct timespec ts;
-    struct timeval tp;
-    int rc = gettimeofday( &tp, NULL );
-    ts.tv_sec = tp.tv_sec;
-    ts.tv_nsec = tp.tv_usec * 1000;
-
-    while( timeoutMs > 30 )
+    if( spinBeforeWaiting )
     {
-        // Wait 30 milliseconds for the signal, then check again.
-        // This is in case we  missed the signal between the top of this function and pthread_cond_timedwait, or after the end of the loop and pthread_cond_timedwait
-        ts.tv_nsec += 30 * 1000000;
-        if( ts.tv_nsec >= 1000000000 )
-        {
-            ts.tv_nsec -= 1000000000;
-            ts.tv_sec++;
-        }
-
-        // [SBC] added mutex lock/unlock around cond_timedwait.
-        // this prevents airplay from generating a whole much of errors.
-        // not sure how this works on other platforms since according to
-        // the docs you are suppost to hold the lock before you wait
-        // on the cond.
-        pthread_mutex_lock( &hMutex );
-        pthread_cond_timedwait( &eventList, &hMutex, &ts );
-        pthread_mutex_unlock( &hMutex );
-
-        timeoutMs -= 30;
-
-        isSignaledMutex.lock();
-        if( isSignaled == true )
+        for( int i = 0; i < RAK_SIGNALED_EVENT_SPIN_COUNT; i++ )
         {
-            isSignaled = false;
-            isSignaledMutex.unlock();
-            return;
+            CpuRelax();
+            if( TakeSignal( state ) )
+                return;
         }
-        isSignaledMutex.unlock();
     }
 
-    // Wait the remaining time, and turn off the signal in case it was set
-    ts.tv_nsec += timeoutMs * 1000000;
-    if( ts.tv_nsec >= 1000000000 )
+    struct timespec deadline;
+    clock_gettime( CLOCK_MONOTONIC, &deadline );
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += ( timeoutMs % 1000 ) * 1000000L;
+    if( deadline.tv_nsec >= 1000000000L )
     {
-        ts.tv_nsec -= 1000000000;
-        ts.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+        deadline.tv_sec++;
     }
 
-    pthread_mutex_lock( &hMutex );
-    pthread_cond_timedwait( &eventList, &hMutex, &ts );
-    pthread_mutex_unlock( &hMutex );
-
-    isSignaledMutex.lock();
+    for( ;; )
+    {
+        int current = state.load( std::memory_order_relaxed );
+        if( current == EVENT_SIGNALED )
+        {
+            if( state.compare_exchange_weak( current, EVENT_UNSIGNALED, std::memory_order_acquire ) )
+                return;
+            continue;
+        }
+        // Tell SetEvent to wake this thread. If the event was set meanwhile, look again.
+        if( current == EVENT_UNSIGNALED && !state.compare_exchange_weak( current, EVENT_UNSIGNALED_WITH_WAITERS, std::memory_order_relaxed ) )
+            continue;
+        // Returns at once if the state is no longer EVENT_UNSIGNALED_WITH_WAITERS
+        if( FutexWait( &state, EVENT_UNSIGNALED_WITH_WAITERS, &deadline ) != 0 && errno == ETIMEDOUT )
+            return;
+    }
+#else
+    std::unique_lock<std::mutex> lock( isSignaledMutex );
+    eventList.wait_until( lock, std::chrono::steady_clock::now() + std::chrono::milliseconds( timeoutMs ), [this]() { return isSignaled; } );
     isSignaled = false;
-    isSignaledMutex.unlock();
-
 #endif
 }
 
@@ -12,16 +12,23 @@
 
 #if defined( _WIN32 )
 #include "WindowsIncludes.h"
+#elif defined( __linux__ )
+#include <atomic>
 #else
+#include <condition_variable>
 #include <mutex>
-#include <pthread.h>
-#include <sys/types.h>
 #endif
 
 #include "Export.h"
 
+// Times WaitOnEvent checks for the event before sleeping, on machines with more than one hardware thread.
+// SetEvent from another core typically lands within this, saving the sleep and the wake up.
+#define RAK_SIGNALED_EVENT_SPIN_COUNT 200
+
 namespace RakNet {
 
+/// Wakes one thread, such as RakPeer's update thread, when another has something for it.
+/// Like an auto-reset event on Windows: SetEvent stays signaled until a WaitOnEvent returns because of it.
 class RAK_DLL_EXPORT SignaledEvent
 {
 public:
@@ -31,18 +38,20 @@ public:
     void InitEvent( void );
     void CloseEvent( void );
     void SetEvent( void );
+    /// Returns when the event is set, or after \a timeoutMs, measured on a monotonic clock
     void WaitOnEvent( int timeoutMs );
 
 protected:
 #ifdef _WIN32
     HANDLE eventList;
+#elif defined( __linux__ )
+    // One of the EventState values, and the futex the waiters sleep on
+    std::atomic<int> state;
+    bool spinBeforeWaiting;
 #else
     std::mutex isSignaledMutex;
+    std::condition_variable eventList;
     bool isSignaled;
-    pthread_condattr_t condAttr;
-    pthread_cond_t eventList;
-    pthread_mutex_t hMutex;
-    pthread_mutexattr_t mutexAttr;
 #endif
 };
 
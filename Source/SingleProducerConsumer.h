@@ -124,10 +124,10 @@ SingleProducerConsumer<SingleProducerConsumerType>::~SingleProducerConsumer()
     while( readPointer != writeAheadPointer )
     {
         next = readPointer->next;
-        RakNet::OP_DELETE( (char*)readPointer, _FILE_AND_LINE_ );
+        RakNet::OP_DELETE( (DataPlusPtr*)readPointer, _FILE_AND_LINE_ );
         readPointer = next;
     }
-    RakNet::OP_DELETE( (char*)readPointer, _FILE_AND_LINE_ );
+    RakNet::OP_DELETE( (DataPlusPtr*)readPointer, _FILE_AND_LINE_ );
 }
 
 template<class SingleProducerConsumerType>
@@ -230,7 +230,7 @@ void SingleProducerConsumer<SingleProducerConsumerType>::Clear( void )
 #ifdef _DEBUG
         RakAssert( writePointer != readPointer );
 #endif
-        RakNet::OP_DELETE( (char*)writePointer, _FILE_AND_LINE_ );
+        RakNet::OP_DELETE( (DataPlusPtr*)writePointer, _FILE_AND_LINE_ );
         writePointer = next;
     }
 
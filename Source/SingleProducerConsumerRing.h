@@ -0,0 +1,515 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief \b [Internal] Passes queued data between threads through contiguous rings, one element or several at a time
+///
+
+#pragma once
+
+#include "RakAssert.h"
+#include "RakMemoryOverride.h"
+#include "Export.h"
+
+#include <atomic>
+#include <stdint.h>
+
+namespace RakNet { namespace DataStructures {
+
+/// \brief A single producer consumer implementation on contiguous, cache line padded rings, without critical sections.
+/// Locks like SingleProducerConsumer, and can replace it. WriteLockN() and ReadLockN() also lock runs of consecutive elements at once.
+/// Neither thread ever waits for the other. When a ring is full, the producer chains a ring at least twice the size after it,
+/// which the consumer moves on to once it has read everything before it, freeing the ring it leaves.
+template<class SingleProducerConsumerType>
+class RAK_DLL_EXPORT SingleProducerConsumerRing
+{
+public:
+    /// \param[in] initialCapacity Elements in the first ring, rounded up to a power of 2
+    SingleProducerConsumerRing( int initialCapacity = 64 );
+
+    // Destructor
+    ~SingleProducerConsumerRing();
+
+    /// WriteLock must be immediately followed by WriteUnlock.  These two functions must be called in the same thread.
+    /// \return A pointer to a block of data you can write to.
+    SingleProducerConsumerType* WriteLock( void );
+
+    /// Locks up to \a maxCount consecutive elements, to be unlocked with WriteUnlockN() or as many calls to WriteUnlock()
+    /// \param[in] maxCount The most elements to lock
+    /// \param[out] count How many were locked, at least 1. Fewer than \a maxCount where the ring wraps around.
+    /// \return The first of \a count consecutive elements you can write to
+    SingleProducerConsumerType* WriteLockN( int maxCount, int* count );
+
+    /// Call if you don't want to write to a block of data from WriteLock() after all.
+    /// Cancelling locks cancels all locks back up to the data passed.  So if you lock twice and cancel using the first lock, the second lock is ignored
+    /// \param[in] cancelToLocation Which WriteLock() to cancel.
+    void CancelWriteLock( SingleProducerConsumerType* cancelToLocation );
+
+    /// Call when you are done writing to a block of memory returned by WriteLock()
+    void WriteUnlock( void );
+
+    /// Call when you are done writing to the \a count least recently locked elements
+    void WriteUnlockN( int count );
+
+    /// ReadLock must be immediately followed by ReadUnlock. These two functions must be called in the same thread.
+    /// \retval 0 No data is availble to read
+    /// \retval Non-zero The data previously written to, in another thread, by WriteLock followed by WriteUnlock.
+    SingleProducerConsumerType* ReadLock( void );
+
+    /// Locks up to \a maxCount consecutive elements to read, to be unlocked with ReadUnlockN() or as many calls to ReadUnlock()
+    /// \param[in] maxCount The most elements to lock
+    /// \param[out] count How many were locked. Fewer than \a maxCount where the ring wraps around, or when fewer were written.
+    /// \return The first of \a count consecutive elements, or 0 if no data is available to read
+    SingleProducerConsumerType* ReadLockN( int maxCount, int* count );
+
+    // Cancelling locks cancels all locks back up to the data passed.  So if you lock twice and cancel using the first lock, the second lock is ignored
+    /// param[in] Which ReadLock() to cancel.
+    void CancelReadLock( SingleProducerConsumerType* cancelToLocation );
+
+    /// Signals that we are done reading the the data from the least recent call of ReadLock.
+    /// At this point that pointer is no longer valid, and should no longer be read.
+    void ReadUnlock( void );
+
+    /// Signals that we are done reading the \a count least recently locked elements
+    void ReadUnlockN( int count );
+
+    /// Clear is not thread-safe and none of the lock or unlock functions should be called while it is running.
+    /// Keeps the largest ring
+    void Clear( void );
+
+    /// This function will estimate how many elements are waiting to be read.  It's threadsafe enough that the value returned is stable, but not threadsafe enough to give accurate results.
+    /// \return An ESTIMATE of how many data elements are waiting to be read
+    int Size( void ) const;
+
+    /// Make sure that the pointer we done reading for the call to ReadUnlock is the right pointer.
+    /// param[in] A previous pointer returned by ReadLock()
+    bool CheckReadUnlockOrder( const SingleProducerConsumerType* data ) const;
+
+    /// Returns if ReadUnlock was called before ReadLock
+    /// \return If the read is locked
+    bool ReadIsLocked( void ) const;
+
+private:
+    struct Ring
+    {
+        SingleProducerConsumerType* elements;
+        uint64_t capacity;
+        char capacityPadding[64 - sizeof( SingleProducerConsumerType* ) - sizeof( uint64_t )];
+
+        // Written by the producer. Elements before it can be read.
+        std::atomic<uint64_t> writeIndex;
+        char writeIndexPadding[64 - sizeof( std::atomic<uint64_t> )];
+        // Written by the consumer. Elements before it can be written again.
+        std::atomic<uint64_t> readIndex;
+        char readIndexPadding[64 - sizeof( std::atomic<uint64_t> )];
+        // Set once everything written to this ring can be read, for the consumer to move on to
+        std::atomic<Ring*> next;
+
+        // Producer only. The ring chained after this one, and where the locks in this one stopped.
+        Ring* nextWrite;
+        uint64_t writeEnd;
+
+        SingleProducerConsumerType* At( uint64_t index ) const { return elements + ( index & ( capacity - 1 ) ); }
+        bool Contains( const SingleProducerConsumerType* element ) const { return element >= elements && element < elements + capacity; }
+    };
+
+    static const uint64_t noWriteEnd = ~(uint64_t)0;
+
+    Ring* AllocateRing( uint64_t capacity );
+    void FreeRing( Ring* ring );
+    // Moves the locks on to the ring after the full one, chaining a new one if needed
+    Ring* Grow( int maxCount );
+    // Hands the consumer the rings the locks moved on from, once everything locked in them was unlocked
+    void LinkWrittenRings( void );
+    // Frees the rings the consumer moved on from, once everything read from them was unlocked
+    void FreeReadRings( void );
+
+    // Producer
+    Ring* writeRing;
+    Ring* writeAheadRing;
+    uint64_t writeAheadIndex;
+    // writeAheadRing->readIndex when last read
+    uint64_t cachedReadIndex;
+    std::atomic<unsigned> writeCount;
+    char producerPadding[64];
+
+    // Consumer
+    Ring* readRing;
+    Ring* readAheadRing;
+    uint64_t readAheadIndex;
+    // readAheadRing->writeIndex when last read
+    uint64_t cachedWriteIndex;
+    std::atomic<unsigned> readCount;
+};
+
+template<class SingleProducerConsumerType>
+SingleProducerConsumerRing<SingleProducerConsumerType>::SingleProducerConsumerRing( int initialCapacity )
+{
+    uint64_t capacity = 2;
+    while( capacity < (uint64_t)initialCapacity )
+        capacity <<= 1;
+
+    writeRing = writeAheadRing = readRing = readAheadRing = AllocateRing( capacity );
+    writeAheadIndex = readAheadIndex = 0;
+    cachedReadIndex = cachedWriteIndex = 0;
+    writeCount.store( 0, std::memory_order_relaxed );
+    readCount.store( 0, std::memory_order_relaxed );
+}
+
+template<class SingleProducerConsumerType>
+SingleProducerConsumerRing<SingleProducerConsumerType>::~SingleProducerConsumerRing()
+{
+    // Every ring after the oldest was chained by the producer
+    Ring* ring = readRing;
+    while( ring != 0 )
+    {
+        Ring* next = ring->nextWrite;
+        FreeRing( ring );
+        ring = next;
+    }
+}
+
+template<class SingleProducerConsumerType>
+SingleProducerConsumerType* SingleProducerConsumerRing<SingleProducerConsumerType>::WriteLock( void )
+{
+    int count;
+    return WriteLockN( 1, &count );
+}
+
+template<class SingleProducerConsumerType>
+SingleProducerConsumerType* SingleProducerConsumerRing<SingleProducerConsumerType>::WriteLockN( int maxCount, int* count )
+{
+    RakAssert( maxCount > 0 );
+
+    Ring* ring = writeAheadRing;
+    uint64_t free = ring->capacity - ( writeAheadIndex - cachedReadIndex );
+    if( free < (uint64_t)maxCount )
+    {
+        cachedReadIndex = ring->readIndex.load( std::memory_order_acquire );
+        free = ring->capacity - ( writeAheadIndex - cachedReadIndex );
+    }
+    if( free == 0 )
+    {
+        ring = Grow( maxCount );
+        free = ring->capacity;
+    }
+
+    // Up to where the ring wraps around
+    uint64_t run = ring->capacity - ( writeAheadIndex & ( ring->capacity - 1 ) );
+    if( run > free )
+        run = free;
+    if( run > (uint64_t)maxCount )
+        run = maxCount;
+
+    SingleProducerConsumerType* first = ring->At( writeAheadIndex );
+    writeAheadIndex += run;
+    *count = (int)run;
+    return first;
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::CancelWriteLock( SingleProducerConsumerType* cancelToLocation )
+{
+    // Anything still locked is in writeRing or a ring chained after it
+    Ring* ring = writeRing;
+    while( ring != 0 && ring->Contains( cancelToLocation ) == false )
+        ring = ring->nextWrite;
+    RakAssert( ring != 0 );
+    if( ring == 0 )
+        return;
+
+    // The locked elements are the capacity after the written ones, so the offset in the ring places it
+    const uint64_t written = ring->writeIndex.load( std::memory_order_relaxed );
+    writeAheadIndex = written + ( ( (uint64_t)( cancelToLocation - ring->elements ) - written ) & ( ring->capacity - 1 ) );
+    writeAheadRing = ring;
+    cachedReadIndex = ring->readIndex.load( std::memory_order_acquire );
+    for( ; ring != 0; ring = ring->nextWrite )
+        ring->writeEnd = noWriteEnd;
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::WriteUnlock( void )
+{
+    WriteUnlockN( 1 );
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::WriteUnlockN( int count )
+{
+    // Only this thread writes it, so no read-modify-write is needed
+    writeCount.store( writeCount.load( std::memory_order_relaxed ) + count, std::memory_order_relaxed );
+
+    if( writeRing == writeAheadRing )
+    {
+        // If hits, then called WriteUnlock for more than was locked
+        RakAssert( writeRing->writeIndex.load( std::memory_order_relaxed ) + count <= writeAheadIndex );
+        // User is done with the data, allow reading it
+        writeRing->writeIndex.store( writeRing->writeIndex.load( std::memory_order_relaxed ) + count, std::memory_order_release );
+        return;
+    }
+
+    // The locks span the rings chained while they were held
+    uint64_t remaining = count;
+    while( remaining > 0 )
+    {
+        const uint64_t written = writeRing->writeIndex.load( std::memory_order_relaxed );
+        const uint64_t lockedEnd = writeRing == writeAheadRing ? writeAheadIndex : writeRing->writeEnd;
+        uint64_t unlocked = lockedEnd - written;
+        if( unlocked > remaining )
+            unlocked = remaining;
+
+        // If hits, then called WriteUnlock for more than was locked
+        RakAssert( unlocked > 0 );
+        if( unlocked == 0 )
+            break;
+
+        // User is done with the data, allow reading it
+        writeRing->writeIndex.store( written + unlocked, std::memory_order_release );
+        remaining -= unlocked;
+        LinkWrittenRings();
+    }
+}
+
+template<class SingleProducerConsumerType>
+SingleProducerConsumerType* SingleProducerConsumerRing<SingleProducerConsumerType>::ReadLock( void )
+{
+    int count;
+    return ReadLockN( 1, &count );
+}
+
+template<class SingleProducerConsumerType>
+SingleProducerConsumerType* SingleProducerConsumerRing<SingleProducerConsumerType>::ReadLockN( int maxCount, int* count )
+{
+    RakAssert( maxCount > 0 );
+
+    Ring* ring = readAheadRing;
+    uint64_t available = cachedWriteIndex - readAheadIndex;
+    if( available < (uint64_t)maxCount )
+    {
+        cachedWriteIndex = ring->writeIndex.load( std::memory_order_acquire );
+        available = cachedWriteIndex - readAheadIndex;
+    }
+    while( available == 0 )
+    {
+        Ring* next = ring->next.load( std::memory_order_acquire );
+        if( next == 0 )
+        {
+            *count = 0;
+            return 0;
+        }
+
+        // Everything written to this ring could be read before next was set
+        cachedWriteIndex = ring->writeIndex.load( std::memory_order_acquire );
+        if( cachedWriteIndex == readAheadIndex )
+        {
+            ring = readAheadRing = next;
+            readAheadIndex = 0;
+            cachedWriteIndex = ring->writeIndex.load( std::memory_order_acquire );
+            FreeReadRings();
+        }
+        available = cachedWriteIndex - readAheadIndex;
+    }
+
+    // Up to where the ring wraps around
+    uint64_t run = ring->capacity - ( readAheadIndex & ( ring->capacity - 1 ) );
+    if( run > available )
+        run = available;
+    if( run > (uint64_t)maxCount )
+        run = maxCount;
+
+    SingleProducerConsumerType* first = ring->At( readAheadIndex );
+    readAheadIndex += run;
+    *count = (int)run;
+    return first;
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::CancelReadLock( SingleProducerConsumerType* cancelToLocation )
+{
+#ifdef _DEBUG
+    RakAssert( ReadIsLocked() );
+#endif
+
+    // Anything still locked is in readRing or a ring the consumer moved on to after it
+    Ring* ring = readRing;
+    while( ring != 0 && ring->Contains( cancelToLocation ) == false )
+        ring = ring->next.load( std::memory_order_acquire );
+    RakAssert( ring != 0 );
+    if( ring == 0 )
+        return;
+
+    const uint64_t read = ring->readIndex.load( std::memory_order_relaxed );
+    readAheadIndex = read + ( ( (uint64_t)( cancelToLocation - ring->elements ) - read ) & ( ring->capacity - 1 ) );
+    readAheadRing = ring;
+    cachedWriteIndex = ring->writeIndex.load( std::memory_order_acquire );
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::ReadUnlock( void )
+{
+    ReadUnlockN( 1 );
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::ReadUnlockN( int count )
+{
+    readCount.store( readCount.load( std::memory_order_relaxed ) + count, std::memory_order_relaxed );
+
+    if( readRing == readAheadRing )
+    {
+        // If hits, then called ReadUnlock before ReadLock
+        RakAssert( readRing->readIndex.load( std::memory_order_relaxed ) + count <= readAheadIndex );
+        // Allow writes to this memory
+        readRing->readIndex.store( readRing->readIndex.load( std::memory_order_relaxed ) + count, std::memory_order_release );
+        return;
+    }
+
+    // The locks span the rings the consumer moved on to while they were held
+    uint64_t remaining = count;
+    while( remaining > 0 )
+    {
+        const uint64_t read = readRing->readIndex.load( std::memory_order_relaxed );
+        const uint64_t lockedEnd = readRing == readAheadRing ? readAheadIndex : readRing->writeIndex.load( std::memory_order_relaxed );
+        uint64_t unlocked = lockedEnd - read;
+        if( unlocked > remaining )
+            unlocked = remaining;
+
+        // If hits, then called ReadUnlock before ReadLock
+        RakAssert( unlocked > 0 );
+        if( unlocked == 0 )
+            break;
+
+        // Allow writes to this memory
+        readRing->readIndex.store( read + unlocked, std::memory_order_release );
+        remaining -= unlocked;
+        FreeReadRings();
+    }
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::Clear( void )
+{
+    // The constructor always allocates a ring. This tells the compiler so, which otherwise warns about writing through a null largest.
+    if( readRing == 0 )
+        return;
+
+    Ring* largest = readRing;
+    for( Ring* ring = readRing; ring != 0; ring = ring->nextWrite )
+    {
+        if( ring->capacity > largest->capacity )
+            largest = ring;
+    }
+    Ring* ring = readRing;
+    while( ring != 0 )
+    {
+        Ring* next = ring->nextWrite;
+        if( ring != largest )
+            FreeRing( ring );
+        ring = next;
+    }
+
+    largest->writeIndex.store( 0, std::memory_order_relaxed );
+    largest->readIndex.store( 0, std::memory_order_relaxed );
+    largest->next.store( 0, std::memory_order_relaxed );
+    largest->nextWrite = 0;
+    largest->writeEnd = noWriteEnd;
+    writeRing = writeAheadRing = readRing = readAheadRing = largest;
+    writeAheadIndex = readAheadIndex = 0;
+    cachedReadIndex = cachedWriteIndex = 0;
+    writeCount.store( 0, std::memory_order_relaxed );
+    readCount.store( 0, std::memory_order_relaxed );
+}
+
+template<class SingleProducerConsumerType>
+int SingleProducerConsumerRing<SingleProducerConsumerType>::Size( void ) const
+{
+    return (int)( writeCount.load( std::memory_order_relaxed ) - readCount.load( std::memory_order_relaxed ) );
+}
+
+template<class SingleProducerConsumerType>
+bool SingleProducerConsumerRing<SingleProducerConsumerType>::CheckReadUnlockOrder( const SingleProducerConsumerType* data ) const
+{
+    return readRing->At( readRing->readIndex.load( std::memory_order_relaxed ) ) == data;
+}
+
+template<class SingleProducerConsumerType>
+bool SingleProducerConsumerRing<SingleProducerConsumerType>::ReadIsLocked( void ) const
+{
+    return readAheadRing != readRing || readAheadIndex != readRing->readIndex.load( std::memory_order_relaxed );
+}
+
+template<class SingleProducerConsumerType>
+typename SingleProducerConsumerRing<SingleProducerConsumerType>::Ring* SingleProducerConsumerRing<SingleProducerConsumerType>::AllocateRing( uint64_t capacity )
+{
+    Ring* ring = RakNet::OP_NEW<Ring>( _FILE_AND_LINE_ );
+    ring->elements = RakNet::OP_NEW_ARRAY<SingleProducerConsumerType>( (int)capacity, _FILE_AND_LINE_ );
+    ring->capacity = capacity;
+    ring->writeIndex.store( 0, std::memory_order_relaxed );
+    ring->readIndex.store( 0, std::memory_order_relaxed );
+    ring->next.store( 0, std::memory_order_relaxed );
+    ring->nextWrite = 0;
+    ring->writeEnd = noWriteEnd;
+    return ring;
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::FreeRing( Ring* ring )
+{
+    RakNet::OP_DELETE_ARRAY( ring->elements, _FILE_AND_LINE_ );
+    RakNet::OP_DELETE( ring, _FILE_AND_LINE_ );
+}
+
+template<class SingleProducerConsumerType>
+typename SingleProducerConsumerRing<SingleProducerConsumerType>::Ring* SingleProducerConsumerRing<SingleProducerConsumerType>::Grow( int maxCount )
+{
+    // A ring left after CancelWriteLock() is empty, and used again
+    Ring* grown = writeAheadRing->nextWrite;
+    if( grown == 0 )
+    {
+        uint64_t capacity = writeAheadRing->capacity * 2;
+        while( capacity < (uint64_t)maxCount )
+            capacity <<= 1;
+        grown = AllocateRing( capacity );
+        writeAheadRing->nextWrite = grown;
+    }
+
+    writeAheadRing->writeEnd = writeAheadIndex;
+    writeAheadRing = grown;
+    writeAheadIndex = 0;
+    cachedReadIndex = 0;
+    LinkWrittenRings();
+    return grown;
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::LinkWrittenRings( void )
+{
+    while( writeRing != writeAheadRing && writeRing->writeIndex.load( std::memory_order_relaxed ) == writeRing->writeEnd )
+    {
+        // The consumer may free writeRing as soon as next is set
+        Ring* next = writeRing->nextWrite;
+        writeRing->next.store( next, std::memory_order_release );
+        writeRing = next;
+    }
+}
+
+template<class SingleProducerConsumerType>
+void SingleProducerConsumerRing<SingleProducerConsumerType>::FreeReadRings( void )
+{
+    // The consumer only moves on from a ring once next is set, after which the producer no longer uses it
+    while( readRing != readAheadRing && readRing->readIndex.load( std::memory_order_relaxed ) == readRing->writeIndex.load( std::memory_order_relaxed ) )
+    {
+        Ring* next = readRing->next.load( std::memory_order_acquire );
+        FreeRing( readRing );
+        readRing = next;
+    }
+}
+
+}} // namespace RakNet::DataStructures
@@ -33,3 +33,10 @@
 #define send__ send
 #define setsockopt__ setsockopt
 #define shutdown__ shutdown
+
+// Gathered send of several buffers in one call
+#if defined( _WIN32 )
+#define WSASend__ WSASend
+#else
+#define sendmsg__ sendmsg
+#endif
@@ -0,0 +1,305 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "StringTable.h"
+
+#include "BitStream.h"
+#include "MessageIdentifiers.h"
+#include "StringCompressor.h"
+
+#include <string.h>
+
+using namespace RakNet;
+
+// Each string starts with 1 and an ID for a string already defined, 01, an ID and the string to define it, or 00 and a string that is not interned.
+// Each ID is followed by its generation, which counts the times the sender reused it.
+
+StringTableSender::StringTableSender( unsigned int _maxEntries, unsigned int _maxStringLength )
+{
+    maxEntries = _maxEntries;
+    maxStringLength = _maxStringLength;
+}
+
+void StringTableSender::EncodeString( const char* input, int maxCharsToWrite, RakNetGUID guid, BitStream* output )
+{
+    size_t charsToWrite = 0;
+    if( input != 0 )
+    {
+        charsToWrite = strlen( input );
+        if( maxCharsToWrite > 0 && charsToWrite >= (size_t)maxCharsToWrite )
+            charsToWrite = maxCharsToWrite - 1;
+    }
+
+    if( input == 0 || charsToWrite > maxStringLength || maxEntries == 0 )
+    {
+        output->Write0();
+        output->Write0();
+        StringCompressor::Instance()->EncodeString( input, maxCharsToWrite, output );
+        return;
+    }
+
+    Connection& connection = connections[guid];
+    std::string string( input, charsToWrite );
+    unsigned int id;
+    auto found = connection.ids.find( string );
+    if( found != connection.ids.end() )
+    {
+        id = found->second;
+        Entry& entry = connection.entries[id];
+        connection.recentlyUsed.splice( connection.recentlyUsed.begin(), connection.recentlyUsed, entry.recentlyUsed );
+        entry.messagesInFlight++;
+        if( entry.isAcknowledged )
+        {
+            output->Write1();
+            output->WriteVarInt( id );
+            output->WriteVarInt( entry.generation );
+            connection.unsent.referencedIds.push_back( id );
+            return;
+        }
+    }
+    else
+    {
+        id = AssignId( connection, string );
+        if( id == maxEntries )
+        {
+            output->Write0();
+            output->Write0();
+            StringCompressor::Instance()->EncodeString( string.c_str(), 0, output );
+            return;
+        }
+        connection.entries[id].messagesInFlight++;
+    }
+
+    // Defined again until a message defining it is acknowledged
+    output->Write0();
+    output->Write1();
+    output->WriteVarInt( id );
+    output->WriteVarInt( connection.entries[id].generation );
+    StringCompressor::Instance()->EncodeString( string.c_str(), 0, output );
+    connection.unsent.definedIds.push_back( id );
+}
+
+void StringTableSender::EncodeString( const std::string& input, int maxCharsToWrite, RakNetGUID guid, BitStream* output )
+{
+    EncodeString( input.c_str(), maxCharsToWrite, guid, output );
+}
+
+void StringTableSender::SetSendReceipt( RakNetGUID guid, uint32_t sendReceipt )
+{
+    auto it = connections.find( guid );
+    if( it == connections.end() )
+        return;
+
+    Connection& connection = it->second;
+    if( connection.unsent.definedIds.empty() && connection.unsent.referencedIds.empty() )
+        return;
+
+    Message& message = connection.inFlight[sendReceipt];
+    message.definedIds.insert( message.definedIds.end(), connection.unsent.definedIds.begin(), connection.unsent.definedIds.end() );
+    message.referencedIds.insert( message.referencedIds.end(), connection.unsent.referencedIds.begin(), connection.unsent.referencedIds.end() );
+    connection.unsent.definedIds.clear();
+    connection.unsent.referencedIds.clear();
+
+    // Send() returns 0 when nothing was sent
+    if( sendReceipt == 0 )
+        OnResolved( guid, 0, false );
+}
+
+bool StringTableSender::OnReceive( const Packet* packet )
+{
+    if( packet->length < 1 + sizeof( uint32_t ) || ( packet->data[0] != ID_SND_RECEIPT_ACKED && packet->data[0] != ID_SND_RECEIPT_LOSS ) )
+        return false;
+
+    // Written in host order by ReliabilityLayer
+    uint32_t sendReceipt;
+    memcpy( &sendReceipt, packet->data + 1, sizeof( sendReceipt ) );
+    return OnResolved( packet->guid, sendReceipt, packet->data[0] == ID_SND_RECEIPT_ACKED );
+}
+
+bool StringTableSender::OnAcknowledged( RakNetGUID guid, uint32_t sendReceipt )
+{
+    return OnResolved( guid, sendReceipt, true );
+}
+
+bool StringTableSender::OnLost( RakNetGUID guid, uint32_t sendReceipt )
+{
+    return OnResolved( guid, sendReceipt, false );
+}
+
+unsigned int StringTableSender::GetAcknowledgedCount( RakNetGUID guid ) const
+{
+    auto it = connections.find( guid );
+    if( it == connections.end() )
+        return 0;
+
+    unsigned int count = 0;
+    for( const Entry& entry : it->second.entries )
+    {
+        if( entry.isAcknowledged )
+            count++;
+    }
+    return count;
+}
+
+void StringTableSender::RemoveConnection( RakNetGUID guid )
+{
+    connections.erase( guid );
+}
+
+void StringTableSender::Clear( void )
+{
+    connections.clear();
+}
+
+unsigned int StringTableSender::AssignId( Connection& connection, const std::string& string )
+{
+    unsigned int id;
+    if( connection.entries.size() < maxEntries )
+    {
+        id = (unsigned int)connection.entries.size();
+        connection.entries.push_back( Entry() );
+        connection.entries[id].generation = 0;
+        connection.recentlyUsed.push_front( id );
+        connection.entries[id].recentlyUsed = connection.recentlyUsed.begin();
+    }
+    else
+    {
+        // The least recently used ID that no message in flight uses
+        auto it = connection.recentlyUsed.end();
+        do
+        {
+            if( it == connection.recentlyUsed.begin() )
+                return maxEntries;
+            --it;
+        } while( connection.entries[*it].messagesInFlight > 0 );
+
+        id = *it;
+        connection.ids.erase( connection.entries[id].string );
+        // Messages reported lost that used the ID may still arrive, and the receiver tells them apart by this
+        connection.entries[id].generation++;
+        connection.recentlyUsed.splice( connection.recentlyUsed.begin(), connection.recentlyUsed, it );
+    }
+
+    Entry& entry = connection.entries[id];
+    entry.string = string;
+    entry.messagesInFlight = 0;
+    entry.isAcknowledged = false;
+    connection.ids[string] = id;
+    return id;
+}
+
+bool StringTableSender::OnResolved( RakNetGUID guid, uint32_t sendReceipt, bool isAcknowledged )
+{
+    auto connection = connections.find( guid );
+    if( connection == connections.end() )
+        return false;
+
+    auto message = connection->second.inFlight.find( sendReceipt );
+    if( message == connection->second.inFlight.end() )
+        return false;
+
+    std::vector<Entry>& entries = connection->second.entries;
+    for( unsigned int id : message->second.definedIds )
+    {
+        entries[id].messagesInFlight--;
+        if( isAcknowledged )
+            entries[id].isAcknowledged = true;
+    }
+    for( unsigned int id : message->second.referencedIds )
+        entries[id].messagesInFlight--;
+
+    connection->second.inFlight.erase( message );
+    return true;
+}
+
+StringTableReceiver::StringTableReceiver( unsigned int _maxEntries, unsigned int _maxStringLength )
+{
+    maxEntries = _maxEntries;
+    maxStringLength = _maxStringLength;
+}
+
+bool StringTableReceiver::DecodeString( char* output, int maxCharsToWrite, RakNetGUID guid, BitStream* input )
+{
+    if( maxCharsToWrite <= 0 )
+        return false;
+
+    output[0] = 0;
+    std::string string;
+    if( DecodeString( &string, guid, input ) == false )
+        return false;
+
+    const size_t length = string.size() < (size_t)maxCharsToWrite ? string.size() : (size_t)maxCharsToWrite - 1;
+    memcpy( output, string.c_str(), length );
+    output[length] = 0;
+    return true;
+}
+
+bool StringTableReceiver::DecodeString( std::string& output, int maxCharsToWrite, RakNetGUID guid, BitStream* input )
+{
+    if( maxCharsToWrite <= 0 )
+    {
+        output.clear();
+        return true;
+    }
+
+    if( DecodeString( &output, guid, input ) == false )
+        return false;
+
+    if( output.size() >= (size_t)maxCharsToWrite )
+        output.resize( maxCharsToWrite - 1 );
+    return true;
+}
+
+void StringTableReceiver::RemoveConnection( RakNetGUID guid )
+{
+    connections.erase( guid );
+}
+
+void StringTableReceiver::Clear( void )
+{
+    connections.clear();
+}
+
+bool StringTableReceiver::DecodeString( std::string* output, RakNetGUID guid, BitStream* input )
+{
+    bool isInterned, isDefinition = false;
+    if( input->Read( isInterned ) == false || ( isInterned == false && input->Read( isDefinition ) == false ) )
+        return false;
+
+    if( isInterned == false && isDefinition == false )
+        return StringCompressor::Instance()->DecodeString( *output, 0xFFFF, input );
+
+    uint32_t id, generation;
+    if( input->ReadVarInt( id ) == false || id >= maxEntries || input->ReadVarInt( generation ) == false )
+        return false;
+
+    std::vector<Entry>& entries = connections[guid];
+    if( isInterned )
+    {
+        // A late message referring to what the ID meant before it was reused
+        if( id >= entries.size() || entries[id].isDefined == false || entries[id].generation != generation )
+            return false;
+        *output = entries[id].string;
+        return true;
+    }
+
+    if( StringCompressor::Instance()->DecodeString( *output, maxStringLength + 1, input ) == false )
+        return false;
+
+    if( id >= entries.size() )
+        entries.resize( id + 1, Entry{ std::string(), 0, false } );
+    // A late definition does not replace a later one, though it still holds its own string
+    if( entries[id].isDefined && (int32_t)( generation - entries[id].generation ) < 0 )
+        return true;
+    entries[id].string = *output;
+    entries[id].generation = generation;
+    entries[id].isDefined = true;
+    return true;
+}
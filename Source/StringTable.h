@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Sends each repeated string to a connection once, then refers to it by a small ID.
+///
+
+#pragma once
+
+#include "Export.h"
+#include "RakNetTypes.h"
+
+#include <list>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RakNet {
+
+class BitStream;
+
+/// \brief Writes strings for each connection, interning those it sends repeatedly.
+/// \details The first time a string goes to a connection it is written with StringCompressor along with a new ID. Once the message carrying it is acknowledged,
+/// the string is written as just that ID. Until then, or while every ID is in use, it is written in full again.
+/// Each connection has up to \a maxEntries IDs. When they run out, the least recently used one is reused for the new string,
+/// once every message that used it was acknowledged or reported lost.
+/// A message reported lost may still arrive later, so each ID is written with how many times it was reused. The receiver rejects a reference
+/// to an earlier use of the ID and does not let a late definition replace a later one, so it never reads a reused ID with its old meaning.
+/// Call SetSendReceipt() after sending each message written with EncodeString(), and pass ID_SND_RECEIPT_ACKED and ID_SND_RECEIPT_LOSS to OnReceive().
+/// Without receipts strings are always written in full.
+/// Uses StringCompressor::Instance(), which exists while a RakPeer does.
+/// \sa StringTableReceiver
+class RAK_DLL_EXPORT StringTableSender
+{
+public:
+    /// \param[in] maxEntries How many strings each connection can intern. Must match the StringTableReceiver.
+    /// \param[in] maxStringLength Longer strings are always written in full. Must match the StringTableReceiver.
+    StringTableSender( unsigned int maxEntries = 256, unsigned int maxStringLength = 255 );
+
+    /// Same as StringCompressor::EncodeString(), for the connection \a guid
+    void EncodeString( const char* input, int maxCharsToWrite, RakNetGUID guid, BitStream* output );
+    void EncodeString( const std::string& input, int maxCharsToWrite, RakNetGUID guid, BitStream* output );
+
+    /// Identify the message holding the strings written for \a guid since the last call, so its receipt can be matched
+    void SetSendReceipt( RakNetGUID guid, uint32_t sendReceipt );
+
+    /// Pass packets from RakPeerInterface::Receive() here
+    /// \return true if \a packet was the ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS of a message with strings. Other packets are left to the caller.
+    bool OnReceive( const Packet* packet );
+
+    /// The message sent with \a sendReceipt arrived, so the IDs it defined may be used
+    bool OnAcknowledged( RakNetGUID guid, uint32_t sendReceipt );
+
+    /// The message sent with \a sendReceipt was lost. The strings it defined are written in full next time.
+    bool OnLost( RakNetGUID guid, uint32_t sendReceipt );
+
+    /// \return How many strings \a guid can be sent as an ID
+    unsigned int GetAcknowledgedCount( RakNetGUID guid ) const;
+
+    /// Forget \a guid, for example on ID_DISCONNECTION_NOTIFICATION
+    void RemoveConnection( RakNetGUID guid );
+
+    void Clear( void );
+
+protected:
+    struct Entry
+    {
+        std::string string;
+        // Messages using the ID that were neither acknowledged nor lost
+        unsigned int messagesInFlight;
+        // Times the ID was reused
+        uint32_t generation;
+        bool isAcknowledged;
+        std::list<unsigned int>::iterator recentlyUsed;
+    };
+
+    struct Message
+    {
+        std::vector<unsigned int> definedIds;
+        std::vector<unsigned int> referencedIds;
+    };
+
+    struct Connection
+    {
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, unsigned int> ids;
+        // Most recently used first
+        std::list<unsigned int> recentlyUsed;
+        // Written since the last SetSendReceipt()
+        Message unsent;
+        std::unordered_map<uint32_t, Message> inFlight;
+    };
+
+    /// \return An ID for \a string, or maxEntries if every ID is used by a message in flight
+    unsigned int AssignId( Connection& connection, const std::string& string );
+    bool OnResolved( RakNetGUID guid, uint32_t sendReceipt, bool isAcknowledged );
+
+    std::unordered_map<RakNetGUID, Connection> connections;
+    unsigned int maxEntries;
+    unsigned int maxStringLength;
+};
+
+/// \brief Reads the strings a StringTableSender writes, keeping the strings each connection defined
+class RAK_DLL_EXPORT StringTableReceiver
+{
+public:
+    /// \param[in] maxEntries Must match the StringTableSender
+    /// \param[in] maxStringLength Must match the StringTableSender
+    StringTableReceiver( unsigned int maxEntries = 256, unsigned int maxStringLength = 255 );
+
+    /// Same as StringCompressor::DecodeString(), for strings from \a guid
+    /// \return false if the stream ends early or refers to an ID \a guid did not define, or has since defined again
+    bool DecodeString( char* output, int maxCharsToWrite, RakNetGUID guid, BitStream* input );
+    bool DecodeString( std::string& output, int maxCharsToWrite, RakNetGUID guid, BitStream* input );
+
+    /// Forget \a guid, for example on ID_DISCONNECTION_NOTIFICATION
+    void RemoveConnection( RakNetGUID guid );
+
+    void Clear( void );
+
+protected:
+    /// Reads a string into \a output, in full
+    bool DecodeString( std::string* output, RakNetGUID guid, BitStream* input );
+
+    struct Entry
+    {
+        std::string string;
+        uint32_t generation;
+        bool isDefined;
+    };
+
+    std::unordered_map<RakNetGUID, std::vector<Entry>> connections;
+    unsigned int maxEntries;
+    unsigned int maxStringLength;
+};
+
+} // namespace RakNet
@@ -20,6 +20,7 @@
 typedef int socklen_t;
 #else
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <pthread.h>
 #endif
@@ -1103,32 +1104,15 @@ void UpdateTCPInterfaceLoop( void* arg )
                         if( FD_ISSET( socketCopy, &writeFD ) )
                         {
                             RemoteClient* rc = &sts->remoteClients[i];
-                            unsigned int bytesInBuffer;
-                            int bytesAvailable;
-                            int bytesSent;
                             std::lock_guard<std::mutex> guard( rc->outgoingDataMutex );
-                            bytesInBuffer = rc->outgoingData.GetBytesWritten();
-                            if( bytesInBuffer > 0 )
+                            // Send straight from the queue, both parts at once if it wraps
+                            DataStructures::ByteQueueRegion regions[2];
+                            int regionCount = rc->outgoingData.PeekReadRegions( regions );
+                            if( regionCount > 0 )
                             {
-                                unsigned int contiguousLength;
-                                char* contiguousBytesPointer = rc->outgoingData.PeekContiguousBytes( &contiguousLength );
-                                if( contiguousLength < (unsigned int)BUFF_SIZE && contiguousLength < bytesInBuffer )
-                                {
-                                    if( bytesInBuffer > BUFF_SIZE )
-                                        bytesAvailable = BUFF_SIZE;
-                                    else
-                                        bytesAvailable = bytesInBuffer;
-                                    rc->outgoingData.ReadBytes( data, bytesAvailable, true );
-                                    bytesSent = rc->Send( data, bytesAvailable );
-                                }
-                                else
-                                {
-                                    bytesSent = rc->Send( contiguousBytesPointer, contiguousLength );
-                                }
-
+                                int bytesSent = rc->SendRegions( regions, regionCount );
                                 if( bytesSent > 0 )
                                     rc->outgoingData.IncrementReadOffset( bytesSent );
-                                bytesInBuffer = rc->outgoingData.GetBytesWritten();
                             }
                         }
 
@@ -1190,6 +1174,33 @@ void RemoteClient::SendOrBuffer( const char** data, const unsigned int* lengths,
         }
     }
 }
+static int SendGathered( __TCPSOCKET__ s, const DataStructures::ByteQueueRegion* regions, int regionCount )
+{
+#ifdef _WIN32
+    WSABUF buffers[2];
+    for( int i = 0; i < regionCount; i++ )
+    {
+        buffers[i].buf = regions[i].data;
+        buffers[i].len = regions[i].length;
+    }
+    DWORD bytesSent;
+    if( WSASend__( s, buffers, (DWORD)regionCount, &bytesSent, 0, 0, 0 ) == SOCKET_ERROR )
+        return -1;
+    return (int)bytesSent;
+#else
+    iovec buffers[2];
+    for( int i = 0; i < regionCount; i++ )
+    {
+        buffers[i].iov_base = regions[i].data;
+        buffers[i].iov_len = regions[i].length;
+    }
+    msghdr message;
+    memset( &message, 0, sizeof( message ) );
+    message.msg_iov = buffers;
+    message.msg_iovlen = regionCount;
+    return (int)sendmsg__( s, &message, 0 );
+#endif
+}
 #if OPEN_SSL_CLIENT_SUPPORT == 1
 bool RemoteClient::InitSSL( SSL_CTX* ctx, SSL_METHOD* meth )
 {
@@ -1286,6 +1297,14 @@ int RemoteClient::Send( const char* data, unsigned int length )
     else
         return send__( socket, data, length, 0 );
 }
+int RemoteClient::SendRegions( const DataStructures::ByteQueueRegion* regions, int regionCount )
+{
+    // SSL_write takes one buffer. The rest goes on the next write.
+    if( ssl )
+        return SSL_write( ssl, regions[0].data, regions[0].length );
+    else
+        return SendGathered( socket, regions, regionCount );
+}
 int RemoteClient::Recv( char* data, const int dataSize )
 {
     if( ssl )
@@ -1298,6 +1317,10 @@ int RemoteClient::Send( const char* data, unsigned int length )
 {
     return send__( socket, data, length, 0 );
 }
+int RemoteClient::SendRegions( const DataStructures::ByteQueueRegion* regions, int regionCount )
+{
+    return SendGathered( socket, regions, regionCount );
+}
 int RemoteClient::Recv( char* data, const int dataSize )
 {
     return recv__( socket, data, dataSize, 0 );
@@ -213,6 +213,9 @@ struct RemoteClient
     int Send( const char* data, unsigned int length );
     int Recv( char* data, const int dataSize );
 #endif
+    /// Sends regions from outgoingData in one call, as if they were one buffer
+    /// \return Bytes sent, or -1 on error
+    int SendRegions( const DataStructures::ByteQueueRegion* regions, int regionCount );
     void Reset( void )
     {
         std::lock_guard<std::mutex> guard( outgoingDataMutex );
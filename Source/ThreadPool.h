@@ -13,17 +13,22 @@
 #include "RakMemoryOverride.h"
 #include "Export.h"
 #include "RakThread.h"
+#include "DS_ThreadsafeMemoryPool.h"
+#include "DS_WorkStealingDeque.h"
 #include "SignaledEvent.h"
 
-#ifdef _WIN32
-#else
-#include <unistd.h>
-#endif
-
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace RakNet {
 
@@ -40,6 +45,12 @@ public:
 /// This class does not allocate or deallocate memory.  It is up to the user to handle memory management.
 /// InputType and OutputType are stored directly in a queue.  For large structures, if you plan to delete from the middle of the queue,
 /// you might wish to store pointers rather than the structures themselves so the array can shift efficiently.
+///
+/// Input from AddInput() goes to a shared queue. Workers claim it in batches of a fair share of what is queued, and run a batch in order.
+/// Work from Submit() on a worker goes to that worker's WorkStealingDeque, and the other workers steal from it when they run out.
+/// Idle workers sleep until work arrives, rather than polling.
+/// Adding work wakes at most one sleeping worker, and only if no worker is already looking for work, so a producer that is faster
+/// than the workers does not make a system call per input.
 template<class InputType, class OutputType>
 struct RAK_DLL_EXPORT ThreadPool
 {
@@ -58,6 +69,7 @@ struct RAK_DLL_EXPORT ThreadPool
     void SetThreadDataInterface( ThreadDataInterface* tdi, void* context );
 
     /// Stops all threads
+    /// Input the threads claimed but did not start goes back to the input queue, in the order it was added
     void StopThreads( void );
 
     /// Adds a function to a queue with data to pass to that function.  This function will be called from the thread
@@ -70,6 +82,20 @@ struct RAK_DLL_EXPORT ThreadPool
     /// \param[in] inputData The parameter to pass to \a userCallback
     void AddInput( OutputType ( *workerThreadCallback )( InputType, bool* returnOutput, void* perThreadData ), InputType inputData );
 
+    /// Runs \a function on a worker thread, passing it the data stored per thread
+    /// Called from a worker of this pool, \a function goes to that worker's deque, where idle workers can steal it
+    /// \param[in] function Anything callable with a void*
+    /// \return Becomes ready with what \a function returned, or the exception it threw
+    template<class Function>
+    std::future<typename std::invoke_result<Function, void*>::type> Submit( Function function );
+
+    /// Waits for \a future and returns its result
+    /// On a worker of this pool, runs other work while it waits, so that work can wait for work it submitted without taking up a thread.
+    /// When there is no other work, it sleeps until the future is ready or work is added.
+    /// Futures from Submit() wake it when they become ready. Others are checked every 10 milliseconds.
+    template<class ResultType>
+    ResultType Wait( std::future<ResultType>& future );
+
     /// Adds to the output queue
     /// Use it if you want to inject output into the same queue that the system uses. Normally you would not use this. Consider it a convenience function.
     /// \param[in] outputData The output to inject
@@ -101,6 +127,7 @@ struct RAK_DLL_EXPORT ThreadPool
 
     /// Lock the input buffer before calling the functions InputSize, InputAtIndex, and RemoveInputAtIndex
     /// It is only necessary to lock the input or output while the threads are running
+    /// While the threads are running, the input buffer only holds input no thread has claimed yet
     void LockInput( void );
 
     /// Unlock the input buffer after you are done with the functions InputSize, GetInputAtIndex, and RemoveInputAtIndex
@@ -153,9 +180,72 @@ struct RAK_DLL_EXPORT ThreadPool
     void Resume( void );
 
 protected:
+    // Most input a worker claims from the input queue at once
+    static const unsigned maxClaim = 16;
+
+    // From Submit()
+    struct Task
+    {
+        std::function<void( void* )> function;
+    };
+
+    struct Worker
+    {
+        ThreadPool* threadPool;
+        int index;
+        void* perThreadData;
+        DataStructures::WorkStealingDeque<Task*> deque;
+        // Memory of tasks this worker ran, for the tasks it makes next, so that only tasks from other threads go through taskPool's lock
+        std::vector<Task*> freeTasks;
+        // Input this worker claimed, which only it runs. claimedNext and claimedEnd are only used by this worker.
+        OutputType ( *claimedCallbacks[maxClaim] )( InputType, bool*, void* );
+        InputType claimedInputs[maxClaim];
+        unsigned claimedNext, claimedEnd;
+        // claimedEnd - claimedNext, for HasInput() on other threads
+        std::atomic<int> claimedCount;
+        // Order the batch was claimed in, so that StopThreads() can put batches back in order
+        uint64_t claimSequence;
+        // Set to wake this worker while it is in parkedWorkers
+        SignaledEvent wakeEvent;
+    };
+
+    // Most task memory a worker keeps in freeTasks
+    static const size_t maxFreeTasks = 256;
+
+    // The worker of this thread, if it is one
+    static Worker*& CurrentWorker( void );
+
+    void QueueSubmitted( Task* task );
+    void UpdateQueuedCount( void ) { queuedCount.store( (int)( inputQueue.size() + submittedQueue.size() ), std::memory_order_relaxed ); }
+    void AddQueuedCount( int count ) { queuedCount.store( queuedCount.load( std::memory_order_relaxed ) + count, std::memory_order_relaxed ); }
+    void UpdateOutputCount( void ) { outputCount.store( (int)outputQueue.size(), std::memory_order_relaxed ); }
+    void AddOutputCount( int count ) { outputCount.store( outputCount.load( std::memory_order_relaxed ) + count, std::memory_order_relaxed ); }
+    void WakeWorker( void );
+    // Wakes every sleeping thread, so they check again whether to run
+    void WakeAll( void );
+    // Stops searching, and sleeps until there is work, the pool is resumed or the threads stop
+    void Park( Worker* worker );
+    // Sleeps until \a isReady returns true or there is work, while \a worker waits in Wait()
+    void ParkUntil( Worker* worker, const std::function<bool()>& isReady );
+    // Takes \a worker out of parkedWorkers, with parkMutex locked
+    // \return False if another thread woke it first
+    bool Unpark( Worker* worker );
+    // Finds work in \a worker's deque, else in what it claimed, else claims from the input queues, else steals from another worker
+    // \param[out] task The task found, or 0 if the work is claimed input, for RunClaimedInput()
+    // \return If there is work
+    bool FindWork( Worker* worker, Task** task );
+    // Claims from submittedQueue, else a batch from inputQueue
+    bool ClaimInput( Worker* worker, Task** task );
+    void RunTask( Task* task, Worker* worker );
+    // Runs the next input \a worker claimed
+    void RunClaimedInput( Worker* worker );
+    // \param[in] worker The worker of this thread, or 0 if it is not one
+    Task* AllocateTask( Worker* worker );
+    void DeallocateTask( Task* task, Worker* worker = 0 );
+
     // It is valid to cancel input before it is processed.  To do so, lock the inputQueue with inputQueueMutex,
     // Scan the list, and remove the item you don't want.
-    std::mutex inputQueueMutex, outputQueueMutex, workingThreadCountMutex, runThreadsMutex;
+    std::mutex inputQueueMutex, outputQueueMutex, runThreadsMutex;
 
     void* ( *perThreadDataFactory )();
     void ( *perThreadDataDestructor )( void* );
@@ -164,121 +254,132 @@ protected:
     // at the same index
     std::deque<OutputType ( * )( InputType, bool*, void* )> inputFunctionQueue;
     std::deque<InputType> inputQueue;
+    // Submitted from threads that are not workers, guarded by inputQueueMutex
+    std::deque<Task*> submittedQueue;
     std::deque<OutputType> outputQueue;
 
     ThreadDataInterface* threadDataInterface;
     void* tdiContext;
 
+    std::vector<Worker*> workers;
+    DataStructures::ThreadsafeMemoryPool<Task> taskPool;
 
     template<class ThreadInputType, class ThreadOutputType>
     friend void WorkerThread( void* arg );
 
 
     /// \internal
-    bool runThreads;
+    std::atomic<bool> runThreads;
+    /// \internal
+    std::atomic<bool> isPaused;
     /// \internal
     int numThreadsRunning;
     /// \internal
-    int numThreadsWorking;
+    std::atomic<int> numThreadsWorking;
     /// \internal
     std::mutex numThreadsRunningMutex;
-
-    SignaledEvent quitAndIncomingDataEvents;
+    std::condition_variable numThreadsRunningCondition;
+
+    // Work added and not yet started that any worker can take: in inputQueue, submittedQueue or a deque.
+    // Input a worker claimed is counted in its claimedCount instead.
+    std::atomic<int> pendingCount;
+    // Counts claimed batches, guarded by inputQueueMutex
+    uint64_t claimSequence;
+    // Entries in inputQueue and submittedQueue, so workers can skip locking them when empty.
+    // Only stored to with inputQueueMutex held, so it needs no read-modify-write.
+    std::atomic<int> queuedCount;
+    // Entries in outputQueue, stored to with outputQueueMutex held
+    std::atomic<int> outputCount;
+
+    std::mutex parkMutex;
+    // Workers sleeping in Park() or Wait() that nobody has woken yet, guarded by parkMutex. The last to park is woken first.
+    std::vector<Worker*> parkedWorkers;
+    // Size of parkedWorkers, so adding work can skip parkMutex when nobody sleeps
+    std::atomic<int> numThreadsParked;
+    // Threads sleeping in Wait(), which a submitted function wakes when it finishes
+    std::atomic<int> numThreadsWaiting;
+    // Workers looking for work, which will find what is added without being woken
+    std::atomic<int> numThreadsSearching;
 };
 
 template<class ThreadInputType, class ThreadOutputType>
 void WorkerThread( void* arg )
 {
-    ThreadPool<ThreadInputType, ThreadOutputType>* threadPool = (ThreadPool<ThreadInputType, ThreadOutputType>*)arg;
+    typedef ThreadPool<ThreadInputType, ThreadOutputType> Pool;
+    typename Pool::Worker* worker = (typename Pool::Worker*)arg;
+    Pool* threadPool = worker->threadPool;
 
-    bool returnOutput;
-    ThreadOutputType ( *userCallback )( ThreadInputType, bool*, void* );
-    ThreadInputType inputData;
-    ThreadOutputType callbackOutput;
-
-    userCallback = 0;
-
-    void* perThreadData;
     if( threadPool->perThreadDataFactory )
-        perThreadData = threadPool->perThreadDataFactory();
+        worker->perThreadData = threadPool->perThreadDataFactory();
     else if( threadPool->threadDataInterface )
-        perThreadData = threadPool->threadDataInterface->PerThreadFactory( threadPool->tdiContext );
+        worker->perThreadData = threadPool->threadDataInterface->PerThreadFactory( threadPool->tdiContext );
     else
-        perThreadData = 0;
-
-    // Increase numThreadsRunning
-    threadPool->numThreadsRunningMutex.lock();
-    ++threadPool->numThreadsRunning;
-    threadPool->numThreadsRunningMutex.unlock();
+        worker->perThreadData = 0;
+    Pool::CurrentWorker() = worker;
 
-    while( 1 )
+    while( threadPool->runThreads.load() )
     {
-        //#ifdef _WIN32
-        if( userCallback == 0 )
-        {
-            threadPool->quitAndIncomingDataEvents.WaitOnEvent( 1000 );
-        }
-        // #else
-        //      if (userCallback==0)
-        //          std::this_thread::sleep_for( std::chrono::milliseconds( 30 ) );
-        // #endif
-
-        threadPool->runThreadsMutex.lock();
-        if( threadPool->runThreads == false )
-        {
-            threadPool->runThreadsMutex.unlock();
-            break;
-        }
-        threadPool->runThreadsMutex.unlock();
-
-        threadPool->workingThreadCountMutex.lock();
-        ++threadPool->numThreadsWorking;
-        threadPool->workingThreadCountMutex.unlock();
-
-        // Read input data
-        userCallback = 0;
-        threadPool->inputQueueMutex.lock();
-        if( !threadPool->inputFunctionQueue.empty() )
+        // Counted before checking isPaused, so that Pause() either sees this thread working or this thread sees the pause.
+        // The thread stays counted as working from one task to the next, until it runs out.
+        threadPool->numThreadsWorking.fetch_add( 1 );
+        threadPool->numThreadsSearching.fetch_add( 1 );
+        bool foundWork;
+        typename Pool::Task* task;
+        while( ( foundWork = threadPool->isPaused.load() == false && threadPool->FindWork( worker, &task ) ) == true )
         {
-            userCallback = threadPool->inputFunctionQueue.front();
-            threadPool->inputFunctionQueue.pop_front();
-            inputData = threadPool->inputQueue.front();
-            threadPool->inputQueue.pop_front();
-        }
-        threadPool->inputQueueMutex.unlock();
-
-        if( userCallback )
-        {
-            callbackOutput = userCallback( inputData, &returnOutput, perThreadData );
-            if( returnOutput )
+            threadPool->numThreadsSearching.fetch_sub( 1 );
+            // Nobody else was woken for the work added while this thread searched
+            if( threadPool->pendingCount.load() > 0 )
+                threadPool->WakeWorker();
+            if( task )
+                threadPool->RunTask( task, worker );
+            else
             {
-                std::lock_guard<std::mutex> guard( threadPool->outputQueueMutex );
-                threadPool->outputQueue.push_back( callbackOutput );
+                // The whole batch, unless the pool stops or pauses
+                do
+                    threadPool->RunClaimedInput( worker );
+                while( worker->claimedNext != worker->claimedEnd && threadPool->runThreads.load() && threadPool->isPaused.load() == false );
             }
+            if( threadPool->runThreads.load() == false )
+                break;
+            threadPool->numThreadsSearching.fetch_add( 1 );
         }
+        threadPool->numThreadsWorking.fetch_sub( 1 );
 
-        std::lock_guard<std::mutex> guard( threadPool->workingThreadCountMutex );
-        --threadPool->numThreadsWorking;
+        // Stops searching
+        if( foundWork == false )
+            threadPool->Park( worker );
     }
 
-    // Decrease numThreadsRunning
-    threadPool->numThreadsRunningMutex.lock();
-    --threadPool->numThreadsRunning;
-    threadPool->numThreadsRunningMutex.unlock();
-
+    Pool::CurrentWorker() = 0;
     if( threadPool->perThreadDataDestructor )
-        threadPool->perThreadDataDestructor( perThreadData );
+        threadPool->perThreadDataDestructor( worker->perThreadData );
     else if( threadPool->threadDataInterface )
-        threadPool->threadDataInterface->PerThreadDestructor( perThreadData, threadPool->tdiContext );
+        threadPool->threadDataInterface->PerThreadDestructor( worker->perThreadData, threadPool->tdiContext );
+
+    // Decrease numThreadsRunning. StopThreads() may free the worker once this is done.
+    std::lock_guard<std::mutex> guard( threadPool->numThreadsRunningMutex );
+    --threadPool->numThreadsRunning;
+    threadPool->numThreadsRunningCondition.notify_all();
 }
 template<class InputType, class OutputType>
 ThreadPool<InputType, OutputType>::ThreadPool()
 {
-    runThreads = false;
+    runThreads.store( false );
+    isPaused.store( false );
     numThreadsRunning = 0;
     threadDataInterface = 0;
     tdiContext = 0;
-    numThreadsWorking = 0;
+    perThreadDataFactory = 0;
+    perThreadDataDestructor = 0;
+    numThreadsWorking.store( 0 );
+    pendingCount.store( 0 );
+    queuedCount.store( 0 );
+    outputCount.store( 0 );
+    numThreadsParked.store( 0 );
+    claimSequence = 0;
+    numThreadsWaiting.store( 0 );
+    numThreadsSearching.store( 0 );
 }
 template<class InputType, class OutputType>
 ThreadPool<InputType, OutputType>::~ThreadPool()
@@ -291,49 +392,55 @@ bool ThreadPool<InputType, OutputType>::StartThreads( int numThreads, int stackS
 {
     (void)stackSize;
 
-    runThreadsMutex.lock();
-    if( runThreads == true )
     {
-        // Already running
-        runThreadsMutex.unlock();
-        return false;
-    }
-    runThreadsMutex.unlock();
+        std::lock_guard<std::mutex> guard( runThreadsMutex );
+        if( runThreads.load() == true )
+        {
+            // Already running
+            return false;
+        }
 
-    quitAndIncomingDataEvents.InitEvent();
+        perThreadDataFactory = _perThreadDataFactory;
+        perThreadDataDestructor = _perThreadDataDestructor;
 
-    perThreadDataFactory = _perThreadDataFactory;
-    perThreadDataDestructor = _perThreadDataDestructor;
+        for( int i = 0; i < numThreads; i++ )
+        {
+            Worker* worker = RakNet::OP_NEW<Worker>( _FILE_AND_LINE_ );
+            worker->threadPool = this;
+            worker->index = i;
+            worker->perThreadData = 0;
+            worker->claimedNext = 0;
+            worker->claimedEnd = 0;
+            worker->claimedCount.store( 0 );
+            worker->claimSequence = 0;
+            worker->wakeEvent.InitEvent();
+            workers.push_back( worker );
+        }
 
-    runThreadsMutex.lock();
-    runThreads = true;
-    runThreadsMutex.unlock();
+        numThreadsWorking.store( 0 );
+        isPaused.store( false );
+        runThreads.store( true );
+    }
 
-    numThreadsWorking = 0;
-    unsigned threadId = 0;
-    (void)threadId;
-    int i;
-    for( i = 0; i < numThreads; i++ )
+    // Threads count as running from when they are created, so that StopThreads() waits for those that have yet to start
+    for( Worker* worker : workers )
     {
-        int errorCode = RakThread::Create( WorkerThread<InputType, OutputType>, this );
+        {
+            std::lock_guard<std::mutex> guard( numThreadsRunningMutex );
+            ++numThreadsRunning;
+        }
+        int errorCode = RakThread::Create( WorkerThread<InputType, OutputType>, worker );
 
         if( errorCode != 0 )
         {
+            {
+                std::lock_guard<std::mutex> guard( numThreadsRunningMutex );
+                --numThreadsRunning;
+            }
             StopThreads();
             return false;
         }
     }
-    // Wait for number of threads running to increase to numThreads
-    bool done = false;
-    while( done == false )
-    {
-        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
-        std::lock_guard<std::mutex> guard( numThreadsRunningMutex );
-        if( numThreadsRunning == numThreads )
-        {
-            done = true;
-        }
-    }
 
     return true;
 }
@@ -346,52 +453,108 @@ void ThreadPool<InputType, OutputType>::SetThreadDataInterface( ThreadDataInterf
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::StopThreads( void )
 {
-    runThreadsMutex.lock();
-    if( runThreads == false )
-    {
-        runThreadsMutex.unlock();
+    std::lock_guard<std::mutex> runGuard( runThreadsMutex );
+    if( runThreads.load() == false )
         return;
-    }
 
-    runThreads = false;
-    runThreadsMutex.unlock();
+    runThreads.store( false );
+    WakeAll();
 
     // Wait for number of threads running to decrease to 0
-    bool done = false;
-    while( done == false )
     {
-        quitAndIncomingDataEvents.SetEvent();
+        std::unique_lock<std::mutex> lock( numThreadsRunningMutex );
+        numThreadsRunningCondition.wait( lock, [this]() { return numThreadsRunning == 0; } );
+    }
 
-        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
-        std::lock_guard<std::mutex> guard( numThreadsRunningMutex );
-        if( numThreadsRunning == 0 )
+    // Put what the workers claimed but did not start back in front of what nobody claimed, the latest batch first
+    std::lock_guard<std::mutex> guard( inputQueueMutex );
+    std::sort( workers.begin(), workers.end(), []( const Worker* a, const Worker* b ) { return a->claimSequence > b->claimSequence; } );
+    for( Worker* worker : workers )
+    {
+        for( unsigned i = worker->claimedEnd; i-- > worker->claimedNext; )
         {
-            done = true;
+            inputFunctionQueue.push_front( worker->claimedCallbacks[i] );
+            inputQueue.push_front( worker->claimedInputs[i] );
+            pendingCount.fetch_add( 1 );
         }
+        Task* task;
+        while( ( task = worker->deque.Take() ) != 0 )
+            submittedQueue.push_front( task );
+        for( Task* freeTask : worker->freeTasks )
+            taskPool.Release( freeTask, _FILE_AND_LINE_ );
+        worker->wakeEvent.CloseEvent();
+        RakNet::OP_DELETE( worker, _FILE_AND_LINE_ );
     }
-
-    quitAndIncomingDataEvents.CloseEvent();
+    workers.clear();
+    UpdateQueuedCount();
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::AddInput( OutputType ( *workerThreadCallback )( InputType, bool* returnOutput, void* perThreadData ), InputType inputData )
 {
-    inputQueueMutex.lock();
-    inputQueue.push_back( inputData );
-    inputFunctionQueue.push_back( workerThreadCallback );
-    inputQueueMutex.unlock();
+    {
+        std::lock_guard<std::mutex> guard( inputQueueMutex );
+        // Counted first, so that a worker that sees nothing pending cannot miss this
+        pendingCount.fetch_add( 1 );
+        inputQueue.push_back( inputData );
+        inputFunctionQueue.push_back( workerThreadCallback );
+        AddQueuedCount( 1 );
+    }
 
-    quitAndIncomingDataEvents.SetEvent();
+    WakeWorker();
+}
+template<class InputType, class OutputType>
+template<class Function>
+std::future<typename std::invoke_result<Function, void*>::type> ThreadPool<InputType, OutputType>::Submit( Function function )
+{
+    typedef typename std::invoke_result<Function, void*>::type ResultType;
+    std::shared_ptr<std::packaged_task<ResultType( void* )>> packagedTask =
+        std::make_shared<std::packaged_task<ResultType( void* )>>( std::move( function ) );
+    std::future<ResultType> future = packagedTask->get_future();
+
+    Worker* worker = CurrentWorker();
+    Task* task = AllocateTask( worker != 0 && worker->threadPool == this ? worker : 0 );
+    task->function = [this, packagedTask]( void* perThreadData ) {
+        ( *packagedTask )( perThreadData );
+        // Pairs with the fence in ParkUntil(), so that either this sees the waiter, or the waiter sees the future is ready
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( numThreadsWaiting.load( std::memory_order_relaxed ) > 0 )
+            WakeAll();
+    };
+    QueueSubmitted( task );
+    return future;
+}
+template<class InputType, class OutputType>
+template<class ResultType>
+ResultType ThreadPool<InputType, OutputType>::Wait( std::future<ResultType>& future )
+{
+    Worker* worker = CurrentWorker();
+    if( worker != 0 && worker->threadPool == this )
+    {
+        std::function<bool()> isReady = [&future]() { return future.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready; };
+        while( !isReady() )
+        {
+            Task* task;
+            if( FindWork( worker, &task ) == false )
+                ParkUntil( worker, isReady );
+            else if( task )
+                RunTask( task, worker );
+            else
+                RunClaimedInput( worker );
+        }
+    }
+    return future.get();
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::AddOutput( OutputType outputData )
 {
     std::lock_guard<std::mutex> guard( outputQueueMutex );
     outputQueue.push_back( outputData );
+    AddOutputCount( 1 );
 }
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::HasOutputFast( void )
 {
-    return !outputQueue.empty();
+    return outputCount.load( std::memory_order_relaxed ) > 0;
 }
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::HasOutput( void )
@@ -402,13 +565,19 @@ bool ThreadPool<InputType, OutputType>::HasOutput( void )
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::HasInputFast( void )
 {
-    return !inputQueue.empty();
+    return HasInput();
 }
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::HasInput( void )
 {
-    std::lock_guard<std::mutex> guard( inputQueueMutex );
-    return !inputQueue.empty();
+    if( pendingCount.load() > 0 )
+        return true;
+    for( Worker* worker : workers )
+    {
+        if( worker->claimedCount.load() > 0 )
+            return true;
+    }
+    return false;
 }
 template<class InputType, class OutputType>
 OutputType ThreadPool<InputType, OutputType>::GetOutput( void )
@@ -416,31 +585,28 @@ OutputType ThreadPool<InputType, OutputType>::GetOutput( void )
     // Real output check
     std::lock_guard<std::mutex> guard( outputQueueMutex );
     OutputType output = outputQueue.front();
-    outputQueue.pop_front()
+    outputQueue.pop_front();
+    AddOutputCount( -1 );
     return output;
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::Clear( void )
 {
-    runThreadsMutex.lock();
-    if( runThreads )
-    {
-        runThreadsMutex.unlock();
-        inputQueueMutex.lock();
-        inputFunctionQueue.clear();
-        inputQueue.clear();
-        inputQueueMutex.unlock();
-
-        outputQueueMutex.lock();
-        outputQueue.clear();
-        outputQueueMutex.unlock();
-    }
-    else
     {
+        std::lock_guard<std::mutex> guard( inputQueueMutex );
+        pendingCount.fetch_sub( (int)( inputQueue.size() + submittedQueue.size() ) );
         inputFunctionQueue.clear();
         inputQueue.clear();
-        outputQueue.clear();
+        // Their futures report a broken promise
+        for( Task* task : submittedQueue )
+            DeallocateTask( task );
+        submittedQueue.clear();
+        UpdateQueuedCount();
     }
+
+    std::lock_guard<std::mutex> guard( outputQueueMutex );
+    outputQueue.clear();
+    UpdateOutputCount();
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::LockInput( void )
@@ -467,6 +633,8 @@ void ThreadPool<InputType, OutputType>::RemoveInputAtIndex( unsigned index )
 {
     inputQueue.erase( inputQueue.begin() + index );
     inputFunctionQueue.erase( inputFunctionQueue.begin() + index );
+    AddQueuedCount( -1 );
+    pendingCount.fetch_sub( 1 );
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::LockOutput( void )
@@ -492,18 +660,22 @@ template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::RemoveOutputAtIndex( unsigned index )
 {
     outputQueue.erase( outputQueue.begin() + index );
+    AddOutputCount( -1 );
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::ClearInput( void )
 {
+    pendingCount.fetch_sub( (int)inputQueue.size() );
     inputQueue.clear();
     inputFunctionQueue.clear();
+    UpdateQueuedCount();
 }
 
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::ClearOutput( void )
 {
     outputQueue.clear();
+    UpdateOutputCount();
 }
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::IsWorking( void )
@@ -514,29 +686,23 @@ bool ThreadPool<InputType, OutputType>::IsWorking( void )
     if( HasOutputFast() && HasOutput() )
         return true;
 
-    if( HasInputFast() && HasInput() )
+    if( HasInput() )
         return true;
 
     // Need to check is working again, in case the thread was between the first and second checks
-    workingThreadCountMutex.lock();
-    bool isWorking = numThreadsWorking != 0;
-    workingThreadCountMutex.unlock();
-
-    return isWorking;
+    return numThreadsWorking.load() != 0;
 }
 
 template<class InputType, class OutputType>
 int ThreadPool<InputType, OutputType>::NumThreadsWorking( void )
 {
-    return numThreadsWorking;
+    return numThreadsWorking.load();
 }
 
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::WasStarted( void )
 {
-    std::lock_guard<std::mutex> guard( runThreadsMutex );
-    bool b = runThreads;
-    return b;
+    return runThreads.load();
 }
 template<class InputType, class OutputType>
 bool ThreadPool<InputType, OutputType>::Pause( void )
@@ -544,17 +710,238 @@ bool ThreadPool<InputType, OutputType>::Pause( void )
     if( WasStarted() == false )
         return false;
 
-    workingThreadCountMutex.lock();
-    while( numThreadsWorking > 0 )
+    isPaused.store( true );
+    while( numThreadsWorking.load() > 0 )
     {
-        std::this_thread::sleep_for( std::chrono::milliseconds( 30 ) );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
     }
     return true;
 }
 template<class InputType, class OutputType>
 void ThreadPool<InputType, OutputType>::Resume( void )
 {
-    workingThreadCountMutex.unlock();
+    isPaused.store( false );
+    WakeAll();
+}
+template<class InputType, class OutputType>
+typename ThreadPool<InputType, OutputType>::Worker*& ThreadPool<InputType, OutputType>::CurrentWorker( void )
+{
+    static thread_local Worker* worker = 0;
+    return worker;
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::QueueSubmitted( Task* task )
+{
+    Worker* worker = CurrentWorker();
+    if( worker != 0 && worker->threadPool == this )
+    {
+        pendingCount.fetch_add( 1 );
+        worker->deque.Push( task );
+    }
+    else
+    {
+        std::lock_guard<std::mutex> guard( inputQueueMutex );
+        pendingCount.fetch_add( 1 );
+        submittedQueue.push_back( task );
+        AddQueuedCount( 1 );
+    }
+
+    WakeWorker();
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::WakeWorker( void )
+{
+    // Park() stops searching before it checks pendingCount, and pendingCount went up before this, so one of the two sees the other.
+    // One woken worker at a time keeps the others asleep when one can keep up, and the worker wakes the next if it cannot.
+    // A worker stops counting as parked once it is woken, so adding more work before it runs does not wake it again.
+    if( numThreadsParked.load() > 0 && numThreadsSearching.load() == 0 )
+    {
+        Worker* worker = 0;
+        {
+            std::lock_guard<std::mutex> guard( parkMutex );
+            if( !parkedWorkers.empty() )
+            {
+                worker = parkedWorkers.back();
+                parkedWorkers.pop_back();
+                numThreadsParked.store( (int)parkedWorkers.size() );
+            }
+        }
+        if( worker )
+            worker->wakeEvent.SetEvent();
+    }
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::WakeAll( void )
+{
+    std::vector<Worker*> woken;
+    {
+        std::lock_guard<std::mutex> guard( parkMutex );
+        woken.swap( parkedWorkers );
+        numThreadsParked.store( 0 );
+    }
+    for( Worker* worker : woken )
+        worker->wakeEvent.SetEvent();
+}
+template<class InputType, class OutputType>
+bool ThreadPool<InputType, OutputType>::Unpark( Worker* worker )
+{
+    typename std::vector<Worker*>::iterator it = std::find( parkedWorkers.begin(), parkedWorkers.end(), worker );
+    if( it == parkedWorkers.end() )
+        return false;
+    parkedWorkers.erase( it );
+    numThreadsParked.store( (int)parkedWorkers.size() );
+    return true;
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::Park( Worker* worker )
+{
+    {
+        std::lock_guard<std::mutex> guard( parkMutex );
+        parkedWorkers.push_back( worker );
+        numThreadsParked.store( (int)parkedWorkers.size() );
+        numThreadsSearching.fetch_sub( 1 );
+        if( runThreads.load() == false || ( isPaused.load() == false && pendingCount.load() > 0 ) )
+        {
+            Unpark( worker );
+            return;
+        }
+    }
+
+    // Set by whoever takes this worker out of parkedWorkers, even if that happens before this waits.
+    // Returns after a second regardless, and the worker searches again and parks again if there is nothing.
+    worker->wakeEvent.WaitOnEvent( 1000 );
+    std::lock_guard<std::mutex> guard( parkMutex );
+    Unpark( worker );
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::ParkUntil( Worker* worker, const std::function<bool()>& isReady )
+{
+    {
+        std::lock_guard<std::mutex> guard( parkMutex );
+        parkedWorkers.push_back( worker );
+        numThreadsParked.store( (int)parkedWorkers.size() );
+        numThreadsWaiting.fetch_add( 1 );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( runThreads.load() == false || pendingCount.load() > 0 || isReady() )
+        {
+            Unpark( worker );
+            numThreadsWaiting.fetch_sub( 1 );
+            return;
+        }
+    }
+
+    // Futures from Submit() wake this when they are ready. Others are checked every 10 milliseconds.
+    worker->wakeEvent.WaitOnEvent( 10 );
+    bool wokenForWork;
+    {
+        std::lock_guard<std::mutex> guard( parkMutex );
+        wokenForWork = Unpark( worker ) == false;
+        numThreadsWaiting.fetch_sub( 1 );
+    }
+
+    // This worker was woken for work, but returns from Wait() without looking for it
+    if( wokenForWork && isReady() && pendingCount.load() > 0 )
+        WakeWorker();
+}
+template<class InputType, class OutputType>
+bool ThreadPool<InputType, OutputType>::FindWork( Worker* worker, Task** task )
+{
+    *task = worker->deque.Take();
+    if( *task == 0 )
+    {
+        if( worker->claimedNext != worker->claimedEnd )
+            return true;
+        if( ClaimInput( worker, task ) )
+            return true;
+    }
+    for( size_t i = 1; *task == 0 && i < workers.size(); i++ )
+        *task = workers[( worker->index + i ) % workers.size()]->deque.Steal();
+
+    if( *task == 0 )
+        return false;
+    pendingCount.fetch_sub( 1 );
+    return true;
+}
+template<class InputType, class OutputType>
+bool ThreadPool<InputType, OutputType>::ClaimInput( Worker* worker, Task** task )
+{
+    if( queuedCount.load( std::memory_order_relaxed ) <= 0 )
+        return false;
+
+    std::lock_guard<std::mutex> guard( inputQueueMutex );
+    if( !submittedQueue.empty() )
+    {
+        *task = submittedQueue.front();
+        submittedQueue.pop_front();
+        AddQueuedCount( -1 );
+        pendingCount.fetch_sub( 1 );
+        return true;
+    }
+    if( inputQueue.empty() )
+        return false;
+
+    // A fair share of the input, as only this worker can run what it claims
+    unsigned claimCount = (unsigned)( inputQueue.size() / workers.size() ) + 1;
+    if( claimCount > inputQueue.size() )
+        claimCount = (unsigned)inputQueue.size();
+    if( claimCount > maxClaim )
+        claimCount = maxClaim;
+
+    for( unsigned i = 0; i < claimCount; i++ )
+    {
+        worker->claimedCallbacks[i] = inputFunctionQueue.front();
+        worker->claimedInputs[i] = inputQueue.front();
+        inputFunctionQueue.pop_front();
+        inputQueue.pop_front();
+    }
+    worker->claimedNext = 0;
+    worker->claimedEnd = claimCount;
+    worker->claimedCount.store( (int)claimCount, std::memory_order_relaxed );
+    worker->claimSequence = ++claimSequence;
+    AddQueuedCount( -(int)claimCount );
+    // Counted as claimed before it stops counting as pending, so HasInput() does not miss it in between
+    pendingCount.fetch_sub( (int)claimCount );
+    return true;
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::RunTask( Task* task, Worker* worker )
+{
+    task->function( worker->perThreadData );
+    DeallocateTask( task, worker );
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::RunClaimedInput( Worker* worker )
+{
+    // Taken before the callback runs, in case it calls Wait() and runs more of the batch itself
+    const unsigned index = worker->claimedNext++;
+    worker->claimedCount.store( (int)( worker->claimedEnd - worker->claimedNext ), std::memory_order_relaxed );
+    bool returnOutput;
+    OutputType callbackOutput = worker->claimedCallbacks[index]( worker->claimedInputs[index], &returnOutput, worker->perThreadData );
+    if( returnOutput )
+        AddOutput( callbackOutput );
+}
+template<class InputType, class OutputType>
+typename ThreadPool<InputType, OutputType>::Task* ThreadPool<InputType, OutputType>::AllocateTask( Worker* worker )
+{
+    void* memory;
+    if( worker != 0 && !worker->freeTasks.empty() )
+    {
+        memory = worker->freeTasks.back();
+        worker->freeTasks.pop_back();
+    }
+    else
+        memory = taskPool.Allocate( _FILE_AND_LINE_ );
+    return new( memory ) Task;
+}
+template<class InputType, class OutputType>
+void ThreadPool<InputType, OutputType>::DeallocateTask( Task* task, Worker* worker )
+{
+    // Call delete operator, taskPool doesn't do this
+    task->~Task();
+    if( worker != 0 && worker->freeTasks.size() < maxFreeTasks )
+        worker->freeTasks.push_back( task );
+    else
+        taskPool.Release( task, _FILE_AND_LINE_ );
 }
 
 } // namespace RakNet
@@ -0,0 +1,1227 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "BitStreamBenchmarkTest.h"
+
+#include "BitStreamArena.h"
+#include "BitStreamView.h"
+#include "Quantizer.h"
+#include "Rand.h"
+#include "SuperFastHash.h"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string.h>
+
+/*
+Description:
+Checks BitStream bit packing against a bit at a time reference, and measures its throughput in bits per nanosecond
+
+Success conditions:
+WriteBits produces the same stream as writing each bit with Write0 and Write1, for every width, offset and alignment
+ReadBits returns what was written
+Overwriting bits in the middle of a stream leaves the bytes after them alone
+WriteArray writes the same bits as Write on each element, at any offset, and ReadArray reads them back
+ReadArray rejects counts over its limit and longer than the stream
+ReadVarInt returns what WriteVarInt wrote for every integer type, in the expected number of bytes, and rejects malformed and out of range varints
+without moving the read offset, so an out of range value can still be read into a larger type
+BitStreamView reads everything BitStream reads the same way, and stops at the end of its data
+A RAKNET_SERIALIZABLE type is written the same as writing its fields by hand, and reads back through Serialize and BitStreamView
+The SIMD quantizers give bit for bit the same results as the scalar ones, and quantized floats, vectors and quaternions read back within their precision
+Streams built on a BitStreamArena hold the same data as streams on the heap, stop calling rakMalloc_Ex after the first tick, and arrive intact after the arena is reset
+
+Failure conditions:
+Any of the above fails. Throughput is only reported.
+
+BitStream Functions Explicitly Tested:
+WriteBits
+ReadBits
+Write0
+Write1
+Write
+Read
+WriteCompressed
+ReadCompressed
+WriteArray
+ReadArray
+SerializeArray
+WriteVarInt
+ReadVarInt
+SerializeVarInt
+BitStreamView
+RAKNET_SERIALIZABLE
+WriteQuantizedFloats
+ReadQuantizedFloats
+WriteQuantizedVectors
+ReadQuantizedVectors
+WriteQuantizedQuats
+ReadQuantizedQuats
+SetArena
+*/
+
+// Field widths in a typical replication stream: flags, small enums, quantized values, ids and whole words
+static const BitSize_t mixedWidths[] = { 1, 1, 2, 3, 4, 5, 7, 8, 10, 12, 13, 16, 16, 24, 32, 32, 48, 64 };
+
+// The bytes ReadBits gives back for a field: whole bytes, then the partial byte aligned as asked, other bits 0
+static void ExpectedField( const unsigned char* field, BitSize_t width, bool alignedRight, unsigned char* out )
+{
+    const BitSize_t wholeBytes = width >> 3, partialBits = width & 7;
+    memcpy( out, field, wholeBytes );
+    if( partialBits > 0 )
+    {
+        unsigned char partialByte = field[wholeBytes];
+        if( alignedRight )
+            out[wholeBytes] = partialByte & ( ( 1 << partialBits ) - 1 );
+        else
+            out[wholeBytes] = partialByte & (unsigned char)( 0xFF << ( 8 - partialBits ) );
+    }
+}
+
+static void WriteBitAtATime( BitStream* bitStream, const unsigned char* expected, BitSize_t width, bool alignedRight )
+{
+    for( BitSize_t i = 0; i < width; i++ )
+    {
+        unsigned char byte = expected[i >> 3];
+        BitSize_t bit = i & 7;
+        // A right aligned partial byte starts its bits further right
+        if( alignedRight && ( i >> 3 ) == ( width >> 3 ) )
+            bit += 8 - ( width & 7 );
+        if( byte & ( 0x80 >> bit ) )
+            bitStream->Write1();
+        else
+            bitStream->Write0();
+    }
+}
+
+// WriteArray must match Write on each element, with the stream aligned or not
+template <class templateType>
+static bool ArrayMatchesElements( RakNetRandom& rnr )
+{
+    std::vector<templateType> values( 1000 );
+    for( templateType& value : values )
+    {
+        unsigned char bytes[sizeof( templateType )];
+        for( unsigned char& byte : bytes )
+            byte = (unsigned char)rnr.RandomMT();
+        memcpy( &value, bytes, sizeof( value ) );
+    }
+
+    for( BitSize_t offset = 0; offset < 8; offset += 3 )
+    {
+        BitStream bulk, elements;
+        for( BitSize_t i = 0; i < offset; i++ )
+        {
+            bulk.Write1();
+            elements.Write1();
+        }
+        bulk.WriteArray( values );
+        elements.WriteVarInt( (uint32_t)values.size() );
+        for( const templateType& value : values )
+            elements.Write( value );
+
+        if( bulk.GetNumberOfBitsUsed() != elements.GetNumberOfBitsUsed() || memcmp( bulk.GetData(), elements.GetData(), bulk.GetNumberOfBytesUsed() ) != 0 )
+            return false;
+
+        std::vector<templateType> readBack;
+        bulk.IgnoreBits( offset );
+        if( bulk.SerializeArray( false, readBack, (unsigned int)values.size() ) == false || readBack.size() != values.size() ||
+            memcmp( readBack.data(), values.data(), values.size() * sizeof( templateType ) ) != 0 )
+            return false;
+    }
+    return true;
+}
+
+template <class templateType>
+static bool VarIntRoundTrips( RakNetRandom& rnr )
+{
+    // The extremes, then values of every magnitude
+    std::vector<templateType> values;
+    values.push_back( 0 );
+    values.push_back( std::numeric_limits<templateType>::min() );
+    values.push_back( std::numeric_limits<templateType>::max() );
+    for( int i = 0; i < 2000; i++ )
+    {
+        uint64_t random = ( (uint64_t)rnr.RandomMT() << 32 ) | rnr.RandomMT();
+        values.push_back( (templateType)( random >> ( rnr.RandomMT() % 64 ) ) );
+    }
+
+    BitStream bitStream;
+    bitStream.Write1();
+    for( templateType value : values )
+        bitStream.WriteVarInt( value );
+
+    bitStream.IgnoreBits( 1 );
+    for( templateType value : values )
+    {
+        templateType readBack;
+        if( bitStream.SerializeVarInt( false, readBack ) == false || readBack != value )
+            return false;
+    }
+    return bitStream.GetNumberOfUnreadBits() == 0;
+}
+
+static BitSize_t VarIntBytes( int64_t value )
+{
+    BitStream bitStream;
+    bitStream.WriteVarInt( value );
+    return bitStream.GetNumberOfBytesUsed();
+}
+
+// Something like a replication message, with a field of each kind
+struct ParsedMessage
+{
+    MessageID id;
+    bool flag;
+    uint32_t entity;
+    float health;
+    uint24_t sequence;
+    RakNetGUID guid;
+    SystemAddress address;
+    std::string name;
+    int16_t compressed;
+    uint32_t varInt;
+    std::vector<uint16_t> array;
+    unsigned char bits;
+    float ranged;
+
+    bool operator==( const ParsedMessage& other ) const
+    {
+        return id == other.id && flag == other.flag && entity == other.entity && health == other.health && sequence.val == other.sequence.val && guid == other.guid &&
+               address == other.address && name == other.name && compressed == other.compressed && varInt == other.varInt && array == other.array && bits == other.bits &&
+               ranged == other.ranged;
+    }
+};
+
+static void WriteMessage( BitStream* bitStream, const ParsedMessage& message )
+{
+    bitStream->Write( message.id );
+    bitStream->Write( message.flag );
+    bitStream->Write( message.entity );
+    bitStream->Write( message.health );
+    bitStream->Write( message.sequence );
+    bitStream->Write( message.guid );
+    bitStream->Write( message.address );
+    bitStream->Write( message.name );
+    bitStream->WriteCompressed( message.compressed );
+    bitStream->WriteVarInt( message.varInt );
+    bitStream->WriteArray( message.array );
+    bitStream->WriteBits( &message.bits, 5 );
+    bitStream->WriteFloat16( message.ranged, -10.0f, 10.0f );
+}
+
+// The same calls on BitStream and BitStreamView
+template <class Reader>
+static bool ReadMessage( Reader* reader, ParsedMessage* message )
+{
+    return reader->Read( message->id ) && reader->Read( message->flag ) && reader->Read( message->entity ) && reader->Read( message->health ) &&
+           reader->Read( message->sequence ) && reader->Read( message->guid ) && reader->Read( message->address ) && reader->Read( message->name ) &&
+           reader->ReadCompressed( message->compressed ) && reader->ReadVarInt( message->varInt ) && reader->ReadArray( message->array, 100 ) &&
+           reader->ReadBits( &message->bits, 5 ) && reader->ReadFloat16( message->ranged, -10.0f, 10.0f );
+}
+
+// The same kind of message declared with RAKNET_SERIALIZABLE, with a nested type and array fields
+struct SchemaVector
+{
+    float x, y, z;
+};
+RAKNET_SERIALIZABLE( SchemaVector, x, y, z )
+
+struct SchemaEntity
+{
+    uint32_t id;
+    bool isAlive;
+    SchemaVector position;
+    int16_t ammo[4];
+    std::array<uint8_t, 3> color;
+    uint24_t sequence;
+    std::string name;
+};
+RAKNET_SERIALIZABLE( SchemaEntity, id, isAlive, position, ammo, color, sequence, name )
+
+static_assert( SerializedSize<SchemaVector>::maxBits == 96 && SerializedSize<SchemaVector>::isBounded, "SchemaVector is 3 floats" );
+static_assert( SerializedSize<SchemaEntity>::maxBits == 32 + 1 + 96 + 64 + 24 + 31 + 23 && !SerializedSize<SchemaEntity>::isBounded, "SchemaEntity has a string" );
+
+static void WriteEntityByHand( BitStream* bitStream, const SchemaEntity& entity )
+{
+    bitStream->Write( entity.id );
+    bitStream->Write( entity.isAlive );
+    bitStream->Write( entity.position.x );
+    bitStream->Write( entity.position.y );
+    bitStream->Write( entity.position.z );
+    for( int16_t ammo : entity.ammo )
+        bitStream->Write( ammo );
+    for( uint8_t color : entity.color )
+        bitStream->Write( color );
+    bitStream->Write( entity.sequence );
+    bitStream->Write( entity.name );
+}
+
+static bool SchemaEntitiesEqual( const SchemaEntity& a, const SchemaEntity& b )
+{
+    return a.id == b.id && a.isAlive == b.isAlive && a.position.x == b.position.x && a.position.y == b.position.y && a.position.z == b.position.z &&
+           memcmp( a.ammo, b.ammo, sizeof( a.ammo ) ) == 0 && a.color == b.color && a.sequence.val == b.sequence.val && a.name == b.name;
+}
+
+// Random unit quaternions, with ties between the largest components and negative largest components among them
+static void MakeQuats( RakNetRandom& rnr, unsigned int count, std::vector<float>* wxyz )
+{
+    wxyz->resize( count * 4 );
+    for( unsigned int i = 0; i < count; i++ )
+    {
+        float* q = wxyz->data() + i * 4;
+        switch( i % 8 )
+        {
+        case 0: q[0] = 0.5f; q[1] = -0.5f; q[2] = 0.5f; q[3] = -0.5f; break;
+        case 1: q[0] = 0.0f; q[1] = -0.70710678f; q[2] = 0.70710678f; q[3] = 0.0f; break;
+        case 2: q[0] = 0.0f; q[1] = 0.0f; q[2] = 0.0f; q[3] = -1.0f; break;
+        default:
+            float length = 0.0f;
+            for( int k = 0; k < 4; k++ )
+            {
+                q[k] = rnr.FrandomMT() * 2.0f - 1.0f;
+                length += q[k] * q[k];
+            }
+            length = sqrtf( length );
+            for( int k = 0; k < 4; k++ )
+                q[k] /= length;
+        }
+    }
+}
+
+// Counts what BitStreams take from rakMalloc_Ex and rakRealloc_Ex
+static int heapAllocationCount;
+static void* ( *heapMalloc )( size_t size, const char* file, unsigned int line );
+static void* ( *heapRealloc )( void* p, size_t size, const char* file, unsigned int line );
+static void* CountingMalloc( size_t size, const char* file, unsigned int line )
+{
+    heapAllocationCount++;
+    return heapMalloc( size, file, line );
+}
+static void* CountingRealloc( void* p, size_t size, const char* file, unsigned int line )
+{
+    heapAllocationCount++;
+    return heapRealloc( p, size, file, line );
+}
+
+// About 1.2 kilobytes of per client state, so the stream leaves the stack
+static void WriteClientSnapshot( BitStream* bitStream, unsigned int client, unsigned int tick )
+{
+    uint32_t state[300];
+    for( unsigned int i = 0; i < 300; i++ )
+        state[i] = client * 7919 + tick * 31 + i;
+    bitStream->Write( (MessageID)ID_USER_PACKET_ENUM );
+    bitStream->WriteArray( state, 300 );
+}
+
+// Builds a snapshot for every client, all alive at once as when they are queued before sending
+// \return Allocations made through rakMalloc_Ex and rakRealloc_Ex
+static int BuildTick( BitStreamArena* arena, unsigned int clientCount, unsigned int tick, uint64_t* checksum )
+{
+    heapAllocationCount = 0;
+    heapMalloc = GetMalloc_Ex();
+    heapRealloc = GetRealloc_Ex();
+    SetMalloc_Ex( CountingMalloc );
+    SetRealloc_Ex( CountingRealloc );
+    {
+        std::vector<BitStream> streams( clientCount );
+        for( unsigned int client = 0; client < clientCount; client++ )
+        {
+            streams[client].SetArena( arena );
+            WriteClientSnapshot( &streams[client], client, tick );
+        }
+        for( unsigned int client = 0; client < clientCount; client++ )
+            *checksum = *checksum * 31 + SuperFastHash( (const char*)streams[client].GetData(), streams[client].GetNumberOfBytesUsed() );
+    }
+    if( arena )
+        arena->Reset();
+    SetMalloc_Ex( heapMalloc );
+    SetRealloc_Ex( heapRealloc );
+    return heapAllocationCount;
+}
+
+// Usable at compile time
+static constexpr unsigned char constantData[] = { 0x12, 0x34, 0x56 };
+static constexpr BitStreamView constantView( constantData, sizeof( constantData ) );
+static_assert( constantView.GetNumberOfUnreadBits() == 24, "BitStreamView should be constexpr" );
+
+template <class Function>
+static double BitsPerNanosecond( uint64_t bits, Function function )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start );
+    return (double)bits / (double)( elapsed.count() > 0 ? elapsed.count() : 1 );
+}
+
+int BitStreamBenchmarkTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    RakNetRandom rnr;
+    rnr.SeedMT( 1 );
+
+    if( isVerbose )
+        printf( "Checking WriteBits and ReadBits against a bit at a time reference\n" );
+
+    // Fields of every width up to 80 bits with random contents, including the bits outside a partial byte
+    struct Field
+    {
+        BitSize_t width;
+        bool alignedRight;
+        unsigned char data[10];
+    };
+    std::vector<Field> fields( 20000 );
+    for( Field& field : fields )
+    {
+        field.width = 1 + rnr.RandomMT() % 80;
+        field.alignedRight = ( rnr.RandomMT() & 1 ) != 0;
+        for( unsigned char& byte : field.data )
+            byte = (unsigned char)rnr.RandomMT();
+    }
+
+    BitStream packed, reference;
+    for( const Field& field : fields )
+    {
+        unsigned char expected[10];
+        ExpectedField( field.data, field.width, field.alignedRight, expected );
+        packed.WriteBits( field.data, field.width, field.alignedRight );
+        WriteBitAtATime( &reference, expected, field.width, field.alignedRight );
+    }
+
+    if( packed.GetNumberOfBitsUsed() != reference.GetNumberOfBitsUsed() ||
+        memcmp( packed.GetData(), reference.GetData(), packed.GetNumberOfBytesUsed() ) != 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "WriteBits differs from writing a bit at a time\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    for( const Field& field : fields )
+    {
+        unsigned char expected[10], actual[10];
+        ExpectedField( field.data, field.width, field.alignedRight, expected );
+        memset( actual, 0xCD, sizeof( actual ) );
+        if( packed.ReadBits( actual, field.width, field.alignedRight ) == false || memcmp( actual, expected, BITS_TO_BYTES( field.width ) ) != 0 )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "ReadBits did not return what was written\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 2;
+        }
+    }
+
+    unsigned char overflow;
+    if( packed.ReadBits( &overflow, 1 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "ReadBits read past the end\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    // Patching a field in place, as done for headers written after their contents
+    unsigned char pattern[64];
+    memset( pattern, 0xA5, sizeof( pattern ) );
+    for( BitSize_t offset = 0; offset < 16; offset++ )
+    {
+        for( BitSize_t width = 1; width <= 64; width++ )
+        {
+            BitStream patched;
+            patched.WriteBits( pattern, sizeof( pattern ) * 8 );
+            const unsigned char zeros[8] = {};
+            patched.SetWriteOffset( offset );
+            patched.WriteBits( zeros, width );
+            patched.SetWriteOffset( sizeof( pattern ) * 8 );
+
+            // The bits before the field and the bytes after its last byte are untouched
+            const BitSize_t lastByte = ( offset + width - 1 ) >> 3;
+            bool intact = ( patched.GetData()[offset >> 3] >> ( 8 - ( offset & 7 ) ) ) == ( 0xA5 >> ( 8 - ( offset & 7 ) ) ) || ( offset & 7 ) == 0;
+            intact = intact && memcmp( patched.GetData() + lastByte + 1, pattern + lastByte + 1, sizeof( pattern ) - lastByte - 1 ) == 0;
+            for( BitSize_t i = offset; i < offset + width; i++ )
+                intact = intact && ( patched.GetData()[i >> 3] & ( 0x80 >> ( i & 7 ) ) ) == 0;
+            if( !intact )
+            {
+                if( isVerbose )
+                    DebugTools::ShowError( "Overwriting bits changed the bits around them\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+                return 3;
+            }
+        }
+    }
+
+    if( isVerbose )
+        printf( "Checking WriteArray and ReadArray\n" );
+
+    struct Vector3
+    {
+        float x, y, z;
+    };
+    if( !ArrayMatchesElements<uint8_t>( rnr ) || !ArrayMatchesElements<int16_t>( rnr ) || !ArrayMatchesElements<uint32_t>( rnr ) ||
+        !ArrayMatchesElements<float>( rnr ) || !ArrayMatchesElements<double>( rnr ) || !ArrayMatchesElements<uint64_t>( rnr ) ||
+        !ArrayMatchesElements<Vector3>( rnr ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "WriteArray differs from writing each element\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 4;
+    }
+
+    {
+        std::vector<float> floats( 100, 1.0f );
+        BitStream arrayStream;
+        arrayStream.WriteArray( floats );
+
+        // Over the limit, then a count the stream is too short for
+        std::vector<float> readBack;
+        bool tooMany = arrayStream.ReadArray( readBack, 99 );
+        BitStream truncated( arrayStream.GetData(), arrayStream.GetNumberOfBytesUsed() - 1, false );
+        bool tooShort = truncated.ReadArray( readBack, 1000 );
+        arrayStream.ResetReadPointer();
+        float fixedArray[100];
+        arrayStream.IgnoreBits( arrayStream.GetNumberOfBitsUsed() - 99 * 32 );
+        bool pastEnd = arrayStream.ReadArray( fixedArray, 100 );
+        if( tooMany || tooShort || pastEnd || readBack.size() != 0 )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "ReadArray accepted a bad count\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 5;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Checking WriteVarInt and ReadVarInt\n" );
+
+    if( !VarIntRoundTrips<uint8_t>( rnr ) || !VarIntRoundTrips<int8_t>( rnr ) || !VarIntRoundTrips<uint16_t>( rnr ) || !VarIntRoundTrips<int16_t>( rnr ) ||
+        !VarIntRoundTrips<uint32_t>( rnr ) || !VarIntRoundTrips<int32_t>( rnr ) || !VarIntRoundTrips<uint64_t>( rnr ) || !VarIntRoundTrips<int64_t>( rnr ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "ReadVarInt did not return what WriteVarInt wrote\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    // Zigzag keeps small magnitudes small whatever their sign
+    if( VarIntBytes( 0 ) != 1 || VarIntBytes( -1 ) != 1 || VarIntBytes( 63 ) != 1 || VarIntBytes( -64 ) != 1 || VarIntBytes( 64 ) != 2 ||
+        VarIntBytes( 8191 ) != 2 || VarIntBytes( 8192 ) != 3 || VarIntBytes( std::numeric_limits<int64_t>::min() ) != 10 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "WriteVarInt used the wrong number of bytes\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 7;
+    }
+
+    {
+        // Too long, truncated, and too big for the type read into
+        unsigned char tooLong[11] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+        unsigned char truncated[3] = { 0xFF, 0xFF, 0xFF };
+        BitStream tooLongStream( tooLong, sizeof( tooLong ), false ), truncatedStream( truncated, sizeof( truncated ), false );
+        uint64_t value64;
+        bool acceptedTooLong = tooLongStream.ReadVarInt( value64 );
+        bool acceptedTruncated = truncatedStream.ReadVarInt( value64 );
+
+        BitStream tooBigStream;
+        tooBigStream.WriteVarInt( (uint32_t)256 );
+        tooBigStream.WriteVarInt( (int32_t)-129 );
+        uint8_t value8;
+        int8_t signed8;
+        bool acceptedTooBig = tooBigStream.ReadVarInt( value8 );
+        tooBigStream.ResetReadPointer();
+        tooBigStream.IgnoreBits( 16 );
+        bool acceptedTooSmall = tooBigStream.ReadVarInt( signed8 );
+        bool movedReadOffset = tooBigStream.GetReadOffset() != 16;
+
+        // A larger type still reads the values rejected above, from where the rejected read started
+        uint16_t value16;
+        int16_t signed16;
+        tooBigStream.ResetReadPointer();
+        bool rereadTooBig = tooBigStream.ReadVarInt( value8 ) == false && tooBigStream.ReadVarInt( value16 ) && value16 == 256;
+        bool rereadTooSmall = tooBigStream.ReadVarInt( signed8 ) == false && tooBigStream.ReadVarInt( signed16 ) && signed16 == -129;
+
+        tooBigStream.ResetReadPointer();
+        BitStreamView tooBigView( tooBigStream );
+        bool viewRereadTooBig = tooBigView.ReadVarInt( value8 ) == false && tooBigView.GetReadOffset() == 0 && tooBigView.ReadVarInt( value16 ) && value16 == 256;
+        bool viewRereadTooSmall = tooBigView.ReadVarInt( signed8 ) == false && tooBigView.GetReadOffset() == 16 && tooBigView.ReadVarInt( signed16 ) && signed16 == -129;
+
+        if( acceptedTooLong || acceptedTruncated || acceptedTooBig || acceptedTooSmall || tooLongStream.GetReadOffset() != 0 )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "ReadVarInt accepted a malformed or out of range varint\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 8;
+        }
+
+        if( movedReadOffset || !rereadTooBig || !rereadTooSmall || !viewRereadTooBig || !viewRereadTooSmall )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "ReadVarInt moved past a value out of range of its type\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 13;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Checking BitStreamView\n" );
+
+    ParsedMessage message;
+    message.id = ID_USER_PACKET_ENUM;
+    message.flag = true;
+    message.entity = 123456;
+    message.health = 87.5f;
+    message.sequence = 0x123456;
+    message.guid = RakNetGUID( 0x1122334455667788ULL );
+    message.address = SystemAddress( "192.168.1.20", 61000 );
+    message.name = "player";
+    message.compressed = -3;
+    message.varInt = 300;
+    message.array = { 1, 2, 3, 65535 };
+    message.bits = 0x15;
+    message.ranged = -10.0f; // Exact, since WriteFloat16 is lossy inside its range
+
+    BitStream messageStream;
+    WriteMessage( &messageStream, message );
+
+    Packet packet;
+    packet.data = messageStream.GetData();
+    packet.length = messageStream.GetNumberOfBytesUsed();
+    packet.bitSize = messageStream.GetNumberOfBitsUsed();
+
+    ParsedMessage fromBitStream, fromView;
+    BitStream parseStream( packet.data, packet.length, false );
+    BitStreamView view( &packet );
+    bool bitStreamParsed = ReadMessage( &parseStream, &fromBitStream );
+    bool viewParsed = ReadMessage( &view, &fromView );
+
+    // Reading on past the end fails, and a truncated view fails part way
+    uint32_t pastEnd;
+    bool viewReadPastEnd = view.Read( pastEnd );
+    BitStreamView truncatedView( packet.data, packet.bitSize - 8, 0 );
+    ParsedMessage fromTruncated;
+    bool truncatedParsed = ReadMessage( &truncatedView, &fromTruncated );
+
+    if( !bitStreamParsed || !viewParsed || !( fromBitStream == message ) || !( fromView == message ) || viewReadPastEnd || truncatedParsed ||
+        view.GetReadOffset() != parseStream.GetReadOffset() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "BitStreamView read differently from BitStream\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 9;
+    }
+
+    if( isVerbose )
+        printf( "Checking RAKNET_SERIALIZABLE\n" );
+
+    SchemaEntity entity;
+    entity.id = 42;
+    entity.isAlive = true;
+    entity.position = { 1.5f, -2.0f, 300.25f };
+    entity.ammo[0] = 10;
+    entity.ammo[1] = -1;
+    entity.ammo[2] = 0;
+    entity.ammo[3] = 32767;
+    entity.color = { 255, 128, 0 };
+    entity.sequence = 0xABCDEF;
+    entity.name = "entity";
+
+    // Odd offsets, so the fields straddle bytes
+    BitStream bySchema, byHand;
+    bySchema.Write1();
+    byHand.Write1();
+    bySchema.Serialize( true, entity );
+    WriteEntityByHand( &byHand, entity );
+
+    SchemaEntity fromSchema, fromSchemaView, fromSchemaTruncated;
+    bySchema.IgnoreBits( 1 );
+    bool schemaRead = bySchema.Serialize( false, fromSchema );
+    BitStreamView schemaView( bySchema.GetData(), bySchema.GetNumberOfBitsUsed(), 1 );
+    bool schemaViewRead = schemaView.Read( fromSchemaView );
+    BitStreamView schemaTruncatedView( bySchema.GetData(), bySchema.GetNumberOfBitsUsed() - 8, 1 );
+    bool schemaTruncatedRead = schemaTruncatedView.Read( fromSchemaTruncated );
+
+    if( bySchema.GetNumberOfBitsUsed() != byHand.GetNumberOfBitsUsed() || memcmp( bySchema.GetData(), byHand.GetData(), bySchema.GetNumberOfBytesUsed() ) != 0 ||
+        !schemaRead || !schemaViewRead || schemaTruncatedRead || !SchemaEntitiesEqual( fromSchema, entity ) || !SchemaEntitiesEqual( fromSchemaView, entity ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A RAKNET_SERIALIZABLE type was not written as its fields\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 10;
+    }
+
+    if( isVerbose )
+        printf( "Checking the %s quantizers against the scalar ones\n", QuantizeGetImplementation() );
+
+    // Odd counts, so the scalar tails run too, and values outside the range
+    const unsigned int quantizeCount = 1001;
+    std::vector<float> floats( quantizeCount * 3 );
+    for( size_t i = 0; i < floats.size(); i++ )
+        floats[i] = rnr.FrandomMT() * 2400.0f - 1200.0f;
+    floats[5] = std::numeric_limits<float>::quiet_NaN();
+    floats[6] = std::numeric_limits<float>::infinity();
+    floats[7] = -std::numeric_limits<float>::infinity();
+    floats[8] = -0.0f;
+    floats[9] = -1000.0f;
+    floats[10] = 1000.0f;
+    std::vector<float> quats;
+    MakeQuats( rnr, quantizeCount, &quats );
+
+    bool quantizersMatch = true;
+    const int precisions[] = { 1, 7, 12, 16, 24 };
+    const float boxMin[3] = { -1000.0f, -10.0f, 0.0f }, boxMax[3] = { 1000.0f, 10.0f, 500.0f };
+    std::vector<uint32_t> simdQuantized( quantizeCount * 4 ), scalarQuantized( quantizeCount * 4 );
+    std::vector<float> simdValues( quantizeCount * 4 ), scalarValues( quantizeCount * 4 );
+    for( int bits : precisions )
+    {
+        QuantizeParameters range, box;
+        QuantizeParametersForRange( -1000.0f, 1000.0f, bits, &range );
+        QuantizeParametersForBox( boxMin, boxMax, bits, &box );
+        for( const QuantizeParameters* parameters : { &range, &box } )
+        {
+            const unsigned int count = (unsigned int)floats.size();
+            QuantizeFloats( floats.data(), count, *parameters, simdQuantized.data() );
+            QuantizeFloatsPortable( floats.data(), count, *parameters, scalarQuantized.data() );
+            DequantizeFloats( scalarQuantized.data(), count, *parameters, simdValues.data() );
+            DequantizeFloatsPortable( scalarQuantized.data(), count, *parameters, scalarValues.data() );
+            quantizersMatch = quantizersMatch && memcmp( simdQuantized.data(), scalarQuantized.data(), count * sizeof( uint32_t ) ) == 0 &&
+                              memcmp( simdValues.data(), scalarValues.data(), count * sizeof( float ) ) == 0;
+        }
+
+        QuantizeParameters quatParameters;
+        QuantizeParametersForRange( -0.707106781f, 0.707106781f, bits, &quatParameters );
+        QuantizeQuats( quats.data(), quantizeCount, quatParameters, simdQuantized.data() );
+        QuantizeQuatsPortable( quats.data(), quantizeCount, quatParameters, scalarQuantized.data() );
+        DequantizeQuats( scalarQuantized.data(), quantizeCount, quatParameters, simdValues.data() );
+        DequantizeQuatsPortable( scalarQuantized.data(), quantizeCount, quatParameters, scalarValues.data() );
+        quantizersMatch = quantizersMatch && memcmp( simdQuantized.data(), scalarQuantized.data(), quantizeCount * 4 * sizeof( uint32_t ) ) == 0 &&
+                          memcmp( simdValues.data(), scalarValues.data(), quantizeCount * 4 * sizeof( float ) ) == 0;
+    }
+
+    // Through a stream, one bit off alignment
+    BitStream quantizedStream;
+    quantizedStream.Write1();
+    quantizedStream.WriteQuantizedFloats( floats.data() + 11, quantizeCount, -1200.0f, 1200.0f, 13 );
+    quantizedStream.WriteQuantizedVectors( floats.data(), quantizeCount, boxMin, boxMax, 16 );
+    quantizedStream.WriteQuantizedQuats( quats.data(), quantizeCount, 12 );
+    const bool quantizedSizeRight = quantizedStream.GetNumberOfBitsUsed() == 1 + quantizeCount * ( 13 + 3 * 16 + 2 + 3 * 12 );
+
+    std::vector<float> readFloats( quantizeCount ), readVectors( quantizeCount * 3 ), readQuats( quantizeCount * 4 );
+    quantizedStream.IgnoreBits( 1 );
+    bool quantizedRead = quantizedStream.ReadQuantizedFloats( readFloats.data(), quantizeCount, -1200.0f, 1200.0f, 13 );
+    BitStreamView quantizedView( quantizedStream.GetData(), quantizedStream.GetNumberOfBitsUsed(), quantizedStream.GetReadOffset() );
+    quantizedRead = quantizedRead && quantizedView.ReadQuantizedVectors( readVectors.data(), quantizeCount, boxMin, boxMax, 16 ) &&
+                    quantizedView.ReadQuantizedQuats( readQuats.data(), quantizeCount, 12 ) && quantizedView.GetNumberOfUnreadBits() == 0;
+    const BitSize_t offsetAtEnd = quantizedView.GetReadOffset();
+    quantizedRead = quantizedRead && !quantizedView.ReadQuantizedQuats( readQuats.data(), 1, 12 ) && quantizedView.GetReadOffset() == offsetAtEnd;
+
+    bool quantizedWithinPrecision = true;
+    for( unsigned int i = 0; i < quantizeCount; i++ )
+        quantizedWithinPrecision = quantizedWithinPrecision && fabsf( readFloats[i] - floats[i + 11] ) <= 2400.0f / 8191.0f * 0.51f;
+    for( unsigned int i = 0; i < quantizeCount * 3; i++ )
+    {
+        const unsigned int axis = i % 3;
+        const float expected = std::isnan( floats[i] ) ? boxMin[axis] : std::min( std::max( floats[i], boxMin[axis] ), boxMax[axis] );
+        quantizedWithinPrecision = quantizedWithinPrecision && fabsf( readVectors[i] - expected ) <= ( boxMax[axis] - boxMin[axis] ) / 65535.0f * 0.51f;
+    }
+    for( unsigned int i = 0; i < quantizeCount; i++ )
+    {
+        // The same rotation, up to sign
+        float dot = 0.0f;
+        for( int k = 0; k < 4; k++ )
+            dot += quats[i * 4 + k] * readQuats[i * 4 + k];
+        quantizedWithinPrecision = quantizedWithinPrecision && fabsf( dot ) > 0.99999f;
+    }
+
+    if( !quantizersMatch || !quantizedSizeRight || !quantizedRead || !quantizedWithinPrecision )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Quantized values differ between paths or did not read back\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 11;
+    }
+
+    if( isVerbose )
+        printf( "Checking BitStreamArena\n" );
+
+    const unsigned int clientCount = 200;
+    BitStreamArena tickArena;
+    bool arenaMatchesHeap = true, arenaStoppedAllocating = true;
+    int firstTickArenaAllocations = 0, heapAllocationsPerTick = 0;
+    for( unsigned int tick = 0; tick < 5; tick++ )
+    {
+        uint64_t heapChecksum = 0, arenaChecksum = 0;
+        heapAllocationsPerTick = BuildTick( 0, clientCount, tick, &heapChecksum );
+        const int arenaAllocations = BuildTick( &tickArena, clientCount, tick, &arenaChecksum );
+        arenaMatchesHeap = arenaMatchesHeap && heapChecksum == arenaChecksum;
+        if( tick == 0 )
+            firstTickArenaAllocations = arenaAllocations;
+        else
+            arenaStoppedAllocating = arenaStoppedAllocating && arenaAllocations == 0;
+    }
+
+    // Moving data between the heap and an arena, and building one stream at a time, which reuses the memory of the stream before
+    BitStreamArenaStatistics arenaStatistics;
+    {
+        BitStream onHeap;
+        WriteClientSnapshot( &onHeap, 1, 1 );
+        onHeap.SetArena( &tickArena );
+        WriteClientSnapshot( &onHeap, 2, 2 );
+        onHeap.SetArena( 0 );
+        BitStream expected;
+        WriteClientSnapshot( &expected, 1, 1 );
+        WriteClientSnapshot( &expected, 2, 2 );
+        arenaMatchesHeap = arenaMatchesHeap && onHeap.GetNumberOfBitsUsed() == expected.GetNumberOfBitsUsed() &&
+                           memcmp( onHeap.GetData(), expected.GetData(), expected.GetNumberOfBytesUsed() ) == 0;
+    }
+    for( unsigned int client = 0; client < clientCount; client++ )
+    {
+        BitStream oneAtATime;
+        oneAtATime.SetArena( &tickArena );
+        WriteClientSnapshot( &oneAtATime, client, 0 );
+    }
+    tickArena.GetStatistics( &arenaStatistics );
+    arenaStoppedAllocating = arenaStoppedAllocating && tickArena.GetLiveAllocationCount() == 0 && arenaStatistics.bytesUsed == 0;
+    tickArena.Reset();
+
+    if( isVerbose )
+        printf( "Heap %d allocations per tick, arena %d on the first tick then none, %u kilobytes reserved\n", heapAllocationsPerTick, firstTickArenaAllocations,
+                (unsigned int)( arenaStatistics.bytesReserved / 1024 ) );
+
+    // Send copies the data, so the arena can be reset and reused before the message goes out
+    RakPeerInterface* arenaSender = RakPeerInterface::GetInstance();
+    destroyList.push_back( arenaSender );
+    RakPeerInterface* arenaReceiver = RakPeerInterface::GetInstance();
+    destroyList.push_back( arenaReceiver );
+    SocketDescriptor receiverSocketDescriptor( 60000, 0 );
+    arenaReceiver->Startup( 1, &receiverSocketDescriptor, 1 );
+    arenaReceiver->SetMaximumIncomingConnections( 1 );
+    SocketDescriptor senderSocketDescriptor;
+    arenaSender->Startup( 1, &senderSocketDescriptor, 1 );
+    arenaSender->Connect( "127.0.0.1", 60000, 0, 0 );
+    Packet* accepted = CommonFunctions::WaitAndReturnMessageWithID( arenaSender, ID_CONNECTION_REQUEST_ACCEPTED, 10000 );
+    bool arrivedIntact = accepted != 0;
+    if( accepted )
+    {
+        const RakNetGUID receiverGuid = accepted->guid;
+        arenaSender->DeallocatePacket( accepted );
+        {
+            BitStream arenaStream;
+            arenaStream.SetArena( &tickArena );
+            WriteClientSnapshot( &arenaStream, 3, 3 );
+            arenaSender->Send( &arenaStream, HIGH_PRIORITY, RELIABLE_ORDERED, 0, receiverGuid, false );
+        }
+        tickArena.Reset();
+        void* reused = tickArena.Allocate( 4096 );
+        memset( reused, 0xCD, 4096 );
+
+        BitStream expected;
+        WriteClientSnapshot( &expected, 3, 3 );
+        Packet* received = CommonFunctions::WaitAndReturnMessageWithID( arenaReceiver, ID_USER_PACKET_ENUM, 5000 );
+        arrivedIntact = received != 0 && received->length == expected.GetNumberOfBytesUsed() && memcmp( received->data, expected.GetData(), received->length ) == 0;
+        if( received )
+            arenaReceiver->DeallocatePacket( received );
+        tickArena.Release( reused );
+    }
+    DestroyPeers();
+
+    if( !arenaMatchesHeap || firstTickArenaAllocations == 0 || heapAllocationsPerTick < (int)clientCount || !arenaStoppedAllocating || !arrivedIntact )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A stream on an arena differs from the heap or kept allocating\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 12;
+    }
+
+    if( isVerbose )
+        printf( "Measuring throughput\n" );
+
+    // A mixed stream, long enough to leave the stack allocation, rewritten many times
+    const int fieldsPerStream = 4096, repetitions = 200;
+    std::vector<uint64_t> values( fieldsPerStream );
+    std::vector<BitSize_t> widths( fieldsPerStream );
+    uint64_t bitsPerStream = 0;
+    for( int i = 0; i < fieldsPerStream; i++ )
+    {
+        widths[i] = mixedWidths[rnr.RandomMT() % ( sizeof( mixedWidths ) / sizeof( mixedWidths[0] ) )];
+        values[i] = ( (uint64_t)rnr.RandomMT() << 32 ) | rnr.RandomMT();
+        bitsPerStream += widths[i];
+    }
+
+    BitStream benchmark;
+    const double writeBitsRate = BitsPerNanosecond( bitsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+                benchmark.WriteBits( (const unsigned char*)&values[i], widths[i] );
+        }
+    } );
+
+    uint64_t checksum = 0;
+    const double readBitsRate = BitsPerNanosecond( bitsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetReadPointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+            {
+                uint64_t value = 0;
+                benchmark.ReadBits( (unsigned char*)&value, widths[i] );
+                checksum += value;
+            }
+        }
+    } );
+
+    // Typical message fields through the templated interface, starting off a byte boundary
+    const uint64_t typedBitsPerRecord = 1 + 16 + 32 + 32;
+    const double typedWriteRate = BitsPerNanosecond( typedBitsPerRecord * fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+            {
+                benchmark.Write( ( values[i] & 1 ) != 0 );
+                benchmark.Write( (uint16_t)values[i] );
+                benchmark.Write( (uint32_t)( values[i] >> 16 ) );
+                benchmark.Write( (float)i );
+            }
+        }
+    } );
+
+    const double typedReadRate = BitsPerNanosecond( typedBitsPerRecord * fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetReadPointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+            {
+                bool flag = false;
+                uint16_t shortValue = 0;
+                uint32_t intValue = 0;
+                float floatValue = 0.0f;
+                benchmark.Read( flag );
+                benchmark.Read( shortValue );
+                benchmark.Read( intValue );
+                benchmark.Read( floatValue );
+                checksum += flag + shortValue + intValue + (uint64_t)floatValue;
+            }
+        }
+    } );
+
+    // Counts the bits of the compressed encoding, however many that comes to
+    benchmark.ResetWritePointer();
+    for( int i = 0; i < fieldsPerStream; i++ )
+        benchmark.WriteCompressed( (uint32_t)( values[i] >> ( widths[i] & 31 ) ) );
+    const uint64_t compressedBits = benchmark.GetNumberOfBitsUsed();
+    const double compressedWriteRate = BitsPerNanosecond( compressedBits * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+                benchmark.WriteCompressed( (uint32_t)( values[i] >> ( widths[i] & 31 ) ) );
+        }
+    } );
+
+    const double compressedReadRate = BitsPerNanosecond( compressedBits * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetReadPointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+            {
+                uint32_t value;
+                benchmark.ReadCompressed( value );
+                checksum += value;
+            }
+        }
+    } );
+
+    // Positions, one bit off alignment, element by element and in bulk
+    std::vector<float> positions( fieldsPerStream * 3 );
+    for( size_t i = 0; i < positions.size(); i++ )
+        positions[i] = (float)values[i % fieldsPerStream];
+    const uint64_t positionBits = positions.size() * 32;
+    const double elementWriteRate = BitsPerNanosecond( positionBits * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            benchmark.Write1();
+            for( float position : positions )
+                benchmark.Write( position );
+        }
+    } );
+
+    const double arrayWriteRate = BitsPerNanosecond( positionBits * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            benchmark.Write1();
+            benchmark.WriteArray( positions.data(), (unsigned int)positions.size() );
+        }
+    } );
+
+    const double arrayReadRate = BitsPerNanosecond( positionBits * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetReadPointer();
+            benchmark.IgnoreBits( 1 );
+            benchmark.ReadArray( positions.data(), (unsigned int)positions.size() );
+        }
+    } );
+
+    // Positions and rotations of a server tick, quantized in bulk against one value at a time
+    std::vector<float> rotations;
+    MakeQuats( rnr, fieldsPerStream, &rotations );
+    const float worldMin[3] = { -4096.0f, -4096.0f, -4096.0f }, worldMax[3] = { 4096.0f, 4096.0f, 4096.0f };
+    for( float& position : positions )
+        position = std::fmod( position, 4096.0f );
+    const double float16WriteRate = BitsPerNanosecond( fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            for( size_t i = 0; i < positions.size(); i++ )
+                benchmark.WriteFloat16( positions[i], worldMin[i % 3], worldMax[i % 3] );
+        }
+    } );
+    const double quantizedVectorWriteRate = BitsPerNanosecond( fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            benchmark.WriteQuantizedVectors( positions.data(), fieldsPerStream, worldMin, worldMax, 16 );
+        }
+    } );
+    const double quantizedVectorReadRate = BitsPerNanosecond( fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetReadPointer();
+            benchmark.ReadQuantizedVectors( positions.data(), fieldsPerStream, worldMin, worldMax, 16 );
+        }
+    } );
+    const double normQuatWriteRate = BitsPerNanosecond( fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            for( int i = 0; i < fieldsPerStream; i++ )
+                benchmark.WriteNormQuat( rotations[i * 4], rotations[i * 4 + 1], rotations[i * 4 + 2], rotations[i * 4 + 3] );
+        }
+    } );
+    const double quantizedQuatWriteRate = BitsPerNanosecond( fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetWritePointer();
+            benchmark.WriteQuantizedQuats( rotations.data(), fieldsPerStream, 12 );
+        }
+    } );
+    const double quantizedQuatReadRate = BitsPerNanosecond( fieldsPerStream * repetitions, [&]() {
+        for( int repetition = 0; repetition < repetitions; repetition++ )
+        {
+            benchmark.ResetReadPointer();
+            benchmark.ReadQuantizedQuats( rotations.data(), fieldsPerStream, 12 );
+        }
+    } );
+
+    // A tick of per client snapshots, with every stream on the heap and then on an arena
+    uint64_t tickChecksum = 0;
+    const int tickRepetitions = 50;
+    const double heapTickRate = BitsPerNanosecond( tickRepetitions, [&]() {
+        for( int repetition = 0; repetition < tickRepetitions; repetition++ )
+            BuildTick( 0, clientCount, repetition, &tickChecksum );
+    } );
+    const double arenaTickRate = BitsPerNanosecond( tickRepetitions, [&]() {
+        for( int repetition = 0; repetition < tickRepetitions; repetition++ )
+            BuildTick( &tickArena, clientCount, repetition, &tickChecksum );
+    } );
+    checksum += tickChecksum;
+
+    // Realistic header values: entity ids, small signed deltas, and millisecond timestamps a few hours into a session
+    const int distributionCount = 3;
+    const char* distributionNames[distributionCount] = { "entity ids", "deltas", "timestamps" };
+    std::vector<int64_t> distributions[distributionCount];
+    for( int i = 0; i < fieldsPerStream; i++ )
+    {
+        distributions[0].push_back( rnr.RandomMT() % 5000 );
+        distributions[1].push_back( (int64_t)( rnr.RandomMT() % 64 ) + (int64_t)( rnr.RandomMT() % 64 ) - 64 );
+        distributions[2].push_back( 10000000 + (int64_t)i * 16 + rnr.RandomMT() % 8 );
+    }
+
+    struct EncodingResult
+    {
+        double bitsPerValue, writeRate, readRate;
+    };
+    EncodingResult varIntResults[distributionCount], compressedResults[distributionCount];
+    for( int d = 0; d < distributionCount; d++ )
+    {
+        const std::vector<int64_t>& distribution = distributions[d];
+        const uint64_t valueCount = (uint64_t)distribution.size() * repetitions;
+
+        benchmark.ResetWritePointer();
+        for( int64_t value : distribution )
+            benchmark.WriteVarInt( (int32_t)value );
+        varIntResults[d].bitsPerValue = (double)benchmark.GetNumberOfBitsUsed() / distribution.size();
+        varIntResults[d].writeRate = BitsPerNanosecond( valueCount, [&]() {
+            for( int repetition = 0; repetition < repetitions; repetition++ )
+            {
+                benchmark.ResetWritePointer();
+                for( int64_t value : distribution )
+                    benchmark.WriteVarInt( (int32_t)value );
+            }
+        } );
+        varIntResults[d].readRate = BitsPerNanosecond( valueCount, [&]() {
+            for( int repetition = 0; repetition < repetitions; repetition++ )
+            {
+                benchmark.ResetReadPointer();
+                for( size_t i = 0; i < distribution.size(); i++ )
+                {
+                    int32_t value = 0;
+                    benchmark.ReadVarInt( value );
+                    checksum += value;
+                }
+            }
+        } );
+
+        benchmark.ResetWritePointer();
+        for( int64_t value : distribution )
+            benchmark.WriteCompressed( (int32_t)value );
+        compressedResults[d].bitsPerValue = (double)benchmark.GetNumberOfBitsUsed() / distribution.size();
+        compressedResults[d].writeRate = BitsPerNanosecond( valueCount, [&]() {
+            for( int repetition = 0; repetition < repetitions; repetition++ )
+            {
+                benchmark.ResetWritePointer();
+                for( int64_t value : distribution )
+                    benchmark.WriteCompressed( (int32_t)value );
+            }
+        } );
+        compressedResults[d].readRate = BitsPerNanosecond( valueCount, [&]() {
+            for( int repetition = 0; repetition < repetitions; repetition++ )
+            {
+                benchmark.ResetReadPointer();
+                for( size_t i = 0; i < distribution.size(); i++ )
+                {
+                    int32_t value;
+                    benchmark.ReadCompressed( value );
+                    checksum += value;
+                }
+            }
+        } );
+    }
+
+    // Parsing the start of a received packet, as an OnReceive handler would
+    const int parseCount = 1000000;
+    const double bitStreamParseRate = BitsPerNanosecond( parseCount, [&]() {
+        for( int i = 0; i < parseCount; i++ )
+        {
+            BitStream bitStream( packet.data, packet.length, false );
+            MessageID id;
+            uint32_t entity;
+            bitStream.Read( id );
+            bitStream.IgnoreBits( 1 );
+            bitStream.Read( entity );
+            checksum += entity;
+        }
+    } );
+    const double viewParseRate = BitsPerNanosecond( parseCount, [&]() {
+        for( int i = 0; i < parseCount; i++ )
+        {
+            BitStreamView packetView( &packet );
+            MessageID id;
+            uint32_t entity;
+            packetView.Read( id );
+            packetView.IgnoreBits( 1 );
+            packetView.Read( entity );
+            checksum += entity;
+        }
+    } );
+
+    // Writing a struct through its schema, against the same fields by hand
+    const int entityCount = 1000000;
+    BitStream entityStream;
+    const double handEntityRate = BitsPerNanosecond( entityCount, [&]() {
+        for( int i = 0; i < entityCount; i++ )
+        {
+            entityStream.Reset();
+            entity.id = i;
+            WriteEntityByHand( &entityStream, entity );
+            checksum += entityStream.GetNumberOfBitsUsed();
+        }
+    } );
+    const double schemaEntityRate = BitsPerNanosecond( entityCount, [&]() {
+        for( int i = 0; i < entityCount; i++ )
+        {
+            entityStream.Reset();
+            entity.id = i;
+            entityStream.Write( entity );
+            checksum += entityStream.GetNumberOfBitsUsed();
+        }
+    } );
+
+    if( isVerbose )
+    {
+        printf( "WriteBits, mixed widths:       %6.3f bits/ns\n", writeBitsRate );
+        printf( "ReadBits, mixed widths:        %6.3f bits/ns\n", readBitsRate );
+        printf( "Write bool, u16, u32, float:   %6.3f bits/ns\n", typedWriteRate );
+        printf( "Read bool, u16, u32, float:    %6.3f bits/ns\n", typedReadRate );
+        printf( "WriteCompressed u32:           %6.3f bits/ns\n", compressedWriteRate );
+        printf( "ReadCompressed u32:            %6.3f bits/ns\n", compressedReadRate );
+        printf( "Write float, one at a time:    %6.3f bits/ns\n", elementWriteRate );
+        printf( "WriteArray float:              %6.3f bits/ns\n", arrayWriteRate );
+        printf( "ReadArray float:               %6.3f bits/ns\n", arrayReadRate );
+        // Rates here are values per nanosecond
+        printf( "WriteFloat16 x3:               %6.3f vectors/ns\n", float16WriteRate );
+        printf( "WriteQuantizedVectors (%s):  %6.3f vectors/ns\n", QuantizeGetImplementation(), quantizedVectorWriteRate );
+        printf( "ReadQuantizedVectors:          %6.3f vectors/ns\n", quantizedVectorReadRate );
+        printf( "WriteNormQuat:                 %6.3f quats/ns\n", normQuatWriteRate );
+        printf( "WriteQuantizedQuats:           %6.3f quats/ns\n", quantizedQuatWriteRate );
+        printf( "ReadQuantizedQuats:            %6.3f quats/ns\n", quantizedQuatReadRate );
+        for( int d = 0; d < distributionCount; d++ )
+        {
+            // Rates here are values per nanosecond
+            printf( "%-11s VarInt     %5.1f bits, write %6.3f, read %6.3f values/ns\n", distributionNames[d], varIntResults[d].bitsPerValue, varIntResults[d].writeRate, varIntResults[d].readRate );
+            printf( "%-11s Compressed %5.1f bits, write %6.3f, read %6.3f values/ns\n", distributionNames[d], compressedResults[d].bitsPerValue, compressedResults[d].writeRate, compressedResults[d].readRate );
+        }
+        printf( "Parse header, BitStream:       %6.1f ns/packet\n", 1.0 / bitStreamParseRate );
+        printf( "Parse header, BitStreamView:   %6.1f ns/packet\n", 1.0 / viewParseRate );
+        printf( "Write struct, by hand:         %6.1f ns/struct\n", 1.0 / handEntityRate );
+        printf( "Write struct, schema:          %6.1f ns/struct\n", 1.0 / schemaEntityRate );
+        printf( "Build %u snapshots, heap:      %6.1f us/tick\n", clientCount, 0.001 / heapTickRate );
+        printf( "Build %u snapshots, arena:     %6.1f us/tick\n", clientCount, 0.001 / arenaTickRate );
+        printf( "(checksum %llu)\n", (unsigned long long)checksum );
+    }
+
+    return 0;
+}
+
+std::string BitStreamBenchmarkTest::GetTestName() const
+{
+    return "BitStreamBenchmarkTest";
+}
+
+std::string BitStreamBenchmarkTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case  0: return "No error";                                                     break;
+    case  1: return "WriteBits differs from writing a bit at a time";               break;
+    case  2: return "ReadBits did not return what was written";                     break;
+    case  3: return "Overwriting bits changed the bits around them";                break;
+    case  4: return "WriteArray differs from writing each element";                 break;
+    case  5: return "ReadArray accepted a bad count";                               break;
+    case  6: return "ReadVarInt did not return what WriteVarInt wrote";             break;
+    case  7: return "WriteVarInt used the wrong number of bytes";                   break;
+    case  8: return "ReadVarInt accepted a malformed or out of range varint";       break;
+    case  9: return "BitStreamView read differently from BitStream";                break;
+    case 10: return "A RAKNET_SERIALIZABLE type was not written as its fields";     break;
+    case 11: return "Quantized values differ between paths or did not read back";   break;
+    case 12: return "A stream on an arena differs from the heap or kept allocating";  break;
+    case 13: return "ReadVarInt moved past a value out of range of its type";       break;
+    default: return "Undefined Error";                                              break;
+    }
+    // clang-format on
+}
+
+BitStreamBenchmarkTest::BitStreamBenchmarkTest( void )
+{
+}
+
+BitStreamBenchmarkTest::~BitStreamBenchmarkTest( void )
+{
+}
+
+void BitStreamBenchmarkTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -0,0 +1,292 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "ByteQueueTest.h"
+
+#include "DS_ByteQueue.h"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/*
+Description:
+Writes, reads, peeks and rewinds random lengths through a ByteQueue and a std::deque, so the queue wraps and grows while wrapped
+Fills the free space described by ReserveWriteRegions directly, and reads back through PeekReadRegions
+On systems with socketpair, passes bytes from one queue to another with writev and readv on those regions
+
+Success conditions:
+The queue always holds the same bytes as the std::deque, in the same order
+Regions cover exactly the bytes waiting or the free space, and wrap into a second region only at the end of the buffer
+
+Failure conditions:
+Any of the above fails
+
+ByteQueue Functions Explicitly Tested:
+WriteBytes
+ReadBytes
+GetBytesWritten
+PeekContiguousBytes
+PeekReadRegions
+ReserveWriteRegions
+IncrementWriteOffset
+IncrementReadOffset
+DecrementReadOffset
+Clear
+*/
+
+namespace {
+
+bool Matches( const DataStructures::ByteQueue& queue, const std::deque<char>& expected )
+{
+    DataStructures::ByteQueueRegion regions[2];
+    const int regionCount = queue.PeekReadRegions( regions );
+    if( queue.GetBytesWritten() != expected.size() || ( regionCount == 0 ) != expected.empty() )
+        return false;
+    size_t index = 0;
+    for( int region = 0; region < regionCount; region++ )
+    {
+        for( unsigned i = 0; i < regions[region].length; i++ )
+        {
+            if( index >= expected.size() || regions[region].data[i] != expected[index++] )
+                return false;
+        }
+    }
+    unsigned contiguousLength;
+    const char* contiguous = queue.PeekContiguousBytes( &contiguousLength );
+    return index == expected.size() && ( regionCount == 0 || ( contiguous == regions[0].data && contiguousLength == regions[0].length ) );
+}
+
+bool MatchesDeque( unsigned seed )
+{
+    DataStructures::ByteQueue queue;
+    std::deque<char> expected;
+    std::mt19937 random( seed );
+    char buffer[5000];
+    char next = 0;
+    // How far back DecrementReadOffset may go, as only bytes still in the buffer can be read again
+    std::deque<char> consumed;
+
+    for( int operation = 0; operation < 20000; operation++ )
+    {
+        // Reads outnumber writes, so the queue keeps emptying and the offsets keep moving round the buffer
+        const unsigned kind = random() % 10;
+        // Mostly small, sometimes larger than the buffer, so it grows while the bytes wrap
+        const unsigned length = random() % 8 == 0 ? random() % 5000 : random() % 300;
+        if( kind < 2 )
+        {
+            for( unsigned i = 0; i < length; i++ )
+                buffer[i] = next++;
+            queue.WriteBytes( buffer, length, _FILE_AND_LINE_ );
+            expected.insert( expected.end(), buffer, buffer + length );
+            consumed.clear();
+        }
+        else if( kind < 3 )
+        {
+            // Write part of the free space described, as a short readv would
+            DataStructures::ByteQueueRegion regions[2];
+            const int regionCount = queue.ReserveWriteRegions( length, regions, _FILE_AND_LINE_ );
+            // Free space that wraps ends where the bytes waiting start, or where it started if there are none
+            DataStructures::ByteQueueRegion readRegions[2];
+            const char* freeEnd = queue.PeekReadRegions( readRegions ) > 0 ? readRegions[0].data : regions[0].data;
+            const unsigned freeLength = regions[0].length + ( regionCount == 2 ? regions[1].length : 0 );
+            if( freeLength < length || ( regionCount == 2 && regions[1].data + regions[1].length != freeEnd ) )
+                return false;
+            unsigned written = 0;
+            for( int region = 0; region < regionCount && written < length; region++ )
+            {
+                for( unsigned i = 0; i < regions[region].length && written < length; i++, written++ )
+                    regions[region].data[i] = next++;
+            }
+            queue.IncrementWriteOffset( length );
+            for( unsigned i = 0; i < length; i++ )
+                expected.push_back( (char)( next - length + i ) );
+            consumed.clear();
+        }
+        else if( kind < 7 )
+        {
+            const bool peek = kind == 6;
+            const bool read = queue.ReadBytes( buffer, length, peek );
+            const size_t readLength = length < expected.size() ? length : expected.size();
+            if( read != ( readLength > 0 ) || !std::equal( expected.begin(), expected.begin() + readLength, buffer ) )
+                return false;
+            if( !peek )
+            {
+                consumed.insert( consumed.end(), expected.begin(), expected.begin() + readLength );
+                expected.erase( expected.begin(), expected.begin() + readLength );
+            }
+        }
+        else if( kind < 9 )
+        {
+            const unsigned skip = length < expected.size() ? length : (unsigned)expected.size();
+            queue.IncrementReadOffset( skip );
+            consumed.insert( consumed.end(), expected.begin(), expected.begin() + skip );
+            expected.erase( expected.begin(), expected.begin() + skip );
+        }
+        else
+        {
+            const unsigned rewind = length < consumed.size() ? length : (unsigned)consumed.size();
+            queue.DecrementReadOffset( rewind );
+            expected.insert( expected.begin(), consumed.end() - rewind, consumed.end() );
+            consumed.erase( consumed.end() - rewind, consumed.end() );
+        }
+
+        if( !Matches( queue, expected ) )
+            return false;
+        if( operation % 5000 == 4999 )
+        {
+            queue.Clear( _FILE_AND_LINE_ );
+            expected.clear();
+            consumed.clear();
+        }
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// Bytes go from one queue to the other through a socket, without being copied anywhere else
+bool PassThroughSocket( void )
+{
+    int sockets[2];
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, sockets ) != 0 )
+        return false;
+    // Some rounds send nothing, and the receiver must not wait for them
+    fcntl( sockets[0], F_SETFL, O_NONBLOCK );
+    fcntl( sockets[1], F_SETFL, O_NONBLOCK );
+
+    DataStructures::ByteQueue sender, receiver;
+    std::mt19937 random( 7 );
+    char buffer[700];
+    char next = 0, expectedNext = 0;
+    unsigned checked = 0;
+    bool valid = true;
+    for( int round = 0; valid && round < 2000; round++ )
+    {
+        const unsigned length = random() % sizeof( buffer );
+        for( unsigned i = 0; i < length; i++ )
+            buffer[i] = next++;
+        sender.WriteBytes( buffer, length, _FILE_AND_LINE_ );
+
+        DataStructures::ByteQueueRegion regions[2];
+        iovec buffers[2];
+        int regionCount = sender.PeekReadRegions( regions );
+        if( regionCount > 0 )
+        {
+            for( int i = 0; i < regionCount; i++ )
+            {
+                buffers[i].iov_base = regions[i].data;
+                buffers[i].iov_len = regions[i].length;
+            }
+            // Sometimes less than all of it, so the sender keeps wrapping
+            if( round % 3 == 0 && buffers[regionCount - 1].iov_len > 1 )
+                buffers[regionCount - 1].iov_len /= 2;
+            const ssize_t sent = writev( sockets[0], buffers, regionCount );
+            if( sent > 0 )
+                sender.IncrementReadOffset( (unsigned)sent );
+        }
+
+        regionCount = receiver.ReserveWriteRegions( 64, regions, _FILE_AND_LINE_ );
+        for( int i = 0; i < regionCount; i++ )
+        {
+            buffers[i].iov_base = regions[i].data;
+            buffers[i].iov_len = regions[i].length;
+        }
+        const ssize_t received = readv( sockets[1], buffers, regionCount );
+        if( received > 0 )
+            receiver.IncrementWriteOffset( (unsigned)received );
+
+        // Consume some, so the receiver wraps too
+        unsigned readLength = random() % sizeof( buffer );
+        if( readLength > receiver.GetBytesWritten() )
+            readLength = receiver.GetBytesWritten();
+        receiver.ReadBytes( buffer, readLength, false );
+        for( unsigned i = 0; valid && i < readLength; i++ )
+            valid = buffer[i] == expectedNext++;
+        checked += readLength;
+    }
+
+    close( sockets[0] );
+    close( sockets[1] );
+    return valid && checked > 0;
+}
+#endif
+
+} // namespace
+
+int ByteQueueTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Comparing against std::deque\n" );
+
+    if( !MatchesDeque( 1 ) || !MatchesDeque( 2 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "The queue did not hold the bytes written, in order\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+#ifndef _WIN32
+    if( isVerbose )
+        printf( "Passing bytes between queues with writev and readv\n" );
+
+    if( !PassThroughSocket() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Bytes sent from one queue did not arrive in the other in order\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+#endif
+
+    return 0;
+}
+
+std::string ByteQueueTest::GetTestName() const
+{
+    return "ByteQueueTest";
+}
+
+std::string ByteQueueTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "The queue did not hold the bytes written, in order";                        break;
+    case 2: return "Bytes sent from one queue did not arrive in the other in order";            break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+ByteQueueTest::ByteQueueTest( void )
+{
+}
+
+ByteQueueTest::~ByteQueueTest( void )
+{
+}
+
+void ByteQueueTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
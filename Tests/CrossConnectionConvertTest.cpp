@@ -11,6 +11,7 @@
 #include "CrossConnectionConvertTest.h"
 
 #include <chrono>
+#include <string.h>
 #include <thread>
 
  /*
@@ -42,10 +43,12 @@ int CrossConnectionConvertTest::RunTest( bool isVerbose, bool noPauses )
     destroyList.push_back( client );
 
 
-    server->Startup( 1, &SocketDescriptor( SERVER_PORT, 0 ), 1 );
+    SocketDescriptor serverSocketDescriptor( SERVER_PORT, 0 );
+    server->Startup( 1, &serverSocketDescriptor, 1 );
     server->SetMaximumIncomingConnections( 1 );
 
-    client->Startup( 1, &SocketDescriptor( 0, 0 ), 1 );
+    SocketDescriptor clientSocketDescriptor( 0, 0 );
+    client->Startup( 1, &clientSocketDescriptor, 1 );
 
     client->Ping( serverIP, SERVER_PORT, false );
 
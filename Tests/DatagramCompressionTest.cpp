@@ -0,0 +1,371 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DatagramCompressionTest.h"
+
+#include "LZCompressor.h"
+#include "RakNetStatistics.h"
+#include "Rand.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+/*
+Description:
+Tests the LZ datagram compression stage
+
+Success conditions:
+LZCompress and LZDecompress round trip compressible, random and empty data, and malformed data is rejected
+Reliable ordered messages arrive intact between two systems with compression, and the statistics show a ratio above 1
+A system with compression disabled can still connect to one that has it enabled
+
+Failure conditions:
+Any of the above fails
+
+RakPeerInterface Functions used, tested indirectly by its use:
+Startup
+SetMaximumIncomingConnections
+Connect
+Receive
+DeallocatePacket
+Send
+GetStatistics
+
+RakPeerInterface Functions Explicitly Tested:
+SetDatagramCompression
+GetDatagramCompression
+*/
+
+// Something like a game state update: small values, repeated field layout, slowly changing positions
+static void WriteEntityState( std::vector<unsigned char>& out, RakNetRandom& rnr, int frame, int entity )
+{
+    unsigned char state[24];
+    memset( state, 0, sizeof( state ) );
+    state[0] = (unsigned char)entity;
+    state[1] = 1;
+    state[4] = (unsigned char)( frame / 4 );
+    state[8] = (unsigned char)( entity * 3 );
+    state[12] = (unsigned char)( rnr.RandomMT() & 3 );
+    state[16] = 100;
+    state[20] = (unsigned char)( entity & 1 );
+    out.insert( out.end(), state, state + sizeof( state ) );
+}
+
+static bool RoundTrip( const std::vector<unsigned char>& input, unsigned int* compressedLength )
+{
+    std::vector<unsigned char> compressed( LZCompressBound( (unsigned int)input.size() ) );
+    std::vector<unsigned char> decompressed( input.size() + 1 );
+    *compressedLength = LZCompress( input.data(), (unsigned int)input.size(), compressed.data(), (unsigned int)compressed.size() );
+    if( *compressedLength == 0 )
+        return false;
+    unsigned int decompressedLength;
+    if( LZDecompress( compressed.data(), *compressedLength, decompressed.data(), (unsigned int)decompressed.size(), &decompressedLength ) == false )
+        return false;
+    return decompressedLength == input.size() && memcmp( decompressed.data(), input.data(), input.size() ) == 0;
+}
+
+static bool ConnectAndWait( RakPeerInterface* client, unsigned short port )
+{
+    client->Connect( "127.0.0.1", port, 0, 0 );
+    Packet* packet = CommonFunctions::WaitAndReturnMessageWithID( client, ID_CONNECTION_REQUEST_ACCEPTED, 5000 );
+    if( packet == 0 )
+        return false;
+    client->DeallocatePacket( packet );
+    return true;
+}
+
+int DatagramCompressionTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Testing LZ round trips\n" );
+
+    RakNetRandom rnr;
+    rnr.SeedMT( 12345 );
+
+    std::vector<unsigned char> gameState;
+    for( int entity = 0; entity < 60; entity++ )
+        WriteEntityState( gameState, rnr, 0, entity );
+
+    std::vector<unsigned char> random( 1400 );
+    for( unsigned char& c : random )
+        c = (unsigned char)rnr.RandomMT();
+
+    std::vector<unsigned char> repeated( 5000, 'a' );
+    std::vector<unsigned char> empty;
+
+    unsigned int gameStateLength, randomLength, repeatedLength, emptyLength;
+    if( !RoundTrip( gameState, &gameStateLength ) || !RoundTrip( random, &randomLength ) || !RoundTrip( repeated, &repeatedLength ) || !RoundTrip( empty, &emptyLength ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "LZ round trip failed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    // Lengths 0 to 300 catch the edge cases around the minimum match and the end of the input
+    for( unsigned int length = 0; length < 300; length++ )
+    {
+        std::vector<unsigned char> prefix( gameState.begin(), gameState.begin() + length );
+        unsigned int prefixLength;
+        if( !RoundTrip( prefix, &prefixLength ) )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "LZ round trip failed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 1;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Game state %u -> %u bytes, random %u -> %u bytes, repeated %u -> %u bytes\n", (unsigned int)gameState.size(), gameStateLength, (unsigned int)random.size(), randomLength, (unsigned int)repeated.size(), repeatedLength );
+
+    if( gameStateLength >= gameState.size() / 2 || randomLength > LZCompressBound( (unsigned int)random.size() ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "LZ did not compress as expected\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    // Random data must not fit when the output may not be larger than the input
+    unsigned char output[2048];
+    if( LZCompress( random.data(), (unsigned int)random.size(), output, (unsigned int)random.size() - 1 ) != 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "LZ did not compress as expected\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( isVerbose )
+        printf( "Testing malformed input is rejected\n" );
+
+    // Truncations and a random stream must fail or stay in bounds, never crash
+    unsigned char compressed[2048];
+    unsigned int compressedLength = LZCompress( gameState.data(), (unsigned int)gameState.size(), compressed, sizeof( compressed ) );
+    unsigned int decompressedLength;
+    bool acceptedMalformed = false;
+    for( unsigned int length = 1; length < compressedLength; length++ )
+    {
+        if( LZDecompress( compressed, length, output, sizeof( output ), &decompressedLength ) && decompressedLength == gameState.size() )
+            acceptedMalformed = true;
+    }
+    if( LZDecompress( compressed, compressedLength, output, (unsigned int)gameState.size() - 1, &decompressedLength ) )
+        acceptedMalformed = true;
+    for( int i = 0; i < 1000; i++ )
+    {
+        unsigned char garbage[64];
+        for( unsigned char& c : garbage )
+            c = (unsigned char)rnr.RandomMT();
+        LZDecompress( garbage, sizeof( garbage ), output, sizeof( output ), &decompressedLength );
+    }
+    if( acceptedMalformed )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Malformed input was accepted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    if( isVerbose )
+    {
+        const int passes = 20000;
+        unsigned int size = 1200;
+        volatile unsigned int sink = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for( int i = 0; i < passes; i++ )
+            sink = sink + LZCompress( gameState.data(), size, compressed, sizeof( compressed ) );
+        double compressSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        compressedLength = LZCompress( gameState.data(), size, compressed, sizeof( compressed ) );
+        start = std::chrono::steady_clock::now();
+        for( int i = 0; i < passes; i++ )
+        {
+            LZDecompress( compressed, compressedLength, output, sizeof( output ), &decompressedLength );
+            sink = sink + decompressedLength;
+        }
+        double decompressSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        printf( "Compress %.0f MB/s, decompress %.0f MB/s on %u byte datagrams\n", (double)passes * size / ( 1024.0 * 1024.0 ) / compressSeconds, (double)passes * size / ( 1024.0 * 1024.0 ) / decompressSeconds, size );
+    }
+
+    if( isVerbose )
+        printf( "Testing reliable ordered sends with compression\n" );
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    destroyList.push_back( server );
+    RakPeerInterface* client = RakPeerInterface::GetInstance();
+    destroyList.push_back( client );
+
+    server->SetDatagramCompression( true );
+    client->SetDatagramCompression( true );
+    if( client->GetDatagramCompression() == false )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "GetDatagramCompression did not return what was set\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 4;
+    }
+
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 2, &serverSocketDescriptor, 1 );
+    server->SetMaximumIncomingConnections( 2 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( client, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 5;
+    }
+
+    // Frames of entity updates, plus some random messages that do not compress
+    const int frameCount = 300;
+    const int entitiesPerFrame = 20;
+    std::vector<std::vector<unsigned char>> sent;
+    for( int frame = 0; frame < frameCount; frame++ )
+    {
+        std::vector<unsigned char> message;
+        message.push_back( (MessageID)ID_USER_PACKET_ENUM );
+        if( frame % 10 == 9 )
+        {
+            for( int i = 0; i < 200; i++ )
+                message.push_back( (unsigned char)rnr.RandomMT() );
+        }
+        else
+        {
+            for( int entity = 0; entity < entitiesPerFrame; entity++ )
+                WriteEntityState( message, rnr, frame, entity );
+        }
+        client->Send( (const char*)message.data(), (int)message.size(), HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+        sent.push_back( message );
+    }
+
+    size_t nextExpected = 0;
+    bool corruptMessage = false;
+    TimeMS stopWaiting = GetTimeMS() + 10000;
+    while( nextExpected < sent.size() && corruptMessage == false && GetTimeMS() < stopWaiting )
+    {
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() )
+        {
+            if( packet->data[0] != ID_USER_PACKET_ENUM )
+                continue;
+
+            if( nextExpected >= sent.size() || packet->length != sent[nextExpected].size() || memcmp( packet->data, sent[nextExpected].data(), packet->length ) != 0 )
+                corruptMessage = true;
+            nextExpected++;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    if( corruptMessage || nextExpected != sent.size() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Messages were lost or arrived corrupted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    RakNetStatistics clientStatistics, serverStatistics;
+    client->GetStatistics( server->GetMyBoundAddress(), &clientStatistics );
+    server->GetStatistics( client->GetMyBoundAddress(), &serverStatistics );
+    if( isVerbose )
+    {
+        printf( "Compressed %" PRINTF_64_BIT_MODIFIER "u -> %" PRINTF_64_BIT_MODIFIER "u bytes, ratio %.2f, %" PRINTF_64_BIT_MODIFIER "u us compressing, %" PRINTF_64_BIT_MODIFIER "u us decompressing\n",
+                (long long unsigned int)clientStatistics.compressionInputBytes, (long long unsigned int)clientStatistics.compressionOutputBytes,
+                clientStatistics.compressionRatio, (long long unsigned int)clientStatistics.compressionTimeUS, (long long unsigned int)serverStatistics.decompressionTimeUS );
+    }
+
+    if( clientStatistics.compressionInputBytes == 0 || clientStatistics.compressionRatio <= 1.0f )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Statistics do not show compression\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 7;
+    }
+
+    if( isVerbose )
+        printf( "Testing connecting without compression to a system that has it\n" );
+
+    RakPeerInterface* legacyClient = RakPeerInterface::GetInstance();
+    destroyList.push_back( legacyClient );
+    SocketDescriptor legacyClientSocketDescriptor;
+    legacyClient->Startup( 1, &legacyClientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( legacyClient, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without compression could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 8;
+    }
+
+    legacyClient->Send( (const char*)sent[0].data(), (int)sent[0].size(), HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+    Packet* packet = CommonFunctions::WaitAndReturnMessageWithID( server, ID_USER_PACKET_ENUM, 5000 );
+    if( packet == 0 || packet->length != sent[0].size() || memcmp( packet->data, sent[0].data(), packet->length ) != 0 )
+    {
+        if( packet )
+            server->DeallocatePacket( packet );
+        if( isVerbose )
+            DebugTools::ShowError( "Client without compression could not send\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 9;
+    }
+    server->DeallocatePacket( packet );
+
+    RakNetStatistics legacyStatistics;
+    legacyClient->GetStatistics( server->GetMyBoundAddress(), &legacyStatistics );
+    if( legacyStatistics.compressionInputBytes != 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without compression compressed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 10;
+    }
+
+    return 0;
+}
+
+std::string DatagramCompressionTest::GetTestName() const
+{
+    return "DatagramCompressionTest";
+}
+
+std::string DatagramCompressionTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case  0: return "No error";                                                     break;
+    case  1: return "LZ round trip failed";                                         break;
+    case  2: return "LZ did not compress as expected";                              break;
+    case  3: return "Malformed input was accepted";                                 break;
+    case  4: return "GetDatagramCompression did not return what was set";          break;
+    case  5: return "Client could not connect";                                     break;
+    case  6: return "Messages were lost or arrived corrupted";                      break;
+    case  7: return "Statistics do not show compression";                           break;
+    case  8: return "Client without compression could not connect";                 break;
+    case  9: return "Client without compression could not send";                    break;
+    case 10: return "Client without compression compressed";                        break;
+    default: return "Undefined Error";                                              break;
+    }
+    // clang-format on
+}
+
+DatagramCompressionTest::DatagramCompressionTest( void )
+{
+}
+
+DatagramCompressionTest::~DatagramCompressionTest( void )
+{
+}
+
+void DatagramCompressionTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
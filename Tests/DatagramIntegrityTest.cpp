@@ -0,0 +1,348 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DatagramIntegrityTest.h"
+
+#include "CRC32C.h"
+#include "DR_SHA1.h"
+#include "Rand.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/*
+Description:
+Tests the CRC32C datagram integrity check
+
+Success conditions:
+CRC32C matches the reference value and the hardware and portable implementations agree
+Reliable ordered messages arrive intact while datagrams are being corrupted on the wire
+A system with the check disabled can still connect to one that has it enabled
+
+Failure conditions:
+Any of the above fails
+
+RakPeerInterface Functions used, tested indirectly by its use:
+Startup
+SetMaximumIncomingConnections
+Connect
+Receive
+DeallocatePacket
+Send
+AttachPlugin
+SetIncomingDatagramEventHandler
+
+RakPeerInterface Functions Explicitly Tested:
+SetDatagramIntegrityCheck
+GetDatagramIntegrityCheck
+*/
+
+// Corrupts one byte of every 8th datagram once the connection is up
+static std::atomic<bool> corruptDatagrams( false );
+static std::atomic<int> datagramsCorrupted( 0 );
+static std::atomic<int> datagramsSeen( 0 );
+
+static bool CorruptingDatagramHandler( RNS2RecvStruct* recvStruct )
+{
+    if( corruptDatagrams && recvStruct->bytesRead > 1 && ( ++datagramsSeen % 8 ) == 0 )
+    {
+        // Skip the first byte so the datagram is still recognized as a connected datagram
+        int index = 1 + datagramsSeen % ( recvStruct->bytesRead - 1 );
+        recvStruct->data[index] ^= 0x5A;
+        ++datagramsCorrupted;
+    }
+    return true;
+}
+
+class ChecksumFailureCounter : public PluginInterface2
+{
+public:
+    ChecksumFailureCounter()
+    : checksumFailures( 0 )
+    {
+    }
+    bool UsesReliabilityLayer( void ) const { return true; }
+    void OnReliabilityLayerNotification( const char* errorMessage, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress, bool isError )
+    {
+        (void)bitsUsed;
+        (void)remoteSystemAddress;
+        (void)isError;
+        if( strcmp( errorMessage, "CheckDatagramChecksum failed" ) == 0 )
+            ++checksumFailures;
+    }
+    std::atomic<int> checksumFailures;
+};
+
+static double MegabytesPerSecond( size_t bytes, std::chrono::steady_clock::duration elapsed )
+{
+    double seconds = std::chrono::duration<double>( elapsed ).count();
+    return seconds > 0.0 ? (double)bytes / ( 1024.0 * 1024.0 ) / seconds : 0.0;
+}
+
+static bool ConnectAndWait( RakPeerInterface* client, unsigned short port )
+{
+    client->Connect( "127.0.0.1", port, 0, 0 );
+    Packet* packet = CommonFunctions::WaitAndReturnMessageWithID( client, ID_CONNECTION_REQUEST_ACCEPTED, 5000 );
+    if( packet == 0 )
+        return false;
+    client->DeallocatePacket( packet );
+    return true;
+}
+
+int DatagramIntegrityTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Testing CRC32C reference value\n" );
+
+    const unsigned char check[] = "123456789";
+    if( CRC32C( check, 9 ) != 0xE3069283 || CRC32CPortable( check, 9 ) != 0xE3069283 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "CRC32C does not match the reference value\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Testing hardware and portable CRC32C agree (hardware %s)\n", CRC32CIsHardwareAccelerated() ? "available" : "not available" );
+
+    const unsigned int bufferSize = 1024 * 1024;
+    std::vector<unsigned char> buffer( bufferSize );
+    RakNetRandom rnr;
+    rnr.SeedMT( 12345 );
+    for( unsigned char& c : buffer )
+        c = (unsigned char)rnr.RandomMT();
+
+    for( unsigned int offset = 0; offset < 16; offset++ )
+    {
+        for( unsigned int length = 0; length < 300; length++ )
+        {
+            const unsigned char* data = &buffer[offset];
+            uint32_t whole = CRC32C( data, length );
+            if( whole != CRC32CPortable( data, length ) || whole != CRC32C( data + length / 3, length - length / 3, CRC32C( data, length / 3 ) ) )
+            {
+                if( isVerbose )
+                    DebugTools::ShowError( "Hardware and portable CRC32C differ\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+                return 2;
+            }
+        }
+    }
+
+    if( isVerbose )
+    {
+        const int passes = 64;
+        volatile uint32_t sink = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for( int i = 0; i < passes; i++ )
+            sink = sink + CRC32C( &buffer[0], bufferSize );
+        double crcSpeed = MegabytesPerSecond( (size_t)passes * bufferSize, std::chrono::steady_clock::now() - start );
+
+        start = std::chrono::steady_clock::now();
+        for( int i = 0; i < passes; i++ )
+            sink = sink + CRC32CPortable( &buffer[0], bufferSize );
+        double portableSpeed = MegabytesPerSecond( (size_t)passes * bufferSize, std::chrono::steady_clock::now() - start );
+
+        start = std::chrono::steady_clock::now();
+        for( int i = 0; i < passes; i++ )
+        {
+            CSHA1 sha1;
+            sha1.Reset();
+            sha1.Update( &buffer[0], bufferSize );
+            sha1.Final();
+            sink = sink + sha1.GetHash()[0];
+        }
+        double sha1Speed = MegabytesPerSecond( (size_t)passes * bufferSize, std::chrono::steady_clock::now() - start );
+
+        printf( "CRC32C %.0f MB/s, CRC32C portable %.0f MB/s, SHA1 %.0f MB/s\n", crcSpeed, portableSpeed, sha1Speed );
+    }
+
+    if( isVerbose )
+        printf( "Testing reliable ordered sends over a corrupting link\n" );
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    destroyList.push_back( server );
+    RakPeerInterface* client = RakPeerInterface::GetInstance();
+    destroyList.push_back( client );
+
+    // Must outlive the peers, so deleted in DestroyPeers()
+    ChecksumFailureCounter* serverFailures = new ChecksumFailureCounter;
+    pluginList.push_back( serverFailures );
+    ChecksumFailureCounter* clientFailures = new ChecksumFailureCounter;
+    pluginList.push_back( clientFailures );
+    server->AttachPlugin( serverFailures );
+    client->AttachPlugin( clientFailures );
+
+    server->SetDatagramIntegrityCheck( true );
+    client->SetDatagramIntegrityCheck( true );
+    if( server->GetDatagramIntegrityCheck() == false )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "GetDatagramIntegrityCheck did not return what was set\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 2, &serverSocketDescriptor, 1 );
+    server->SetMaximumIncomingConnections( 2 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( client, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 4;
+    }
+
+    datagramsCorrupted = 0;
+    datagramsSeen = 0;
+    server->SetIncomingDatagramEventHandler( CorruptingDatagramHandler );
+    client->SetIncomingDatagramEventHandler( CorruptingDatagramHandler );
+    corruptDatagrams = true;
+
+    const int messageCount = 500;
+    const int messageLength = 200;
+    for( int i = 0; i < messageCount; i++ )
+    {
+        BitStream bsOut;
+        bsOut.Write( (MessageID)ID_USER_PACKET_ENUM );
+        bsOut.Write( i );
+        for( int j = 0; j < messageLength; j++ )
+            bsOut.Write( (unsigned char)( i + j ) );
+        client->Send( &bsOut, HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+    }
+
+    int nextExpected = 0;
+    bool corruptMessage = false;
+    TimeMS stopWaiting = GetTimeMS() + 10000;
+    while( nextExpected < messageCount && corruptMessage == false && GetTimeMS() < stopWaiting )
+    {
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() )
+        {
+            if( packet->data[0] != ID_USER_PACKET_ENUM )
+                continue;
+
+            BitStream bsIn( packet->data, packet->length, false );
+            bsIn.IgnoreBytes( sizeof( MessageID ) );
+            int index = -1;
+            bsIn.Read( index );
+            if( index != nextExpected || packet->length != sizeof( MessageID ) + sizeof( int ) + messageLength )
+                corruptMessage = true;
+            for( int j = 0; j < messageLength && corruptMessage == false; j++ )
+            {
+                unsigned char c;
+                bsIn.Read( c );
+                if( c != (unsigned char)( index + j ) )
+                    corruptMessage = true;
+            }
+            nextExpected++;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    corruptDatagrams = false;
+    // Let datagrams that were corrupted in flight reach the reliability layer
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+
+    int checksumFailures = serverFailures->checksumFailures + clientFailures->checksumFailures;
+    if( isVerbose )
+        printf( "Corrupted %i datagrams, %i rejected\n", datagramsCorrupted.load(), checksumFailures );
+
+    if( corruptMessage || nextExpected != messageCount )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Messages were lost or arrived corrupted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 5;
+    }
+
+    if( datagramsCorrupted == 0 || checksumFailures != datagramsCorrupted )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Not every corrupted datagram was rejected\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    if( isVerbose )
+        printf( "Testing connecting without the check to a system that has it\n" );
+
+    RakPeerInterface* legacyClient = RakPeerInterface::GetInstance();
+    destroyList.push_back( legacyClient );
+    SocketDescriptor legacyClientSocketDescriptor;
+    legacyClient->Startup( 1, &legacyClientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( legacyClient, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without the check could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 7;
+    }
+
+    BitStream bsOut;
+    bsOut.Write( (MessageID)( ID_USER_PACKET_ENUM + 1 ) );
+    legacyClient->Send( &bsOut, HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+    if( !CommonFunctions::WaitForMessageWithID( server, ID_USER_PACKET_ENUM + 1, 5000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without the check could not send\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 8;
+    }
+
+    return 0;
+}
+
+std::string DatagramIntegrityTest::GetTestName() const
+{
+    return "DatagramIntegrityTest";
+}
+
+std::string DatagramIntegrityTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case  0: return "No error";                                                     break;
+    case  1: return "CRC32C does not match the reference value";                    break;
+    case  2: return "Hardware and portable CRC32C differ";                          break;
+    case  3: return "GetDatagramIntegrityCheck did not return what was set";       break;
+    case  4: return "Client could not connect";                                     break;
+    case  5: return "Messages were lost or arrived corrupted";                      break;
+    case  6: return "Not every corrupted datagram was rejected";                    break;
+    case  7: return "Client without the check could not connect";                   break;
+    case  8: return "Client without the check could not send";                      break;
+    default: return "Undefined Error";                                              break;
+    }
+    // clang-format on
+}
+
+DatagramIntegrityTest::DatagramIntegrityTest( void )
+{
+}
+
+DatagramIntegrityTest::~DatagramIntegrityTest( void )
+{
+}
+
+void DatagramIntegrityTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+
+    for( PluginInterface2* pPlugin : pluginList )
+    {
+        delete pPlugin;
+    }
+    pluginList.clear();
+}
@@ -0,0 +1,326 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DeltaSnapshotTest.h"
+
+#include "DeltaSnapshot.h"
+#include "Rand.h"
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+/*
+Description:
+Sends snapshots of a game world with DeltaSnapshotSender and DeltaSnapshotReceiver, first with simulated loss and acknowledgements, then between two systems,
+and compares the bandwidth to sending every snapshot in full
+
+Success conditions:
+Every snapshot that arrives reads back as sent
+Deltas take less than half the bandwidth of full snapshots
+Snapshots are sent in full before anything is acknowledged, and again once acknowledgements stop for longer than the baselines kept
+A delta whose baseline the receiver does not have is rejected
+Between two systems, ID_SND_RECEIPT_ACKED moves the baseline forward and the snapshots arrive intact
+
+Failure conditions:
+Any of the above fails
+
+RakPeerInterface Functions used, tested indirectly by its use:
+Startup
+SetMaximumIncomingConnections
+Connect
+Receive
+DeallocatePacket
+Send
+GetMyGUID
+
+RakPeerInterface Functions Explicitly Tested:
+None
+*/
+
+struct DeltaEntity
+{
+    uint32_t id;
+    float position[3];
+    float yaw;
+    uint16_t health;
+    uint8_t animation;
+    bool isFiring;
+};
+RAKNET_SERIALIZABLE( DeltaEntity, id, position, yaw, health, animation, isFiring )
+
+struct DeltaWorld
+{
+    uint32_t tick;
+    DeltaEntity entities[32];
+};
+RAKNET_SERIALIZABLE( DeltaWorld, tick, entities )
+
+static void CreateWorld( DeltaWorld* world )
+{
+    memset( world, 0, sizeof( *world ) );
+    for( uint32_t i = 0; i < 32; i++ )
+    {
+        world->entities[i].id = 1000 + i;
+        world->entities[i].position[0] = (float)i * 10.0f;
+        world->entities[i].health = 100;
+    }
+}
+
+// A few entities move each tick, and now and then one is hurt or changes animation
+static void Simulate( DeltaWorld* world, RakNetRandom* rnr )
+{
+    world->tick++;
+    for( int i = 0; i < 4; i++ )
+    {
+        DeltaEntity& entity = world->entities[rnr->RandomMT() % 32];
+        entity.position[0] += rnr->FrandomMT() - 0.5f;
+        entity.position[2] += rnr->FrandomMT() - 0.5f;
+        entity.yaw = rnr->FrandomMT() * 360.0f;
+        entity.isFiring = rnr->FrandomMT() < 0.2f;
+    }
+    if( rnr->FrandomMT() < 0.1f )
+    {
+        DeltaEntity& entity = world->entities[rnr->RandomMT() % 32];
+        entity.health = entity.health > 10 ? entity.health - 10 : 100;
+        entity.animation = (uint8_t)( rnr->RandomMT() % 8 );
+    }
+}
+
+static BitSize_t FullSnapshotBits( const DeltaWorld& world )
+{
+    BitStream bitStream;
+    bitStream.Write( world );
+    return bitStream.GetNumberOfBitsUsed();
+}
+
+int DeltaSnapshotTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    RakNetRandom rnr;
+    rnr.SeedMT( 1 );
+
+    if( isVerbose )
+        printf( "Sending snapshots with 10%% loss and acknowledgements 3 ticks late\n" );
+
+    const unsigned int maxBaselines = 32;
+    const int tickCount = 1000, outageStart = 500, outageEnd = 560;
+    const RakNetGUID clientGuid( 1 );
+    DeltaSnapshotSender<DeltaWorld> sender( maxBaselines );
+    DeltaSnapshotReceiver<DeltaWorld> receiver( maxBaselines );
+    DeltaWorld world;
+    CreateWorld( &world );
+
+    struct PendingAcknowledgement
+    {
+        int tick;
+        uint32_t sendReceipt;
+    };
+    std::deque<PendingAcknowledgement> acknowledgements;
+    uint64_t fullBits = 0, sentBits = 0;
+    bool readBackAsSent = true, firstWasFull = false, fullDuringOutage = false;
+    for( int tick = 0; tick < tickCount; tick++ )
+    {
+        Simulate( &world, &rnr );
+
+        BitStream bitStream;
+        const uint32_t sequence = sender.Write( world, clientGuid, &bitStream );
+        const uint32_t sendReceipt = tick + 1;
+        sender.SetSendReceipt( clientGuid, sequence, sendReceipt );
+
+        const BitSize_t full = FullSnapshotBits( world );
+        fullBits += full;
+        sentBits += bitStream.GetNumberOfBitsUsed();
+        if( tick == 0 )
+            firstWasFull = bitStream.GetNumberOfBitsUsed() >= full;
+        if( tick == outageEnd - 1 )
+            fullDuringOutage = bitStream.GetNumberOfBitsUsed() >= full;
+
+        if( rnr.FrandomMT() >= 0.1f )
+        {
+            DeltaWorld received;
+            uint32_t receivedSequence;
+            if( receiver.Read( &bitStream, &received, &receivedSequence ) == false || receivedSequence != sequence ||
+                DeltaSnapshotCodec::Equals( received, world ) == false )
+                readBackAsSent = false;
+
+            // The acknowledgements of a whole stretch are lost
+            if( tick < outageStart || tick >= outageEnd )
+                acknowledgements.push_back( { tick + 3, sendReceipt } );
+        }
+
+        while( !acknowledgements.empty() && acknowledgements.front().tick <= tick )
+        {
+            sender.OnAcknowledged( clientGuid, acknowledgements.front().sendReceipt );
+            acknowledgements.pop_front();
+        }
+    }
+
+    if( isVerbose )
+        printf( "Full snapshots %u bytes, deltas %u bytes, %.1f%% saved\n", (unsigned int)BITS_TO_BYTES( fullBits ), (unsigned int)BITS_TO_BYTES( sentBits ),
+                100.0 - 100.0 * sentBits / fullBits );
+
+    if( !readBackAsSent )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A snapshot did not read back as sent\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( sentBits * 2 >= fullBits )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Deltas did not save at least half the bandwidth\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( !firstWasFull || !fullDuringOutage )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Snapshots were not sent in full without acknowledgements\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    // A receiver that has not seen the baseline, as after reconnecting
+    {
+        BitStream bitStream;
+        sender.Write( world, clientGuid, &bitStream );
+        DeltaSnapshotReceiver<DeltaWorld> newReceiver( maxBaselines );
+        DeltaWorld received;
+        if( newReceiver.Read( &bitStream, &received ) )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A delta against an unknown baseline was accepted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 4;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Sending snapshots between two systems\n" );
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    destroyList.push_back( server );
+    RakPeerInterface* client = RakPeerInterface::GetInstance();
+    destroyList.push_back( client );
+
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 2, &serverSocketDescriptor, 1 );
+    server->SetMaximumIncomingConnections( 2 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+
+    client->Connect( "127.0.0.1", 60000, 0, 0 );
+    Packet* accepted = CommonFunctions::WaitAndReturnMessageWithID( client, ID_CONNECTION_REQUEST_ACCEPTED, 10000 );
+    if( accepted == 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 5;
+    }
+    client->DeallocatePacket( accepted );
+
+    DeltaSnapshotSender<DeltaWorld> serverSender( maxBaselines );
+    DeltaSnapshotReceiver<DeltaWorld> clientReceiver( maxBaselines );
+    const RakNetGUID remoteClientGuid = client->GetMyGUID();
+    CreateWorld( &world );
+
+    const int snapshotCount = 200;
+    std::vector<DeltaWorld> sentWorlds;
+    uint64_t networkFullBytes = 0, networkSentBytes = 0;
+    int receivedCount = 0, acknowledgedCount = 0;
+    bool networkReadBackAsSent = true;
+    for( int i = 0; i < snapshotCount + 20; i++ )
+    {
+        if( i < snapshotCount )
+        {
+            Simulate( &world, &rnr );
+            sentWorlds.push_back( world );
+            serverSender.Send( world, server, remoteClientGuid, ID_USER_PACKET_ENUM );
+            networkFullBytes += 1 + BITS_TO_BYTES( FullSnapshotBits( world ) );
+        }
+
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() )
+        {
+            if( serverSender.OnReceive( packet ) )
+                acknowledgedCount++;
+        }
+
+        for( Packet* packet = client->Receive(); packet; client->DeallocatePacket( packet ), packet = client->Receive() )
+        {
+            if( packet->data[0] != ID_USER_PACKET_ENUM )
+                continue;
+
+            networkSentBytes += packet->length;
+            BitStream bitStream( packet->data, packet->length, false );
+            bitStream.IgnoreBytes( sizeof( MessageID ) );
+            DeltaWorld received;
+            uint32_t sequence;
+            if( clientReceiver.Read( &bitStream, &received, &sequence ) == false || sequence >= sentWorlds.size() ||
+                DeltaSnapshotCodec::Equals( received, sentWorlds[sequence] ) == false )
+                networkReadBackAsSent = false;
+            receivedCount++;
+        }
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    if( isVerbose )
+        printf( "%d of %d snapshots arrived, %d acknowledged, full %u bytes, sent %u bytes, %.1f%% saved\n", receivedCount, snapshotCount, acknowledgedCount,
+                (unsigned int)networkFullBytes, (unsigned int)networkSentBytes, 100.0 - 100.0 * networkSentBytes / networkFullBytes );
+
+    if( !networkReadBackAsSent || receivedCount < snapshotCount / 2 || acknowledgedCount == 0 || networkSentBytes * 2 >= networkFullBytes )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Snapshots between two systems did not arrive intact as deltas\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    return 0;
+}
+
+std::string DeltaSnapshotTest::GetTestName() const
+{
+    return "DeltaSnapshotTest";
+}
+
+std::string DeltaSnapshotTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                          break;
+    case 1: return "A snapshot did not read back as sent";                              break;
+    case 2: return "Deltas did not save at least half the bandwidth";                   break;
+    case 3: return "Snapshots were not sent in full without acknowledgements";          break;
+    case 4: return "A delta against an unknown baseline was accepted";                  break;
+    case 5: return "Client could not connect";                                          break;
+    case 6: return "Snapshots between two systems did not arrive intact as deltas";     break;
+    default: return "Undefined Error";                                                  break;
+    }
+    // clang-format on
+}
+
+DeltaSnapshotTest::DeltaSnapshotTest( void )
+{
+}
+
+DeltaSnapshotTest::~DeltaSnapshotTest( void )
+{
+}
+
+void DeltaSnapshotTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
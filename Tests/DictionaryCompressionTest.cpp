@@ -0,0 +1,494 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "DictionaryCompressionTest.h"
+
+#include "CompressionDictionary.h"
+#include "LZCompressor.h"
+#include "RakNetStatistics.h"
+#include "Rand.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+/*
+Description:
+Tests compressing small messages against a shared dictionary
+
+Success conditions:
+LZ with a dictionary round trips, including matches that reach into the dictionary, and malformed data is rejected
+A dictionary trained from sample messages compresses new messages better than compressing them on their own
+A client without the dictionary receives it while connecting, messages arrive intact in both directions, and the per message ID ratio is above 1
+A client that already has the dictionary uses it right away, and a client without dictionary compression still connects
+At MTU 400, messages that are larger than a datagram whether compressed or not arrive intact
+
+Failure conditions:
+Any of the above fails
+
+RakPeerInterface Functions used, tested indirectly by its use:
+Startup
+SetMaximumIncomingConnections
+Connect
+Receive
+DeallocatePacket
+Send
+GetStatistics
+
+RakPeerInterface Functions Explicitly Tested:
+SetDictionaryCompression
+GetDictionaryCompression
+SetCompressionDictionary
+GetCompressionDictionaryID
+SetCompressionDictionaryTrainer
+SetPathMTUDiscovery
+*/
+
+static const char* const playerNames[] = { "Ardent", "Bramble", "Cinder", "Dusk", "Ember", "Fable", "Gale", "Harrow" };
+
+// Small messages of the kind a game sends: entity updates and chat, sharing layouts and strings but not much within one message
+static void MakeMessage( std::vector<unsigned char>& message, RakNetRandom& rnr, int index )
+{
+    message.clear();
+    if( index % 4 == 3 )
+    {
+        message.push_back( (MessageID)( ID_USER_PACKET_ENUM + 1 ) );
+        const char* name = playerNames[rnr.RandomMT() % 8];
+        char text[96];
+        sprintf( text, "%s: gg, meet at the north gate after the round", name );
+        message.insert( message.end(), text, text + strlen( text ) );
+    }
+    else
+    {
+        message.push_back( (MessageID)ID_USER_PACKET_ENUM );
+        unsigned short entity = (unsigned short)( 1000 + rnr.RandomMT() % 16 );
+        unsigned char update[32] = { 0x01, 0x00, 0x00, 0x10, 0x7F, 0x3F, 0x00, 0x00, 0x80, 0x3F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x20, 0x41, 0x02, 0x00, 0x64, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x01, 0x00, 0x00 };
+        memcpy( update + 1, &entity, sizeof( entity ) );
+        update[6] = (unsigned char)rnr.RandomMT();
+        update[12] = (unsigned char)rnr.RandomMT();
+        message.insert( message.end(), update, update + sizeof( update ) );
+    }
+}
+
+// 337 to 511 bytes, from mostly dictionary to mostly random, so that compressed some fit in one datagram at MTU 400 and some do not
+static void MakeLargeMessage( std::vector<unsigned char>& message, RakNetRandom& rnr, const std::vector<unsigned char>& dictionary, int index )
+{
+    const unsigned int length = 337 + index % 175;
+    const unsigned int randomPercent = index * 7 % 100;
+    message.assign( 1, (MessageID)( ID_USER_PACKET_ENUM + 2 ) );
+    while( message.size() < length )
+    {
+        if( rnr.RandomMT() % 100 < randomPercent )
+            message.push_back( (unsigned char)rnr.RandomMT() );
+        else
+        {
+            unsigned int start = rnr.RandomMT() % ( (unsigned int)dictionary.size() - 32 );
+            message.insert( message.end(), dictionary.begin() + start, dictionary.begin() + start + 32 );
+        }
+    }
+    message.resize( length );
+}
+
+// Connection requests are padded to find the MTU during the handshake, so only datagrams of a connection are held to MINIMUM_MTU_SIZE
+static bool MinimumMTUPath( RNS2RecvStruct* recvStruct )
+{
+    const bool isConnected = ( recvStruct->data[0] & 0x80 ) != 0;
+    return isConnected == false || recvStruct->bytesRead + UDP_HEADER_SIZE <= MINIMUM_MTU_SIZE;
+}
+
+// Waits for path MTU discovery to bring both directions of the connection down to MINIMUM_MTU_SIZE
+static bool WaitForMinimumMTU( RakPeerInterface* client, RakPeerInterface* server, TimeMS timeout )
+{
+    TimeMS stopWaiting = GetTimeMS() + timeout;
+    while( GetTimeMS() < stopWaiting )
+    {
+        if( client->GetMTUSize( server->GetMyBoundAddress() ) == MINIMUM_MTU_SIZE && server->GetMTUSize( client->GetMyBoundAddress() ) == MINIMUM_MTU_SIZE )
+            return true;
+
+        // Keep the receive queues drained
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() ) {}
+        for( Packet* packet = client->Receive(); packet; client->DeallocatePacket( packet ), packet = client->Receive() ) {}
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+    return false;
+}
+
+static bool DictionaryRoundTrip( const CompressionDictionary& dictionary, const std::vector<unsigned char>& input, unsigned int* compressedLength )
+{
+    unsigned char compressed[2048];
+    unsigned char decompressed[2048];
+    *compressedLength = dictionary.Compress( input.data(), (unsigned int)input.size(), compressed, sizeof( compressed ) );
+    if( *compressedLength == 0 )
+        return false;
+    unsigned int decompressedLength;
+    if( dictionary.Decompress( compressed, *compressedLength, decompressed, sizeof( decompressed ), &decompressedLength ) == false )
+        return false;
+    return decompressedLength == input.size() && memcmp( decompressed, input.data(), input.size() ) == 0;
+}
+
+static bool ConnectAndWait( RakPeerInterface* client, unsigned short port )
+{
+    client->Connect( "127.0.0.1", port, 0, 0 );
+    Packet* packet = CommonFunctions::WaitAndReturnMessageWithID( client, ID_CONNECTION_REQUEST_ACCEPTED, 5000 );
+    if( packet == 0 )
+        return false;
+    client->DeallocatePacket( packet );
+    return true;
+}
+
+// Send messages from sender to receiver and check they arrive intact and in order
+static bool SendAndVerify( RakPeerInterface* sender, RakPeerInterface* receiver, const std::vector<std::vector<unsigned char>>& sent )
+{
+    const int messageCount = (int)sent.size();
+    for( const std::vector<unsigned char>& message : sent )
+        sender->Send( (const char*)message.data(), (int)message.size(), HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+
+    int nextExpected = 0;
+    TimeMS stopWaiting = GetTimeMS() + 10000;
+    while( nextExpected < messageCount && GetTimeMS() < stopWaiting )
+    {
+        for( Packet* packet = receiver->Receive(); packet; receiver->DeallocatePacket( packet ), packet = receiver->Receive() )
+        {
+            if( packet->data[0] < ID_USER_PACKET_ENUM )
+                continue;
+
+            if( nextExpected >= messageCount || packet->length != sent[nextExpected].size() || memcmp( packet->data, sent[nextExpected].data(), packet->length ) != 0 )
+            {
+                receiver->DeallocatePacket( packet );
+                return false;
+            }
+            nextExpected++;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+    return nextExpected == messageCount;
+}
+
+static bool SendAndVerify( RakPeerInterface* sender, RakPeerInterface* receiver, RakNetRandom& rnr, int messageCount )
+{
+    std::vector<std::vector<unsigned char>> sent( messageCount );
+    for( int i = 0; i < messageCount; i++ )
+        MakeMessage( sent[i], rnr, i );
+    return SendAndVerify( sender, receiver, sent );
+}
+
+int DictionaryCompressionTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Testing LZ round trips with a dictionary\n" );
+
+    RakNetRandom rnr;
+    rnr.SeedMT( 12345 );
+
+    std::vector<unsigned char> dictionaryData( 3000 );
+    for( unsigned char& c : dictionaryData )
+        c = (unsigned char)rnr.RandomMT();
+    CompressionDictionary randomDictionary( dictionaryData.data(), (unsigned int)dictionaryData.size() );
+
+    // Pieces of the dictionary, including its very start and end, mixed with new data and repeats of the input itself
+    for( unsigned int length = 0; length < 400; length++ )
+    {
+        std::vector<unsigned char> input;
+        while( input.size() < length )
+        {
+            unsigned int kind = rnr.RandomMT() % 4;
+            unsigned int pieceLength = 1 + rnr.RandomMT() % 40;
+            if( kind == 0 )
+            {
+                unsigned int start = rnr.RandomMT() % ( (unsigned int)dictionaryData.size() - pieceLength );
+                input.insert( input.end(), dictionaryData.begin() + start, dictionaryData.begin() + start + pieceLength );
+            }
+            else if( kind == 1 )
+                input.insert( input.end(), dictionaryData.end() - pieceLength, dictionaryData.end() );
+            else if( kind == 2 && input.size() > pieceLength )
+                input.insert( input.end(), input.end() - pieceLength, input.end() - pieceLength / 2 );
+            else
+                input.push_back( (unsigned char)rnr.RandomMT() );
+        }
+        input.resize( length );
+
+        unsigned int compressedLength;
+        if( !DictionaryRoundTrip( randomDictionary, input, &compressedLength ) )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "LZ round trip with a dictionary failed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 1;
+        }
+    }
+
+    // A message that is entirely in the dictionary compresses to almost nothing, and does not decompress without it
+    std::vector<unsigned char> inDictionary( dictionaryData.end() - 200, dictionaryData.end() );
+    unsigned char compressed[1024];
+    unsigned char decompressed[1024];
+    unsigned int compressedLength = randomDictionary.Compress( inDictionary.data(), (unsigned int)inDictionary.size(), compressed, sizeof( compressed ) );
+    unsigned int decompressedLength;
+    if( compressedLength == 0 || compressedLength > 8 || LZDecompress( compressed, compressedLength, decompressed, sizeof( decompressed ), &decompressedLength ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "LZ with a dictionary did not compress as expected\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( isVerbose )
+        printf( "Testing training a dictionary\n" );
+
+    CompressionDictionaryTrainer trainer( 1024 );
+    std::vector<unsigned char> message;
+    for( int i = 0; i < 2000; i++ )
+    {
+        MakeMessage( message, rnr, i );
+        trainer.AddSample( message.data(), (unsigned int)message.size() );
+    }
+
+    std::vector<unsigned char> trained;
+    auto start = std::chrono::steady_clock::now();
+    trainer.Train( 4096, trained );
+    double trainMilliseconds = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    if( trainer.GetSampleCount() != 1024 || trained.empty() || trained.size() > 4096 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Training did not produce a dictionary\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    CompressionDictionary trainedDictionary( trained.data(), (unsigned int)trained.size() );
+    size_t inputBytes = 0, standaloneBytes = 0, dictionaryBytes = 0;
+    for( int i = 0; i < 400; i++ )
+    {
+        MakeMessage( message, rnr, i );
+        unsigned int length;
+        if( !DictionaryRoundTrip( trainedDictionary, message, &length ) )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "LZ round trip with a dictionary failed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 1;
+        }
+        inputBytes += message.size();
+        dictionaryBytes += std::min<size_t>( length, message.size() );
+        unsigned int standaloneLength = LZCompress( message.data(), (unsigned int)message.size(), compressed, sizeof( compressed ) );
+        standaloneBytes += std::min<size_t>( standaloneLength, message.size() );
+    }
+
+    if( isVerbose )
+        printf( "Trained %u byte dictionary from %u samples in %.1f ms. Ratio %.2f with it, %.2f without\n", (unsigned int)trained.size(), trainer.GetSampleCount(), trainMilliseconds,
+                (double)inputBytes / (double)dictionaryBytes, (double)inputBytes / (double)standaloneBytes );
+
+    if( dictionaryBytes * 3 > inputBytes * 2 || dictionaryBytes >= standaloneBytes )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "The trained dictionary does not help\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 4;
+    }
+
+    if( isVerbose )
+        printf( "Testing a client receiving the dictionary while connecting\n" );
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    destroyList.push_back( server );
+    RakPeerInterface* client = RakPeerInterface::GetInstance();
+    destroyList.push_back( client );
+
+    CompressionDictionaryTrainer serverTrainer;
+    server->SetCompressionDictionaryTrainer( &serverTrainer );
+    server->SetDictionaryCompression( true );
+    server->SetCompressionDictionary( trained.data(), (unsigned int)trained.size() );
+    client->SetDictionaryCompression( true );
+    if( client->GetDictionaryCompression() == false || server->GetCompressionDictionaryID() != trainedDictionary.GetID() || client->GetCompressionDictionaryID() != 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Dictionary settings did not return what was set\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 5;
+    }
+
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 4, &serverSocketDescriptor, 1 );
+    server->SetMaximumIncomingConnections( 4 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( client, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    if( client->GetCompressionDictionaryID() != trainedDictionary.GetID() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client did not receive the dictionary\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 7;
+    }
+
+    if( !SendAndVerify( client, server, rnr, 300 ) || !SendAndVerify( server, client, rnr, 300 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Messages were lost or arrived corrupted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 8;
+    }
+
+    RakNetStatistics clientStatistics, serverStatistics;
+    client->GetStatistics( server->GetMyBoundAddress(), &clientStatistics );
+    server->GetStatistics( client->GetMyBoundAddress(), &serverStatistics );
+    if( isVerbose )
+    {
+        printf( "Client to server: update ratio %.2f, chat ratio %.2f\n", clientStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM ), clientStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM + 1 ) );
+        printf( "Server to client: update ratio %.2f, chat ratio %.2f\n", serverStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM ), serverStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM + 1 ) );
+    }
+
+    if( clientStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM ) <= 1.0f || clientStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM + 1 ) <= 1.0f ||
+        serverStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM ) <= 1.0f || serverStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM + 1 ) <= 1.0f )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Statistics do not show compression\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 9;
+    }
+
+    if( serverTrainer.GetSampleCount() == 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Outgoing messages were not sampled\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 10;
+    }
+
+    if( isVerbose )
+        printf( "Testing a client that already has the dictionary\n" );
+
+    RakPeerInterface* knownClient = RakPeerInterface::GetInstance();
+    destroyList.push_back( knownClient );
+    knownClient->SetDictionaryCompression( true );
+    knownClient->SetCompressionDictionary( trained.data(), (unsigned int)trained.size() );
+    SocketDescriptor knownClientSocketDescriptor;
+    knownClient->Startup( 1, &knownClientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( knownClient, 60000 ) || !SendAndVerify( knownClient, server, rnr, 50 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client with the dictionary could not connect and send\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 11;
+    }
+
+    RakNetStatistics knownClientStatistics;
+    knownClient->GetStatistics( server->GetMyBoundAddress(), &knownClientStatistics );
+    if( knownClientStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM ) <= 1.0f )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Statistics do not show compression\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 9;
+    }
+
+    if( isVerbose )
+        printf( "Testing connecting without dictionary compression to a system that has it\n" );
+
+    RakPeerInterface* legacyClient = RakPeerInterface::GetInstance();
+    destroyList.push_back( legacyClient );
+    SocketDescriptor legacyClientSocketDescriptor;
+    legacyClient->Startup( 1, &legacyClientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( legacyClient, 60000 ) || !SendAndVerify( legacyClient, server, rnr, 50 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without dictionary compression could not connect and send\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 12;
+    }
+
+    RakNetStatistics legacyStatistics;
+    legacyClient->GetStatistics( server->GetMyBoundAddress(), &legacyStatistics );
+    if( legacyStatistics.messageCompressionInputBytes[ID_USER_PACKET_ENUM] != 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without dictionary compression compressed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 13;
+    }
+
+    if( isVerbose )
+        printf( "Testing messages around the size of a datagram at MTU %i\n", MINIMUM_MTU_SIZE );
+
+    // Path MTU discovery takes the connection down from the MTU of the handshake, which the path does not carry
+    server->SetPathMTUDiscovery( true );
+    server->SetIncomingDatagramEventHandler( MinimumMTUPath );
+    RakPeerInterface* smallMTUClient = RakPeerInterface::GetInstance();
+    destroyList.push_back( smallMTUClient );
+    smallMTUClient->SetDictionaryCompression( true );
+    smallMTUClient->SetCompressionDictionary( trained.data(), (unsigned int)trained.size() );
+    smallMTUClient->SetPathMTUDiscovery( true );
+    smallMTUClient->SetIncomingDatagramEventHandler( MinimumMTUPath );
+    SocketDescriptor smallMTUClientSocketDescriptor;
+    smallMTUClient->Startup( 1, &smallMTUClientSocketDescriptor, 1 );
+
+    std::vector<std::vector<unsigned char>> largeMessages( 350 );
+    for( int i = 0; i < (int)largeMessages.size(); i++ )
+        MakeLargeMessage( largeMessages[i], rnr, trained, i );
+
+    RakNetStatistics smallMTUStatistics;
+    if( !ConnectAndWait( smallMTUClient, 60000 ) || !WaitForMinimumMTU( smallMTUClient, server, 20000 ) || !SendAndVerify( smallMTUClient, server, largeMessages ) ||
+        !SendAndVerify( server, smallMTUClient, largeMessages ) || smallMTUClient->GetStatistics( server->GetMyBoundAddress(), &smallMTUStatistics ) == 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Messages around the size of a datagram at MTU 400 were lost\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 14;
+    }
+
+    if( isVerbose )
+        printf( "Ratio %.2f\n", smallMTUStatistics.GetMessageCompressionRatio( ID_USER_PACKET_ENUM + 2 ) );
+
+    server->SetIncomingDatagramEventHandler( 0 );
+    server->SetCompressionDictionaryTrainer( 0 );
+    return 0;
+}
+
+std::string DictionaryCompressionTest::GetTestName() const
+{
+    return "DictionaryCompressionTest";
+}
+
+std::string DictionaryCompressionTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case  0: return "No error";                                                             break;
+    case  1: return "LZ round trip with a dictionary failed";                               break;
+    case  2: return "LZ with a dictionary did not compress as expected";                    break;
+    case  3: return "Training did not produce a dictionary";                                break;
+    case  4: return "The trained dictionary does not help";                                 break;
+    case  5: return "Dictionary settings did not return what was set";                      break;
+    case  6: return "Client could not connect";                                             break;
+    case  7: return "Client did not receive the dictionary";                                break;
+    case  8: return "Messages were lost or arrived corrupted";                              break;
+    case  9: return "Statistics do not show compression";                                   break;
+    case 10: return "Outgoing messages were not sampled";                                   break;
+    case 11: return "Client with the dictionary could not connect and send";               break;
+    case 12: return "Client without dictionary compression could not connect and send";    break;
+    case 13: return "Client without dictionary compression compressed";                     break;
+    case 14: return "Messages around the size of a datagram at MTU 400 were lost";          break;
+    default: return "Undefined Error";                                                      break;
+    }
+    // clang-format on
+}
+
+DictionaryCompressionTest::DictionaryCompressionTest( void )
+{
+}
+
+DictionaryCompressionTest::~DictionaryCompressionTest( void )
+{
+}
+
+void DictionaryCompressionTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -59,7 +59,8 @@ int EightPeerTest::RunTest( bool isVerbose, bool noPauses )
             lastNumberReceivedFromList[i][j] = 0;
         }
 
-        peerList[i]->Startup( peerNum * 2, &SocketDescriptor( 60000 + i, 0 ), 1 );
+        SocketDescriptor peerSocketDescriptor( 60000 + i, 0 );
+        peerList[i]->Startup( peerNum * 2, &peerSocketDescriptor, 1 );
         peerList[i]->SetMaximumIncomingConnections( peerNum );
     }
 
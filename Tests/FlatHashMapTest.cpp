@@ -0,0 +1,292 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "FlatHashMapTest.h"
+
+#include "DS_FlatHashMap.h"
+#include "DS_OrderedList.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+
+/*
+Description:
+Inserts, looks up and removes random keys in a FlatHashMap and in std::unordered_map, and checks they agree,
+once with std::hash and once with a hash that sends most keys to the same few buckets
+Removes elements while iterating by index, and clears with and without deallocating
+Then times insert, lookup and remove at 1k, 10k and 100k keys against OrderedList, keyed the way NatPunchthroughServer keys its users
+
+Success conditions:
+Every key maps to its index and its data, duplicates are refused, and removed keys are gone
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+FlatHashMap Functions Explicitly Tested:
+Insert
+GetIndexFromKey
+HasData
+GetElementFromKey
+GetKeyAtIndex
+operator[]
+Remove
+RemoveIfExists
+RemoveAtIndex
+Reserve
+Clear
+Size
+*/
+
+namespace {
+
+// Puts every key in one of 4 homes, so probes are long and wrap around the table
+struct CollidingHash
+{
+    std::size_t operator()( uint64_t key ) const { return ( key & 3 ) << 60; }
+};
+
+template<class hasher>
+bool MatchesUnorderedMap( unsigned seed, uint64_t keyRange, int operations )
+{
+    DataStructures::FlatHashMap<uint64_t, uint64_t, hasher> map;
+    std::unordered_map<uint64_t, uint64_t> reference;
+    std::mt19937_64 random( seed );
+
+    for( int operation = 0; operation < operations; operation++ )
+    {
+        const uint64_t key = random() % keyRange;
+        const unsigned kind = (unsigned)( random() % 8 );
+        if( kind < 4 )
+        {
+            const bool isNew = reference.find( key ) == reference.end();
+            const unsigned index = map.Insert( key, key * 3, false, _FILE_AND_LINE_ );
+            if( isNew != ( index != ~0u ) || ( isNew && index != map.Size() - 1 ) )
+                return false;
+            if( isNew )
+                reference[key] = key * 3;
+        }
+        else if( kind < 6 )
+        {
+            const bool exists = reference.erase( key ) > 0;
+            if( exists )
+                map.Remove( key );
+            else
+                map.RemoveIfExists( key );
+        }
+        else if( kind < 7 && map.Size() > 0 )
+        {
+            const unsigned index = (unsigned)( random() % map.Size() );
+            reference.erase( map.GetKeyAtIndex( index ) );
+            map.RemoveAtIndex( index );
+        }
+        else
+        {
+            uint64_t element = 0;
+            const bool exists = reference.find( key ) != reference.end();
+            if( map.HasData( key ) != exists || map.GetElementFromKey( key, element ) != exists || ( exists && element != key * 3 ) )
+                return false;
+        }
+
+        if( map.Size() != reference.size() )
+            return false;
+        if( operation % 997 == 0 )
+        {
+            for( unsigned index = 0; index < map.Size(); index++ )
+            {
+                bool objectExists;
+                const uint64_t indexKey = map.GetKeyAtIndex( index );
+                if( map.GetIndexFromKey( indexKey, &objectExists ) != index || !objectExists || map[index] != reference[indexKey] )
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+struct BenchmarkUser
+{
+    RakNetGUID guid;
+};
+
+int BenchmarkUserComp( const RakNetGUID& key, BenchmarkUser* const& data )
+{
+    if( key < data->guid )
+        return -1;
+    if( key > data->guid )
+        return 1;
+    return 0;
+}
+
+struct Timings
+{
+    double insert, lookup, remove;
+};
+
+double NanosecondsPerKey( std::chrono::steady_clock::time_point start, size_t count )
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() / (double)count;
+}
+
+// Looks every key up 4 times, as lookups outnumber changes in the plugins
+template<class Map>
+Timings TimeMap( Map& map, const std::vector<BenchmarkUser*>& users, const std::vector<BenchmarkUser*>& removeOrder, bool* valid )
+{
+    Timings timings;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for( BenchmarkUser* user : users )
+        map.Insert( user->guid, user, true, _FILE_AND_LINE_ );
+    timings.insert = NanosecondsPerKey( start, users.size() );
+
+    start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for( int pass = 0; pass < 4; pass++ )
+    {
+        for( BenchmarkUser* user : users )
+        {
+            bool objectExists;
+            const unsigned index = map.GetIndexFromKey( user->guid, &objectExists );
+            found += objectExists && map[index] == user;
+        }
+    }
+    timings.lookup = NanosecondsPerKey( start, users.size() * 4 );
+
+    start = std::chrono::steady_clock::now();
+    for( BenchmarkUser* user : removeOrder )
+        map.Remove( user->guid );
+    timings.remove = NanosecondsPerKey( start, users.size() );
+
+    *valid = *valid && found == users.size() * 4 && map.Size() == 0;
+    return timings;
+}
+
+} // namespace
+
+int FlatHashMapTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Comparing against std::unordered_map\n" );
+
+    if( !MatchesUnorderedMap<std::hash<uint64_t>>( 1, 5000, 300000 ) || !MatchesUnorderedMap<std::hash<uint64_t>>( 2, 64, 100000 ) || !MatchesUnorderedMap<CollidingHash>( 3, 300, 100000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A key did not map to its index or data\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Removing while iterating and clearing\n" );
+
+    {
+        DataStructures::FlatHashMap<int, int> map;
+        for( int key = 0; key < 1000; key++ )
+            map.Insert( key, -key, true, _FILE_AND_LINE_ );
+
+        // The last element moves into the index removed, so check that index again
+        unsigned index = 0;
+        while( index < map.Size() )
+        {
+            if( map.GetKeyAtIndex( index ) % 2 == 0 )
+                map.RemoveAtIndex( index );
+            else
+                index++;
+        }
+        bool valid = map.Size() == 500;
+        for( int key = 0; valid && key < 1000; key++ )
+            valid = map.HasData( key ) == ( key % 2 == 1 ) && ( key % 2 == 0 || map.GetElementFromKey( key ) == -key );
+
+        map.Clear( true, _FILE_AND_LINE_ );
+        valid = valid && map.Size() == 0 && map.HasData( 1 ) == false && map.Insert( 1, 1, true, _FILE_AND_LINE_ ) == 0;
+        map.Clear( false, _FILE_AND_LINE_ );
+        valid = valid && map.Size() == 0 && map.HasData( 1 ) == false;
+        map.Reserve( 100, _FILE_AND_LINE_ );
+        for( int key = 0; key < 100; key++ )
+            map.Insert( key, key, true, _FILE_AND_LINE_ );
+        valid = valid && map.Size() == 100 && map.GetElementFromKey( 99 ) == 99;
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Removing while iterating or clearing lost or kept the wrong elements\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 2;
+        }
+    }
+
+    if( isVerbose )
+    {
+        printf( "Nanoseconds per key, random RakNetGUIDs inserted, looked up and removed in a different order\n" );
+        printf( "%8s %14s %14s %14s %14s %14s %14s\n", "keys", "list insert", "map insert", "list lookup", "map lookup", "list remove", "map remove" );
+        std::mt19937_64 random( 4 );
+        const unsigned counts[] = { 1000, 10000, 100000 };
+        for( unsigned count : counts )
+        {
+            std::vector<BenchmarkUser> storage( count );
+            std::vector<BenchmarkUser*> users, removeOrder;
+            for( BenchmarkUser& user : storage )
+            {
+                user.guid = RakNetGUID( random() );
+                users.push_back( &user );
+            }
+            removeOrder = users;
+            std::shuffle( removeOrder.begin(), removeOrder.end(), random );
+
+            bool valid = true;
+            DataStructures::OrderedList<RakNetGUID, BenchmarkUser*, BenchmarkUserComp> list;
+            DataStructures::FlatHashMap<RakNetGUID, BenchmarkUser*> map;
+            const Timings listTimings = TimeMap( list, users, removeOrder, &valid );
+            const Timings mapTimings = TimeMap( map, users, removeOrder, &valid );
+            printf( "%8u %14.1f %14.1f %14.1f %14.1f %14.1f %14.1f\n", count, listTimings.insert, mapTimings.insert, listTimings.lookup, mapTimings.lookup, listTimings.remove, mapTimings.remove );
+            if( !valid )
+            {
+                DebugTools::ShowError( "A key was lost while timing\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+std::string FlatHashMapTest::GetTestName() const
+{
+    return "FlatHashMapTest";
+}
+
+std::string FlatHashMapTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "A key did not map to its index or data";                                    break;
+    case 2: return "Removing while iterating or clearing lost or kept the wrong elements";      break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+FlatHashMapTest::FlatHashMapTest( void )
+{
+}
+
+FlatHashMapTest::~FlatHashMapTest( void )
+{
+}
+
+void FlatHashMapTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
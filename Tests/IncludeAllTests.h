@@ -28,3 +28,22 @@
 #include "SystemAddressAndGuidTest.h"
 #include "PacketAndLowLevelTestsTest.h"
 #include "MiscellaneousTestsTest.h"
+#include "DatagramIntegrityTest.h"
+#include "DatagramCompressionTest.h"
+#include "DictionaryCompressionTest.h"
+#include "PathMTUDiscoveryTest.h"
+#include "NetworkSimulatorTest.h"
+#include "BitStreamBenchmarkTest.h"
+#include "DeltaSnapshotTest.h"
+#include "StringCompressorTest.h"
+#include "StringTableTest.h"
+#include "ThreadsafeMemoryPoolTest.h"
+#include "ThreadsafeAllocatingQueueTest.h"
+#include "ThreadPoolTest.h"
+#include "SingleProducerConsumerRingTest.h"
+#include "FlatHashMapTest.h"
+#include "RangeListTest.h"
+#include "ByteQueueTest.h"
+#include "MemoryBackendTest.h"
+#include "MemoryProfilerTest.h"
+#include "SignaledEventTest.h"
@@ -11,6 +11,7 @@
 #include "LocalIsConnectedTest.h"
 
 #include <chrono>
+#include <string.h>
 #include <thread>
 
 /*
@@ -53,8 +54,10 @@ int LocalIsConnectedTest::RunTest( bool isVerbose, bool noPauses )
     client = RakPeerInterface::GetInstance();
     destroyList.push_back( client );
 
-    client->Startup( 1, &SocketDescriptor(), 1 );
-    server->Startup( 1, &SocketDescriptor( 60000, 0 ), 1 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 1, &serverSocketDescriptor, 1 );
     server->SetMaximumIncomingConnections( 1 );
 
     SystemAddress serverAddress( "127.0.0.1", 60000 );
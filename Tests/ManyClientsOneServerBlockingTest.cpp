@@ -216,12 +216,14 @@ int ManyClientsOneServerBlockingTest::RunTest( bool isVerbose, bool noPauses )
         clientList[i] = RakPeerInterface::GetInstance();
         destroyList.push_back( clientList[i] );
 
-        clientList[i]->Startup( 1, &SocketDescriptor(), 1 );
+        SocketDescriptor clientSocketDescriptor;
+        clientList[i]->Startup( 1, &clientSocketDescriptor, 1 );
     }
 
     server = RakPeerInterface::GetInstance();
     destroyList.push_back( server );
-    server->Startup( clientNum, &SocketDescriptor( 60000, 0 ), 1 );
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( clientNum, &serverSocketDescriptor, 1 );
     server->SetMaximumIncomingConnections( clientNum );
 
     //Connect all the clients to the server
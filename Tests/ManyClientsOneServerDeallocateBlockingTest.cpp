@@ -238,11 +238,13 @@ int ManyClientsOneServerDeallocateBlockingTest::RunTest( bool isVerbose, bool no
 
         clientList[i] = RakPeerInterface::GetInstance();
 
-        clientList[i]->Startup( 1, &SocketDescriptor(), 1 );
+        SocketDescriptor clientSocketDescriptor;
+        clientList[i]->Startup( 1, &clientSocketDescriptor, 1 );
     }
 
     server = RakPeerInterface::GetInstance();
-    server->Startup( clientNum, &SocketDescriptor( 60000, 0 ), 1 );
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( clientNum, &serverSocketDescriptor, 1 );
     server->SetMaximumIncomingConnections( clientNum );
 
     const int timeoutTime = 1000;
@@ -293,7 +295,8 @@ int ManyClientsOneServerDeallocateBlockingTest::RunTest( bool isVerbose, bool no
                 RakPeerInterface::DestroyInstance( clientList[i] );
                 clientList[i] = RakPeerInterface::GetInstance();
 
-                clientList[i]->Startup( 1, &SocketDescriptor(), 1 );
+                SocketDescriptor clientSocketDescriptor;
+                clientList[i]->Startup( 1, &clientSocketDescriptor, 1 );
             }
         }
 
@@ -0,0 +1,346 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "MemoryBackendTest.h"
+
+#include "RakMemoryBackend.h"
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string.h>
+#include <thread>
+
+/*
+Description:
+Allocates every size class, sizes passed on to malloc and huge allocations, and reallocates across all of them
+Counts allocations against two copies of the same file name and checks they are reported as one file
+Passes blocks between threads that free what others allocated
+The backend is called directly rather than installed, as the other tests allocate with malloc
+
+Success conditions:
+Blocks are aligned to 16, never overlap, and keep their contents when reallocated
+Bytes and allocations in use per file match what was allocated, and go back to 0 when freed
+Free bytes in the size classes follow blocks being allocated and freed, and are kept when a thread exits
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+RakMemoryBackend Functions Explicitly Tested:
+MemoryBackendMalloc_Ex
+MemoryBackendRealloc_Ex
+MemoryBackendFree_Ex
+GetMemoryBackendUsage
+GetMemoryBackendStatistics
+*/
+
+namespace {
+
+// Two copies of one name, as a header included by two translation units would pass
+const char sizesFile[] = "MemoryBackendTestSizes.cpp";
+const char sizesFileCopy[] = "MemoryBackendTestSizes.cpp";
+const char threadsFile[] = "MemoryBackendTestThreads.cpp";
+
+void Fill( void* p, size_t size, unsigned char seed )
+{
+    for( size_t i = 0; i < size; i++ )
+        ( (unsigned char*)p )[i] = (unsigned char)( seed + i * 7 );
+}
+
+bool Filled( const void* p, size_t size, unsigned char seed )
+{
+    for( size_t i = 0; i < size; i++ )
+    {
+        if( ( (const unsigned char*)p )[i] != (unsigned char)( seed + i * 7 ) )
+            return false;
+    }
+    return true;
+}
+
+bool FindUsage( const char* file, MemoryBackendUsage* found )
+{
+    MemoryBackendUsage usage[RAK_MEMORY_BACKEND_MAX_FILES];
+    const unsigned int count = GetMemoryBackendUsage( usage, RAK_MEMORY_BACKEND_MAX_FILES );
+    for( unsigned int i = 0; i < count; i++ )
+    {
+        if( usage[i].file && strcmp( usage[i].file, file ) == 0 )
+        {
+            *found = usage[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SizesKeepContents( void )
+{
+    std::vector<size_t> sizes;
+    for( size_t size = 0; size <= 1024; size++ )
+        sizes.push_back( size );
+    for( size_t size = 1024; size <= RAK_MEMORY_BACKEND_MAX_SMALL_SIZE + 64; size += 61 )
+        sizes.push_back( size );
+    const size_t large[] = { 65536, 500000, RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE - 1, RAK_MEMORY_BACKEND_HUGE_ALLOCATION_SIZE,
+        RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE - 16, RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE, 5 * RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE + 3 };
+    sizes.insert( sizes.end(), large, large + sizeof( large ) / sizeof( large[0] ) );
+
+    std::vector<void*> blocks;
+    uint64_t bytes = 0;
+    for( size_t i = 0; i < sizes.size(); i++ )
+    {
+        void* p = MemoryBackendMalloc_Ex( sizes[i], i % 2 ? sizesFile : sizesFileCopy, __LINE__ );
+        if( p == 0 || ( (uintptr_t)p & 15 ) != 0 )
+            return false;
+        Fill( p, sizes[i], (unsigned char)i );
+        blocks.push_back( p );
+        bytes += sizes[i];
+    }
+
+    MemoryBackendUsage usage;
+    if( !FindUsage( sizesFile, &usage ) || usage.bytesInUse != bytes || usage.allocationsInUse != sizes.size() )
+        return false;
+    MemoryBackendStatistics statistics;
+    GetMemoryBackendStatistics( &statistics );
+#if defined( __linux__ )
+    if( statistics.bytesMapped < 8 * (uint64_t)RAK_MEMORY_BACKEND_HUGE_PAGE_SIZE )
+        return false;
+#endif
+
+    // Grow and shrink each block to another size, within its size class, to another class, to and from malloc and huge pages
+    std::mt19937 random( 1 );
+    for( size_t i = 0; i < blocks.size(); i++ )
+    {
+        if( !Filled( blocks[i], sizes[i], (unsigned char)i ) )
+            return false;
+        const size_t newSize = sizes[random() % sizes.size()];
+        void* p = MemoryBackendRealloc_Ex( blocks[i], newSize, sizesFile, __LINE__ );
+        if( p == 0 || ( (uintptr_t)p & 15 ) != 0 || !Filled( p, newSize < sizes[i] ? newSize : sizes[i], (unsigned char)i ) )
+            return false;
+        Fill( p, newSize, (unsigned char)i );
+        blocks[i] = p;
+        bytes += newSize - sizes[i];
+        sizes[i] = newSize;
+    }
+    if( !FindUsage( sizesFile, &usage ) || usage.bytesInUse != bytes || usage.allocationsInUse != sizes.size() )
+        return false;
+
+    for( size_t i = 0; i < blocks.size(); i++ )
+    {
+        if( !Filled( blocks[i], sizes[i], (unsigned char)i ) )
+            return false;
+        MemoryBackendFree_Ex( blocks[i], sizesFile, __LINE__ );
+    }
+    return FindUsage( sizesFile, &usage ) && usage.bytesInUse == 0 && usage.allocationsInUse == 0;
+}
+
+// Each thread frees blocks the previous thread allocated, so blocks keep moving between thread caches
+bool ThreadsShareBlocks( int threadCount, int rounds )
+{
+    std::vector<std::vector<std::pair<void*, size_t>>> handoff( threadCount );
+    std::vector<std::mutex> handoffMutex( threadCount );
+    // Not vector<bool>, as the threads write their own element at the same time
+    std::vector<char> valid( threadCount, 1 );
+
+    std::vector<std::thread> threads;
+    for( int t = 0; t < threadCount; t++ )
+    {
+        threads.emplace_back( [&, t]() {
+            std::mt19937 random( t );
+            std::vector<std::pair<void*, size_t>> own, received;
+            for( int round = 0; round < rounds; round++ )
+            {
+                for( int i = 0; i < 64; i++ )
+                {
+                    const size_t size = random() % 8 == 0 ? random() % 40000 : random() % 512;
+                    void* p = MemoryBackendMalloc_Ex( size, threadsFile, __LINE__ );
+                    Fill( p, size, (unsigned char)size );
+                    own.push_back( std::make_pair( p, size ) );
+                }
+                {
+                    std::lock_guard<std::mutex> guard( handoffMutex[( t + 1 ) % threadCount] );
+                    handoff[( t + 1 ) % threadCount].insert( handoff[( t + 1 ) % threadCount].end(), own.begin(), own.begin() + own.size() / 2 );
+                }
+                own.erase( own.begin(), own.begin() + own.size() / 2 );
+                {
+                    std::lock_guard<std::mutex> guard( handoffMutex[t] );
+                    received.swap( handoff[t] );
+                }
+                // Free the other thread's blocks, and some of this thread's
+                received.insert( received.end(), own.begin(), own.begin() + own.size() / 2 );
+                own.erase( own.begin(), own.begin() + own.size() / 2 );
+                for( const std::pair<void*, size_t>& block : received )
+                {
+                    if( !Filled( block.first, block.second, (unsigned char)block.second ) )
+                        valid[t] = 0;
+                    MemoryBackendFree_Ex( block.first, threadsFile, __LINE__ );
+                }
+                received.clear();
+            }
+            for( const std::pair<void*, size_t>& block : own )
+            {
+                if( !Filled( block.first, block.second, (unsigned char)block.second ) )
+                    valid[t] = 0;
+                MemoryBackendFree_Ex( block.first, threadsFile, __LINE__ );
+            }
+        } );
+    }
+    for( std::thread& thread : threads )
+        thread.join();
+    // Blocks handed to a thread that had already finished
+    for( std::vector<std::pair<void*, size_t>>& remaining : handoff )
+    {
+        for( const std::pair<void*, size_t>& block : remaining )
+            MemoryBackendFree_Ex( block.first, threadsFile, __LINE__ );
+    }
+
+    MemoryBackendUsage usage;
+    bool allValid = FindUsage( threadsFile, &usage ) && usage.bytesInUse == 0 && usage.allocationsInUse == 0;
+    for( int t = 0; t < threadCount; t++ )
+        allValid = allValid && valid[t] != 0;
+    return allValid;
+}
+
+// Run after ThreadsShareBlocks, so that blocks freed by threads that exited are in the shared lists
+bool FreeBytesCounted( void )
+{
+    MemoryBackendStatistics before;
+    GetMemoryBackendStatistics( &before );
+    // Every block the other threads carved is free again
+    if( before.bytesFreeInSizeClasses == 0 || before.bytesFreeInSizeClasses > before.bytesInChunks )
+        return false;
+
+    // Less than a batch, so they stay in this thread's cache
+    const int count = 10;
+    const size_t size = 100;
+    void* blocks[count];
+    for( int i = 0; i < count; i++ )
+        blocks[i] = MemoryBackendMalloc_Ex( size, threadsFile, __LINE__ );
+    MemoryBackendStatistics allocated;
+    GetMemoryBackendStatistics( &allocated );
+    for( int i = 0; i < count; i++ )
+        MemoryBackendFree_Ex( blocks[i], threadsFile, __LINE__ );
+    MemoryBackendStatistics freed;
+    GetMemoryBackendStatistics( &freed );
+
+    // Each block is the size rounded up to its class, at most a quarter more, plus a 16 byte header
+    const uint64_t difference = freed.bytesFreeInSizeClasses - allocated.bytesFreeInSizeClasses;
+    return freed.bytesFreeInSizeClasses <= freed.bytesInChunks && difference >= count * ( size + 16 ) && difference <= count * ( size + size / 4 + 16 );
+}
+
+// \return Nanoseconds per allocation and free, of sizes a RakPeer typically asks for
+double TimeAllocations( void* ( *allocate )( size_t, const char*, unsigned int ), void ( *release )( void*, const char*, unsigned int ), int threadCount )
+{
+    const int perThread = 2000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for( int t = 0; t < threadCount; t++ )
+    {
+        threads.emplace_back( [=]() {
+            std::mt19937 random( t );
+            void* live[256] = {};
+            for( int i = 0; i < perThread; i++ )
+            {
+                const unsigned int slot = random() % 256;
+                release( live[slot], _FILE_AND_LINE_ );
+                live[slot] = allocate( 16 + random() % 1500, _FILE_AND_LINE_ );
+            }
+            for( void* p : live )
+                release( p, _FILE_AND_LINE_ );
+        } );
+    }
+    for( std::thread& thread : threads )
+        thread.join();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() / ( (double)perThread * threadCount );
+}
+
+} // namespace
+
+int MemoryBackendTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Allocating and reallocating every kind of size\n" );
+
+    if( !SizesKeepContents() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A block was misaligned, lost its contents or was counted wrongly\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Freeing blocks on other threads\n" );
+
+    if( !ThreadsShareBlocks( 4, 2000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Blocks passed between threads overlapped or were counted wrongly\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( !FreeBytesCounted() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Free bytes in the size classes were counted wrongly\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    if( isVerbose )
+    {
+        printf( "Nanoseconds per allocation and free, 16 to 1515 bytes, %u hardware threads\n", std::thread::hardware_concurrency() );
+        printf( "%8s %14s %14s\n", "threads", "malloc", "backend" );
+        const int threadCounts[] = { 1, 4 };
+        for( int threadCount : threadCounts )
+        {
+            const double system = TimeAllocations( _RakMalloc_Ex, _RakFree_Ex, threadCount );
+            const double backend = TimeAllocations( MemoryBackendMalloc_Ex, MemoryBackendFree_Ex, threadCount );
+            printf( "%8d %14.1f %14.1f\n", threadCount, system, backend );
+        }
+        PrintMemoryBackendUsage();
+    }
+
+    return 0;
+}
+
+std::string MemoryBackendTest::GetTestName() const
+{
+    return "MemoryBackendTest";
+}
+
+std::string MemoryBackendTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "A block was misaligned, lost its contents or was counted wrongly";          break;
+    case 2: return "Blocks passed between threads overlapped or were counted wrongly";          break;
+    case 3: return "Free bytes in the size classes were counted wrongly";                       break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+MemoryBackendTest::MemoryBackendTest( void )
+{
+}
+
+MemoryBackendTest::~MemoryBackendTest( void )
+{
+}
+
+void MemoryBackendTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
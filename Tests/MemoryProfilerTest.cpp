@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "MemoryProfilerTest.h"
+
+#include "RakMemoryProfiler.h"
+
+#include <chrono>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+/*
+Description:
+Allocates, reallocates and frees at a few lines of made up files, and checks what GetMemoryProfilerSites() reports for each
+Counts two copies of the same file name at the same line, as one site
+Allocates and frees the same site from several threads, each freeing blocks another allocated
+The profiler is called directly rather than started, as the other tests allocate with malloc
+
+Success conditions:
+Live bytes, live allocations, peaks and allocation counts match what was done at each site, and rates are reported after sampling
+Sites are sorted by what was asked for
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+RakMemoryProfiler Functions Explicitly Tested:
+MemoryProfilerMalloc_Ex
+MemoryProfilerRealloc_Ex
+MemoryProfilerFree_Ex
+SampleMemoryProfiler
+GetMemoryProfilerSites
+*/
+
+namespace {
+
+// Two copies of one name, as a header included by two translation units would pass
+const char sitesFile[] = "MemoryProfilerTestSites.cpp";
+const char sitesFileCopy[] = "MemoryProfilerTestSites.cpp";
+const char threadsFile[] = "MemoryProfilerTestThreads.cpp";
+
+bool FindSite( const char* file, unsigned int line, MemoryProfilerSort sort, MemoryProfilerSite* found, unsigned int* rank = 0 )
+{
+    std::vector<MemoryProfilerSite> sites( RAK_MEMORY_PROFILER_MAX_SITES );
+    const unsigned int count = GetMemoryProfilerSites( sites.data(), RAK_MEMORY_PROFILER_MAX_SITES, sort );
+    unsigned int sameFileRank = 0;
+    for( unsigned int i = 0; i < count; i++ )
+    {
+        if( sites[i].file == 0 || strcmp( sites[i].file, file ) != 0 )
+            continue;
+        if( sites[i].line == line )
+        {
+            *found = sites[i];
+            if( rank )
+                *rank = sameFileRank;
+            return true;
+        }
+        sameFileRank++;
+    }
+    return false;
+}
+
+bool Matches( unsigned int line, uint64_t liveBytes, uint64_t liveAllocations, uint64_t peakBytes, uint64_t allocationCount )
+{
+    MemoryProfilerSite site;
+    return FindSite( sitesFile, line, MPS_LIVE_BYTES, &site ) && site.liveBytes == liveBytes && site.liveAllocations == liveAllocations && site.peakBytes == peakBytes &&
+        site.allocationCount == allocationCount;
+}
+
+bool SitesCounted( void )
+{
+    // Line 1 grows to 100 blocks of 1000 bytes and shrinks to 10, through both copies of the file name
+    std::vector<void*> blocks;
+    for( int i = 0; i < 100; i++ )
+        blocks.push_back( MemoryProfilerMalloc_Ex( 1000, i % 2 ? sitesFile : sitesFileCopy, 1 ) );
+    SampleMemoryProfiler();
+    for( int i = 10; i < 100; i++ )
+        MemoryProfilerFree_Ex( blocks[i], sitesFile, 1 );
+    blocks.resize( 10 );
+    if( !Matches( 1, 10000, 10, 100000, 100 ) )
+        return false;
+
+    // Line 2 reallocates two of them, which then count at line 2
+    for( int i = 0; i < 2; i++ )
+    {
+        memset( blocks[i], i, 1000 );
+        blocks[i] = MemoryProfilerRealloc_Ex( blocks[i], 30000, sitesFile, 2 );
+        const char* bytes = (const char*)blocks[i];
+        if( bytes[0] != i || bytes[999] != i )
+            return false;
+    }
+    if( !Matches( 1, 8000, 8, 100000, 100 ) || !Matches( 2, 60000, 2, 60000, 2 ) )
+        return false;
+
+    // Line 3 allocates the most, and is the only one allocating between the last two samples
+    void* largest = MemoryProfilerMalloc_Ex( 200000, sitesFile, 3 );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    SampleMemoryProfiler();
+    for( int i = 0; i < 1000; i++ )
+        MemoryProfilerFree_Ex( MemoryProfilerMalloc_Ex( 64, sitesFile, 3 ), sitesFile, 3 );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    SampleMemoryProfiler();
+    MemoryProfilerSite site;
+    unsigned int liveRank, rateRank, peakRank;
+    if( !FindSite( sitesFile, 3, MPS_LIVE_BYTES, &site, &liveRank ) || site.allocationsPerSecond <= 0 || site.bytesPerSecond <= 0 || liveRank != 0 )
+        return false;
+    if( !FindSite( sitesFile, 3, MPS_ALLOCATIONS_PER_SECOND, &site, &rateRank ) || rateRank != 0 )
+        return false;
+    if( !FindSite( sitesFile, 1, MPS_PEAK_BYTES, &site, &peakRank ) || peakRank != 1 )
+        return false;
+
+    MemoryProfilerFree_Ex( largest, sitesFile, 3 );
+    for( void* block : blocks )
+        MemoryProfilerFree_Ex( block, sitesFile, 1 );
+    return Matches( 1, 0, 0, 100000, 100 ) && Matches( 2, 0, 0, 60000, 2 ) && Matches( 3, 0, 0, 200000, 1001 );
+}
+
+// Each thread frees blocks the previous thread allocated, so allocations and frees of a block are counted on different shards
+bool ThreadsCounted( int threadCount, int rounds )
+{
+    std::vector<std::vector<void*>> handoff( threadCount );
+    std::vector<std::mutex> handoffMutex( threadCount );
+    std::vector<std::thread> threads;
+    for( int t = 0; t < threadCount; t++ )
+    {
+        threads.emplace_back( [&, t]() {
+            std::vector<void*> received;
+            for( int round = 0; round < rounds; round++ )
+            {
+                std::vector<void*> own;
+                for( int i = 0; i < 16; i++ )
+                    own.push_back( MemoryProfilerMalloc_Ex( 100, threadsFile, 1 ) );
+                {
+                    std::lock_guard<std::mutex> guard( handoffMutex[( t + 1 ) % threadCount] );
+                    handoff[( t + 1 ) % threadCount].insert( handoff[( t + 1 ) % threadCount].end(), own.begin(), own.end() );
+                }
+                {
+                    std::lock_guard<std::mutex> guard( handoffMutex[t] );
+                    received.swap( handoff[t] );
+                }
+                for( void* block : received )
+                    MemoryProfilerFree_Ex( block, threadsFile, 1 );
+                received.clear();
+            }
+        } );
+    }
+    for( std::thread& thread : threads )
+        thread.join();
+
+    MemoryProfilerSite site;
+    uint64_t remaining = 0;
+    for( const std::vector<void*>& blocks : handoff )
+        remaining += blocks.size();
+    const bool valid = FindSite( threadsFile, 1, MPS_LIVE_BYTES, &site ) && site.liveAllocations == remaining && site.liveBytes == remaining * 100 &&
+        site.allocationCount == (uint64_t)threadCount * rounds * 16;
+    for( const std::vector<void*>& blocks : handoff )
+    {
+        for( void* block : blocks )
+            MemoryProfilerFree_Ex( block, threadsFile, 1 );
+    }
+    return valid && FindSite( threadsFile, 1, MPS_LIVE_BYTES, &site ) && site.liveAllocations == 0 && site.liveBytes == 0;
+}
+
+// \return Nanoseconds per allocation and free, of sizes a RakPeer typically asks for
+double TimeAllocations( void* ( *allocate )( size_t, const char*, unsigned int ), void ( *release )( void*, const char*, unsigned int ), int threadCount )
+{
+    const int perThread = 2000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for( int t = 0; t < threadCount; t++ )
+    {
+        threads.emplace_back( [=]() {
+            void* live[256] = {};
+            unsigned int random = t + 1;
+            for( int i = 0; i < perThread; i++ )
+            {
+                random = random * 1664525 + 1013904223;
+                const unsigned int slot = random >> 24;
+                release( live[slot], _FILE_AND_LINE_ );
+                live[slot] = allocate( 16 + ( random & 1023 ), _FILE_AND_LINE_ );
+            }
+            for( void* p : live )
+                release( p, _FILE_AND_LINE_ );
+        } );
+    }
+    for( std::thread& thread : threads )
+        thread.join();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() / ( (double)perThread * threadCount );
+}
+
+} // namespace
+
+int MemoryProfilerTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Counting allocations per site\n" );
+
+    if( !SitesCounted() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A site reported the wrong bytes, allocations, peak or order\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Counting allocations freed on other threads\n" );
+
+    if( !ThreadsCounted( 4, 5000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Allocations freed on other threads were counted wrongly\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( isVerbose )
+    {
+        printf( "Nanoseconds per allocation and free, 16 to 1039 bytes, %u hardware threads\n", std::thread::hardware_concurrency() );
+        printf( "%8s %14s %14s\n", "threads", "malloc", "profiled" );
+        const int threadCounts[] = { 1, 4 };
+        for( int threadCount : threadCounts )
+        {
+            const double system = TimeAllocations( _RakMalloc_Ex, _RakFree_Ex, threadCount );
+            const double profiled = TimeAllocations( MemoryProfilerMalloc_Ex, MemoryProfilerFree_Ex, threadCount );
+            printf( "%8d %14.1f %14.1f\n", threadCount, system, profiled );
+        }
+        PrintMemoryProfilerReport( 8, MPS_PEAK_BYTES );
+    }
+
+    return 0;
+}
+
+std::string MemoryProfilerTest::GetTestName() const
+{
+    return "MemoryProfilerTest";
+}
+
+std::string MemoryProfilerTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "A site reported the wrong bytes, allocations, peak or order";               break;
+    case 2: return "Allocations freed on other threads were counted wrongly";                   break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+MemoryProfilerTest::MemoryProfilerTest( void )
+{
+}
+
+MemoryProfilerTest::~MemoryProfilerTest( void )
+{
+}
+
+void MemoryProfilerTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
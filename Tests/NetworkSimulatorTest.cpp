@@ -0,0 +1,357 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "NetworkSimulatorTest.h"
+
+#include "NetworkSimulator.h"
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+/*
+Description:
+Tests NetworkSimulator, on its own with a simulated clock and between two systems
+
+Success conditions:
+The same seed gives the same losses and delivery order, and a different seed does not
+Gilbert-Elliott loss has the stationary loss rate of its parameters and comes in bursts
+The bottleneck delivers at its bandwidth, delays datagrams by its queue depth and drops them when the queue is full
+Reordered and duplicated datagrams are delivered out of order and twice
+Reliable ordered messages arrive intact between two systems on the "wifi-congested" profile
+
+Failure conditions:
+Any of the above fails
+
+RakPeerInterface Functions used, tested indirectly by its use:
+Startup
+SetMaximumIncomingConnections
+Connect
+Receive
+DeallocatePacket
+Send
+GetSockets
+GetAveragePing
+
+RakPeerInterface Functions Explicitly Tested:
+None, NetworkSimulator is attached as a SocketLayerOverride
+*/
+
+// Records what would have gone to the socket
+class RecordingSimulator : public NetworkSimulator
+{
+public:
+    RecordingSimulator( const NetworkSimulatorProfile& profile, unsigned int seed )
+    : NetworkSimulator( profile, seed )
+    {
+    }
+
+    struct Delivery
+    {
+        uint32_t index;
+        RakNet::TimeUS time;
+    };
+    std::vector<Delivery> deliveries;
+    RakNet::TimeUS now;
+
+    // Sends datagramCount numbered datagrams of datagramLength bytes, one every intervalUS, and delivers everything
+    void Run( int datagramCount, int datagramLength, RakNet::TimeUS intervalUS )
+    {
+        std::vector<char> datagram( datagramLength );
+        SystemAddress address( "127.0.0.1", 60000 );
+        for( int i = 0; i < datagramCount; i++ )
+        {
+            now = (RakNet::TimeUS)i * intervalUS;
+            memcpy( datagram.data(), &i, sizeof( i ) );
+            Send( datagram.data(), datagramLength, address, now );
+            Update( now );
+        }
+        now = (RakNet::TimeUS)datagramCount * intervalUS + 10000000;
+        Update( now );
+    }
+
+protected:
+    virtual void Deliver( const char* data, int length, const SystemAddress& systemAddress )
+    {
+        (void)length;
+        (void)systemAddress;
+        Delivery delivery;
+        memcpy( &delivery.index, data, sizeof( delivery.index ) );
+        delivery.time = now;
+        deliveries.push_back( delivery );
+    }
+};
+
+static bool ConnectAndWait( RakPeerInterface* client, unsigned short port )
+{
+    client->Connect( "127.0.0.1", port, 0, 0 );
+    Packet* packet = CommonFunctions::WaitAndReturnMessageWithID( client, ID_CONNECTION_REQUEST_ACCEPTED, 10000 );
+    if( packet == 0 )
+        return false;
+    client->DeallocatePacket( packet );
+    return true;
+}
+
+int NetworkSimulatorTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    NetworkSimulatorProfile wifi;
+    if( !NetworkSimulatorProfile::GetNamedProfile( "wifi-congested", &wifi ) || !NetworkSimulatorProfile::GetNamedProfile( "lte", &wifi ) ||
+        !NetworkSimulatorProfile::GetNamedProfile( "transatlantic", &wifi ) || NetworkSimulatorProfile::GetNamedProfile( "dial-up", &wifi ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Named profiles are wrong\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+    NetworkSimulatorProfile::GetNamedProfile( "wifi-congested", &wifi );
+
+    if( isVerbose )
+        printf( "Testing runs are reproducible\n" );
+
+    RecordingSimulator first( wifi, 1234 ), second( wifi, 1234 ), otherSeed( wifi, 4321 );
+    first.Run( 20000, 200, 1000 );
+    second.Run( 20000, 200, 1000 );
+    otherSeed.Run( 20000, 200, 1000 );
+
+    NetworkSimulatorStatistics firstStatistics, secondStatistics, otherSeedStatistics;
+    first.GetStatistics( &firstStatistics );
+    second.GetStatistics( &secondStatistics );
+    otherSeed.GetStatistics( &otherSeedStatistics );
+
+    bool sameDeliveries = first.deliveries.size() == second.deliveries.size();
+    for( size_t i = 0; sameDeliveries && i < first.deliveries.size(); i++ )
+        sameDeliveries = first.deliveries[i].index == second.deliveries[i].index && first.deliveries[i].time == second.deliveries[i].time;
+
+    if( !sameDeliveries || memcmp( &firstStatistics, &secondStatistics, sizeof( firstStatistics ) ) != 0 || firstStatistics.datagramsLost == otherSeedStatistics.datagramsLost )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Runs with the same seed differ\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( isVerbose )
+        printf( "Testing Gilbert-Elliott loss\n" );
+
+    NetworkSimulatorProfile burstLoss;
+    burstLoss.goodToBadProbability = 0.02f;
+    burstLoss.badToGoodProbability = 0.2f;
+    burstLoss.badLossProbability = 0.5f;
+    RecordingSimulator burstLossSimulator( burstLoss, 1 );
+    const int burstLossCount = 200000;
+    burstLossSimulator.Run( burstLossCount, 100, 1000 );
+
+    // Without reordering, indices that are missing between deliveries were lost
+    std::vector<bool> lost( burstLossCount, true );
+    for( const RecordingSimulator::Delivery& delivery : burstLossSimulator.deliveries )
+        lost[delivery.index] = false;
+    int lossCount = 0, lossAfterLossCount = 0;
+    for( int i = 0; i < burstLossCount; i++ )
+    {
+        if( lost[i] )
+        {
+            lossCount++;
+            if( i > 0 && lost[i - 1] )
+                lossAfterLossCount++;
+        }
+    }
+    const double expectedLossRate = burstLoss.goodToBadProbability / ( burstLoss.goodToBadProbability + burstLoss.badToGoodProbability ) * burstLoss.badLossProbability;
+    const double lossRate = (double)lossCount / burstLossCount;
+    const double lossAfterLossRate = (double)lossAfterLossCount / lossCount;
+    if( isVerbose )
+        printf( "Loss rate %.4f, expected %.4f, after a loss %.4f\n", lossRate, expectedLossRate, lossAfterLossRate );
+
+    if( lossRate < expectedLossRate * 0.9 || lossRate > expectedLossRate * 1.1 || lossAfterLossRate < lossRate * 4 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Loss does not follow the Gilbert-Elliott model\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    if( isVerbose )
+        printf( "Testing the bottleneck\n" );
+
+    // Ten times what the link carries, for one second
+    NetworkSimulatorProfile bottleneck;
+    bottleneck.bandwidthBytesPerSecond = 100000;
+    bottleneck.burstBytes = 1000;
+    bottleneck.queueBytes = 10000;
+    RecordingSimulator bottleneckSimulator( bottleneck, 1 );
+    bottleneckSimulator.Run( 1000, 1000, 1000 );
+
+    NetworkSimulatorStatistics bottleneckStatistics;
+    bottleneckSimulator.GetStatistics( &bottleneckStatistics );
+    unsigned int deliveredInOneSecond = 0;
+    for( const RecordingSimulator::Delivery& delivery : bottleneckSimulator.deliveries )
+        deliveredInOneSecond += delivery.time <= 1000000;
+    if( isVerbose )
+        printf( "%u of 1000 datagrams delivered in one second, %u dropped by the queue, up to %.1f ms in the queue\n", deliveredInOneSecond,
+                (unsigned int)bottleneckStatistics.datagramsQueueDropped, bottleneckStatistics.maxQueueDelayUS / 1000.0 );
+
+    // 100 from the bandwidth, plus the burst
+    if( deliveredInOneSecond < 95 || deliveredInOneSecond > 105 || bottleneckStatistics.datagramsQueueDropped < 850 ||
+        bottleneckStatistics.maxQueueDelayUS < 90000 || bottleneckStatistics.maxQueueDelayUS > 110000 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "The bottleneck did not limit bandwidth and queue depth\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 4;
+    }
+
+    if( isVerbose )
+        printf( "Testing reordering and duplication\n" );
+
+    NetworkSimulatorProfile reorder;
+    reorder.latencyMS = 10;
+    reorder.reorderProbability = 0.1f;
+    reorder.reorderWindowMS = 20;
+    reorder.duplicateProbability = 0.05f;
+    RecordingSimulator reorderSimulator( reorder, 1 );
+    reorderSimulator.Run( 10000, 100, 1000 );
+
+    NetworkSimulatorStatistics reorderStatistics;
+    reorderSimulator.GetStatistics( &reorderStatistics );
+    unsigned int outOfOrder = 0;
+    for( size_t i = 1; i < reorderSimulator.deliveries.size(); i++ )
+        outOfOrder += reorderSimulator.deliveries[i].index < reorderSimulator.deliveries[i - 1].index;
+    if( isVerbose )
+        printf( "%u reordered, %u duplicated, %u delivered out of order\n", (unsigned int)reorderStatistics.datagramsReordered, (unsigned int)reorderStatistics.datagramsDuplicated, outOfOrder );
+
+    if( reorderStatistics.datagramsReordered < 900 || reorderStatistics.datagramsReordered > 1100 || reorderStatistics.datagramsDuplicated < 400 ||
+        reorderStatistics.datagramsDuplicated > 600 || outOfOrder < 500 || reorderSimulator.deliveries.size() != 10000 + reorderStatistics.datagramsDuplicated )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Datagrams were not reordered and duplicated\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 5;
+    }
+
+    if( isVerbose )
+        printf( "Testing reliable ordered sends over the wifi-congested profile\n" );
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    destroyList.push_back( server );
+    RakPeerInterface* client = RakPeerInterface::GetInstance();
+    destroyList.push_back( client );
+
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 2, &serverSocketDescriptor, 1 );
+    server->SetMaximumIncomingConnections( 2 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+
+    // Destroyed with the peers, which must stop using them first
+    serverSimulator.reset( new NetworkSimulator( wifi, 1 ) );
+    clientSimulator.reset( new NetworkSimulator( wifi, 2 ) );
+    if( !serverSimulator->Attach( server ) || !clientSimulator->Attach( client ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Could not attach the simulator\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    if( !ConnectAndWait( client, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 7;
+    }
+
+    const int messageCount = 500;
+    int nextExpected = 0, sent = 0;
+    bool corruptMessage = false;
+    TimeMS stopWaiting = GetTimeMS() + 30000;
+    std::vector<unsigned char> message( 300 );
+    while( nextExpected < messageCount && corruptMessage == false && GetTimeMS() < stopWaiting )
+    {
+        for( int i = 0; i < 5 && sent < messageCount; i++, sent++ )
+        {
+            memset( message.data(), sent & 0xFF, message.size() );
+            message[0] = (MessageID)ID_USER_PACKET_ENUM;
+            client->Send( (const char*)message.data(), (int)message.size(), HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+        }
+
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() )
+        {
+            if( packet->data[0] != ID_USER_PACKET_ENUM )
+                continue;
+
+            if( packet->length != message.size() || packet->data[1] != ( nextExpected & 0xFF ) || packet->data[message.size() - 1] != ( nextExpected & 0xFF ) )
+                corruptMessage = true;
+            nextExpected++;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    NetworkSimulatorStatistics clientStatistics;
+    clientSimulator->GetStatistics( &clientStatistics );
+    if( isVerbose )
+        printf( "%d of %d messages arrived, client sent %u datagrams, %u lost, %u duplicated, %u reordered, average ping %d ms\n", nextExpected, messageCount,
+                (unsigned int)clientStatistics.datagramsSent, (unsigned int)clientStatistics.datagramsLost, (unsigned int)clientStatistics.datagramsDuplicated,
+                (unsigned int)clientStatistics.datagramsReordered, client->GetAveragePing( server->GetMyBoundAddress() ) );
+
+    if( corruptMessage || nextExpected != messageCount )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Messages were lost or arrived corrupted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 8;
+    }
+
+    if( clientStatistics.datagramsLost == 0 || client->GetAveragePing( server->GetMyBoundAddress() ) < (int)wifi.latencyMS * 2 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "The simulator did not affect the connection\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 9;
+    }
+
+    return 0;
+}
+
+std::string NetworkSimulatorTest::GetTestName() const
+{
+    return "NetworkSimulatorTest";
+}
+
+std::string NetworkSimulatorTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case  0: return "No error";                                                     break;
+    case  1: return "Named profiles are wrong";                                     break;
+    case  2: return "Runs with the same seed differ";                               break;
+    case  3: return "Loss does not follow the Gilbert-Elliott model";               break;
+    case  4: return "The bottleneck did not limit bandwidth and queue depth";       break;
+    case  5: return "Datagrams were not reordered and duplicated";                  break;
+    case  6: return "Could not attach the simulator";                               break;
+    case  7: return "Client could not connect";                                     break;
+    case  8: return "Messages were lost or arrived corrupted";                      break;
+    case  9: return "The simulator did not affect the connection";                  break;
+    default: return "Undefined Error";                                              break;
+    }
+    // clang-format on
+}
+
+NetworkSimulatorTest::NetworkSimulatorTest( void )
+{
+}
+
+NetworkSimulatorTest::~NetworkSimulatorTest( void )
+{
+}
+
+void NetworkSimulatorTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+    serverSimulator.reset();
+    clientSimulator.reset();
+}
@@ -11,6 +11,7 @@
 #include "OfflineMessagesConvertTest.h"
 
 #include <chrono>
+#include <string.h>
 #include <thread>
 
 /*
@@ -0,0 +1,293 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "PathMTUDiscoveryTest.h"
+
+#include <atomic>
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+/*
+Description:
+Tests path MTU discovery on an established connection, over a simulated path that drops datagrams larger than its MTU
+
+Success conditions:
+The MTU found during the handshake is raised to within PATH_MTU_DISCOVERY_GRANULARITY of a larger path MTU
+When the path MTU drops, the MTU follows it down, the connection survives and split messages are sized for the new MTU
+A system without path MTU discovery keeps the MTU from the handshake
+
+Failure conditions:
+Any of the above fails
+
+RakPeerInterface Functions used, tested indirectly by its use:
+Startup
+SetMaximumIncomingConnections
+Connect
+Receive
+DeallocatePacket
+Send
+SetIncomingDatagramEventHandler
+
+RakPeerInterface Functions Explicitly Tested:
+SetPathMTUDiscovery
+GetPathMTUDiscovery
+GetMTUSize
+*/
+
+// The simulated path. Datagrams larger than this, including the UDP header, are dropped in both directions.
+static std::atomic<int> pathMTU( MAXIMUM_MTU_SIZE );
+// Largest datagram, including the UDP header, the server received since this was last reset
+static std::atomic<int> largestDatagram( 0 );
+
+static bool ClientPath( RNS2RecvStruct* recvStruct )
+{
+    return recvStruct->bytesRead + UDP_HEADER_SIZE <= pathMTU;
+}
+
+static bool ServerPath( RNS2RecvStruct* recvStruct )
+{
+    int size = recvStruct->bytesRead + UDP_HEADER_SIZE;
+    if( size > pathMTU )
+        return false;
+    if( size > largestDatagram )
+        largestDatagram = size;
+    return true;
+}
+
+static bool ConnectAndWait( RakPeerInterface* client, unsigned short port )
+{
+    // Short intervals so the handshake gets through its larger MTUs quickly
+    client->Connect( "127.0.0.1", port, 0, 0, 0, 0, 12, 100 );
+    Packet* packet = CommonFunctions::WaitAndReturnMessageWithID( client, ID_CONNECTION_REQUEST_ACCEPTED, 5000 );
+    if( packet == 0 )
+        return false;
+    client->DeallocatePacket( packet );
+    return true;
+}
+
+// Waits until both directions of the connection settled just below the path MTU
+static bool WaitForMTU( RakPeerInterface* client, RakPeerInterface* server, int expected, TimeMS timeout )
+{
+    TimeMS stopWaiting = GetTimeMS() + timeout;
+    while( GetTimeMS() < stopWaiting )
+    {
+        int clientMTU = client->GetMTUSize( server->GetMyBoundAddress() );
+        int serverMTU = server->GetMTUSize( client->GetMyBoundAddress() );
+        if( clientMTU <= expected && clientMTU > expected - PATH_MTU_DISCOVERY_GRANULARITY &&
+            serverMTU <= expected && serverMTU > expected - PATH_MTU_DISCOVERY_GRANULARITY )
+            return true;
+
+        // Keep the receive queues drained
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() ) {}
+        for( Packet* packet = client->Receive(); packet; client->DeallocatePacket( packet ), packet = client->Receive() ) {}
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+    return false;
+}
+
+// Sends numbered messages of messageLength bytes reliable ordered from client to server, and checks they all arrive in order
+static bool SendAndReceive( RakPeerInterface* client, RakPeerInterface* server, int messageCount, int messageLength )
+{
+    std::vector<unsigned char> message( messageLength );
+    int nextExpected = 0;
+    bool corruptMessage = false;
+    TimeMS stopWaiting = GetTimeMS() + 15000;
+    int sent = 0;
+    while( nextExpected < messageCount && corruptMessage == false && GetTimeMS() < stopWaiting )
+    {
+        // A few at a time, so messages are in flight throughout
+        for( int i = 0; i < 4 && sent < messageCount; i++, sent++ )
+        {
+            memset( message.data(), sent & 0xFF, message.size() );
+            message[0] = (MessageID)ID_USER_PACKET_ENUM;
+            client->Send( (const char*)message.data(), (int)message.size(), HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true );
+        }
+
+        for( Packet* packet = server->Receive(); packet; server->DeallocatePacket( packet ), packet = server->Receive() )
+        {
+            if( packet->data[0] != ID_USER_PACKET_ENUM )
+                continue;
+
+            if( (int)packet->length != messageLength || packet->data[1] != ( nextExpected & 0xFF ) || packet->data[messageLength - 1] != ( nextExpected & 0xFF ) )
+                corruptMessage = true;
+            nextExpected++;
+        }
+        for( Packet* packet = client->Receive(); packet; client->DeallocatePacket( packet ), packet = client->Receive() ) {}
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+    return corruptMessage == false && nextExpected == messageCount;
+}
+
+int PathMTUDiscoveryTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    RakPeerInterface* server = RakPeerInterface::GetInstance();
+    destroyList.push_back( server );
+    RakPeerInterface* client = RakPeerInterface::GetInstance();
+    destroyList.push_back( client );
+
+    server->SetPathMTUDiscovery( true );
+    client->SetPathMTUDiscovery( true );
+    if( client->GetPathMTUDiscovery() == false )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "GetPathMTUDiscovery did not return what was set\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    pathMTU = 1400;
+    largestDatagram = 0;
+    server->SetIncomingDatagramEventHandler( ServerPath );
+    client->SetIncomingDatagramEventHandler( ClientPath );
+
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 2, &serverSocketDescriptor, 1 );
+    server->SetMaximumIncomingConnections( 2 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+
+    if( isVerbose )
+        printf( "Testing the MTU is raised from the handshake to a path MTU of %i\n", (int)pathMTU );
+
+    if( !ConnectAndWait( client, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    // The handshake only tries a few sizes, so it settles below the path MTU
+    int handshakeMTU = client->GetMTUSize( server->GetMyBoundAddress() );
+    if( isVerbose )
+        printf( "Handshake MTU %i\n", handshakeMTU );
+
+    if( !WaitForMTU( client, server, pathMTU, 10000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "MTU was not raised to the path MTU\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    if( isVerbose )
+        printf( "MTU raised to %i\n", client->GetMTUSize( server->GetMyBoundAddress() ) );
+
+    if( isVerbose )
+        printf( "Testing the MTU follows the path MTU down while messages are sent\n" );
+
+    // Messages smaller than the new path MTU, packed into datagrams larger than it
+    pathMTU = 1000;
+    TimeMS lowered = GetTimeMS();
+    if( !SendAndReceive( client, server, 600, 300 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Messages were lost after the path MTU dropped\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 4;
+    }
+
+    if( !WaitForMTU( client, server, pathMTU, PATH_MTU_DISCOVERY_CONFIRM_INTERVAL + 10000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "MTU was not lowered to the path MTU\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 5;
+    }
+
+    if( isVerbose )
+        printf( "MTU lowered to %i after %i ms\n", client->GetMTUSize( server->GetMyBoundAddress() ), (int)( GetTimeMS() - lowered ) );
+
+    // Split messages are now sized for the new MTU, and fill it
+    largestDatagram = 0;
+    if( !SendAndReceive( client, server, 40, 4000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Split messages were lost\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 6;
+    }
+
+    if( isVerbose )
+        printf( "Largest datagram %i\n", (int)largestDatagram );
+
+    if( largestDatagram > pathMTU || largestDatagram <= pathMTU - 2 * PATH_MTU_DISCOVERY_GRANULARITY )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Datagrams were not sized for the new MTU\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 7;
+    }
+
+    if( isVerbose )
+        printf( "Testing connecting without path MTU discovery to a system that has it\n" );
+
+    RakPeerInterface* legacyClient = RakPeerInterface::GetInstance();
+    destroyList.push_back( legacyClient );
+    legacyClient->SetIncomingDatagramEventHandler( ClientPath );
+    SocketDescriptor legacyClientSocketDescriptor;
+    legacyClient->Startup( 1, &legacyClientSocketDescriptor, 1 );
+
+    if( !ConnectAndWait( legacyClient, 60000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Client without path MTU discovery could not connect\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 8;
+    }
+
+    handshakeMTU = legacyClient->GetMTUSize( server->GetMyBoundAddress() );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1000 ) );
+    if( legacyClient->GetMTUSize( server->GetMyBoundAddress() ) != handshakeMTU || server->GetMTUSize( legacyClient->GetMyBoundAddress() ) != handshakeMTU )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "MTU changed without path MTU discovery\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 9;
+    }
+
+    return 0;
+}
+
+std::string PathMTUDiscoveryTest::GetTestName() const
+{
+    return "PathMTUDiscoveryTest";
+}
+
+std::string PathMTUDiscoveryTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case  0: return "No error";                                                     break;
+    case  1: return "GetPathMTUDiscovery did not return what was set";              break;
+    case  2: return "Client could not connect";                                     break;
+    case  3: return "MTU was not raised to the path MTU";                           break;
+    case  4: return "Messages were lost after the path MTU dropped";                break;
+    case  5: return "MTU was not lowered to the path MTU";                          break;
+    case  6: return "Split messages were lost";                                     break;
+    case  7: return "Datagrams were not sized for the new MTU";                     break;
+    case  8: return "Client without path MTU discovery could not connect";          break;
+    case  9: return "MTU changed without path MTU discovery";                       break;
+    default: return "Undefined Error";                                              break;
+    }
+    // clang-format on
+}
+
+PathMTUDiscoveryTest::PathMTUDiscoveryTest( void )
+{
+}
+
+PathMTUDiscoveryTest::~PathMTUDiscoveryTest( void )
+{
+}
+
+void PathMTUDiscoveryTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -59,7 +59,8 @@ int PeerConnectDisconnectWithCancelPendingTest::RunTest( bool isVerbose, bool no
         peerList[i] = RakPeerInterface::GetInstance();
         destroyList.push_back( peerList[i] );
 
-        peerList[i]->Startup( maxConnections, &SocketDescriptor( 60000 + i, 0 ), 1 );
+        SocketDescriptor peerSocketDescriptor( 60000 + i, 0 );
+        peerList[i]->Startup( maxConnections, &peerSocketDescriptor, 1 );
         peerList[i]->SetMaximumIncomingConnections( maxConnections );
     }
 
@@ -52,7 +52,8 @@ int PingTestsTest::RunTest( bool isVerbose, bool noPauses )
 
     receiver = RakPeerInterface::GetInstance();
     destroyList.push_back( receiver );
-    receiver->Startup( 2, &SocketDescriptor( 60000, 0 ), 1 );
+    SocketDescriptor receiverSocketDescriptor( 60000, 0 );
+    receiver->Startup( 2, &receiverSocketDescriptor, 1 );
     receiver->SetMaximumIncomingConnections( 2 );
     Packet* packet;
 
@@ -0,0 +1,353 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "RangeListTest.h"
+
+#include "DS_RangeList.h"
+#include "DS_OrderedList.h"
+
+#include <chrono>
+#include <random>
+#include <set>
+
+/*
+Description:
+Inserts sequence numbers in order, out of order and more than once, past the ranges stored inline, and checks the ranges against a std::set
+Serializes with clearSerialized into datagrams too small for all the ranges, and deserializes them
+Then times acking 10000 datagrams a second on one connection, against RangeList as it was with OrderedList and a temporary BitStream
+
+Success conditions:
+The ranges are sorted, disjoint, do not touch, and hold exactly the numbers inserted, also after copying
+Every range serialized comes out of Deserialize, in datagrams no larger than maxBits
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+RangeList Functions Explicitly Tested:
+Insert
+Clear
+Size
+RangeSum
+operator[]
+Serialize
+Deserialize
+*/
+
+namespace {
+
+typedef DataStructures::RangeList<DatagramSequenceNumberType> AckList;
+
+bool Matches( const AckList& list, const std::set<uint32_t>& expected )
+{
+    std::set<uint32_t> covered;
+    for( unsigned i = 0; i < list.Size(); i++ )
+    {
+        if( list[i].maxIndex < list[i].minIndex )
+            return false;
+        // Ranges that touch should have been joined
+        if( i > 0 && !( list[i - 1].maxIndex + (uint32_t)1 < list[i].minIndex ) )
+            return false;
+        for( uint32_t number = list[i].minIndex.val; number <= list[i].maxIndex.val; number++ )
+            covered.insert( number );
+    }
+    return covered == expected && list.RangeSum() == expected.size();
+}
+
+// RangeList as it was before inline storage, kept to compare the time taken
+template<class range_type>
+int OldRangeNodeComp( const range_type& a, const DataStructures::RangeNode<range_type>& b )
+{
+    if( a < b.minIndex )
+        return -1;
+    if( a == b.minIndex )
+        return 0;
+    return 1;
+}
+
+template<class range_type>
+class OldRangeList
+{
+public:
+    void Insert( range_type index );
+    BitSize_t Serialize( BitStream* in, BitSize_t maxBits, bool clearSerialized );
+    unsigned Size( void ) const { return ranges.Size(); }
+
+    DataStructures::OrderedList<range_type, DataStructures::RangeNode<range_type>, OldRangeNodeComp<range_type>> ranges;
+};
+
+template<class range_type>
+BitSize_t OldRangeList<range_type>::Serialize( BitStream* in, BitSize_t maxBits, bool clearSerialized )
+{
+    BitStream tempBS;
+    BitSize_t bitsWritten = 0;
+    unsigned short countWritten = 0;
+    unsigned i;
+    for( i = 0; i < ranges.Size(); i++ )
+    {
+        if( (int)sizeof( unsigned short ) * 8 + bitsWritten + (int)sizeof( range_type ) * 8 * 2 + 1 > maxBits )
+            break;
+        unsigned char minEqualsMax = ranges[i].minIndex == ranges[i].maxIndex ? 1 : 0;
+        tempBS.Write( minEqualsMax );
+        tempBS.Write( ranges[i].minIndex );
+        bitsWritten += sizeof( range_type ) * 8 + 8;
+        if( ranges[i].minIndex != ranges[i].maxIndex )
+        {
+            tempBS.Write( ranges[i].maxIndex );
+            bitsWritten += sizeof( range_type ) * 8;
+        }
+        countWritten++;
+    }
+
+    in->AlignWriteToByteBoundary();
+    BitSize_t before = in->GetWriteOffset();
+    in->Write( countWritten );
+    bitsWritten += in->GetWriteOffset() - before;
+    in->Write( &tempBS, tempBS.GetNumberOfBitsUsed() );
+
+    if( clearSerialized && countWritten )
+    {
+        unsigned rangeSize = ranges.Size();
+        for( i = 0; i < rangeSize - countWritten; i++ )
+            ranges[i] = ranges[i + countWritten];
+        ranges.RemoveFromEnd( countWritten );
+    }
+    return bitsWritten;
+}
+
+template<class range_type>
+void OldRangeList<range_type>::Insert( range_type index )
+{
+    if( ranges.Size() == 0 )
+    {
+        ranges.Insert( index, DataStructures::RangeNode<range_type>( index, index ), true, _FILE_AND_LINE_ );
+        return;
+    }
+
+    bool objectExists;
+    unsigned insertionIndex = ranges.GetIndexFromKey( index, &objectExists );
+    if( insertionIndex == ranges.Size() )
+    {
+        if( index == ranges[insertionIndex - 1].maxIndex + (range_type)1 )
+            ranges[insertionIndex - 1].maxIndex++;
+        else if( index > ranges[insertionIndex - 1].maxIndex + (range_type)1 )
+            ranges.Insert( index, DataStructures::RangeNode<range_type>( index, index ), true, _FILE_AND_LINE_ );
+        return;
+    }
+
+    if( index < ranges[insertionIndex].minIndex - (range_type)1 )
+    {
+        ranges.InsertAtIndex( DataStructures::RangeNode<range_type>( index, index ), insertionIndex, _FILE_AND_LINE_ );
+        return;
+    }
+    else if( index == ranges[insertionIndex].minIndex - (range_type)1 )
+    {
+        ranges[insertionIndex].minIndex--;
+        if( insertionIndex > 0 && ranges[insertionIndex - 1].maxIndex + (range_type)1 == ranges[insertionIndex].minIndex )
+        {
+            ranges[insertionIndex - 1].maxIndex = ranges[insertionIndex].maxIndex;
+            ranges.RemoveAtIndex( insertionIndex );
+        }
+        return;
+    }
+    else if( index >= ranges[insertionIndex].minIndex && index <= ranges[insertionIndex].maxIndex )
+        return;
+    else if( index == ranges[insertionIndex].maxIndex + (range_type)1 )
+    {
+        ranges[insertionIndex].maxIndex++;
+        if( insertionIndex < ranges.Size() - 1 && ranges[insertionIndex + (range_type)1].minIndex == ranges[insertionIndex].maxIndex + (range_type)1 )
+        {
+            ranges[insertionIndex + 1].minIndex = ranges[insertionIndex].minIndex;
+            ranges.RemoveAtIndex( insertionIndex );
+        }
+        return;
+    }
+}
+
+// Datagrams arrive 100 at a time, as with 10000 a second and an update every 10 milliseconds.
+// 1 in 100 is lost and 1 in 50 arrives after the next one. Each update sends what was received, like ReliabilityLayer::SendACKs.
+// \return Nanoseconds per datagram
+template<class List>
+double TimeAcks( List* list, uint32_t datagrams, BitSize_t maxDatagramBits, size_t* bytesSent )
+{
+    std::mt19937 random( 5 );
+    BitStream updateBitStream;
+    *bytesSent = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for( uint32_t update = 0; update < datagrams; update += 100 )
+    {
+        for( uint32_t number = update; number < update + 100; number++ )
+        {
+            const uint32_t roll = random() % 100;
+            if( roll == 0 )
+                continue;
+            if( roll < 3 && number + 1 < update + 100 )
+            {
+                list->Insert( DatagramSequenceNumberType( number + 1 ) );
+                list->Insert( DatagramSequenceNumberType( number ) );
+                number++;
+                continue;
+            }
+            list->Insert( DatagramSequenceNumberType( number ) );
+        }
+        while( list->Size() > 0 )
+        {
+            updateBitStream.Reset();
+            updateBitStream.Write( (unsigned char)0xC0 );
+            list->Serialize( &updateBitStream, maxDatagramBits, true );
+            *bytesSent += updateBitStream.GetNumberOfBytesUsed();
+        }
+    }
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() / (double)datagrams;
+}
+
+} // namespace
+
+int RangeListTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Inserting in order, out of order and more than once\n" );
+
+    std::mt19937 random( 1 );
+    AckList list;
+    std::set<uint32_t> expected;
+    bool valid = true;
+    for( int round = 0; valid && round < 20; round++ )
+    {
+        list.Clear();
+        expected.clear();
+        const uint32_t base = round == 0 ? 0 : random() % 0xF00000;
+        for( uint32_t number = base; number < base + 2000; number++ )
+        {
+            const uint32_t roll = random() % 10;
+            // Skip some, so there are more ranges than are stored inline
+            if( roll == 0 )
+                continue;
+            // Revisit an earlier number, which may extend, join or fall inside a range
+            const uint32_t inserted = roll == 1 ? base + random() % ( number - base + 1 ) : number;
+            list.Insert( DatagramSequenceNumberType( inserted ) );
+            expected.insert( inserted );
+            if( number % 97 == 0 )
+                valid = valid && Matches( list, expected );
+        }
+        valid = valid && Matches( list, expected ) && list.Size() > 8;
+
+        // Copies own their storage, and may start inline and grow
+        AckList copy( list );
+        AckList assigned;
+        assigned.Insert( DatagramSequenceNumberType( base ) );
+        assigned = list;
+        list.Insert( DatagramSequenceNumberType( base + 100000 ) );
+        valid = valid && Matches( copy, expected ) && Matches( assigned, expected );
+        expected.insert( base + 100000 );
+        valid = valid && Matches( list, expected );
+    }
+    if( !valid )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "The ranges did not hold exactly the numbers inserted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Serializing across several datagrams\n" );
+
+    {
+        AckList received;
+        std::set<uint32_t> receivedNumbers;
+        const BitSize_t maxBits = 200;
+        int datagrams = 0;
+        while( list.Size() > 0 && valid )
+        {
+            BitStream datagram;
+            // Misalign, as the datagram header does
+            datagram.Write( true );
+            const unsigned sizeBefore = list.Size();
+            const BitSize_t bitsWritten = list.Serialize( &datagram, maxBits, true );
+            valid = list.Size() < sizeBefore && datagram.GetNumberOfBitsUsed() - 8 <= bitsWritten && bitsWritten <= maxBits;
+
+            bool header;
+            datagram.Read( header );
+            valid = valid && received.Deserialize( &datagram );
+            for( unsigned i = 0; valid && i < received.Size(); i++ )
+            {
+                for( uint32_t number = received[i].minIndex.val; number <= received[i].maxIndex.val; number++ )
+                    receivedNumbers.insert( number );
+            }
+            datagrams++;
+        }
+        valid = valid && datagrams > 1 && receivedNumbers == expected;
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "The ranges deserialized were not those serialized\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 2;
+        }
+    }
+
+    if( isVerbose )
+    {
+        printf( "Acking 10000 datagrams a second for 60 seconds\n" );
+        // About what GetMaxDatagramSizeExcludingMessageHeaderBits() gives with the default MTU
+        const BitSize_t maxDatagramBits = 1400 * 8;
+        const uint32_t datagrams = 600000;
+        size_t oldBytes, newBytes;
+        double oldTime = 0, newTime = 0;
+        for( int i = 0; i < 3; i++ )
+        {
+            OldRangeList<DatagramSequenceNumberType> oldList;
+            AckList newList;
+            const double oldRun = TimeAcks( &oldList, datagrams, maxDatagramBits, &oldBytes );
+            const double newRun = TimeAcks( &newList, datagrams, maxDatagramBits, &newBytes );
+            oldTime = i == 0 || oldRun < oldTime ? oldRun : oldTime;
+            newTime = i == 0 || newRun < newTime ? newRun : newTime;
+        }
+        printf( "OrderedList and temporary BitStream %6.1f ns per datagram, %5.3f%% of a core, %u bytes of acks\n", oldTime, oldTime * 10000 / 1e7, (unsigned)oldBytes );
+        printf( "Inline ranges, written directly     %6.1f ns per datagram, %5.3f%% of a core, %u bytes of acks\n", newTime, newTime * 10000 / 1e7, (unsigned)newBytes );
+    }
+
+    return 0;
+}
+
+std::string RangeListTest::GetTestName() const
+{
+    return "RangeListTest";
+}
+
+std::string RangeListTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "The ranges did not hold exactly the numbers inserted";                      break;
+    case 2: return "The ranges deserialized were not those serialized";                         break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+RangeListTest::RangeListTest( void )
+{
+}
+
+RangeListTest::~RangeListTest( void )
+{
+}
+
+void RangeListTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
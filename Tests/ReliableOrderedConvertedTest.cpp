@@ -134,7 +134,8 @@ int ReliableOrderedConvertedTest::RunTest( bool isVerbose, bool noPauses )
     if( isVerbose )
         printf( "Connecting...\n" );
 
-    sender->Startup( 1, &SocketDescriptor( localPort, 0 ), 1 );
+    SocketDescriptor senderSocketDescriptor( localPort, 0 );
+    sender->Startup( 1, &senderSocketDescriptor, 1 );
     sender->Connect( ip, remotePort, 0, 0 );
 
     receiver = RakPeerInterface::GetInstance();
@@ -150,7 +151,8 @@ int ReliableOrderedConvertedTest::RunTest( bool isVerbose, bool noPauses )
     if( isVerbose )
         printf( "Waiting for connections...\n" );
 
-    receiver->Startup( 32, &SocketDescriptor( localPort, 0 ), 1 );
+    SocketDescriptor receiverSocketDescriptor( localPort, 0 );
+    receiver->Startup( 32, &receiverSocketDescriptor, 1 );
     receiver->SetMaximumIncomingConnections( 32 );
 
     //  if (sender)
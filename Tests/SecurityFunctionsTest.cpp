@@ -11,6 +11,7 @@
 #include "SecurityFunctionsTest.h"
 
 #include <chrono>
+#include <string.h>
 #include <thread>
 
 /*
@@ -76,8 +77,10 @@ int SecurityFunctionsTest::RunTest( bool isVerbose, bool noPauses )
 
     client = RakPeerInterface::GetInstance();
 
-    client->Startup( 1, &SocketDescriptor(), 1 );
-    server->Startup( 1, &SocketDescriptor( 60000, 0 ), 1 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 1, &serverSocketDescriptor, 1 );
     server->SetMaximumIncomingConnections( 1 );
     server->SetIncomingPassword( thePassword, (int)strlen( thePassword ) );
 
@@ -0,0 +1,202 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "SignaledEventTest.h"
+
+#include "SignaledEvent.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/*
+Description:
+Sets the event before waiting, waits without setting it, and sets it from another thread while one waits, over and over at different moments
+Measures how long the waiting thread takes to wake up, as RakPeer's update thread does when a send is queued
+
+Success conditions:
+A wait on a set event returns at once and clears it, so the next wait times out
+A wait that is never set returns after its timeout, and not much later
+Every SetEvent from another thread wakes the waiting thread, long before its timeout
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+SignaledEvent Functions Explicitly Tested:
+InitEvent
+SetEvent
+WaitOnEvent
+CloseEvent
+*/
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double MillisecondsSince( Clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
+bool SetBeforeWaiting( void )
+{
+    SignaledEvent event;
+    event.InitEvent();
+    event.SetEvent();
+    event.SetEvent();
+    Clock::time_point start = Clock::now();
+    event.WaitOnEvent( 5000 );
+    const double signaledWait = MillisecondsSince( start );
+    // Setting twice still only lets one wait through
+    start = Clock::now();
+    event.WaitOnEvent( 20 );
+    const double unsignaledWait = MillisecondsSince( start );
+    event.CloseEvent();
+    return signaledWait < 1000 && unsignaledWait >= 19;
+}
+
+bool TimesOut( void )
+{
+    SignaledEvent event;
+    event.InitEvent();
+    const int timeouts[] = { 0, 1, 10, 45 };
+    bool valid = true;
+    for( int timeoutMs : timeouts )
+    {
+        const Clock::time_point start = Clock::now();
+        event.WaitOnEvent( timeoutMs );
+        const double waited = MillisecondsSince( start );
+        valid = valid && waited >= timeoutMs - 1 && waited < timeoutMs + 1000;
+    }
+    event.CloseEvent();
+    return valid;
+}
+
+// \param[out] latencies Microseconds from each SetEvent to the waiting thread returning
+// \return If every SetEvent woke the waiting thread well before its timeout
+bool WakesWaiter( int rounds, std::vector<double>* latencies )
+{
+    SignaledEvent event;
+    event.InitEvent();
+    std::atomic<bool> waiting( false );
+    std::atomic<long long> setAt( 0 );
+    std::atomic<bool> valid( true );
+    std::thread waiter( [&]() {
+        for( int round = 0; round < rounds; round++ )
+        {
+            waiting = true;
+            event.WaitOnEvent( 5000 );
+            const long long set = setAt.exchange( 0 );
+            const long long now = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now().time_since_epoch() ).count();
+            if( set == 0 || now - set > 1000000000LL )
+                valid = false;
+            else
+                latencies->push_back( ( now - set ) / 1000.0 );
+        }
+    } );
+    for( int round = 0; round < rounds; round++ )
+    {
+        while( !waiting.exchange( false ) )
+            std::this_thread::yield();
+        // Set the event at different moments of the waiting thread going to sleep
+        for( volatile int spin = 0; spin < ( round * 37 ) % 5000; spin++ )
+        {
+        }
+        setAt = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now().time_since_epoch() ).count();
+        event.SetEvent();
+    }
+    waiter.join();
+    event.CloseEvent();
+    return valid;
+}
+
+} // namespace
+
+int SignaledEventTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Waiting on an event set beforehand\n" );
+
+    if( !SetBeforeWaiting() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A set event did not let exactly one wait through\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Waiting on an event that is never set\n" );
+
+    if( !TimesOut() )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A wait did not last as long as its timeout\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    if( isVerbose )
+        printf( "Setting the event from another thread\n" );
+
+    std::vector<double> latencies;
+    if( !WakesWaiter( 5000, &latencies ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "SetEvent from another thread did not wake the waiting thread\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 3;
+    }
+
+    if( isVerbose )
+    {
+        std::sort( latencies.begin(), latencies.end() );
+        printf( "Microseconds from SetEvent to WaitOnEvent returning, %u hardware threads\n", std::thread::hardware_concurrency() );
+        printf( "median %.1f, 99th percentile %.1f, most %.1f\n", latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back() );
+    }
+
+    return 0;
+}
+
+std::string SignaledEventTest::GetTestName() const
+{
+    return "SignaledEventTest";
+}
+
+std::string SignaledEventTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "A set event did not let exactly one wait through";                          break;
+    case 2: return "A wait did not last as long as its timeout";                                break;
+    case 3: return "SetEvent from another thread did not wake the waiting thread";              break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+SignaledEventTest::SignaledEventTest( void )
+{
+}
+
+SignaledEventTest::~SignaledEventTest( void )
+{
+}
+
+void SignaledEventTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -0,0 +1,351 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "SingleProducerConsumerRingTest.h"
+
+#include "SingleProducerConsumer.h"
+#include "SingleProducerConsumerRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/*
+Description:
+Passes numbered elements from a producer thread to a consumer thread through rings small enough to keep growing,
+locking single elements and runs of them, holding locks while rings are chained and cancelling some,
+then checks the locks on one thread, and compares the throughput with SingleProducerConsumer
+
+Success conditions:
+Every element is read once and in order, including those cancelled and locked again
+Locks held while a ring is chained are unlocked together, and Size, ReadIsLocked, CheckReadUnlockOrder and Clear are right
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+SingleProducerConsumerRing Functions Explicitly Tested:
+WriteLock
+WriteLockN
+CancelWriteLock
+WriteUnlock
+WriteUnlockN
+ReadLock
+ReadLockN
+CancelReadLock
+ReadUnlock
+ReadUnlockN
+Clear
+Size
+CheckReadUnlockOrder
+ReadIsLocked
+*/
+
+namespace {
+
+struct Element
+{
+    uint64_t sequence;
+};
+
+const uint64_t cancelledSequence = ~(uint64_t)0;
+
+// Producer and consumer lock in varying runs, and sometimes cancel part of what they locked
+bool TransferWithCancels( uint64_t total )
+{
+    DataStructures::SingleProducerConsumerRing<Element> queue( 4 );
+    std::atomic<bool> isValid( true );
+
+    std::thread producer( [&]() {
+        uint64_t sequence = 0;
+        unsigned round = 0;
+        while( sequence < total )
+        {
+            round++;
+            int maxCount = 1 + ( round * 7 ) % 40;
+            if( (uint64_t)maxCount > total - sequence )
+                maxCount = (int)( total - sequence );
+            int count;
+            Element* run = maxCount == 1 ? queue.WriteLock() : queue.WriteLockN( maxCount, &count );
+            if( maxCount == 1 )
+                count = 1;
+            for( int i = 0; i < count; i++ )
+                run[i].sequence = sequence++;
+
+            // Locked after the run, and cancelled before the run is unlocked
+            if( round % 13 == 0 )
+            {
+                int extraCount;
+                Element* extra = queue.WriteLockN( 3, &extraCount );
+                for( int i = 0; i < extraCount; i++ )
+                    extra[i].sequence = cancelledSequence;
+                queue.CancelWriteLock( extra );
+            }
+
+            // Held across another lock, which may chain a ring, and unlocked together
+            if( round % 5 == 0 && sequence < total )
+            {
+                int secondCount;
+                Element* second = queue.WriteLockN( 1 + round % 9, &secondCount );
+                if( (uint64_t)secondCount > total - sequence )
+                    queue.CancelWriteLock( second );
+                else
+                {
+                    for( int i = 0; i < secondCount; i++ )
+                        second[i].sequence = sequence++;
+                    count += secondCount;
+                }
+            }
+
+            if( count == 1 && round % 2 == 0 )
+                queue.WriteUnlock();
+            else
+                queue.WriteUnlockN( count );
+        }
+    } );
+
+    std::thread consumer( [&]() {
+        uint64_t expected = 0;
+        unsigned round = 0;
+        while( expected < total && isValid.load( std::memory_order_relaxed ) )
+        {
+            round++;
+            int count;
+            Element* run = round % 3 == 0 ? queue.ReadLock() : queue.ReadLockN( 1 + ( round * 11 ) % 50, &count );
+            if( round % 3 == 0 )
+                count = 1;
+            if( run == 0 )
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if( !queue.CheckReadUnlockOrder( run ) || !queue.ReadIsLocked() )
+                isValid.store( false );
+
+            // Read half, and read the rest again next time
+            if( round % 7 == 0 && count >= 2 )
+            {
+                queue.CancelReadLock( run + count / 2 );
+                count /= 2;
+            }
+            for( int i = 0; i < count; i++ )
+            {
+                if( run[i].sequence != expected++ )
+                    isValid.store( false );
+            }
+            if( count == 1 )
+                queue.ReadUnlock();
+            else
+                queue.ReadUnlockN( count );
+        }
+    } );
+
+    producer.join();
+    consumer.join();
+    return isValid.load() && queue.ReadLock() == 0 && queue.Size() == 0 && queue.ReadIsLocked() == false;
+}
+
+// \param[in] batch Elements locked at a time, for the queues that can lock more than one
+// \return Nanoseconds per element
+template<class Queue>
+double Transfer( Queue* queue, uint64_t total, int batch, bool* valid );
+
+template<>
+double Transfer( DataStructures::SingleProducerConsumer<Element>* queue, uint64_t total, int batch, bool* valid )
+{
+    (void)batch;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread producer( [=]() {
+        for( uint64_t sequence = 0; sequence < total; sequence++ )
+        {
+            queue->WriteLock()->sequence = sequence;
+            queue->WriteUnlock();
+        }
+    } );
+    bool isValid = true;
+    uint64_t expected = 0;
+    while( expected < total )
+    {
+        Element* element = queue->ReadLock();
+        if( element == 0 )
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        isValid = isValid && element->sequence == expected;
+        expected++;
+        queue->ReadUnlock();
+    }
+    producer.join();
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    *valid = isValid;
+    return (double)elapsed / (double)total;
+}
+
+template<>
+double Transfer( DataStructures::SingleProducerConsumerRing<Element>* queue, uint64_t total, int batch, bool* valid )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread producer( [=]() {
+        uint64_t sequence = 0;
+        while( sequence < total )
+        {
+            int count;
+            Element* run = queue->WriteLockN( batch, &count );
+            for( int i = 0; i < count; i++ )
+                run[i].sequence = sequence++;
+            queue->WriteUnlockN( count );
+        }
+    } );
+    bool isValid = true;
+    uint64_t expected = 0;
+    while( expected < total )
+    {
+        int count;
+        Element* run = queue->ReadLockN( batch, &count );
+        if( run == 0 )
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        for( int i = 0; i < count; i++ )
+            isValid = isValid && run[i].sequence == expected++;
+        queue->ReadUnlockN( count );
+    }
+    producer.join();
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    *valid = isValid;
+    return (double)elapsed / (double)total;
+}
+
+} // namespace
+
+int SingleProducerConsumerRingTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Passing elements between threads, growing from a ring of 4\n" );
+
+    if( !TransferWithCancels( 2000000 ) )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "An element was lost, read twice or read out of order\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Holding locks while a ring is chained\n" );
+
+    {
+        DataStructures::SingleProducerConsumerRing<Element> queue( 4 );
+        Element* locked[3];
+        for( int i = 0; i < 3; i++ )
+        {
+            locked[i] = queue.WriteLock();
+            locked[i]->sequence = i;
+        }
+        // One left in the first ring, then a second ring twice the size
+        int lastCount, grownCount;
+        Element* last = queue.WriteLockN( 8, &lastCount );
+        last->sequence = 3;
+        Element* grown = queue.WriteLockN( 8, &grownCount );
+        bool valid = lastCount == 1 && grownCount == 8 && queue.ReadLock() == 0 && queue.Size() == 0;
+        for( int i = 0; i < grownCount; i++ )
+            grown[i].sequence = 4 + i;
+        queue.WriteUnlockN( 12 );
+        valid = valid && queue.Size() == 12;
+
+        int firstCount, secondCount;
+        Element* first = queue.ReadLockN( 16, &firstCount );
+        valid = valid && first == locked[0] && firstCount == 4 && queue.CheckReadUnlockOrder( first ) && queue.ReadIsLocked();
+        Element* second = queue.ReadLockN( 16, &secondCount );
+        valid = valid && second == grown && secondCount == 8;
+        for( int i = 0; valid && i < 4; i++ )
+            valid = first[i].sequence == (uint64_t)i;
+        for( int i = 0; valid && i < 8; i++ )
+            valid = second[i].sequence == (uint64_t)( 4 + i );
+        queue.ReadUnlockN( 12 );
+        valid = valid && queue.ReadIsLocked() == false && queue.Size() == 0 && queue.ReadLock() == 0;
+
+        // Clear keeps the larger ring
+        queue.WriteLock();
+        queue.WriteUnlock();
+        queue.Clear();
+        int clearedCount;
+        valid = valid && queue.ReadLock() == 0 && queue.Size() == 0 && queue.WriteLockN( 100, &clearedCount ) != 0 && clearedCount == 8;
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Locks held while a ring was chained did not unlock in order\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 2;
+        }
+    }
+
+    if( isVerbose )
+    {
+        printf( "Measuring time per element, %u hardware threads\n", std::thread::hardware_concurrency() );
+        const uint64_t total = 10000000;
+        bool valid;
+        // Best of 3, as how far the producer gets ahead depends on the scheduler
+        double linked = 0, ring = 0, batched = 0;
+        for( int i = 0; i < 3; i++ )
+        {
+            DataStructures::SingleProducerConsumer<Element> linkedQueue;
+            DataStructures::SingleProducerConsumerRing<Element> ringQueue;
+            DataStructures::SingleProducerConsumerRing<Element> batchQueue;
+            const double linkedTime = Transfer( &linkedQueue, total, 1, &valid );
+            const double ringTime = Transfer( &ringQueue, total, 1, &valid );
+            const double batchedTime = Transfer( &batchQueue, total, 32, &valid );
+            linked = i == 0 || linkedTime < linked ? linkedTime : linked;
+            ring = i == 0 || ringTime < ring ? ringTime : ring;
+            batched = i == 0 || batchedTime < batched ? batchedTime : batched;
+        }
+        printf( "SingleProducerConsumer                   %6.1f ns\n", linked );
+        printf( "SingleProducerConsumerRing               %6.1f ns\n", ring );
+        printf( "SingleProducerConsumerRing, 32 at a time %6.1f ns\n", batched );
+    }
+
+    return 0;
+}
+
+std::string SingleProducerConsumerRingTest::GetTestName() const
+{
+    return "SingleProducerConsumerRingTest";
+}
+
+std::string SingleProducerConsumerRingTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "An element was lost, read twice or read out of order";                      break;
+    case 2: return "Locks held while a ring was chained did not unlock in order";               break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+SingleProducerConsumerRingTest::SingleProducerConsumerRingTest( void )
+{
+}
+
+SingleProducerConsumerRingTest::~SingleProducerConsumerRingTest( void )
+{
+}
+
+void SingleProducerConsumerRingTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -0,0 +1,276 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "StringCompressorTest.h"
+
+#include "DS_HuffmanEncodingTree.h"
+#include "Rand.h"
+#include "StringCompressor.h"
+
+#include <chrono>
+#include <string.h>
+
+/*
+Description:
+Round trips strings through StringCompressor, checks the table decoder of HuffmanEncodingTree against walking the tree,
+and measures how fast each decodes
+
+Success conditions:
+Strings of any bytes read back as written, at every bit offset, and strings longer than the output are truncated without losing the position in the stream
+The table decoder decodes the same characters as the tree walk from any bits, including trees with codes longer than the table
+Strings that claim more bits than the stream holds are rejected
+
+Failure conditions:
+Any of the above fails. Throughput is only reported.
+
+StringCompressor Functions Explicitly Tested:
+EncodeString
+DecodeString
+
+HuffmanEncodingTree Functions Explicitly Tested:
+GenerateFromFrequencyTable
+EncodeArray
+DecodeArray
+DecodeArrayTreeWalk
+*/
+
+static const char* const chatLines[] = {
+    "gg wp everyone, that was close",
+    "Anyone up for another round? I'll host.",
+    "PlayerOne has joined the lobby",
+    "brb 5 min, need to grab food",
+    "Nice shot! How did you see me behind the crates?",
+    "Team Blue wins the match 3-2",
+    "can someone invite me to the party? name is xX_Sniper_Xx",
+    "Server restarting in 10 minutes for maintenance.",
+};
+
+// Decodes the same bits both ways and compares what comes out
+static bool DecodersAgree( HuffmanEncodingTree* tree, const unsigned char* data, BitSize_t offset, BitSize_t sizeInBits )
+{
+    unsigned char tableOutput[512], walkOutput[512];
+    BitStream tableInput( (unsigned char*)data, BITS_TO_BYTES( offset + sizeInBits ), false );
+    tableInput.IgnoreBits( offset );
+    BitStream walkInput( (unsigned char*)data, BITS_TO_BYTES( offset + sizeInBits ), false );
+    walkInput.IgnoreBits( offset );
+
+    const unsigned tableCount = tree->DecodeArray( &tableInput, sizeInBits, sizeof( tableOutput ), tableOutput );
+    const unsigned walkCount = tree->DecodeArrayTreeWalk( &walkInput, sizeInBits, sizeof( walkOutput ), walkOutput );
+    const unsigned compared = tableCount < sizeof( tableOutput ) ? tableCount : sizeof( tableOutput );
+    return tableCount == walkCount && memcmp( tableOutput, walkOutput, compared ) == 0 && tableInput.GetReadOffset() == walkInput.GetReadOffset();
+}
+
+int StringCompressorTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    RakNetRandom rnr;
+    rnr.SeedMT( 1 );
+    StringCompressor compressor;
+
+    if( isVerbose )
+        printf( "Round tripping strings\n" );
+
+    std::vector<std::string> strings( chatLines, chatLines + sizeof( chatLines ) / sizeof( chatLines[0] ) );
+    strings.push_back( "" );
+    std::string everyByte;
+    for( int c = 1; c < 256; c++ )
+        everyByte += (char)c;
+    strings.push_back( everyByte );
+    for( int i = 0; i < 50; i++ )
+    {
+        std::string random( rnr.RandomMT() % 300, ' ' );
+        for( char& c : random )
+            c = (char)( 1 + rnr.RandomMT() % 255 );
+        strings.push_back( random );
+    }
+
+    bool roundTrips = true;
+    for( const std::string& string : strings )
+    {
+        for( int offset = 0; offset < 8; offset++ )
+        {
+            BitStream bitStream;
+            for( int i = 0; i < offset; i++ )
+                bitStream.Write1();
+            compressor.EncodeString( string.c_str(), 0, &bitStream );
+            bitStream.Write( (uint32_t)0x12345678 );
+
+            bitStream.IgnoreBits( offset );
+            char output[512];
+            uint32_t marker = 0;
+            roundTrips = roundTrips && compressor.DecodeString( output, sizeof( output ), &bitStream ) && string == output &&
+                         bitStream.Read( marker ) && marker == 0x12345678;
+
+            // Truncated to fit, still leaving the stream after the string
+            bitStream.ResetReadPointer();
+            bitStream.IgnoreBits( offset );
+            char truncated[8];
+            marker = 0;
+            roundTrips = roundTrips && compressor.DecodeString( truncated, sizeof( truncated ), &bitStream ) &&
+                         string.substr( 0, sizeof( truncated ) - 1 ) == truncated && bitStream.Read( marker ) && marker == 0x12345678;
+        }
+    }
+
+    if( !roundTrips )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A string did not read back as written\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Comparing the table decoder with the tree walk\n" );
+
+    // The default tree, and one whose Fibonacci frequencies give codes far longer than the table
+    HuffmanEncodingTree englishTree, deepTree;
+    unsigned int frequencies[256];
+    for( int c = 0; c < 256; c++ )
+        frequencies[c] = 1;
+    frequencies[' '] = 11084;
+    frequencies['e'] = 5870;
+    frequencies['t'] = 4771;
+    englishTree.GenerateFromFrequencyTable( frequencies );
+    unsigned int previous = 1, current = 1;
+    for( int c = 0; c < 40; c++ )
+    {
+        frequencies[c] = current;
+        const unsigned int next = previous + current;
+        previous = current;
+        current = next;
+    }
+    for( int c = 40; c < 256; c++ )
+        frequencies[c] = 1;
+    deepTree.GenerateFromFrequencyTable( frequencies );
+
+    bool decodersAgree = true;
+    std::vector<unsigned char> noise( 300 );
+    for( int i = 0; i < 2000; i++ )
+    {
+        for( unsigned char& byte : noise )
+            byte = (unsigned char)rnr.RandomMT();
+        const BitSize_t offset = rnr.RandomMT() % 8, sizeInBits = rnr.RandomMT() % ( ( noise.size() - 1 ) * 8 );
+        decodersAgree = decodersAgree && DecodersAgree( &englishTree, noise.data(), offset, sizeInBits ) &&
+                        DecodersAgree( &deepTree, noise.data(), offset, sizeInBits );
+    }
+
+    // Characters with the longest codes round trip through the deep tree
+    for( int c = 0; c < 256 && decodersAgree; c += 5 )
+    {
+        unsigned char text[64];
+        for( size_t i = 0; i < sizeof( text ); i++ )
+            text[i] = (unsigned char)( ( c + i * 37 ) % 256 );
+        BitStream encoded;
+        encoded.Write0();
+        deepTree.EncodeArray( text, sizeof( text ), &encoded );
+        encoded.IgnoreBits( 1 );
+        unsigned char decoded[64];
+        decodersAgree = deepTree.DecodeArray( &encoded, encoded.GetNumberOfBitsUsed() - 1, sizeof( decoded ), decoded ) == sizeof( text ) &&
+                        memcmp( text, decoded, sizeof( text ) ) == 0 && DecodersAgree( &deepTree, encoded.GetData(), 1, encoded.GetNumberOfBitsUsed() - 1 );
+    }
+
+    if( !decodersAgree )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "The table decoder differs from the tree walk\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    // A length longer than the rest of the stream
+    {
+        BitStream bitStream;
+        bitStream.WriteCompressed( (uint32_t)1000 );
+        bitStream.Write( (uint32_t)0 );
+        char output[64];
+        if( compressor.DecodeString( output, sizeof( output ), &bitStream ) )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A string longer than the stream was accepted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 3;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Measuring decoding throughput\n" );
+
+    BitStream chat;
+    const int linesPerPass = 1000;
+    uint64_t charactersPerPass = 0;
+    for( int i = 0; i < linesPerPass; i++ )
+    {
+        const char* line = chatLines[i % ( sizeof( chatLines ) / sizeof( chatLines[0] ) )];
+        englishTree.EncodeArray( (unsigned char*)line, strlen( line ), &chat );
+        charactersPerPass += strlen( line );
+    }
+
+    const int passes = 20;
+    std::vector<unsigned char> decoded( charactersPerPass + 8 );
+    uint64_t checksum = 0;
+    const auto measure = [&]( bool useTable ) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for( int pass = 0; pass < passes; pass++ )
+        {
+            chat.ResetReadPointer();
+            if( useTable )
+                checksum += englishTree.DecodeArray( &chat, chat.GetNumberOfBitsUsed(), decoded.size(), decoded.data() );
+            else
+                checksum += englishTree.DecodeArrayTreeWalk( &chat, chat.GetNumberOfBitsUsed(), decoded.size(), decoded.data() );
+        }
+        const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+        return (double)( charactersPerPass * passes ) / (double)( elapsed > 0 ? elapsed : 1 );
+    };
+    const double treeWalkRate = measure( false );
+    const double tableRate = measure( true );
+
+    if( isVerbose )
+    {
+        printf( "Tree walk:  %6.3f characters/ns\n", treeWalkRate );
+        printf( "Table:      %6.3f characters/ns\n", tableRate );
+        printf( "(checksum %llu)\n", (unsigned long long)checksum );
+    }
+
+    return 0;
+}
+
+std::string StringCompressorTest::GetTestName() const
+{
+    return "StringCompressorTest";
+}
+
+std::string StringCompressorTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                          break;
+    case 1: return "A string did not read back as written";             break;
+    case 2: return "The table decoder differs from the tree walk";      break;
+    case 3: return "A string longer than the stream was accepted";      break;
+    default: return "Undefined Error";                                  break;
+    }
+    // clang-format on
+}
+
+StringCompressorTest::StringCompressorTest( void )
+{
+}
+
+StringCompressorTest::~StringCompressorTest( void )
+{
+}
+
+void StringCompressorTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -0,0 +1,296 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "StringTableTest.h"
+
+#include "Rand.h"
+#include "StringCompressor.h"
+#include "StringTable.h"
+
+#include <deque>
+#include <string.h>
+
+/*
+Description:
+Sends messages full of repeated item names through StringTableSender and StringTableReceiver with simulated loss, reordering and late receipts,
+with a table smaller than the set of names so that IDs are reused, and compares the bandwidth to StringCompressor alone
+
+Success conditions:
+Every message that arrives reads back as sent, in any order
+Interned strings take less than half the bits of StringCompressor
+A reference to an ID that was never defined is rejected
+A message reported lost that arrives after its ID was reused is rejected, and a late definition does not replace the later one
+Strings longer than the limit and truncated strings read back as StringCompressor would read them
+OnReceive handles ID_SND_RECEIPT_ACKED
+
+Failure conditions:
+Any of the above fails
+
+StringTableSender Functions Explicitly Tested:
+EncodeString
+SetSendReceipt
+OnReceive
+OnAcknowledged
+OnLost
+GetAcknowledgedCount
+
+StringTableReceiver Functions Explicitly Tested:
+DecodeString
+*/
+
+static const char* const itemAdjectives[] = { "Rusty", "Enchanted", "Gleaming", "Cursed", "Ancient", "Masterwork", "Broken", "Legendary" };
+static const char* const itemNouns[] = { "Longsword", "Shield of Dawn", "Healing Potion", "Leather Boots", "Crossbow" };
+
+// Item names, a few of them much more common than the rest
+static std::string RandomItemName( RakNetRandom* rnr )
+{
+    const float skewed = rnr->FrandomMT() * rnr->FrandomMT();
+    const int index = (int)( skewed * ( sizeof( itemAdjectives ) / sizeof( itemAdjectives[0] ) ) * ( sizeof( itemNouns ) / sizeof( itemNouns[0] ) ) );
+    return std::string( itemAdjectives[index % 8] ) + " " + itemNouns[index / 8];
+}
+
+int StringTableTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    RakNetRandom rnr;
+    rnr.SeedMT( 1 );
+    StringCompressor::AddReference();
+
+    if( isVerbose )
+        printf( "Sending item names with 10%% loss, reordering and receipts 3 messages late\n" );
+
+    // 40 names and 32 IDs
+    const unsigned int maxEntries = 32;
+    const RakNetGUID guid( 7 );
+    StringTableSender sender( maxEntries );
+    StringTableReceiver receiver( maxEntries );
+
+    struct InFlight
+    {
+        int deliveryTick;
+        uint32_t sendReceipt;
+        bool isLost;
+        std::vector<std::string> strings;
+        std::vector<unsigned char> data;
+        BitSize_t bits;
+    };
+    std::deque<InFlight> inFlight;
+    struct PendingReceipt
+    {
+        int tick;
+        uint32_t sendReceipt;
+        bool isAcknowledged;
+    };
+    std::deque<PendingReceipt> receipts;
+
+    const int messageCount = 3000;
+    uint64_t internedBits = 0, compressedBits = 0;
+    int arrivedCount = 0;
+    bool readBackAsSent = true;
+    for( int tick = 0; tick < messageCount + 20; tick++ )
+    {
+        if( tick < messageCount )
+        {
+            InFlight message;
+            message.sendReceipt = tick + 1;
+            message.isLost = rnr.FrandomMT() < 0.1f;
+            // Mostly in order, sometimes overtaken by the next few messages
+            message.deliveryTick = tick + 1 + ( rnr.FrandomMT() < 0.1f ? (int)( rnr.RandomMT() % 4 ) : 0 );
+
+            BitStream bitStream, compressed;
+            for( int i = 0; i < 5; i++ )
+            {
+                message.strings.push_back( RandomItemName( &rnr ) );
+                sender.EncodeString( message.strings.back(), 256, guid, &bitStream );
+                StringCompressor::Instance()->EncodeString( message.strings.back(), 256, &compressed );
+            }
+            sender.SetSendReceipt( guid, message.sendReceipt );
+            internedBits += bitStream.GetNumberOfBitsUsed();
+            compressedBits += compressed.GetNumberOfBitsUsed();
+            message.data.assign( bitStream.GetData(), bitStream.GetData() + bitStream.GetNumberOfBytesUsed() );
+            message.bits = bitStream.GetNumberOfBitsUsed();
+            inFlight.push_back( message );
+        }
+
+        for( auto it = inFlight.begin(); it != inFlight.end(); )
+        {
+            if( it->deliveryTick > tick )
+            {
+                ++it;
+                continue;
+            }
+
+            if( it->isLost == false )
+            {
+                BitStream bitStream( it->data.data(), (unsigned int)it->data.size(), false );
+                for( const std::string& expected : it->strings )
+                {
+                    char output[256];
+                    readBackAsSent = readBackAsSent && receiver.DecodeString( output, sizeof( output ), guid, &bitStream ) && expected == output;
+                }
+                readBackAsSent = readBackAsSent && bitStream.GetReadOffset() == it->bits;
+                arrivedCount++;
+            }
+            receipts.push_back( { tick + 3, it->sendReceipt, it->isLost == false } );
+            it = inFlight.erase( it );
+        }
+
+        while( !receipts.empty() && receipts.front().tick <= tick )
+        {
+            if( receipts.front().isAcknowledged )
+                sender.OnAcknowledged( guid, receipts.front().sendReceipt );
+            else
+                sender.OnLost( guid, receipts.front().sendReceipt );
+            receipts.pop_front();
+        }
+    }
+
+    if( isVerbose )
+        printf( "%d of %d messages arrived, StringCompressor %u bytes, interned %u bytes, %.1f%% saved\n", arrivedCount, messageCount,
+                (unsigned int)BITS_TO_BYTES( compressedBits ), (unsigned int)BITS_TO_BYTES( internedBits ), 100.0 - 100.0 * internedBits / compressedBits );
+
+    if( !readBackAsSent )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A string did not read back as sent\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        StringCompressor::RemoveReference();
+        return 1;
+    }
+
+    if( internedBits * 2 >= compressedBits || sender.GetAcknowledgedCount( guid ) == 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Interning did not save at least half the bandwidth\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        StringCompressor::RemoveReference();
+        return 2;
+    }
+
+    // A receiver that missed the definitions, as after reconnecting
+    {
+        BitStream bitStream;
+        sender.EncodeString( "Rusty Longsword", 256, guid, &bitStream );
+        StringTableReceiver newReceiver( maxEntries );
+        char output[256];
+        if( newReceiver.DecodeString( output, sizeof( output ), guid, &bitStream ) )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A reference to an undefined ID was accepted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            StringCompressor::RemoveReference();
+            return 3;
+        }
+    }
+
+    // Too long to intern, truncated, and empty, then acknowledged through OnReceive
+    {
+        const RakNetGUID otherGuid( 8 );
+        const std::string longString( 300, 'x' );
+        BitStream bitStream;
+        sender.EncodeString( longString, 0, otherGuid, &bitStream );
+        sender.EncodeString( "Gleaming Crossbow", 9, otherGuid, &bitStream );
+        sender.EncodeString( "", 0, otherGuid, &bitStream );
+        sender.SetSendReceipt( otherGuid, 5000 );
+
+        unsigned char receiptData[5] = { ID_SND_RECEIPT_ACKED };
+        const uint32_t sendReceipt = 5000;
+        memcpy( receiptData + 1, &sendReceipt, sizeof( sendReceipt ) );
+        Packet receiptPacket;
+        receiptPacket.data = receiptData;
+        receiptPacket.length = sizeof( receiptData );
+        receiptPacket.guid = otherGuid;
+        const bool handledReceipt = sender.OnReceive( &receiptPacket ) && sender.GetAcknowledgedCount( otherGuid ) == 2;
+
+        std::string longOutput, truncatedOutput, emptyOutput;
+        if( !handledReceipt || !receiver.DecodeString( longOutput, 1000, otherGuid, &bitStream ) || longOutput != longString ||
+            !receiver.DecodeString( truncatedOutput, 1000, otherGuid, &bitStream ) || truncatedOutput != "Gleaming" ||
+            !receiver.DecodeString( emptyOutput, 1000, otherGuid, &bitStream ) || !emptyOutput.empty() )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Long, truncated or empty strings did not read back\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            StringCompressor::RemoveReference();
+            return 4;
+        }
+    }
+
+    // One ID, so the second string reuses it while a message referring to the first one is late
+    {
+        const RakNetGUID lateGuid( 9 );
+        StringTableSender oneEntrySender( 1 );
+        StringTableReceiver oneEntryReceiver( 1 );
+        BitStream definition, lateReference, redefinition, reference;
+        oneEntrySender.EncodeString( "Cursed Shield of Dawn", 0, lateGuid, &definition );
+        oneEntrySender.SetSendReceipt( lateGuid, 1 );
+        oneEntrySender.OnAcknowledged( lateGuid, 1 );
+        oneEntrySender.EncodeString( "Cursed Shield of Dawn", 0, lateGuid, &lateReference );
+        oneEntrySender.SetSendReceipt( lateGuid, 2 );
+        oneEntrySender.OnLost( lateGuid, 2 );
+        oneEntrySender.EncodeString( "Ancient Crossbow", 0, lateGuid, &redefinition );
+        oneEntrySender.SetSendReceipt( lateGuid, 3 );
+        oneEntrySender.OnAcknowledged( lateGuid, 3 );
+        oneEntrySender.EncodeString( "Ancient Crossbow", 0, lateGuid, &reference );
+
+        // The definition arrives again after the redefinition, as a duplicate would
+        std::string first, second, late, lateFirst, last;
+        BitStream lateDefinition( definition.GetData(), definition.GetNumberOfBytesUsed(), false );
+        const bool readInOrder = oneEntryReceiver.DecodeString( first, 256, lateGuid, &definition ) && first == "Cursed Shield of Dawn" &&
+                                 oneEntryReceiver.DecodeString( second, 256, lateGuid, &redefinition ) && second == "Ancient Crossbow";
+        const bool acceptedLate = oneEntryReceiver.DecodeString( late, 256, lateGuid, &lateReference );
+        const bool readLate = oneEntryReceiver.DecodeString( lateFirst, 256, lateGuid, &lateDefinition ) && lateFirst == "Cursed Shield of Dawn" &&
+                              oneEntryReceiver.DecodeString( last, 256, lateGuid, &reference ) && last == "Ancient Crossbow";
+        if( !readInOrder || acceptedLate || !readLate )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A late message read a reused ID with its old meaning\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            StringCompressor::RemoveReference();
+            return 5;
+        }
+    }
+
+    StringCompressor::RemoveReference();
+    return 0;
+}
+
+std::string StringTableTest::GetTestName() const
+{
+    return "StringTableTest";
+}
+
+std::string StringTableTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                              break;
+    case 1: return "A string did not read back as sent";                    break;
+    case 2: return "Interning did not save at least half the bandwidth";    break;
+    case 3: return "A reference to an undefined ID was accepted";           break;
+    case 4: return "Long, truncated or empty strings did not read back";    break;
+    case 5: return "A late message read a reused ID with its old meaning";  break;
+    default: return "Undefined Error";                                      break;
+    }
+    // clang-format on
+}
+
+StringTableTest::StringTableTest( void )
+{
+}
+
+StringTableTest::~StringTableTest( void )
+{
+}
+
+void StringTableTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -82,7 +82,8 @@ int SystemAddressAndGuidTest::RunTest( bool isVerbose, bool noPauses )
         return 1;
     }
 
-    client->Startup( 1, &SocketDescriptor( 60001, 0 ), 1 );
+    SocketDescriptor clientSocketDescriptor( 60001, 0 );
+    client->Startup( 1, &clientSocketDescriptor, 1 );
 
     if( !client->IsActive() )
     {
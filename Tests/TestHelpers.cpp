@@ -10,6 +10,8 @@
 
 #include "TestHelpers.h"
 
+#include <string.h>
+
 TestHelpers::TestHelpers( void )
 {
 }
@@ -22,7 +24,8 @@ void TestHelpers::StandardServerPrep( RakPeerInterface*& server )
 {
 
     server = RakPeerInterface::GetInstance();
-    server->Startup( 1, &SocketDescriptor( 60000, 0 ), 1 );
+    SocketDescriptor serverSocketDescriptor( 60000, 0 );
+    server->Startup( 1, &serverSocketDescriptor, 1 );
     server->SetMaximumIncomingConnections( 1 );
 }
 
@@ -31,7 +34,8 @@ void TestHelpers::StandardClientPrep( RakPeerInterface*& client )
 
     client = RakPeerInterface::GetInstance();
 
-    client->Startup( 1, &SocketDescriptor(), 1 );
+    SocketDescriptor clientSocketDescriptor;
+    client->Startup( 1, &clientSocketDescriptor, 1 );
 }
 
 void TestHelpers::StandardServerPrep( RakPeerInterface*& server, std::vector<RakPeerInterface*>& destroyList )
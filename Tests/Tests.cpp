@@ -47,6 +47,25 @@ int main( int argc, char* argv[] )
     testList.push_back( new SystemAddressAndGuidTest() );
     testList.push_back( new PacketAndLowLevelTestsTest() );
     testList.push_back( new MiscellaneousTestsTest() );
+    testList.push_back( new DatagramIntegrityTest() );
+    testList.push_back( new DatagramCompressionTest() );
+    testList.push_back( new DictionaryCompressionTest() );
+    testList.push_back( new PathMTUDiscoveryTest() );
+    testList.push_back( new NetworkSimulatorTest() );
+    testList.push_back( new BitStreamBenchmarkTest() );
+    testList.push_back( new DeltaSnapshotTest() );
+    testList.push_back( new StringCompressorTest() );
+    testList.push_back( new StringTableTest() );
+    testList.push_back( new ThreadsafeMemoryPoolTest() );
+    testList.push_back( new ThreadsafeAllocatingQueueTest() );
+    testList.push_back( new ThreadPoolTest() );
+    testList.push_back( new SingleProducerConsumerRingTest() );
+    testList.push_back( new FlatHashMapTest() );
+    testList.push_back( new RangeListTest() );
+    testList.push_back( new ByteQueueTest() );
+    testList.push_back( new MemoryBackendTest() );
+    testList.push_back( new MemoryProfilerTest() );
+    testList.push_back( new SignaledEventTest() );
 
     int testListSize = static_cast<int>( testList.size() );
 
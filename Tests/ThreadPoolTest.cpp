@@ -0,0 +1,506 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "ThreadPoolTest.h"
+
+#include "ThreadPool.h"
+#include "SignaledEvent.h"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+/*
+Description:
+Runs input through AddInput and GetOutput, submits work and waits for its futures, including work that submits and waits for more work,
+stops the threads with input pending, pauses them, and compares the time per input with the mutex guarded pool it replaced
+
+Success conditions:
+Every input is processed exactly once, with the data made for its thread, and its output returned
+Futures return what was submitted, or its exception, and work waiting on work it submitted finishes even with one thread
+A worker waiting for a future that another worker is still running sleeps rather than using the CPU
+Input not yet processed when the threads stop is left in the input queue in order, and is processed after they start again
+Paused threads process nothing until resumed
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+ThreadPool Functions Explicitly Tested:
+StartThreads
+StopThreads
+AddInput
+Submit
+Wait
+HasOutput
+GetOutput
+IsWorking
+InputSize
+GetInputAtIndex
+Pause
+Resume
+*/
+
+namespace {
+
+std::atomic<int> perThreadDataCount;
+std::atomic<int> processedCount;
+std::atomic<bool> isBlocked;
+std::atomic<bool> releaseBlocked;
+std::vector<std::atomic<unsigned char>>* processed;
+
+void* CreatePerThreadData()
+{
+    perThreadDataCount.fetch_add( 1 );
+    return new int( 0 );
+}
+
+void DestroyPerThreadData( void* perThreadData )
+{
+    perThreadDataCount.fetch_sub( 1 );
+    delete (int*)perThreadData;
+}
+
+int Double( int input, bool* returnOutput, void* perThreadData )
+{
+    // Only this thread uses its data
+    if( perThreadData != 0 )
+        ( *(int*)perThreadData )++;
+    *returnOutput = perThreadData != 0;
+    return input * 2;
+}
+
+int Record( int input, bool* returnOutput, void* perThreadData )
+{
+    (void)perThreadData;
+    if( input == 0 )
+        isBlocked.store( true );
+    while( input == 0 && releaseBlocked.load() == false )
+        std::this_thread::yield();
+    ( *processed )[input].fetch_add( 1 );
+    processedCount.fetch_add( 1 );
+    *returnOutput = false;
+    return input;
+}
+
+int Count( int input, bool* returnOutput, void* perThreadData )
+{
+    (void)perThreadData;
+    *returnOutput = true;
+    return input;
+}
+
+int Fibonacci( ThreadPool<int, int>* threadPool, int n )
+{
+    if( n < 2 )
+        return n;
+    // Submit one half and do the other here
+    std::future<int> first = threadPool->Submit( [threadPool, n]( void* ) { return Fibonacci( threadPool, n - 1 ); } );
+    const int second = Fibonacci( threadPool, n - 2 );
+    return threadPool->Wait( first ) + second;
+}
+
+// The pool before it stole work, cut down to AddInput and GetOutput
+class LockedThreadPool
+{
+public:
+    void StartThreads( int numThreads )
+    {
+        runThreads = true;
+        outputCount = 0;
+        quitAndIncomingDataEvents.InitEvent();
+        for( int i = 0; i < numThreads; i++ )
+            threads.emplace_back( [this]() { WorkerThread(); } );
+    }
+    void StopThreads( void )
+    {
+        {
+            std::lock_guard<std::mutex> guard( runThreadsMutex );
+            runThreads = false;
+        }
+        for( std::thread& thread : threads )
+        {
+            quitAndIncomingDataEvents.SetEvent();
+            thread.join();
+        }
+        quitAndIncomingDataEvents.CloseEvent();
+    }
+    void AddInput( int ( *workerThreadCallback )( int, bool*, void* ), int inputData )
+    {
+        inputQueueMutex.lock();
+        inputQueue.push_back( inputData );
+        inputFunctionQueue.push_back( workerThreadCallback );
+        inputQueueMutex.unlock();
+        quitAndIncomingDataEvents.SetEvent();
+    }
+    // The old pool read outputQueue here without the lock, which is a data race
+    bool HasOutputFast( void ) { return outputCount.load( std::memory_order_relaxed ) > 0; }
+    bool HasOutput( void )
+    {
+        std::lock_guard<std::mutex> guard( outputQueueMutex );
+        return !outputQueue.empty();
+    }
+    int GetOutput( void )
+    {
+        std::lock_guard<std::mutex> guard( outputQueueMutex );
+        int output = outputQueue.front();
+        outputQueue.pop_front();
+        outputCount.store( (int)outputQueue.size(), std::memory_order_relaxed );
+        return output;
+    }
+
+private:
+    void WorkerThread( void )
+    {
+        int ( *userCallback )( int, bool*, void* ) = 0;
+        int inputData = 0;
+        while( 1 )
+        {
+            if( userCallback == 0 )
+                quitAndIncomingDataEvents.WaitOnEvent( 1000 );
+            {
+                std::lock_guard<std::mutex> guard( runThreadsMutex );
+                if( runThreads == false )
+                    break;
+            }
+            userCallback = 0;
+            inputQueueMutex.lock();
+            if( !inputFunctionQueue.empty() )
+            {
+                userCallback = inputFunctionQueue.front();
+                inputFunctionQueue.pop_front();
+                inputData = inputQueue.front();
+                inputQueue.pop_front();
+            }
+            inputQueueMutex.unlock();
+            if( userCallback )
+            {
+                bool returnOutput;
+                int callbackOutput = userCallback( inputData, &returnOutput, 0 );
+                if( returnOutput )
+                {
+                    std::lock_guard<std::mutex> guard( outputQueueMutex );
+                    outputQueue.push_back( callbackOutput );
+                    outputCount.store( (int)outputQueue.size(), std::memory_order_relaxed );
+                }
+            }
+        }
+    }
+
+    std::mutex inputQueueMutex, outputQueueMutex, runThreadsMutex;
+    std::deque<int ( * )( int, bool*, void* )> inputFunctionQueue;
+    std::deque<int> inputQueue;
+    std::deque<int> outputQueue;
+    // Entries in outputQueue, stored to with outputQueueMutex held
+    std::atomic<int> outputCount;
+    bool runThreads;
+    SignaledEvent quitAndIncomingDataEvents;
+    std::vector<std::thread> threads;
+};
+
+// Adds inputs from this thread and gets their output back
+// \return Nanoseconds per input
+template<class Pool>
+double AddInputAndGetOutput( Pool* threadPool, int inputCount )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int received = 0;
+    for( int i = 0; i < inputCount; i++ )
+    {
+        threadPool->AddInput( Count, i );
+        while( threadPool->HasOutputFast() && threadPool->HasOutput() )
+        {
+            threadPool->GetOutput();
+            received++;
+        }
+    }
+    while( received < inputCount )
+    {
+        if( threadPool->HasOutputFast() && threadPool->HasOutput() )
+        {
+            threadPool->GetOutput();
+            received++;
+        }
+        else
+            std::this_thread::yield();
+    }
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    return (double)elapsed / (double)inputCount;
+}
+
+// Adds one input at a time and waits for its output
+// \return Microseconds per round trip
+template<class Pool>
+double RoundTrip( Pool* threadPool, int count )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for( int i = 0; i < count; i++ )
+    {
+        threadPool->AddInput( Count, i );
+        while( !( threadPool->HasOutputFast() && threadPool->HasOutput() ) )
+            std::this_thread::yield();
+        threadPool->GetOutput();
+    }
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    return (double)elapsed / 1000.0 / (double)count;
+}
+
+} // namespace
+
+int ThreadPoolTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Adding input to 4 threads and getting the output\n" );
+
+    {
+        ThreadPool<int, int> threadPool;
+        perThreadDataCount.store( 0 );
+        const bool started = threadPool.StartThreads( 4, 0, CreatePerThreadData, DestroyPerThreadData );
+        const int inputCount = 200000;
+        std::vector<unsigned char> received( inputCount, 0 );
+        bool valid = started && threadPool.StartThreads( 4, 0 ) == false;
+        for( int i = 0; i < inputCount; i++ )
+            threadPool.AddInput( Double, i );
+        int receivedCount = 0;
+        std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+        while( receivedCount < inputCount && valid && std::chrono::steady_clock::now() < timeout )
+        {
+            if( threadPool.HasOutputFast() && threadPool.HasOutput() )
+            {
+                const int output = threadPool.GetOutput();
+                if( output < 0 || output >= inputCount * 2 || ( output & 1 ) || received[output / 2]++ != 0 )
+                    valid = false;
+                receivedCount++;
+            }
+            else
+                std::this_thread::yield();
+        }
+        valid = valid && receivedCount == inputCount && perThreadDataCount.load() == 4;
+        while( threadPool.IsWorking() )
+            std::this_thread::yield();
+        threadPool.StopThreads();
+        valid = valid && perThreadDataCount.load() == 0 && threadPool.HasOutput() == false && threadPool.InputSize() == 0;
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Input was lost, processed twice or processed without its thread's data\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 1;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Submitting work and waiting for it\n" );
+
+    for( int numThreads = 1; numThreads <= 4; numThreads *= 2 )
+    {
+        ThreadPool<int, int> threadPool;
+        threadPool.StartThreads( numThreads, 0 );
+        std::vector<std::future<long long>> futures;
+        for( int i = 0; i < 1000; i++ )
+            futures.push_back( threadPool.Submit( [i]( void* ) { return (long long)i * i; } ) );
+        bool valid = true;
+        for( int i = 0; i < 1000; i++ )
+            valid = valid && threadPool.Wait( futures[i] ) == (long long)i * i;
+
+        std::future<void> throws = threadPool.Submit( []( void* ) { throw std::runtime_error( "Submitted" ); } );
+        bool threw = false;
+        try
+        {
+            threadPool.Wait( throws );
+        }
+        catch( const std::runtime_error& )
+        {
+            threw = true;
+        }
+
+        // Work that waits for work it submitted, on every thread at once
+        std::future<int> fibonacci = threadPool.Submit( [&threadPool]( void* ) { return Fibonacci( &threadPool, 18 ); } );
+        valid = valid && threw && fibonacci.wait_for( std::chrono::seconds( 60 ) ) == std::future_status::ready && fibonacci.get() == 2584;
+        threadPool.StopThreads();
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A future did not return what was submitted\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 2;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Waiting for a future that takes a while\n" );
+
+    {
+        ThreadPool<int, int> threadPool;
+        threadPool.StartThreads( 2, 0 );
+        const std::clock_t start = std::clock();
+        std::future<int> slow = threadPool.Submit( []( void* ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+            return 1;
+        } );
+        // Submitted after slow, so the other worker takes it while slow runs
+        std::future<int> waiting = threadPool.Submit( [&threadPool, &slow]( void* ) { return threadPool.Wait( slow ) + 1; } );
+        const bool finished = threadPool.Wait( waiting ) == 2;
+        // Process time, so a waiter that polled would use most of the 300 milliseconds
+        const double cpuMilliseconds = 1000.0 * (double)( std::clock() - start ) / CLOCKS_PER_SEC;
+        threadPool.StopThreads();
+        if( isVerbose )
+            printf( "%.1f ms of CPU while waiting 300 ms\n", cpuMilliseconds );
+        if( !finished || cpuMilliseconds > 100.0 )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A worker waiting for a future used the CPU\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 5;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Stopping the threads with input pending\n" );
+
+    {
+        const int inputCount = 1000;
+        std::vector<std::atomic<unsigned char>> processedInputs( inputCount );
+        for( std::atomic<unsigned char>& p : processedInputs )
+            p.store( 0 );
+        processed = &processedInputs;
+        processedCount.store( 0 );
+        isBlocked.store( false );
+        releaseBlocked.store( false );
+
+        ThreadPool<int, int> threadPool;
+        threadPool.StartThreads( 1, 0 );
+        // Input 0 holds the thread until it is stopping, with some of the rest claimed by it and the others not
+        for( int i = 0; i < inputCount; i++ )
+            threadPool.AddInput( Record, i );
+        while( isBlocked.load() == false )
+            std::this_thread::yield();
+        std::thread release( []() {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+            releaseBlocked.store( true );
+        } );
+        threadPool.StopThreads();
+        release.join();
+
+        // The rest is left, in the order it was added
+        bool valid = processedCount.load() == 1 && (int)threadPool.InputSize() == inputCount - 1;
+        for( unsigned i = 0; valid && i < threadPool.InputSize(); i++ )
+        {
+            const int input = threadPool.GetInputAtIndex( i );
+            valid = processedInputs[input].load() == 0 && input == (int)i + 1;
+        }
+
+        threadPool.StartThreads( 2, 0 );
+        std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+        while( threadPool.IsWorking() && std::chrono::steady_clock::now() < timeout )
+            std::this_thread::yield();
+        threadPool.StopThreads();
+        valid = valid && processedCount.load() == inputCount && threadPool.InputSize() == 0;
+        for( std::atomic<unsigned char>& p : processedInputs )
+            valid = valid && p.load() == 1;
+        processed = 0;
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Input left when the threads stopped was lost, reordered or processed twice\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 3;
+        }
+    }
+
+    if( isVerbose )
+        printf( "Pausing the threads\n" );
+
+    {
+        ThreadPool<int, int> threadPool;
+        threadPool.StartThreads( 2, 0 );
+        bool valid = threadPool.Pause();
+        for( int i = 0; i < 100; i++ )
+            threadPool.AddInput( Count, i );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        valid = valid && threadPool.HasOutput() == false && threadPool.NumThreadsWorking() == 0 && threadPool.InputSize() == 100;
+        threadPool.Resume();
+        // Not IsWorking(), which stays true while the output is waiting
+        std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::seconds( 60 );
+        while( ( threadPool.HasInput() || threadPool.NumThreadsWorking() > 0 ) && std::chrono::steady_clock::now() < timeout )
+            std::this_thread::yield();
+        valid = valid && threadPool.OutputSize() == 100 && threadPool.InputSize() == 0;
+        threadPool.StopThreads();
+        if( !valid )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Paused threads processed input, or resumed threads did not\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 4;
+        }
+    }
+
+    if( isVerbose )
+    {
+        printf( "Measuring time per input, %u hardware threads\n", std::thread::hardware_concurrency() );
+        printf( "Threads   Mutexes      Work stealing   Round trip: Mutexes  Work stealing\n" );
+        for( int numThreads = 1; numThreads <= 4; numThreads *= 2 )
+        {
+            LockedThreadPool lockedPool;
+            lockedPool.StartThreads( numThreads );
+            const double locked = AddInputAndGetOutput( &lockedPool, 200000 );
+            const double lockedRoundTrip = RoundTrip( &lockedPool, 5000 );
+            lockedPool.StopThreads();
+
+            ThreadPool<int, int> threadPool;
+            threadPool.StartThreads( numThreads, 0 );
+            const double workStealing = AddInputAndGetOutput( &threadPool, 200000 );
+            const double workStealingRoundTrip = RoundTrip( &threadPool, 5000 );
+            threadPool.StopThreads();
+
+            printf( "%7d %8.1f ns %11.1f ns %16.1f us %11.1f us\n", numThreads, locked, workStealing, lockedRoundTrip, workStealingRoundTrip );
+        }
+    }
+
+    return 0;
+}
+
+std::string ThreadPoolTest::GetTestName() const
+{
+    return "ThreadPoolTest";
+}
+
+std::string ThreadPoolTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                                  break;
+    case 1: return "Input was lost, processed twice or processed without its thread's data";                    break;
+    case 2: return "A future did not return what was submitted";                                                break;
+    case 3: return "Input left when the threads stopped was lost, reordered or processed twice";                break;
+    case 4: return "Paused threads processed input, or resumed threads did not";                                break;
+    case 5: return "A worker waiting for a future used the CPU";                                                break;
+    default: return "Undefined Error";                                                                          break;
+    }
+    // clang-format on
+}
+
+ThreadPoolTest::ThreadPoolTest( void )
+{
+}
+
+ThreadPoolTest::~ThreadPoolTest( void )
+{
+}
+
+void ThreadPoolTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "ThreadsafeAllocatingQueueTest.h"
+
+#include "DS_ThreadsafeAllocatingQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/*
+Description:
+Pushes messages from many producer threads to one or more consumers, pushes popped nodes straight back while others push,
+and compares the time per message with the mutex guarded queue it replaced, for 1 to 16 producers
+
+Success conditions:
+Each producer's messages are popped in order by a single consumer, and exactly once by several consumers
+Nodes pushed again as soon as they are popped, at the same address, are neither lost nor popped twice
+Size, IsEmpty, Pop, PopInaccurate and Clear behave as a queue on one thread
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+ThreadsafeAllocatingQueue Functions Explicitly Tested:
+Push
+Pop
+PopInaccurate
+IsEmpty
+Size
+Allocate
+Deallocate
+Clear
+*/
+
+namespace {
+
+const uint32_t liveMagic = 0x4C495645;
+const uint32_t releasedMagic = 0x46524545;
+
+struct Message
+{
+    uint32_t producer;
+    uint32_t sequence;
+    uint32_t magic;
+    uint32_t bounces;
+};
+
+// The queue before it was lock free
+class LockedAllocatingQueue
+{
+public:
+    Message* Allocate( const char* file, unsigned int line )
+    {
+        std::lock_guard<std::mutex> guard( memoryPoolMutex );
+        return new( (void*)memoryPool.Allocate( file, line ) ) Message;
+    }
+    void Deallocate( Message* s, const char* file, unsigned int line )
+    {
+        std::lock_guard<std::mutex> guard( memoryPoolMutex );
+        memoryPool.Release( s, file, line );
+    }
+    void Push( Message* s )
+    {
+        std::lock_guard<std::mutex> guard( queueMutex );
+        queue.push_back( s );
+    }
+    Message* Pop( void )
+    {
+        std::lock_guard<std::mutex> guard( queueMutex );
+        if( queue.empty() )
+            return 0;
+        Message* s = queue.front();
+        queue.pop_front();
+        return s;
+    }
+
+private:
+    DataStructures::MemoryPool<Message> memoryPool;
+    std::mutex memoryPoolMutex;
+    std::deque<Message*> queue;
+    std::mutex queueMutex;
+};
+
+// Producers push numbered messages, consumers pop and deallocate them
+// \param[in] bounces Times each message is pushed again by whoever pops it, before it counts as received
+// \return Nanoseconds per message
+template<class Queue>
+double ProduceAndConsume( Queue* queue, int producerCount, int consumerCount, int messagesPerProducer, uint32_t bounces, bool* valid )
+{
+    const int total = producerCount * messagesPerProducer;
+    std::vector<std::atomic<unsigned char>> received( total );
+    for( std::atomic<unsigned char>& r : received )
+        r.store( 0, std::memory_order_relaxed );
+    std::atomic<int> receivedCount( 0 );
+    std::atomic<bool> isValid( true );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for( int producer = 0; producer < producerCount; producer++ )
+    {
+        threads.emplace_back( [=]() {
+            for( int sequence = 0; sequence < messagesPerProducer; sequence++ )
+            {
+                Message* message = queue->Allocate( _FILE_AND_LINE_ );
+                message->producer = producer;
+                message->sequence = sequence;
+                message->magic = liveMagic;
+                message->bounces = 0;
+                queue->Push( message );
+            }
+        } );
+    }
+    for( int consumer = 0; consumer < consumerCount; consumer++ )
+    {
+        threads.emplace_back( [&, consumer]() {
+            std::vector<uint32_t> nextSequence( producerCount, 0 );
+            while( receivedCount.load( std::memory_order_relaxed ) < total && isValid.load( std::memory_order_relaxed ) )
+            {
+                Message* message = queue->Pop();
+                if( message == 0 )
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if( message->magic != liveMagic || message->producer >= (uint32_t)producerCount || message->sequence >= (uint32_t)messagesPerProducer )
+                {
+                    isValid.store( false );
+                    break;
+                }
+                if( message->bounces < bounces )
+                {
+                    message->bounces++;
+                    queue->Push( message );
+                    continue;
+                }
+
+                // Popped more than once, or out of order with one consumer and no bouncing
+                if( received[message->producer * messagesPerProducer + message->sequence].exchange( 1 ) != 0 ||
+                    ( consumerCount == 1 && bounces == 0 && message->sequence != nextSequence[message->producer]++ ) )
+                    isValid.store( false );
+                message->magic = releasedMagic;
+                queue->Deallocate( message, _FILE_AND_LINE_ );
+                receivedCount.fetch_add( 1 );
+            }
+            (void)consumer;
+        } );
+    }
+    for( std::thread& thread : threads )
+        thread.join();
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    *valid = isValid.load() && receivedCount.load() == total && queue->Pop() == 0;
+    return (double)elapsed / (double)total;
+}
+
+} // namespace
+
+int ThreadsafeAllocatingQueueTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Pushing from 4 producers to 1 consumer, then to 3 consumers\n" );
+
+    bool valid, multipleConsumersValid;
+    {
+        DataStructures::ThreadsafeAllocatingQueue<Message> queue;
+        ProduceAndConsume( &queue, 4, 1, 100000, 0, &valid );
+    }
+    {
+        DataStructures::ThreadsafeAllocatingQueue<Message> queue;
+        ProduceAndConsume( &queue, 4, 3, 100000, 0, &multipleConsumersValid );
+    }
+    if( !valid || !multipleConsumersValid )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A message was lost, popped twice or popped out of order\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( isVerbose )
+        printf( "Pushing popped nodes straight back\n" );
+
+    {
+        DataStructures::ThreadsafeAllocatingQueue<Message> queue;
+        ProduceAndConsume( &queue, 4, 2, 50000, 3, &valid );
+    }
+    if( !valid )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A node pushed again as soon as it was popped was lost or popped twice\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    // One thread
+    {
+        DataStructures::ThreadsafeAllocatingQueue<Message> queue;
+        bool isQueue = queue.IsEmpty() && queue.Size() == 0 && queue.Pop() == 0 && queue.PopInaccurate() == 0;
+        for( uint32_t i = 0; i < 3; i++ )
+        {
+            Message* message = queue.Allocate( _FILE_AND_LINE_ );
+            message->sequence = i;
+            queue.Push( message );
+        }
+        isQueue = isQueue && queue.IsEmpty() == false && queue.Size() == 3;
+        Message* first = queue.Pop();
+        Message* second = queue.PopInaccurate();
+        isQueue = isQueue && first != 0 && first->sequence == 0 && second != 0 && second->sequence == 1 && queue.Size() == 1;
+        if( first != 0 )
+            queue.Deallocate( first, _FILE_AND_LINE_ );
+        // Pushed again behind the third
+        if( second != 0 )
+            queue.Push( second );
+        Message* third = queue.Pop();
+        isQueue = isQueue && third != 0 && third->sequence == 2 && queue.Size() == 1;
+        if( third != 0 )
+            queue.Deallocate( third, _FILE_AND_LINE_ );
+        queue.Clear( _FILE_AND_LINE_ );
+        isQueue = isQueue && queue.IsEmpty() && queue.Pop() == 0;
+
+        if( !isQueue )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Did not behave as a queue on one thread\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 3;
+        }
+    }
+
+    if( isVerbose )
+    {
+        printf( "Measuring time per message with 1 consumer, %u hardware threads\n", std::thread::hardware_concurrency() );
+        printf( "Producers   Mutexes      Lock free\n" );
+        for( int producers = 1; producers <= 16; producers *= 2 )
+        {
+            LockedAllocatingQueue lockedQueue;
+            DataStructures::ThreadsafeAllocatingQueue<Message> queue;
+            const double locked = ProduceAndConsume( &lockedQueue, producers, 1, 1000000 / producers, 0, &valid );
+            const double lockFree = ProduceAndConsume( &queue, producers, 1, 1000000 / producers, 0, &valid );
+            printf( "%9d %8.1f ns %11.1f ns\n", producers, locked, lockFree );
+        }
+    }
+
+    return 0;
+}
+
+std::string ThreadsafeAllocatingQueueTest::GetTestName() const
+{
+    return "ThreadsafeAllocatingQueueTest";
+}
+
+std::string ThreadsafeAllocatingQueueTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                  break;
+    case 1: return "A message was lost, popped twice or popped out of order";                   break;
+    case 2: return "A node pushed again as soon as it was popped was lost or popped twice";     break;
+    case 3: return "Did not behave as a queue on one thread";                                   break;
+    default: return "Undefined Error";                                                          break;
+    }
+    // clang-format on
+}
+
+ThreadsafeAllocatingQueueTest::ThreadsafeAllocatingQueueTest( void )
+{
+}
+
+ThreadsafeAllocatingQueueTest::~ThreadsafeAllocatingQueueTest( void )
+{
+}
+
+void ThreadsafeAllocatingQueueTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}
@@ -0,0 +1,344 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "ThreadsafeMemoryPoolTest.h"
+
+#include "DS_ThreadsafeMemoryPool.h"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/*
+Description:
+Allocates blocks on producer threads and releases them on a consumer thread, as RakPeer does with packets,
+checks that no block is handed out twice, that threads give their magazines back when they exit,
+and compares the time per block with a MemoryPool behind a mutex
+
+Success conditions:
+Every block allocated is live exactly once and arrives intact
+Threads that exited have no magazines left, and threads that outlive a pool can use another one
+Blocks are all returned after Clear() and can be allocated again
+
+Failure conditions:
+Any of the above fails. Timings are only reported.
+
+ThreadsafeMemoryPool Functions Explicitly Tested:
+Allocate
+Release
+Clear
+GetThreadCacheCount
+*/
+
+namespace {
+
+const uint32_t liveMagic = 0x4C495645;
+const uint32_t releasedMagic = 0x46524545;
+
+// About the size of a Packet
+struct Block
+{
+    uint32_t magic;
+    uint32_t producer;
+    uint32_t sequence;
+    char payload[52];
+};
+
+// How RakPeer shared its pools before ThreadsafeMemoryPool
+class LockedMemoryPool
+{
+public:
+    Block* Allocate( const char* file, unsigned int line )
+    {
+        std::lock_guard<std::mutex> guard( mutex );
+        return memoryPool.Allocate( file, line );
+    }
+    void Release( Block* m, const char* file, unsigned int line )
+    {
+        std::lock_guard<std::mutex> guard( mutex );
+        memoryPool.Release( m, file, line );
+    }
+
+private:
+    std::mutex mutex;
+    DataStructures::MemoryPool<Block> memoryPool;
+};
+
+struct Batch
+{
+    Block* blocks[64];
+    int count;
+};
+
+// Producers allocate and fill blocks, handing them to one consumer in batches that releases them
+// \return Nanoseconds per block
+template<class Pool>
+double AllocateAndReleaseAcrossThreads( Pool* pool, int producerCount, int blocksPerProducer, bool* valid )
+{
+    std::mutex handoffMutex;
+    std::deque<Batch> handoff;
+    bool producersValid = true, consumerValid = true;
+    std::mutex validMutex;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for( int producer = 0; producer < producerCount; producer++ )
+    {
+        producers.emplace_back( [&, producer]() {
+            bool isValid = true;
+            Batch batch;
+            batch.count = 0;
+            for( int sequence = 0; sequence < blocksPerProducer; sequence++ )
+            {
+                Block* block = pool->Allocate( _FILE_AND_LINE_ );
+                if( block == 0 || block->magic == liveMagic )
+                {
+                    isValid = false;
+                    break;
+                }
+                block->magic = liveMagic;
+                block->producer = producer;
+                block->sequence = sequence;
+                batch.blocks[batch.count++] = block;
+                if( batch.count == 64 || sequence + 1 == blocksPerProducer )
+                {
+                    std::lock_guard<std::mutex> guard( handoffMutex );
+                    handoff.push_back( batch );
+                    batch.count = 0;
+                }
+            }
+            std::lock_guard<std::mutex> guard( validMutex );
+            producersValid = producersValid && isValid;
+        } );
+    }
+
+    std::thread consumer( [&]() {
+        std::vector<int> nextSequence( producerCount, 0 );
+        int received = 0;
+        while( received < producerCount * blocksPerProducer )
+        {
+            Batch batch;
+            {
+                std::lock_guard<std::mutex> guard( handoffMutex );
+                if( handoff.empty() )
+                    batch.count = 0;
+                else
+                {
+                    batch = handoff.front();
+                    handoff.pop_front();
+                }
+            }
+            if( batch.count == 0 )
+            {
+                std::lock_guard<std::mutex> guard( validMutex );
+                if( producersValid == false )
+                    break;
+                std::this_thread::yield();
+                continue;
+            }
+            for( int i = 0; i < batch.count; i++ )
+            {
+                Block* block = batch.blocks[i];
+                if( block->magic != liveMagic || block->producer >= (uint32_t)producerCount ||
+                    block->sequence != (uint32_t)nextSequence[block->producer]++ )
+                    consumerValid = false;
+                block->magic = releasedMagic;
+                pool->Release( block, _FILE_AND_LINE_ );
+            }
+            received += batch.count;
+        }
+    } );
+
+    for( std::thread& producer : producers )
+        producer.join();
+    consumer.join();
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    *valid = producersValid && consumerValid;
+    return (double)elapsed / ( (double)producerCount * blocksPerProducer );
+}
+
+// Each thread allocates a few blocks and releases them itself
+template<class Pool>
+double AllocateAndReleaseOnEachThread( Pool* pool, int threadCount, int rounds )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for( int t = 0; t < threadCount; t++ )
+    {
+        threads.emplace_back( [pool, rounds]() {
+            Block* blocks[16];
+            for( int round = 0; round < rounds; round++ )
+            {
+                for( Block*& block : blocks )
+                    block = pool->Allocate( _FILE_AND_LINE_ );
+                for( Block* block : blocks )
+                    pool->Release( block, _FILE_AND_LINE_ );
+            }
+        } );
+    }
+    for( std::thread& thread : threads )
+        thread.join();
+    const long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    return (double)elapsed / ( (double)threadCount * rounds * 16 );
+}
+
+} // namespace
+
+int ThreadsafeMemoryPoolTest::RunTest( bool isVerbose, bool noPauses )
+{
+    destroyList.clear();
+
+    if( isVerbose )
+        printf( "Allocating on 3 producer threads and releasing on a consumer\n" );
+
+    DataStructures::ThreadsafeMemoryPool<Block> pool;
+    bool valid;
+    AllocateAndReleaseAcrossThreads( &pool, 3, 200000, &valid );
+    if( !valid )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "A block was handed out twice or arrived damaged\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 1;
+    }
+
+    if( pool.GetThreadCacheCount() != 0 )
+    {
+        if( isVerbose )
+            DebugTools::ShowError( "Threads that exited kept their magazines\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+        return 2;
+    }
+
+    // A thread that outlives the first pool it used, then uses another
+    {
+        DataStructures::ThreadsafeMemoryPool<Block>* first = new DataStructures::ThreadsafeMemoryPool<Block>;
+        DataStructures::ThreadsafeMemoryPool<Block> second;
+        std::mutex stepMutex;
+        int step = 0;
+        bool secondValid = false;
+        std::thread thread( [&]() {
+            first->Release( first->Allocate( _FILE_AND_LINE_ ), _FILE_AND_LINE_ );
+            {
+                std::lock_guard<std::mutex> guard( stepMutex );
+                step = 1;
+            }
+            while( true )
+            {
+                std::lock_guard<std::mutex> guard( stepMutex );
+                if( step == 2 )
+                    break;
+            }
+            Block* block = second.Allocate( _FILE_AND_LINE_ );
+            secondValid = block != 0 && second.GetThreadCacheCount() == 1;
+            second.Release( block, _FILE_AND_LINE_ );
+        } );
+        while( true )
+        {
+            std::lock_guard<std::mutex> guard( stepMutex );
+            if( step == 1 )
+                break;
+        }
+        const bool firstHadCache = first->GetThreadCacheCount() == 1;
+        delete first;
+        {
+            std::lock_guard<std::mutex> guard( stepMutex );
+            step = 2;
+        }
+        thread.join();
+
+        if( !firstHadCache || !secondValid || second.GetThreadCacheCount() != 0 )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "A thread could not use a pool after the one it used before was destroyed\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 3;
+        }
+    }
+
+    // Clear() with blocks in this thread's magazines, then allocate again
+    {
+        std::vector<Block*> blocks;
+        for( int i = 0; i < 100; i++ )
+            blocks.push_back( pool.Allocate( _FILE_AND_LINE_ ) );
+        for( Block* block : blocks )
+            pool.Release( block, _FILE_AND_LINE_ );
+        pool.Clear( _FILE_AND_LINE_ );
+        bool allocatedAgain = pool.GetThreadCacheCount() == 1;
+        for( int i = 0; i < 100; i++ )
+        {
+            blocks[i] = pool.Allocate( _FILE_AND_LINE_ );
+            allocatedAgain = allocatedAgain && blocks[i] != 0;
+        }
+        for( Block* block : blocks )
+        {
+            if( block != 0 )
+                pool.Release( block, _FILE_AND_LINE_ );
+        }
+        if( !allocatedAgain )
+        {
+            if( isVerbose )
+                DebugTools::ShowError( "Could not allocate after Clear()\n", !noPauses && isVerbose, __LINE__, __FILE__ );
+            return 4;
+        }
+    }
+
+    if( isVerbose )
+    {
+        printf( "Measuring time per block\n" );
+
+        LockedMemoryPool lockedPool;
+        DataStructures::ThreadsafeMemoryPool<Block> magazinePool;
+        const double lockedAcross = AllocateAndReleaseAcrossThreads( &lockedPool, 1, 2000000, &valid );
+        const double magazineAcross = AllocateAndReleaseAcrossThreads( &magazinePool, 1, 2000000, &valid );
+        const double lockedEach = AllocateAndReleaseOnEachThread( &lockedPool, 4, 100000 );
+        const double magazineEach = AllocateAndReleaseOnEachThread( &magazinePool, 4, 100000 );
+        printf( "                            MemoryPool+mutex  ThreadsafeMemoryPool\n" );
+        printf( "1 producer, 1 consumer      %10.1f ns       %10.1f ns\n", lockedAcross, magazineAcross );
+        printf( "4 threads, own blocks       %10.1f ns       %10.1f ns\n", lockedEach, magazineEach );
+    }
+
+    return 0;
+}
+
+std::string ThreadsafeMemoryPoolTest::GetTestName() const
+{
+    return "ThreadsafeMemoryPoolTest";
+}
+
+std::string ThreadsafeMemoryPoolTest::ErrorCodeToString( int errorCode ) const
+{
+    // clang-format off
+    switch( errorCode )
+    {
+    case 0: return "No error";                                                                      break;
+    case 1: return "A block was handed out twice or arrived damaged";                               break;
+    case 2: return "Threads that exited kept their magazines";                                      break;
+    case 3: return "A thread could not use a pool after the one it used before was destroyed";      break;
+    case 4: return "Could not allocate after Clear()";                                              break;
+    default: return "Undefined Error";                                                              break;
+    }
+    // clang-format on
+}
+
+ThreadsafeMemoryPoolTest::ThreadsafeMemoryPoolTest( void )
+{
+}
+
+ThreadsafeMemoryPoolTest::~ThreadsafeMemoryPoolTest( void )
+{
+}
+
+void ThreadsafeMemoryPoolTest::DestroyPeers()
+{
+    for( RakPeerInterface* pPeer : destroyList )
+    {
+        RakPeerInterface::DestroyInstance( pPeer );
+    }
+    destroyList.clear();
+}